@@ -0,0 +1,275 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <glib.h>
+
+#include "articlecache.h"
+
+/* File magic and format version. */
+#define CACHE_MAGIC   "GFAC"
+#define CACHE_VERSION 2
+
+/* Offset of a missing string. */
+#define NO_STRING 0xffffffff
+
+/* File header. */
+typedef struct {
+  gchar   magic[4];
+  guint32 version;
+  guint32 n_items;
+  guint32 reserved;
+  guint64 fingerprint;
+} CacheHeader;
+
+/* Article record. */
+typedef struct {
+  guint32 title;
+  guint32 link;
+  guint32 guid;
+  guint32 padding;
+  gint64  date;
+} CacheRecord;
+
+struct _ArticleCacheWriter {
+  gchar   *source;
+  guint64  fingerprint;
+  GArray  *records;
+  GString *strings;
+};
+
+/* Returns the name of the cache file of the feed SOURCE.  The name is
+   derived from a hash of the source URL. */
+static gchar *
+get_cache_filename (const gchar *source)
+{
+  gchar *hash, *name, *filename;
+
+  hash = g_compute_checksum_for_string (G_CHECKSUM_SHA1, source, -1);
+  name = g_strconcat (hash, ".cache", NULL);
+  filename = g_build_filename (g_get_user_cache_dir (),
+                               PACKAGE,
+                               name,
+                               NULL);
+  g_free (name);
+  g_free (hash);
+
+  return filename;
+}
+
+/* Appends STRING to the string table and returns its offset. */
+static guint32
+add_string (ArticleCacheWriter *writer,
+            const gchar        *string)
+{
+  guint32 offset;
+
+  if (string == NULL) {
+    return GUINT32_TO_LE (NO_STRING);
+  }
+
+  offset = writer->strings->len;
+  g_string_append_len (writer->strings, string, strlen (string) + 1);
+
+  return GUINT32_TO_LE (offset);
+}
+
+ArticleCacheWriter *
+article_cache_writer_new (const gchar *source)
+{
+  ArticleCacheWriter *writer;
+
+  g_assert (source != NULL);
+
+  writer = g_new0 (ArticleCacheWriter, 1);
+  writer->source = g_strdup (source);
+  writer->records = g_array_new (FALSE, FALSE, sizeof (CacheRecord));
+  writer->strings = g_string_new (NULL);
+
+  return writer;
+}
+
+void
+article_cache_writer_add (ArticleCacheWriter *writer,
+                          const FeedItem     *item)
+{
+  CacheRecord record;
+
+  g_assert (writer != NULL);
+  g_assert (item != NULL);
+
+  record.title = add_string (writer, item->title);
+  record.link = add_string (writer, item->link);
+  record.guid = add_string (writer, item->guid);
+  record.padding = 0;
+  record.date = GINT64_TO_LE (item->date);
+
+  g_array_append_val (writer->records, record);
+}
+
+void
+article_cache_writer_set_fingerprint (ArticleCacheWriter *writer,
+                                      guint64             fingerprint)
+{
+  g_assert (writer != NULL);
+  writer->fingerprint = fingerprint;
+}
+
+gboolean
+article_cache_writer_commit (ArticleCacheWriter *writer)
+{
+  CacheHeader  header;
+  GString     *data;
+  gchar       *filename, *dirname;
+  GError      *error = NULL;
+  gboolean     result;
+
+  g_assert (writer != NULL);
+
+  memcpy (header.magic, CACHE_MAGIC, 4);
+  header.version = GUINT32_TO_LE (CACHE_VERSION);
+  header.n_items = GUINT32_TO_LE (writer->records->len);
+  header.reserved = 0;
+  header.fingerprint = GUINT64_TO_LE (writer->fingerprint);
+
+  data = g_string_sized_new (sizeof (header) +
+                             writer->records->len * sizeof (CacheRecord) +
+                             writer->strings->len);
+  g_string_append_len (data, (const gchar *) &header, sizeof (header));
+  g_string_append_len (data, writer->records->data,
+                       writer->records->len * sizeof (CacheRecord));
+  g_string_append_len (data, writer->strings->str, writer->strings->len);
+
+  filename = get_cache_filename (writer->source);
+  dirname = g_path_get_dirname (filename);
+  g_mkdir_with_parents (dirname, 0700);
+
+  /* The file is replaced atomically, so a reader never sees a partial
+     cache. */
+  result = g_file_set_contents (filename, data->str, data->len, &error);
+  if (!result) {
+    g_warning ("Failed to write %s: %s", filename, error->message);
+    g_error_free (error);
+  }
+
+  g_free (dirname);
+  g_free (filename);
+  g_string_free (data, TRUE);
+
+  return result;
+}
+
+void
+article_cache_writer_free (ArticleCacheWriter *writer)
+{
+  if (writer == NULL) {
+    return;
+  }
+
+  g_array_free (writer->records, TRUE);
+  g_string_free (writer->strings, TRUE);
+  g_free (writer->source);
+  g_free (writer);
+}
+
+/* Returns the string at OFFSET of the string table, or NULL if OFFSET is
+   missing or out of bounds. */
+static const gchar *
+get_string (const gchar *strings,
+            gsize        length,
+            guint32      offset)
+{
+  offset = GUINT32_FROM_LE (offset);
+
+  if (offset == NO_STRING || offset >= length ||
+      memchr (strings + offset, '\0', length - offset) == NULL) {
+    return NULL;
+  }
+
+  return strings + offset;
+}
+
+gboolean
+article_cache_load (const gchar  *source,
+                    guint64      *fingerprint,
+                    FeedItemFunc  func,
+                    gpointer      user_data)
+{
+  GMappedFile       *file;
+  gchar             *filename;
+  const gchar       *contents;
+  const gchar       *strings;
+  const CacheHeader *header;
+  const CacheRecord *records;
+  gsize              length, n_items, strings_length, i;
+
+  g_assert (source != NULL);
+  g_assert (func != NULL);
+
+  filename = get_cache_filename (source);
+  file = g_mapped_file_new (filename, FALSE, NULL);
+  g_free (filename);
+
+  if (file == NULL) {
+    return FALSE;
+  }
+
+  contents = g_mapped_file_get_contents (file);
+  length = g_mapped_file_get_length (file);
+  header = (const CacheHeader *) contents;
+
+  if (length < sizeof (CacheHeader) ||
+      memcmp (header->magic, CACHE_MAGIC, 4) != 0 ||
+      GUINT32_FROM_LE (header->version) != CACHE_VERSION) {
+    g_mapped_file_free (file);
+    return FALSE;
+  }
+
+  n_items = GUINT32_FROM_LE (header->n_items);
+  if (n_items > (length - sizeof (CacheHeader)) / sizeof (CacheRecord)) {
+    g_mapped_file_free (file);
+    return FALSE;
+  }
+
+  if (fingerprint != NULL) {
+    *fingerprint = GUINT64_FROM_LE (header->fingerprint);
+  }
+
+  records = (const CacheRecord *) (contents + sizeof (CacheHeader));
+  strings = (const gchar *) (records + n_items);
+  strings_length = contents + length - strings;
+
+  for (i = 0; i < n_items; i++) {
+    FeedItem item;
+
+    item.title = get_string (strings, strings_length, records[i].title);
+    item.link = get_string (strings, strings_length, records[i].link);
+    item.guid = get_string (strings, strings_length, records[i].guid);
+    item.date = GINT64_FROM_LE (records[i].date);
+    item.description = NULL;
+
+    func (&item, user_data);
+  }
+
+  g_mapped_file_free (file);
+
+  return TRUE;
+}
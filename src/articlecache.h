@@ -0,0 +1,88 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ARTICLECACHE_H
+#define ARTICLECACHE_H
+
+#include <glib.h>
+
+#include "feedparser.h"
+
+/*
+ * On-disk article cache.
+ *
+ * The articles of each feed are stored in a file under
+ * '$XDG_CACHE_HOME/gtk-feed/' so the feeds menu can be populated at
+ * startup before anything is fetched from the network.  The file is
+ * memory mapped when read, so loading it costs little more than the page
+ * faults.
+ *
+ * File layout (all integers little-endian):
+ *
+ *   header   "GFAC", format version, number of articles, reserved, and
+ *            the fingerprint of the feed document the articles came from
+ *   records  one per article: offsets of the title, link and guid in the
+ *            string table (or 0xffffffff for a missing field), padding,
+ *            and the publication date as seconds since the epoch
+ *   strings  NUL-terminated strings
+ */
+
+typedef struct _ArticleCacheWriter ArticleCacheWriter;
+
+/*
+ * Creates a writer which collects the articles of the feed SOURCE.
+ */
+ArticleCacheWriter * article_cache_writer_new    (const gchar        *source);
+
+/*
+ * Adds ITEM to the cache being written.  Only the title, link, guid and
+ * date are stored.
+ */
+void                 article_cache_writer_add    (ArticleCacheWriter *writer,
+                                                  const FeedItem     *item);
+
+/*
+ * Sets the fingerprint of the feed document being cached.
+ */
+void                 article_cache_writer_set_fingerprint
+                                                 (ArticleCacheWriter *writer,
+                                                  guint64             fingerprint);
+
+/*
+ * Replaces the cache file of the feed with the collected articles.
+ * Returns FALSE if the file could not be written.
+ */
+gboolean             article_cache_writer_commit (ArticleCacheWriter *writer);
+
+/*
+ * Destroys the writer.
+ */
+void                 article_cache_writer_free   (ArticleCacheWriter *writer);
+
+/*
+ * Reads the cached articles of the feed SOURCE and passes them to FUNC in
+ * their original order.  The strings of the items point directly into the
+ * mapped file.  If FINGERPRINT is non-NULL, it is set to the fingerprint of
+ * the cached document.  Returns FALSE if there is no valid cache for the
+ * feed.
+ */
+gboolean             article_cache_load          (const gchar        *source,
+                                                  guint64            *fingerprint,
+                                                  FeedItemFunc        func,
+                                                  gpointer            user_data);
+
+#endif
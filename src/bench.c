@@ -0,0 +1,1921 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Feed parse and sync benchmark.
+ *
+ * Generates synthetic RSS feeds of N items each into a temporary directory
+ * and reads them with the feed core:
+ *
+ *   parse   sequentially in a single thread
+ *   filter  sequentially, through an article filter of R rules none of
+ *           which match
+ *   sync    through the sync engine's worker pool
+ *   http    through the worker pool, from a local HTTP server
+ *   async   on the main loop without blocking, from the local HTTP server
+ *
+ * For each description size, prints the wall clock and CPU time, the
+ * throughput in items per second, the number of heap allocations per item
+ * and the peak resident memory of the process.  The local HTTP server runs
+ * in the same process, so its CPU time is included.  For the HTTP runs,
+ * it also prints how many connections the requests took, as counted by
+ * the client and by the server, and how many bytes compression saved.
+ *
+ * It then syncs the feeds from the local HTTP server twice more, threaded
+ * and asynchronously, the second time with the ETags of the first, and
+ * checks that the server answers 304 Not Modified and that the jobs
+ * finish without reading or parsing the feeds ("full" and "cond").
+ *
+ * It then resyncs the feeds from the local HTTP server Y times, threaded
+ * and asynchronously, with all feeds claiming their articles in one set
+ * of seen articles, and keeps the articles of each feed's latest sync
+ * like the application does.  It fails unless the resident memory stays
+ * flat over the resyncs after a warm-up, and unless the articles which
+ * drop out of the feeds in a last resync are released ("resync").
+ *
+ * Next, it syncs the feeds from the local HTTP server again, threaded and
+ * asynchronously, along with S feeds whose server sends the headers and
+ * then trickles the body a byte at a time, too slowly to finish but fast
+ * enough not to time out.  Either all jobs are given a deadline of D
+ * seconds, counted from the start of each job, which only the stalled
+ * ones may run into ("deadline"), or the stalled jobs are cancelled after
+ * half a second ("cancel").  It prints how long the run took and how long
+ * the stalled jobs took to stop once they should have.
+ *
+ * It then syncs the feeds with the largest descriptions from the local
+ * HTTP server, threaded and asynchronously, each twice at once as two
+ * feeds sharing all their articles and keeping at most half of them each
+ * ("share").  Duplicates must not count against the maximum, so it fails
+ * unless the two keep all the articles between them.
+ *
+ * It then reads an OPML subscription list of O feeds in nested folders
+ * ("import") and writes it back out ("export"), and prints the
+ * throughput in outlines per second and the allocations per outline.
+ *
+ * It then claims 100,000 and 300,000 random articles for 100 feeds
+ * in a set of seen articles and lets each feed renew its claims 20 times,
+ * replacing a tenth of its articles each time ("claim").  It prints the
+ * claims per second and the size of the set, and fails unless the set
+ * holds all the articles in at most 3.2 and 6.4 MB.
+ *
+ * It then marks 500,000 random articles read in a read state store
+ * ("mark"), looks up a million articles of which half are read
+ * ("lookup"), and reopens the store with 50,000 articles in its log
+ * ("reopen").  It prints the articles per second, and fails if the runs
+ * take more than 2 s, 1 s and 100 ms.
+ *
+ * Finally, it adds A synthetic articles of 100 feeds to a search index
+ * ("index") and runs a thousand queries each of a single word ("word"),
+ * of two words ("words") and of the first two letters of a word
+ * ("prefix"), the last word of each query matching as a prefix as when
+ * typing.  It prints the median and the 99th percentile of the query
+ * times, and fails if the latter exceeds 10 ms.
+ * Run with "make bench".
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <zlib.h>
+
+#include "canceltoken.h"
+#include "feedfilter.h"
+#include "feedsync.h"
+#include "http.h"
+#include "itemset.h"
+#include "opml.h"
+#include "readstate.h"
+#include "searchindex.h"
+#include "syncengine.h"
+
+/* Number of heap allocations made by the process.  Counted by wrapping
+   the C library allocator, so allocations made by GLib and libxml are
+   included; other C libraries report zero. */
+static volatile gint n_allocs = 0;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t n, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+void *
+malloc (size_t size)
+{
+  g_atomic_int_inc (&n_allocs);
+  return __libc_malloc (size);
+}
+
+void *
+calloc (size_t n,
+        size_t size)
+{
+  g_atomic_int_inc (&n_allocs);
+  return __libc_calloc (n, size);
+}
+
+void *
+realloc (void   *ptr,
+         size_t  size)
+{
+  g_atomic_int_inc (&n_allocs);
+  return __libc_realloc (ptr, size);
+}
+#endif
+
+static gint n_feeds = 100;
+static gint n_items = 50;
+static gint n_threads = 0;
+static gint n_rules = 1000;
+static gint n_outlines = 10000;
+static gint n_stalled = 2;
+static gint stall_deadline = 2;
+static gint n_resyncs = 1000;
+static gint n_articles = 200000;
+
+static GOptionEntry entries[] = {
+  { "feeds", 'f', 0, G_OPTION_ARG_INT, &n_feeds,
+    "Number of feeds", "N" },
+  { "items", 'i', 0, G_OPTION_ARG_INT, &n_items,
+    "Number of items per feed", "M" },
+  { "threads", 't', 0, G_OPTION_ARG_INT, &n_threads,
+    "Number of sync worker threads (default: automatic)", "N" },
+  { "rules", 'r', 0, G_OPTION_ARG_INT, &n_rules,
+    "Number of filter rules", "R" },
+  { "outlines", 'o', 0, G_OPTION_ARG_INT, &n_outlines,
+    "Number of feeds in the OPML list", "O" },
+  { "stalled", 's', 0, G_OPTION_ARG_INT, &n_stalled,
+    "Number of feeds whose server stalls", "S" },
+  { "deadline", 'd', 0, G_OPTION_ARG_INT, &stall_deadline,
+    "Deadline of the stalled feeds in seconds", "D" },
+  { "resyncs", 'y', 0, G_OPTION_ARG_INT, &n_resyncs,
+    "Number of resyncs of the feeds", "Y" },
+  { "articles", 'a', 0, G_OPTION_ARG_INT, &n_articles,
+    "Number of articles in the search index", "A" },
+  { NULL }
+};
+
+/* Sizes of the item descriptions in bytes. */
+static const gint description_sizes[] = { 0, 256, 4096 };
+
+/* Modes of the runs from the local HTTP server: threaded, then
+   asynchronous. */
+static const gchar *network_modes[] = { "http", "async" };
+
+/* Seconds after which the stalled jobs are cancelled, the most the
+   stalled jobs may take to stop once they should, and the microseconds
+   between the bytes which the server trickles to them. */
+#define CANCEL_DELAY   0.5
+#define MAX_STOP_DELAY 1.0
+#define STALL_INTERVAL 100000
+
+/* Number of resyncs before the resident memory is first measured, and
+   the most in kilobytes by which it may grow over the resyncs after
+   that. */
+#define RESYNC_WARMUP     50
+#define MAX_RESYNC_GROWTH 1024
+
+/* Sizes of the sets of seen articles, and the most kilobytes each may
+   take. */
+static const struct {
+  gint n_claims;
+  gint max_memory;
+} claim_runs[] = { { 100000, 3200 }, { 300000, 6400 } };
+
+/* Number of distinct words in the articles of the search index, numbers
+   of words in the title and in the description of an article, number of
+   queries of each kind, and the most milliseconds 99 in 100 queries may
+   take. */
+#define SEARCH_WORDS       50000
+#define SEARCH_TITLE_WORDS 8
+#define SEARCH_TEXT_WORDS  40
+#define SEARCH_QUERIES     1000
+#define MAX_QUERY_TIME     10.0
+
+/* Number of feeds claiming the seen articles, number of times each feed
+   renews its claims, and the share of its articles which it replaces
+   each time. */
+#define CLAIM_OWNERS    100
+#define CLAIM_RENEWALS  20
+#define CLAIM_TURNOVER  10
+
+/* Number of articles marked read, number of lookups, number of articles
+   in the log when the store is reopened, and the most seconds each may
+   take. */
+#define READ_MARKS           500000
+#define READ_LOOKUPS         1000000
+#define READ_LOG             50000
+#define MAX_READ_MARK_TIME   2.0
+#define MAX_READ_LOOKUP_TIME 1.0
+#define MAX_READ_REOPEN_TIME 0.1
+
+/* Counters of a run from the local HTTP server. */
+typedef struct {
+  HttpStats before;     /* counters of the client before the run */
+  HttpStats after;      /* and after it */
+  guint     accepted;   /* connections accepted by the server */
+} HttpRun;
+
+/* Writes feed number INDEX with items having descriptions of
+   DESCRIPTION_SIZE bytes into DIRECTORY.  Returns the file name. */
+static gchar *
+write_feed (const gchar *directory,
+            gint         index,
+            gint         description_size)
+{
+  GString *document;
+  gchar   *description;
+  gchar   *filename;
+  gchar   *basename;
+  GError  *error = NULL;
+  gint     i;
+
+  description = g_strnfill (description_size, 'x');
+  document = g_string_new ("<?xml version=\"1.0\"?>\n"
+                           "<rss version=\"2.0\"><channel>\n");
+  g_string_append_printf (document,
+                          "<title>Feed %d</title>\n"
+                          "<link>http://example.com/%d/</link>\n",
+                          index, index);
+
+  for (i = 0; i < n_items; i++) {
+    g_string_append_printf (document,
+                            "<item><title>Article %d of feed %d</title>"
+                            "<link>http://example.com/%d/%d.html</link>"
+                            "<guid>http://example.com/%d/%d.html</guid>"
+                            "<pubDate>Sat, 07 Sep 2002 00:00:01 GMT</pubDate>"
+                            "<description>%s</description></item>\n",
+                            i, index, index, i, index, i, description);
+  }
+
+  g_string_append (document, "</channel></rss>\n");
+
+  basename = g_strdup_printf ("feed-%d-%d.xml", description_size, index);
+  filename = g_build_filename (directory, basename, NULL);
+
+  if (!g_file_set_contents (filename, document->str, document->len, &error)) {
+    g_error ("Failed to write %s: %s", filename, error->message);
+  }
+
+  g_free (basename);
+  g_string_free (document, TRUE);
+  g_free (description);
+
+  return filename;
+}
+
+/* Writes N_FEEDS feeds with items having descriptions of
+   DESCRIPTION_SIZE bytes into DIRECTORY.  Returns the file names and
+   stores the URLs at which the local HTTP server on PORT serves them in
+   URLS. */
+static gchar **
+write_feeds (const gchar   *directory,
+             gint           description_size,
+             gint           port,
+             gchar       ***urls)
+{
+  gchar **filenames;
+  gint    i;
+
+  filenames = g_new0 (gchar *, n_feeds + 1);
+  *urls = g_new0 (gchar *, n_feeds + 1);
+  for (i = 0; i < n_feeds; i++) {
+    gchar *basename;
+
+    filenames[i] = write_feed (directory, i, description_size);
+    basename = g_path_get_basename (filenames[i]);
+    (*urls)[i] = g_strdup_printf ("http://127.0.0.1:%d/%s", port, basename);
+    g_free (basename);
+  }
+
+  return filenames;
+}
+
+/* Removes the feeds FILENAMES written by write_feeds() and frees them
+   along with URLS. */
+static void
+remove_feeds (gchar **filenames,
+              gchar **urls)
+{
+  gint i;
+
+  for (i = 0; i < n_feeds; i++) {
+    g_unlink (filenames[i]);
+  }
+  g_strfreev (filenames);
+  g_strfreev (urls);
+}
+
+/* Writes an OPML list of N_OUTLINES feeds into DIRECTORY.  The feeds are
+   in folders of ten, and the folders in groups of ten.  Returns the file
+   name. */
+static gchar *
+write_opml (const gchar *directory)
+{
+  GString *document;
+  gchar   *filename;
+  GError  *error = NULL;
+  gint     i;
+
+  document = g_string_new ("<?xml version=\"1.0\"?>\n"
+                           "<opml version=\"2.0\"><head><title>Feeds"
+                           "</title></head><body>\n");
+
+  for (i = 0; i < n_outlines; i++) {
+    if (i % 100 == 0) {
+      g_string_append_printf (document, "<outline text=\"Group %d\">\n",
+                              i / 100);
+    }
+    if (i % 10 == 0) {
+      g_string_append_printf (document, "<outline text=\"Folder %d\">\n",
+                              i / 10);
+    }
+
+    g_string_append_printf (document,
+                            "<outline type=\"rss\" text=\"Feed %d\" "
+                            "title=\"Feed %d\" "
+                            "xmlUrl=\"http://example.com/%d/feed.xml\" "
+                            "htmlUrl=\"http://example.com/%d/\"/>\n",
+                            i, i, i, i);
+
+    if (i % 10 == 9 || i == n_outlines - 1) {
+      g_string_append (document, "</outline>\n");
+    }
+    if (i % 100 == 99 || i == n_outlines - 1) {
+      g_string_append (document, "</outline>\n");
+    }
+  }
+
+  g_string_append (document, "</body></opml>\n");
+
+  filename = g_build_filename (directory, "feeds.opml", NULL);
+  if (!g_file_set_contents (filename, document->str, document->len, &error)) {
+    g_error ("Failed to write %s: %s", filename, error->message);
+  }
+
+  g_string_free (document, TRUE);
+
+  return filename;
+}
+
+/* Creates a filter of N_RULES rules which match none of the generated
+   articles.  Every tenth rule is a regular expression. */
+static FeedFilter *
+create_filter ()
+{
+  FeedFilter *filter;
+  gint        i;
+
+  filter = feed_filter_new ();
+
+  for (i = 0; i < n_rules; i++) {
+    gchar *pattern;
+
+    if (i % 10 == 9) {
+      pattern = g_strdup_printf ("^sponsored ?%d[a-z]*$", i);
+      if (!feed_filter_add_regex (filter, pattern, NULL)) {
+        g_error ("Failed to compile /%s/", pattern);
+      }
+    } else {
+      pattern = g_strdup_printf ("keyword%d", i);
+      feed_filter_add_keyword (filter, pattern);
+    }
+
+    g_free (pattern);
+  }
+
+  feed_filter_compile (filter);
+
+  return filter;
+}
+
+/* Directory served by the local HTTP server. */
+static gchar        *server_directory = NULL;
+
+/* Counters of the local HTTP server. */
+static guint         server_connections = 0;    /* connections accepted */
+static guint         server_not_modified = 0;   /* 304 responses sent */
+static GStaticMutex  server_mutex = G_STATIC_MUTEX_INIT;
+
+/* Compresses LENGTH bytes of DATA in gzip format.  Returns the compressed
+   data and stores its size in COMPRESSED_LENGTH. */
+static gchar *
+gzip_data (const gchar *data,
+           gsize        length,
+           gsize       *compressed_length)
+{
+  z_stream  stream;
+  gchar    *compressed;
+
+  memset (&stream, 0, sizeof (stream));
+  if (deflateInit2 (&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                    16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    g_error ("Failed to initialize zlib");
+  }
+
+  compressed = g_malloc (deflateBound (&stream, length));
+  stream.next_in = (Bytef *) data;
+  stream.avail_in = length;
+  stream.next_out = (Bytef *) compressed;
+  stream.avail_out = deflateBound (&stream, length);
+
+  if (deflate (&stream, Z_FINISH) != Z_STREAM_END) {
+    g_error ("Failed to compress");
+  }
+
+  *compressed_length = stream.total_out;
+  deflateEnd (&stream);
+
+  return compressed;
+}
+
+/* Writes all of DATA to the socket FD. */
+static gboolean
+send_all (gint         fd,
+          const gchar *data,
+          gsize        length)
+{
+  while (length > 0) {
+    gssize written = send (fd, data, length, MSG_NOSIGNAL);
+
+    if (written <= 0) {
+      return FALSE;
+    }
+    data += written;
+    length -= written;
+  }
+
+  return TRUE;
+}
+
+/* Sends the headers and the start of a feed which never ends, and then
+   trickles whitespace to it until the client gives up.  Returns FALSE,
+   since the connection cannot be reused. */
+static gboolean
+send_stalled (gint fd)
+{
+  const gchar *head = "HTTP/1.1 200 OK\r\n"
+                      "Content-Type: application/rss+xml\r\n"
+                      "Content-Length: 1000000\r\n\r\n"
+                      "<?xml version=\"1.0\"?>\n"
+                      "<rss version=\"2.0\"><channel>\n"
+                      "<title>Stalled</title>\n";
+
+  if (!send_all (fd, head, strlen (head))) {
+    return FALSE;
+  }
+
+  while (send_all (fd, " ", 1)) {
+    g_usleep (STALL_INTERVAL);
+  }
+
+  return FALSE;
+}
+
+/* Sends the response to a request for PATH, compressed and chunked if
+   GZIP is TRUE.  The file is answered with 304 Not Modified if its ETag
+   is IF_NONE_MATCH.  Requests for files named "stall-*" stall.  The
+   response is sent in one piece, so that it does not wait for the
+   acknowledgement of a small first segment. */
+static gboolean
+send_response (gint         fd,
+               const gchar *path,
+               gboolean     gzip,
+               const gchar *if_none_match)
+{
+  gchar    *basename;
+  gchar    *filename;
+  gchar    *data = NULL;
+  gchar    *etag;
+  gsize     length;
+  GString  *response;
+  gboolean  sent;
+
+  basename = g_path_get_basename (path);
+  if (g_str_has_prefix (basename, "stall-")) {
+    g_free (basename);
+    return send_stalled (fd);
+  }
+
+  filename = g_build_filename (server_directory, basename, NULL);
+  g_file_get_contents (filename, &data, &length, NULL);
+  g_free (filename);
+  g_free (basename);
+
+  if (data == NULL) {
+    const gchar *response = "HTTP/1.1 404 Not Found\r\n"
+                            "Content-Length: 0\r\n\r\n";
+
+    return send_all (fd, response, strlen (response));
+  }
+
+  /* The ETag is derived from the contents, in lower case since the
+     request headers are matched in lower case. */
+  etag = g_strdup_printf ("\"%x-%lx\"", g_str_hash (data), (gulong) length);
+
+  if (if_none_match != NULL && strcmp (if_none_match, etag) == 0) {
+    g_static_mutex_lock (&server_mutex);
+    server_not_modified++;
+    g_static_mutex_unlock (&server_mutex);
+
+    response = g_string_new (NULL);
+    g_string_append_printf (response,
+                            "HTTP/1.1 304 Not Modified\r\n"
+                            "ETag: %s\r\n\r\n",
+                            etag);
+  } else if (gzip) {
+    gchar *compressed;
+    gsize  offset;
+
+    compressed = gzip_data (data, length, &length);
+    g_free (data);
+    data = compressed;
+
+    response = g_string_new (NULL);
+    g_string_append_printf (response,
+                            "HTTP/1.1 200 OK\r\n"
+                            "Content-Type: application/rss+xml\r\n"
+                            "ETag: %s\r\n"
+                            "Content-Encoding: gzip\r\n"
+                            "Transfer-Encoding: chunked\r\n\r\n",
+                            etag);
+
+    for (offset = 0; offset < length; offset += 8192) {
+      gsize size = MIN (length - offset, 8192);
+
+      g_string_append_printf (response, "%lx\r\n", (gulong) size);
+      g_string_append_len (response, data + offset, size);
+      g_string_append (response, "\r\n");
+    }
+
+    g_string_append (response, "0\r\n\r\n");
+  } else {
+    response = g_string_new (NULL);
+    g_string_append_printf (response,
+                            "HTTP/1.1 200 OK\r\n"
+                            "Content-Type: application/rss+xml\r\n"
+                            "ETag: %s\r\n"
+                            "Content-Length: %lu\r\n\r\n",
+                            etag, (gulong) length);
+    g_string_append_len (response, data, length);
+  }
+
+  sent = send_all (fd, response->str, response->len);
+  g_string_free (response, TRUE);
+  g_free (etag);
+  g_free (data);
+
+  return sent;
+}
+
+/* Thread serving the requests of a client of the local HTTP server until
+   the client closes the connection. */
+static gpointer
+serve_client (gpointer data)
+{
+  gint     fd = GPOINTER_TO_INT (data);
+  GString *request;
+  gchar    chunk[4096];
+  gssize   length;
+
+  request = g_string_new (NULL);
+
+  while ((length = recv (fd, chunk, sizeof (chunk), 0)) > 0) {
+    gchar *end;
+
+    g_string_append_len (request, chunk, length);
+
+    while ((end = strstr (request->str, "\r\n\r\n")) != NULL) {
+      gchar        path[1024];
+      gchar       *headers;
+      gchar       *if_none_match = NULL;
+      const gchar *value;
+      gboolean     gzip;
+
+      *end = '\0';
+      headers = g_ascii_strdown (request->str, -1);
+      gzip = strstr (headers, "\naccept-encoding:") != NULL &&
+             strstr (headers, "gzip") != NULL;
+
+      value = strstr (headers, "\nif-none-match:");
+      if (value != NULL) {
+        value += strlen ("\nif-none-match:");
+        value += strspn (value, " \t");
+        if_none_match = g_strndup (value, strcspn (value, "\r\n"));
+      }
+
+      if (sscanf (request->str, "GET %1023s ", path) != 1 ||
+          !send_response (fd, path, gzip, if_none_match)) {
+        g_free (if_none_match);
+        g_free (headers);
+        goto done;
+      }
+
+      g_free (if_none_match);
+      g_free (headers);
+      g_string_erase (request, 0, end + 4 - request->str);
+    }
+  }
+
+ done:
+  g_string_free (request, TRUE);
+  close (fd);
+
+  return NULL;
+}
+
+/* Thread accepting the clients of the local HTTP server on the socket
+   DATA. */
+static gpointer
+serve (gpointer data)
+{
+  gint listener = GPOINTER_TO_INT (data);
+  gint fd;
+
+  while ((fd = accept (listener, NULL, NULL)) >= 0) {
+    g_static_mutex_lock (&server_mutex);
+    server_connections++;
+    g_static_mutex_unlock (&server_mutex);
+
+    g_thread_create (serve_client, GINT_TO_POINTER (fd), FALSE, NULL);
+  }
+
+  return NULL;
+}
+
+/* Starts a local HTTP server for the files in DIRECTORY.  Returns its
+   port. */
+static gint
+start_server (const gchar *directory)
+{
+  struct sockaddr_in address;
+  socklen_t          length = sizeof (address);
+  gint               listener;
+
+  server_directory = g_strdup (directory);
+
+  memset (&address, 0, sizeof (address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  address.sin_port = 0;
+
+  listener = socket (AF_INET, SOCK_STREAM, 0);
+  if (listener < 0 ||
+      bind (listener, (struct sockaddr *) &address, sizeof (address)) < 0 ||
+      listen (listener, SOMAXCONN) < 0 ||
+      getsockname (listener, (struct sockaddr *) &address, &length) < 0) {
+    g_error ("Failed to start the HTTP server: %s", g_strerror (errno));
+  }
+
+  g_thread_create (serve, GINT_TO_POINTER (listener), FALSE, NULL);
+
+  return ntohs (address.sin_port);
+}
+
+/* Returns the number of connections the local HTTP server has
+   accepted. */
+static guint
+get_server_connections ()
+{
+  guint n;
+
+  g_static_mutex_lock (&server_mutex);
+  n = server_connections;
+  g_static_mutex_unlock (&server_mutex);
+
+  return n;
+}
+
+/* Returns the number of requests the local HTTP server has answered
+   with 304 Not Modified. */
+static guint
+get_server_not_modified ()
+{
+  guint n;
+
+  g_static_mutex_lock (&server_mutex);
+  n = server_not_modified;
+  g_static_mutex_unlock (&server_mutex);
+
+  return n;
+}
+
+/* Returns the CPU time used by the process so far, in seconds. */
+static gdouble
+get_cpu_time ()
+{
+  struct rusage usage;
+
+  getrusage (RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+/* Returns the peak resident memory of the process in kilobytes. */
+static glong
+get_peak_memory ()
+{
+  struct rusage usage;
+
+  getrusage (RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+/* Returns the current resident memory of the process in kilobytes, or
+   zero if it cannot be read. */
+static glong
+get_memory ()
+{
+  FILE  *file;
+  glong  size;
+  glong  resident = 0;
+
+  file = fopen ("/proc/self/statm", "r");
+  if (file == NULL) {
+    return 0;
+  }
+
+  if (fscanf (file, "%ld %ld", &size, &resident) != 2) {
+    resident = 0;
+  }
+  fclose (file);
+
+  return resident * (sysconf (_SC_PAGESIZE) / 1024);
+}
+
+/* Completion callback of the sync jobs.  Passes JOB back to the main
+   thread. */
+static void
+on_job_done (FeedSyncJob *job)
+{
+  g_async_queue_push (job->user_data, job);
+}
+
+/* Waits for a job queued with on_job_done() as the callback to finish
+   and returns it. */
+static FeedSyncJob *
+pop_job (GAsyncQueue *queue)
+{
+  /* In asynchronous mode, the jobs run in this thread's main loop. */
+  while (sync_engine_get_async () && g_async_queue_length (queue) == 0) {
+    g_main_context_iteration (NULL, TRUE);
+  }
+
+  return g_async_queue_pop (queue);
+}
+
+/* Counts the articles of JOB and frees it. */
+static guint
+finish_job (FeedSyncJob *job)
+{
+  guint n;
+
+  if (job->status != FEED_SYNC_CHANGED) {
+    g_error ("Failed to read %s", job->source);
+  }
+
+  n = job->articles->items->len;
+  feed_sync_job_free (job);
+
+  return n;
+}
+
+/* Reads the feeds in FILENAMES, sequentially if QUEUE is NULL or through
+   the sync engine otherwise, and prints the results as MODE.  The
+   articles are passed through FILTER unless it is NULL. */
+static void
+run (const gchar  *mode,
+     gchar       **filenames,
+     gint          description_size,
+     GAsyncQueue  *queue,
+     FeedFilter   *filter)
+{
+  GTimer  *timer;
+  gdouble  elapsed;
+  gdouble  cpu;
+  guint    n_read = 0;
+  gint     allocs;
+  gint     i;
+
+  allocs = g_atomic_int_get (&n_allocs);
+  cpu = get_cpu_time ();
+  timer = g_timer_new ();
+
+  for (i = 0; i < n_feeds; i++) {
+    FeedSyncJob *job;
+
+    job = feed_sync_job_new (filenames[i],
+                             queue != NULL ? on_job_done : NULL,
+                             queue);
+    job->cache = FALSE;
+    job->filter = filter;
+
+    if (queue == NULL) {
+      feed_sync_run (job);
+      n_read += finish_job (job);
+    } else if (!sync_engine_push (job)) {
+      g_error ("Failed to queue %s", filenames[i]);
+    }
+  }
+
+  if (queue != NULL) {
+    for (i = 0; i < n_feeds; i++) {
+      n_read += finish_job (pop_job (queue));
+    }
+  }
+
+  elapsed = g_timer_elapsed (timer, NULL);
+  cpu = get_cpu_time () - cpu;
+  allocs = g_atomic_int_get (&n_allocs) - allocs;
+  g_timer_destroy (timer);
+
+  if (n_read != (guint) (n_feeds * n_items)) {
+    g_error ("Read %u items instead of %d", n_read, n_feeds * n_items);
+  }
+
+  printf ("%-6s %6d %6d %9d %9.3f %9.3f %12.0f %12.1f %10ld\n",
+          mode,
+          n_feeds, n_items, description_size,
+          elapsed, cpu, n_read / elapsed,
+          (gdouble) allocs / n_read,
+          get_peak_memory ());
+}
+
+/* Syncs the feeds at URLS from the local HTTP server through the sync
+   engine, and then again with the ETags of the first sync, and prints
+   the results as MODE.  The server must answer each second request with
+   304 Not Modified, and the second jobs must finish without reading or
+   parsing the feeds. */
+static void
+run_conditional (const gchar  *mode,
+                 gchar       **urls,
+                 GAsyncQueue  *queue)
+{
+  GHashTable *etags;
+  GTimer     *timer;
+  gdouble     elapsed[2];
+  guint       not_modified;
+  gint        pass, i;
+
+  etags = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  timer = g_timer_new ();
+  not_modified = get_server_not_modified ();
+
+  for (pass = 0; pass < 2; pass++) {
+    g_timer_start (timer);
+
+    for (i = 0; i < n_feeds; i++) {
+      FeedSyncJob *job;
+
+      job = feed_sync_job_new (urls[i], on_job_done, queue);
+      job->cache = FALSE;
+      job->etag = g_strdup (g_hash_table_lookup (etags, urls[i]));
+
+      if (!sync_engine_push (job)) {
+        g_error ("Failed to queue %s", urls[i]);
+      }
+    }
+
+    for (i = 0; i < n_feeds; i++) {
+      FeedSyncJob *job = pop_job (queue);
+
+      if (pass == 0) {
+        if (job->status == FEED_SYNC_CHANGED && job->etag == NULL) {
+          g_error ("%s was sent without an ETag", job->source);
+        }
+        g_hash_table_insert (etags, g_strdup (job->source),
+                             g_strdup (job->etag));
+        finish_job (job);
+        continue;
+      }
+
+      if (job->status != FEED_SYNC_NOT_MODIFIED) {
+        g_error ("%s ended with status %d instead of not modified",
+                 job->source, job->status);
+      }
+      if (job->articles != NULL || job->stats.bytes != 0 ||
+          job->stats.parse_time != 0.0) {
+        g_error ("%s was read although it was not modified", job->source);
+      }
+      feed_sync_job_free (job);
+    }
+
+    elapsed[pass] = g_timer_elapsed (timer, NULL);
+  }
+
+  not_modified = get_server_not_modified () - not_modified;
+  if (not_modified != (guint) n_feeds) {
+    g_error ("The server answered %u requests instead of %d with 304",
+             not_modified, n_feeds);
+  }
+
+  printf ("%-6s %6d %9.3f %9.3f %12u\n",
+          mode, n_feeds, elapsed[0], elapsed[1], not_modified);
+
+  g_timer_destroy (timer);
+  g_hash_table_destroy (etags);
+}
+
+/* Syncs the feeds at URLS from the local HTTP server on PORT through the
+   sync engine, along with N_STALLED feeds which stall, and prints the
+   results as MODE.  If DEADLINE is TRUE, all jobs are given a deadline,
+   which the stalled ones must run into while the others must not, even
+   if they waited for a worker for longer than the deadline.  Otherwise
+   the stalled jobs are cancelled after CANCEL_DELAY seconds. */
+static void
+run_stall (const gchar  *mode,
+           gchar       **urls,
+           gint          port,
+           GAsyncQueue  *queue,
+           gboolean      deadline)
+{
+  CancelToken **tokens;
+  GTimer       *timer;
+  gdouble       limit;
+  gdouble       cancelled_at = 0.0;
+  gdouble       stop_delay = 0.0;
+  gint          n_jobs = n_feeds + n_stalled;
+  gint          n_done = 0;
+  gint          i;
+
+  tokens = g_new (CancelToken *, MAX (n_stalled, 1));
+  timer = g_timer_new ();
+
+  /* The stalled jobs are queued first, so they take workers from the
+     others. */
+  for (i = 0; i < n_jobs; i++) {
+    FeedSyncJob *job;
+    gchar       *url;
+
+    if (i < n_stalled) {
+      url = g_strdup_printf ("http://127.0.0.1:%d/stall-%d.xml", port, i);
+    } else {
+      url = g_strdup (urls[i - n_stalled]);
+    }
+
+    job = feed_sync_job_new (url, on_job_done, queue);
+    job->cache = FALSE;
+    if (deadline) {
+      job->cancel = cancel_token_new (stall_deadline);
+    } else if (i < n_stalled) {
+      job->cancel = cancel_token_new (0);
+    }
+    if (i < n_stalled) {
+      tokens[i] = cancel_token_ref (job->cancel);
+    }
+
+    if (!sync_engine_push (job)) {
+      g_error ("Failed to queue %s", url);
+    }
+    g_free (url);
+  }
+
+  while (n_done < n_jobs) {
+    FeedSyncJob *job;
+
+    if (!deadline && cancelled_at == 0.0 &&
+        g_timer_elapsed (timer, NULL) >= CANCEL_DELAY) {
+      cancelled_at = g_timer_elapsed (timer, NULL);
+      for (i = 0; i < n_stalled; i++) {
+        cancel_token_cancel (tokens[i]);
+      }
+    }
+
+    /* In asynchronous mode, the jobs run in this thread's main loop, which
+       wakes up at least every CANCEL_TOKEN_CHECK_INTERVAL while the
+       stalled jobs run. */
+    if (sync_engine_get_async ()) {
+      job = g_async_queue_try_pop (queue);
+      if (job == NULL) {
+        g_main_context_iteration (NULL, TRUE);
+        continue;
+      }
+    } else {
+      GTimeVal until;
+
+      g_get_current_time (&until);
+      g_time_val_add (&until, 10000);
+      job = g_async_queue_timed_pop (queue, &until);
+      if (job == NULL) {
+        continue;
+      }
+    }
+
+    n_done++;
+
+    if (strstr (job->source, "/stall-") == NULL) {
+      finish_job (job);
+      continue;
+    }
+
+    if (job->status != (deadline ? FEED_SYNC_FAILED : FEED_SYNC_CANCELLED)) {
+      g_error ("%s ended with status %d", job->source, job->status);
+    }
+
+    /* The deadline counts from the start of each job, so a stalled job
+       must have run for all of it, however long it was queued.  The
+       deadline is kept in milliseconds. */
+    if (deadline) {
+      if (job->stats.total_time < stall_deadline - 0.01) {
+        g_error ("%s stopped after %.3f s, before its deadline",
+                 job->source, job->stats.total_time);
+      }
+      stop_delay = MAX (stop_delay, job->stats.total_time - stall_deadline);
+    } else {
+      stop_delay = MAX (stop_delay,
+                        g_timer_elapsed (timer, NULL) - cancelled_at);
+    }
+    feed_sync_job_free (job);
+  }
+
+  limit = deadline ? stall_deadline : CANCEL_DELAY;
+  if (stop_delay > MAX_STOP_DELAY) {
+    g_error ("The stalled %s jobs took %.3f s to stop", mode, stop_delay);
+  }
+
+  printf ("%-6s %-8s %6d %8d %9.3f %9.3f %9.3f\n",
+          mode, deadline ? "deadline" : "cancel",
+          n_feeds, n_stalled, limit, g_timer_elapsed (timer, NULL),
+          stop_delay);
+
+  for (i = 0; i < n_stalled; i++) {
+    cancel_token_unref (tokens[i]);
+  }
+  g_free (tokens);
+  g_timer_destroy (timer);
+}
+
+/* Syncs the feeds at URLS through the sync engine, keeping MAX_ITEMS
+   articles of each, which claim their articles in SEEN.  The articles
+   replace those of the previous sync in GENERATIONS, which are freed, as
+   the application does. */
+static void
+resync (gchar         **urls,
+        GAsyncQueue    *queue,
+        ItemSet        *seen,
+        FeedArticles  **generations,
+        gint            max_items)
+{
+  gint i;
+
+  for (i = 0; i < n_feeds; i++) {
+    FeedSyncJob *job;
+
+    job = feed_sync_job_new (urls[i], on_job_done, queue);
+    job->cache = FALSE;
+    job->seen = seen;
+    job->owner = i + 1;
+    job->max_items = max_items;
+
+    if (!sync_engine_push (job)) {
+      g_error ("Failed to queue %s", urls[i]);
+    }
+  }
+
+  for (i = 0; i < n_feeds; i++) {
+    FeedSyncJob *job = pop_job (queue);
+    gint         index = job->owner - 1;
+
+    if (job->status != FEED_SYNC_CHANGED ||
+        job->articles->items->len != (guint) MIN (max_items, n_items)) {
+      g_error ("Failed to resync %s", job->source);
+    }
+
+    feed_articles_free (generations[index]);
+    generations[index] = job->articles;
+    job->articles = NULL;
+    feed_sync_job_free (job);
+  }
+}
+
+/* Resyncs the feeds at URLS from the local HTTP server through the sync
+   engine RESYNC_WARMUP + N_RESYNCS times and prints the results as MODE.
+   The resident memory must not grow by more than MAX_RESYNC_GROWTH over
+   the last N_RESYNCS.  A last resync keeps only half of the articles of
+   each feed, and the other half must then be released from the set of
+   seen articles. */
+static void
+run_resync (const gchar  *mode,
+            gchar       **urls,
+            GAsyncQueue  *queue)
+{
+  FeedArticles **generations;
+  ItemSet       *seen;
+  GTimer        *timer;
+  glong          start = 0;
+  glong          growth;
+  gint           n_kept = MAX (n_items / 2, 1);
+  gint           round, i;
+
+  generations = g_new0 (FeedArticles *, n_feeds);
+  seen = item_set_new ();
+  timer = g_timer_new ();
+
+  for (round = 0; round < RESYNC_WARMUP + n_resyncs; round++) {
+    if (round == RESYNC_WARMUP) {
+      g_timer_start (timer);
+      start = get_memory ();
+    }
+
+    resync (urls, queue, seen, generations, n_items);
+  }
+
+  growth = get_memory () - start;
+  if (growth > MAX_RESYNC_GROWTH) {
+    g_error ("The resident memory grew by %ld kB over %d %s resyncs",
+             growth, n_resyncs, mode);
+  }
+
+  /* The articles which drop out of the feeds must be released. */
+  resync (urls, queue, seen, generations, n_kept);
+  if (item_set_size (seen) != (guint) (n_feeds * n_kept)) {
+    g_error ("%u articles are claimed instead of %d",
+             item_set_size (seen), n_feeds * n_kept);
+  }
+
+  printf ("%-6s %6d %8d %9.3f %10ld %10ld\n",
+          mode, n_feeds, n_resyncs, g_timer_elapsed (timer, NULL),
+          start, growth);
+
+  for (i = 0; i < n_feeds; i++) {
+    feed_articles_free (generations[i]);
+  }
+  g_free (generations);
+  item_set_free (seen);
+  g_timer_destroy (timer);
+}
+
+/* Resyncs the feeds at URLS from the local HTTP server, threaded and
+   asynchronously. */
+static void
+run_resyncs (gchar       **urls,
+             GAsyncQueue  *queue)
+{
+  gint i;
+
+  printf ("\n%-6s %6s %8s %9s %10s %10s\n",
+          "mode", "feeds", "resyncs", "seconds", "start kB", "growth kB");
+
+  for (i = 0; i < G_N_ELEMENTS (network_modes); i++) {
+    sync_engine_set_async (i == 1);
+    run_resync (network_modes[i], urls, queue);
+  }
+  sync_engine_set_async (FALSE);
+}
+
+/* Syncs each feed at URLS twice at once through the sync engine, as two
+   feeds sharing all their articles, each keeping at most half of them,
+   and prints the results as MODE.  Duplicates must not count against the
+   maximum, so between them the two must keep all the articles. */
+static void
+run_share (const gchar  *mode,
+           gchar       **urls,
+           GAsyncQueue  *queue)
+{
+  ItemSet *seen;
+  GTimer  *timer;
+  guint   *n_kept;
+  gint     max_items = (n_items + 1) / 2;
+  gint     i;
+
+  seen = item_set_new ();
+  timer = g_timer_new ();
+  n_kept = g_new0 (guint, n_feeds);
+
+  for (i = 0; i < 2 * n_feeds; i++) {
+    FeedSyncJob *job;
+
+    job = feed_sync_job_new (urls[i / 2], on_job_done, queue);
+    job->cache = FALSE;
+    job->seen = seen;
+    job->owner = i + 1;
+    job->max_items = max_items;
+
+    if (!sync_engine_push (job)) {
+      g_error ("Failed to queue %s", urls[i / 2]);
+    }
+  }
+
+  for (i = 0; i < 2 * n_feeds; i++) {
+    FeedSyncJob *job = pop_job (queue);
+
+    if (job->status != FEED_SYNC_CHANGED) {
+      g_error ("Failed to sync %s", job->source);
+    }
+    n_kept[(job->owner - 1) / 2] += job->articles->items->len;
+    feed_sync_job_free (job);
+  }
+
+  for (i = 0; i < n_feeds; i++) {
+    if (n_kept[i] != (guint) n_items) {
+      g_error ("Two feeds sharing %s keep %u articles instead of %d",
+               urls[i], n_kept[i], n_items);
+    }
+  }
+
+  printf ("%-6s %6d %6d %9d %9.3f\n",
+          mode, n_feeds, n_items, max_items, g_timer_elapsed (timer, NULL));
+
+  g_free (n_kept);
+  g_timer_destroy (timer);
+  item_set_free (seen);
+}
+
+/* Syncs the feeds at URLS from the local HTTP server as pairs of feeds
+   sharing their articles, threaded and asynchronously. */
+static void
+run_shares (gchar       **urls,
+            GAsyncQueue  *queue)
+{
+  gint i;
+
+  printf ("\n%-6s %6s %6s %9s %9s\n",
+          "mode", "feeds", "items", "max items", "seconds");
+
+  for (i = 0; i < G_N_ELEMENTS (network_modes); i++) {
+    sync_engine_set_async (i == 1);
+    run_share (network_modes[i], urls, queue);
+  }
+  sync_engine_set_async (FALSE);
+}
+
+/* Syncs the feeds at URLS from the local HTTP server twice, threaded
+   and asynchronously, the second time conditionally. */
+static void
+run_conditionals (gchar       **urls,
+                  GAsyncQueue  *queue)
+{
+  gint i;
+
+  printf ("\n%-6s %6s %9s %9s %12s\n",
+          "mode", "feeds", "full s", "cond s", "not modified");
+
+  for (i = 0; i < G_N_ELEMENTS (network_modes); i++) {
+    sync_engine_set_async (i == 1);
+    run_conditional (network_modes[i], urls, queue);
+  }
+  sync_engine_set_async (FALSE);
+}
+
+/* Syncs the feeds at URLS from the local HTTP server on PORT along with
+   the stalled feeds, threaded and asynchronously, with a deadline and
+   with cancellation. */
+static void
+run_stalls (gchar       **urls,
+            gint          port,
+            GAsyncQueue  *queue)
+{
+  gint i;
+
+  printf ("\n%-6s %-8s %6s %8s %9s %9s %9s\n",
+          "mode", "stop", "feeds", "stalled", "limit s", "seconds",
+          "stop s");
+
+  for (i = 0; i < G_N_ELEMENTS (network_modes); i++) {
+    sync_engine_set_async (i == 1);
+    run_stall (network_modes[i], urls, port, queue, TRUE);
+    run_stall (network_modes[i], urls, port, queue, FALSE);
+  }
+  sync_engine_set_async (FALSE);
+}
+
+/* OPML reader callback which keeps the feeds read in FEEDS. */
+static void
+add_outline (const gchar *title,
+             const gchar *url,
+             GPtrArray   *feeds)
+{
+  g_ptr_array_add (feeds, g_strdup (title));
+  g_ptr_array_add (feeds, g_strdup (url));
+}
+
+/* Prints the results of an OPML run. */
+static void
+print_opml_run (const gchar *mode,
+                gdouble      elapsed,
+                gint         allocs)
+{
+  printf ("%-6s %9d %9.3f %12.0f %15.1f %10ld\n",
+          mode, n_outlines, elapsed, n_outlines / elapsed,
+          (gdouble) allocs / n_outlines, get_peak_memory ());
+}
+
+/* Reads the OPML list written into DIRECTORY and writes it back out,
+   timing both. */
+static void
+run_opml (const gchar *directory)
+{
+  OpmlWriter *writer;
+  GPtrArray  *feeds;
+  GTimer     *timer;
+  GError     *error = NULL;
+  gchar      *filename;
+  gchar      *output;
+  gint        allocs;
+  guint       i;
+
+  filename = write_opml (directory);
+  output = g_build_filename (directory, "export.opml", NULL);
+  feeds = g_ptr_array_new ();
+
+  printf ("\n%-6s %9s %9s %12s %15s %10s\n",
+          "mode", "outlines", "seconds", "outlines/s", "allocs/outline",
+          "peak kB");
+
+  allocs = g_atomic_int_get (&n_allocs);
+  timer = g_timer_new ();
+  if (!opml_read (filename, (OpmlFeedFunc) add_outline, feeds, &error)) {
+    g_error ("%s", error->message);
+  }
+  if (feeds->len != (guint) n_outlines * 2) {
+    g_error ("Read %u outlines instead of %d", feeds->len / 2, n_outlines);
+  }
+  print_opml_run ("import", g_timer_elapsed (timer, NULL),
+                  g_atomic_int_get (&n_allocs) - allocs);
+
+  allocs = g_atomic_int_get (&n_allocs);
+  g_timer_start (timer);
+  writer = opml_writer_new (output, "Feeds", &error);
+  if (writer == NULL) {
+    g_error ("%s", error->message);
+  }
+  for (i = 0; i < feeds->len; i += 2) {
+    opml_writer_add (writer, g_ptr_array_index (feeds, i),
+                     g_ptr_array_index (feeds, i + 1));
+  }
+  if (!opml_writer_close (writer, &error)) {
+    g_error ("%s", error->message);
+  }
+  print_opml_run ("export", g_timer_elapsed (timer, NULL),
+                  g_atomic_int_get (&n_allocs) - allocs);
+
+  g_timer_destroy (timer);
+  for (i = 0; i < feeds->len; i++) {
+    g_free (g_ptr_array_index (feeds, i));
+  }
+  g_ptr_array_free (feeds, TRUE);
+  g_unlink (filename);
+  g_unlink (output);
+  g_free (filename);
+  g_free (output);
+}
+
+/* Returns a random 64-bit article hash from RAND. */
+static guint64
+random_hash (GRand *rand)
+{
+  return (guint64) g_rand_int (rand) << 32 | g_rand_int (rand);
+}
+
+/* Claims N_CLAIMS random articles for CLAIM_OWNERS feeds in a set of
+   seen articles, then lets each feed renew its claims CLAIM_RENEWALS
+   times, replacing one in CLAIM_TURNOVER of its articles each time.  The
+   set must hold N_CLAIMS claims and take at most MAX_MEMORY kilobytes. */
+static void
+run_claim (gint n_claims,
+           gint max_memory)
+{
+  ItemSet *seen;
+  GRand   *rand;
+  GTimer  *timer;
+  guint64 *hashes;
+  gsize    memory;
+  gint     round, owner, i;
+
+  seen = item_set_new ();
+  rand = g_rand_new_with_seed (n_claims);
+  timer = g_timer_new ();
+  hashes = g_new (guint64, n_claims);
+
+  for (i = 0; i < n_claims; i++) {
+    hashes[i] = random_hash (rand);
+    if (!item_set_claim (seen, hashes[i], i % CLAIM_OWNERS + 1)) {
+      g_error ("Failed to claim article %d", i);
+    }
+  }
+
+  for (round = 0; round < CLAIM_RENEWALS; round++) {
+    for (owner = 0; owner < CLAIM_OWNERS; owner++) {
+      item_set_renew (seen, owner + 1);
+      for (i = owner; i < n_claims; i += CLAIM_OWNERS) {
+        if (i / CLAIM_OWNERS % CLAIM_TURNOVER == round % CLAIM_TURNOVER) {
+          hashes[i] = random_hash (rand);
+        }
+        if (!item_set_claim (seen, hashes[i], owner + 1)) {
+          g_error ("Failed to claim article %d again", i);
+        }
+      }
+    }
+  }
+
+  memory = item_set_memory (seen);
+  if (item_set_size (seen) != (guint) n_claims) {
+    g_error ("%u articles are claimed instead of %d",
+             item_set_size (seen), n_claims);
+  }
+  if (memory > (gsize) max_memory * 1024) {
+    g_error ("%d claims take %lu kB instead of at most %d kB",
+             n_claims, (gulong) memory / 1024, max_memory);
+  }
+
+  printf ("%-6s %9d %6d %9d %9.3f %12.0f %10lu %12.1f\n",
+          "claim", n_claims, CLAIM_OWNERS, CLAIM_RENEWALS,
+          g_timer_elapsed (timer, NULL),
+          (gdouble) n_claims * (CLAIM_RENEWALS + 1) /
+          g_timer_elapsed (timer, NULL),
+          (gulong) memory / 1024, (gdouble) memory / n_claims);
+
+  g_free (hashes);
+  g_timer_destroy (timer);
+  g_rand_free (rand);
+  item_set_free (seen);
+}
+
+/* Runs the claims of sets of seen articles of each size. */
+static void
+run_claims ()
+{
+  gint i;
+
+  printf ("\n%-6s %9s %6s %9s %9s %12s %10s %12s\n",
+          "mode", "claims", "feeds", "renewals", "seconds", "claims/s",
+          "kB", "bytes/claim");
+
+  for (i = 0; i < G_N_ELEMENTS (claim_runs); i++) {
+    run_claim (claim_runs[i].n_claims, claim_runs[i].max_memory);
+  }
+}
+
+/* Prints a run of the read state store of N_ARTICLES taking SECONDS, and
+   fails if it took more than MAX_SECONDS. */
+static void
+print_read_run (const gchar *mode,
+                gint         n_articles,
+                gdouble      seconds,
+                gdouble      max_seconds)
+{
+  printf ("%-6s %9d %9.3f %12.0f\n",
+          mode, n_articles, seconds, n_articles / seconds);
+
+  if (seconds > max_seconds) {
+    g_error ("%s of %d articles took %.3f s instead of at most %.1f s",
+             mode, n_articles, seconds, max_seconds);
+  }
+}
+
+/* Marks READ_MARKS random articles read in a read state store in
+   DIRECTORY, looks up READ_LOOKUPS articles of which half are read, and
+   reopens the store with READ_LOG articles in its log. */
+static void
+run_read (const gchar *directory)
+{
+  ReadState *state;
+  GRand     *rand;
+  GTimer    *timer;
+  guint64   *hashes;
+  gchar     *dirname;
+  gchar     *filename;
+  FILE      *log;
+  gint       i;
+
+  dirname = g_build_filename (directory, "read", NULL);
+  rand = g_rand_new_with_seed (READ_MARKS);
+  hashes = g_new (guint64, READ_MARKS + READ_LOG);
+  for (i = 0; i < READ_MARKS + READ_LOG; i++) {
+    hashes[i] = random_hash (rand);
+  }
+
+  printf ("\n%-6s %9s %9s %12s\n",
+          "mode", "articles", "seconds", "articles/s");
+
+  timer = g_timer_new ();
+  state = read_state_open (dirname);
+  for (i = 0; i < READ_MARKS; i++) {
+    if (!read_state_mark (state, hashes[i])) {
+      g_error ("Article %d was read before it was marked", i);
+    }
+  }
+  print_read_run ("mark", READ_MARKS, g_timer_elapsed (timer, NULL),
+                  MAX_READ_MARK_TIME);
+
+  /* Every other lookup is of an article which was never marked. */
+  g_timer_start (timer);
+  for (i = 0; i < READ_LOOKUPS; i++) {
+    guint64 hash = i % 2 == 0 ? hashes[i / 2 % READ_MARKS]
+                              : random_hash (rand);
+
+    if (read_state_is_read (state, hash) != (i % 2 == 0)) {
+      g_error ("Lookup %d found the wrong state", i);
+    }
+  }
+  print_read_run ("lookup", READ_LOOKUPS, g_timer_elapsed (timer, NULL),
+                  MAX_READ_LOOKUP_TIME);
+
+  /* The log is written as by READ_LOG marks after a merge, short of the
+     length which would merge it again when the store is opened. */
+  if (!read_state_compact (state)) {
+    g_error ("Failed to merge the read state log");
+  }
+  read_state_close (state);
+
+  filename = g_build_filename (dirname, "read.log", NULL);
+  log = fopen (filename, "ab");
+  if (log == NULL) {
+    g_error ("Failed to open %s: %s", filename, g_strerror (errno));
+  }
+  for (i = READ_MARKS; i < READ_MARKS + READ_LOG; i++) {
+    guint64 record = GUINT64_TO_LE (hashes[i]);
+
+    fwrite (&record, sizeof (record), 1, log);
+  }
+  if (fclose (log) != 0) {
+    g_error ("Failed to write %s: %s", filename, g_strerror (errno));
+  }
+
+  g_timer_start (timer);
+  state = read_state_open (dirname);
+  print_read_run ("reopen", READ_LOG, g_timer_elapsed (timer, NULL),
+                  MAX_READ_REOPEN_TIME);
+
+  if (read_state_size (state) != READ_MARKS + READ_LOG) {
+    g_error ("%u articles are read instead of %d",
+             read_state_size (state), READ_MARKS + READ_LOG);
+  }
+  for (i = 0; i < READ_MARKS + READ_LOG; i += 1000) {
+    if (!read_state_is_read (state, hashes[i])) {
+      g_error ("Article %d is no longer read after reopening", i);
+    }
+  }
+
+  read_state_close (state);
+  g_unlink (filename);
+  g_free (filename);
+  filename = g_build_filename (dirname, "read.table", NULL);
+  g_unlink (filename);
+  g_free (filename);
+  g_rmdir (dirname);
+
+  g_timer_destroy (timer);
+  g_free (hashes);
+  g_rand_free (rand);
+  g_free (dirname);
+}
+
+/* Syllables of the words of the search index articles. */
+static const gchar *syllables[] = {
+  "ba", "ce", "di", "fo", "gu", "ha", "je", "ki", "lo", "mu", "na", "pe",
+  "ri", "so", "tu", "va", "we", "xi", "yo", "zu", "ar", "en", "is", "on"
+};
+
+/* Returns SEARCH_WORDS random words of two to four syllables from
+   RAND. */
+static gchar **
+create_words (GRand *rand)
+{
+  gchar **words;
+  gint    i, k;
+
+  words = g_new0 (gchar *, SEARCH_WORDS + 1);
+  for (i = 0; i < SEARCH_WORDS; i++) {
+    GString *word = g_string_new (NULL);
+    gint     n_syllables = g_rand_int_range (rand, 2, 5);
+
+    for (k = 0; k < n_syllables; k++) {
+      g_string_append (word, syllables[g_rand_int_range (rand, 0,
+                                                         G_N_ELEMENTS
+                                                         (syllables))]);
+    }
+    words[i] = g_string_free (word, FALSE);
+  }
+
+  return words;
+}
+
+/* Returns one of WORDS picked at random from RAND, the first ones much
+   more often than the last ones, as in natural text. */
+static const gchar *
+pick_word (GRand  *rand,
+           gchar **words)
+{
+  gdouble x = g_rand_double (rand);
+
+  return words[(gint) (x * x * x * SEARCH_WORDS)];
+}
+
+/* Appends N_WORDS words picked from WORDS by RAND to TEXT. */
+static void
+append_words (GString  *text,
+              GRand    *rand,
+              gchar   **words,
+              gint      n_words)
+{
+  gint i;
+
+  for (i = 0; i < n_words; i++) {
+    if (i > 0) {
+      g_string_append_c (text, ' ');
+    }
+    g_string_append (text, pick_word (rand, words));
+  }
+}
+
+/* Comparison function for sorting query times. */
+static gint
+compare_times (gconstpointer a,
+               gconstpointer b)
+{
+  gdouble x = *(const gdouble *) a;
+  gdouble y = *(const gdouble *) b;
+
+  return x < y ? -1 : x > y;
+}
+
+/* Runs SEARCH_QUERIES queries of MODE on INDEX, made of N_WORDS words
+   picked from WORDS by RAND, or of the first PREFIX characters of one if
+   PREFIX is not zero, and prints the median and the 99th percentile of
+   their times.  The 99th percentile must not exceed MAX_QUERY_TIME. */
+static void
+run_query (const gchar  *mode,
+           SearchIndex  *index,
+           GRand        *rand,
+           gchar       **words,
+           gint          n_words,
+           gint          prefix)
+{
+  SearchResult results[20];
+  GString     *query;
+  GTimer      *timer;
+  gdouble     *times;
+  gdouble      p50, p99;
+  guint        n_results = 0;
+  gint         i;
+
+  query = g_string_new (NULL);
+  timer = g_timer_new ();
+  times = g_new (gdouble, SEARCH_QUERIES);
+
+  for (i = 0; i < SEARCH_QUERIES; i++) {
+    g_string_truncate (query, 0);
+    append_words (query, rand, words, n_words);
+    if (prefix > 0) {
+      g_string_truncate (query, prefix);
+    }
+
+    g_timer_start (timer);
+    n_results += search_index_query (index, query->str, results,
+                                     G_N_ELEMENTS (results));
+    times[i] = g_timer_elapsed (timer, NULL) * 1000.0;
+  }
+
+  qsort (times, SEARCH_QUERIES, sizeof (gdouble), compare_times);
+  p50 = times[SEARCH_QUERIES / 2];
+  p99 = times[SEARCH_QUERIES * 99 / 100];
+
+  if (p99 > MAX_QUERY_TIME) {
+    g_error ("99 in 100 %s queries take up to %.2f ms instead of %.0f ms",
+             mode, p99, MAX_QUERY_TIME);
+  }
+
+  printf ("%-6s %9d %9d %9.3f %9.3f %9.1f\n",
+          mode, n_articles, SEARCH_QUERIES, p50, p99,
+          (gdouble) n_results / SEARCH_QUERIES);
+
+  g_free (times);
+  g_timer_destroy (timer);
+  g_string_free (query, TRUE);
+}
+
+/* Indexes N_ARTICLES synthetic articles of 100 feeds and times queries
+   of a single word, of two words and of a two-letter prefix of a word. */
+static void
+run_search ()
+{
+  SearchIndex *index;
+  GString     *title, *text, *guid;
+  GRand       *rand;
+  GTimer      *timer;
+  gchar      **words;
+  gint         i;
+
+  index = search_index_new ();
+  rand = g_rand_new_with_seed (n_articles);
+  words = create_words (rand);
+  title = g_string_new (NULL);
+  text = g_string_new (NULL);
+  guid = g_string_new (NULL);
+  timer = g_timer_new ();
+
+  for (i = 0; i < n_articles; i++) {
+    FeedItem item = { 0 };
+
+    g_string_truncate (title, 0);
+    append_words (title, rand, words, SEARCH_TITLE_WORDS);
+    g_string_truncate (text, 0);
+    append_words (text, rand, words, SEARCH_TEXT_WORDS);
+    g_string_printf (guid, "http://example.com/%d/%d.html", i % 100, i);
+
+    item.title = title->str;
+    item.guid = guid->str;
+    item.description = text->str;
+    item.date = i;
+    search_index_add (index, &item, i % 100 + 1);
+  }
+
+  printf ("\n%-6s %9s %9s %12s\n",
+          "mode", "articles", "seconds", "articles/s");
+  printf ("%-6s %9d %9.3f %12.0f\n",
+          "index", n_articles, g_timer_elapsed (timer, NULL),
+          n_articles / g_timer_elapsed (timer, NULL));
+
+  if (search_index_get_size (index) != (guint) n_articles) {
+    g_error ("%u articles are indexed instead of %d",
+             search_index_get_size (index), n_articles);
+  }
+
+  printf ("\n%-6s %9s %9s %9s %9s %9s\n",
+          "mode", "articles", "queries", "p50 ms", "p99 ms", "results");
+
+  run_query ("word", index, rand, words, 1, 0);
+  run_query ("words", index, rand, words, 2, 0);
+  run_query ("prefix", index, rand, words, 1, 2);
+
+  g_timer_destroy (timer);
+  g_string_free (guid, TRUE);
+  g_string_free (text, TRUE);
+  g_string_free (title, TRUE);
+  g_strfreev (words);
+  g_rand_free (rand);
+  search_index_free (index);
+}
+
+/* Logs only warnings and errors, so the debug messages of the feed core
+   do not disturb the timings.  The failures of the stalled feeds are
+   expected and not logged. */
+static void
+log_quiet (const gchar    *domain,
+           GLogLevelFlags  level,
+           const gchar    *message,
+           gpointer        user_data)
+{
+  if ((level & (G_LOG_LEVEL_ERROR | G_LOG_LEVEL_CRITICAL)) ||
+      ((level & G_LOG_LEVEL_WARNING) &&
+       strstr (message, "/stall-") == NULL)) {
+    g_log_default_handler (domain, level, message, user_data);
+  }
+}
+
+int
+main (int argc, char **argv)
+{
+  GOptionContext  *context;
+  GAsyncQueue     *queue;
+  FeedFilter      *filter;
+  HttpRun          http_runs[G_N_ELEMENTS (description_sizes)]
+                            [G_N_ELEMENTS (network_modes)];
+  GError          *error = NULL;
+  gchar           *directory;
+  gchar          **filenames;
+  gchar          **urls;
+  gint             port;
+  gint             i, k;
+
+  g_thread_init (NULL);
+
+  context = g_option_context_new ("- benchmark the feed parser");
+  g_option_context_add_main_entries (context, entries, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    fprintf (stderr, "%s\n", error->message);
+    return 1;
+  }
+  g_option_context_free (context);
+
+  if (n_feeds < 1 || n_items < 1 || n_rules < 1 || n_outlines < 1) {
+    fprintf (stderr, "The numbers of feeds, items, rules and outlines must "
+             "be positive.\n");
+    return 1;
+  }
+
+  if (n_resyncs < 0) {
+    fprintf (stderr, "The number of resyncs must not be negative.\n");
+    return 1;
+  }
+
+  if (n_stalled < 0 || stall_deadline < 1) {
+    fprintf (stderr, "The number of stalled feeds must not be negative, "
+             "and their deadline must be positive.\n");
+    return 1;
+  }
+
+  g_log_set_default_handler (log_quiet, NULL);
+  sync_engine_set_max_threads (n_threads);
+  queue = g_async_queue_new ();
+  filter = create_filter ();
+
+  directory = g_build_filename (g_get_tmp_dir (), "gtk-feed-bench-XXXXXX",
+                                NULL);
+  if (mkdtemp (directory) == NULL) {
+    perror (directory);
+    return 1;
+  }
+
+  port = start_server (directory);
+
+  printf ("%-6s %6s %6s %9s %9s %9s %12s %12s %10s\n",
+          "mode", "feeds", "items", "desc", "seconds", "cpu s",
+          "items/s", "allocs/item", "peak kB");
+
+  for (i = 0; i < G_N_ELEMENTS (description_sizes); i++) {
+    filenames = write_feeds (directory, description_sizes[i], port, &urls);
+
+    run ("parse", filenames, description_sizes[i], NULL, NULL);
+    run ("filter", filenames, description_sizes[i], NULL, filter);
+    run ("sync", filenames, description_sizes[i], queue, NULL);
+
+    for (k = 0; k < G_N_ELEMENTS (network_modes); k++) {
+      HttpRun *http_run = &http_runs[i][k];
+
+      sync_engine_set_async (k == 1);
+      http_get_stats (&http_run->before);
+      http_run->accepted = get_server_connections ();
+      run (network_modes[k], urls, description_sizes[i], queue, NULL);
+      http_get_stats (&http_run->after);
+      http_run->accepted = get_server_connections () - http_run->accepted;
+    }
+    sync_engine_set_async (FALSE);
+
+    remove_feeds (filenames, urls);
+  }
+
+  printf ("\n%-6s %9s %9s %12s %9s %12s %12s %8s\n",
+          "mode", "desc", "requests", "connections", "accepted", "received",
+          "decoded", "saved");
+
+  for (i = 0; i < G_N_ELEMENTS (description_sizes); i++) {
+    for (k = 0; k < G_N_ELEMENTS (network_modes); k++) {
+      HttpStats *before = &http_runs[i][k].before;
+      HttpStats *after = &http_runs[i][k].after;
+      guint64    received = after->bytes_received - before->bytes_received;
+      guint64    decoded = after->bytes_decoded - before->bytes_decoded;
+
+      printf ("%-6s %9d %9u %12u %9u %12lu %12lu %7.1f%%\n",
+              network_modes[k], description_sizes[i],
+              after->n_requests - before->n_requests,
+              after->n_connections - before->n_connections,
+              http_runs[i][k].accepted,
+              (gulong) received, (gulong) decoded,
+              100.0 * (1.0 - (gdouble) received / MAX (decoded, 1)));
+    }
+  }
+
+  filenames = write_feeds (directory, description_sizes[0], port, &urls);
+  run_conditionals (urls, queue);
+  run_resyncs (urls, queue);
+  run_stalls (urls, port, queue);
+  remove_feeds (filenames, urls);
+
+  filenames = write_feeds (directory,
+                           description_sizes[G_N_ELEMENTS (description_sizes)
+                                             - 1],
+                           port, &urls);
+  run_shares (urls, queue);
+  remove_feeds (filenames, urls);
+
+  http_close_idle ();
+
+  run_opml (directory);
+  run_claims ();
+  run_read (directory);
+  run_search ();
+
+  g_rmdir (directory);
+  g_free (directory);
+  g_async_queue_unref (queue);
+  feed_filter_free (filter);
+
+  return 0;
+}
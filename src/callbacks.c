@@ -25,6 +25,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "callbacks.h"
 #include "common.h"
 #include "dialogs.h"
+#include "feedmenu.h"
+#include "feeds.h"
+#include "rssfeed.h"
 
 /* The "activate" handler of the system tray icon.  ICON is the system tray
    status icon object and USER_DATA is ignored.  This event handlers pops
@@ -60,15 +63,25 @@ on_icon_popup_menu (GtkStatusIcon *icon,
                   activate_time);
 }
 
-/* The "activate" handler of the feeds menu item.  ITEM is the menu item
-   object and USER_DATA points to a null-terminated string specifying the
-   URL of the feed article.  This event handler opens feed URL in a web
-   browser. */
+/* The "activate" handler of the article menu items.  ITEM is the menu
+   item object, which holds the index of its article as object data, and
+   USER_DATA points to the Feed structure of the article.  This event
+   handler opens the article's URL in a web browser and marks the article
+   read. */
 void
 on_feed_open (GtkMenuItem *item,
               gpointer     user_data)
 {
-  open_url ((const gchar *) user_data, NULL);
+  Feed  *feed = user_data;
+  guint  index;
+
+  index = GPOINTER_TO_UINT(g_object_get_data (G_OBJECT(item), "index"));
+  g_assert (feed->articles != NULL);
+  g_assert (index < feed->articles->items->len);
+
+  if (open_url (feed_articles_get (feed->articles, index)->link, NULL)) {
+    feed_menu_mark_read (feed, GTK_WIDGET(item));
+  }
 }
 
 /* The "Subscribe" main menu item handler.  ITEM is the menu item object
@@ -91,6 +104,46 @@ on_main_feeds (GtkMenuItem *item,
   show_feeds_dialog ();
 }
 
+/* The "Stop Sync" main menu item handler.  ITEM is the menu item object
+   and USER_DATA is ignored.  This event handler cancels the sync jobs
+   queued or running. */
+void
+on_main_stop (GtkMenuItem *item,
+              gpointer     user_data)
+{
+  rss_feed_cancel_all ();
+}
+
+/* The "Import Feeds" main menu item handler.  ITEM is the menu item object
+   and USER_DATA is ignored.  This event handler shows the import dialog to
+   the user. */
+void
+on_main_import (GtkMenuItem *item,
+                gpointer     user_data)
+{
+  show_import_dialog ();
+}
+
+/* The "Export Feeds" main menu item handler.  ITEM is the menu item object
+   and USER_DATA is ignored.  This event handler shows the export dialog to
+   the user. */
+void
+on_main_export (GtkMenuItem *item,
+                gpointer     user_data)
+{
+  show_export_dialog ();
+}
+
+/* The "Search" main menu item handler.  ITEM is the menu item object and
+   USER_DATA is ignored.  This event handler shows the search dialog to the
+   user. */
+void
+on_main_search (GtkMenuItem *item,
+                gpointer     user_data)
+{
+  show_search_dialog ();
+}
+
 /* The "About" main menu item handler.  ITEM is the menu item object and
    USER_DATA is ignored.  This event handler shows the about dialog to the
    user. */
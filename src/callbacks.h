@@ -28,6 +28,10 @@ void on_feed_open (GtkMenuItem *, gpointer);
 /* Main menu callbacks */
 void on_main_subscribe (GtkMenuItem *, gpointer);
 void on_main_feeds (GtkMenuItem *, gpointer);
+void on_main_stop (GtkMenuItem *, gpointer);
+void on_main_import (GtkMenuItem *, gpointer);
+void on_main_export (GtkMenuItem *, gpointer);
+void on_main_search (GtkMenuItem *, gpointer);
 void on_main_about (GtkMenuItem *, gpointer);
 void on_main_quit (GtkMenuItem *, gpointer);
 
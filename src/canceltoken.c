@@ -0,0 +1,133 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "canceltoken.h"
+
+/* Token state.  CANCELLED is only ever set, so it is read without a lock;
+   TIMER is created once, by the thread running the job.  The deadline is
+   measured on the timer rather than against the wall clock, so setting
+   the system clock neither expires a job early nor extends it. */
+struct _CancelToken {
+  gint    ref_count;
+  gint    cancelled;
+  guint   timeout;      /* seconds from the start to the deadline, or 0 */
+  GTimer *timer;        /* running since the job started, or NULL until
+                           then or if there is no deadline */
+};
+
+/* Returns the milliseconds left until the deadline of TOKEN, which may be
+   negative once it has passed. */
+static gint64
+get_left (CancelToken *token)
+{
+  return (gint64) token->timeout * 1000
+         - (gint64) (g_timer_elapsed (token->timer, NULL) * 1000);
+}
+
+CancelToken *
+cancel_token_new (guint timeout)
+{
+  CancelToken *token;
+
+  token = g_new0 (CancelToken, 1);
+  token->ref_count = 1;
+  token->timeout = timeout;
+
+  return token;
+}
+
+CancelToken *
+cancel_token_ref (CancelToken *token)
+{
+  g_assert (token != NULL);
+
+  g_atomic_int_inc (&token->ref_count);
+  return token;
+}
+
+void
+cancel_token_unref (CancelToken *token)
+{
+  g_assert (token != NULL);
+
+  if (g_atomic_int_dec_and_test (&token->ref_count)) {
+    if (token->timer != NULL) {
+      g_timer_destroy (token->timer);
+    }
+    g_free (token);
+  }
+}
+
+void
+cancel_token_cancel (CancelToken *token)
+{
+  g_assert (token != NULL);
+
+  g_atomic_int_set (&token->cancelled, 1);
+}
+
+void
+cancel_token_start (CancelToken *token)
+{
+  if (token != NULL && token->timeout > 0 && token->timer == NULL) {
+    token->timer = g_timer_new ();
+  }
+}
+
+CancelTokenState
+cancel_token_get_state (CancelToken *token)
+{
+  if (token == NULL) {
+    return CANCEL_TOKEN_ACTIVE;
+  }
+
+  if (g_atomic_int_get (&token->cancelled)) {
+    return CANCEL_TOKEN_CANCELLED;
+  }
+
+  if (token->timer != NULL && get_left (token) <= 0) {
+    return CANCEL_TOKEN_EXPIRED;
+  }
+
+  return CANCEL_TOKEN_ACTIVE;
+}
+
+gboolean
+cancel_token_is_cancelled (CancelToken *token)
+{
+  return token != NULL && g_atomic_int_get (&token->cancelled);
+}
+
+gint
+cancel_token_get_wait (CancelToken *token,
+                       gint         limit)
+{
+  gint64 left;
+
+  if (token == NULL || token->timer == NULL) {
+    return limit;
+  }
+
+  left = get_left (token);
+  return (gint) CLAMP (left, 0, limit);
+}
@@ -0,0 +1,106 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CANCELTOKEN_H
+#define CANCELTOKEN_H
+
+#include <glib.h>
+
+/*
+ * Cancellation token of a sync job.
+ *
+ * A token is shared by the code which starts a job and the code which runs
+ * it.  The former may cancel it at any time from any thread, for example
+ * when the feed is deleted, and the latter checks it whenever it would
+ * otherwise wait, so a job stuck on a slow server ends promptly.  A token
+ * may also carry a deadline, after which it counts as expired, which
+ * bounds the time a single feed can add to a sync however slowly its
+ * server trickles data.  The deadline is counted from the start of the
+ * job, not from its creation, so the time a job waits in a queue does not
+ * count against it, and on a monotonic timer, so changes to the system
+ * clock do not move it.
+ *
+ * Blocking waits are split into slices of CANCEL_TOKEN_CHECK_INTERVAL
+ * milliseconds, after each of which the token is checked.  A NULL token
+ * is never cancelled.
+ */
+
+/*
+ * Milliseconds between checks of a token while waiting.
+ */
+#define CANCEL_TOKEN_CHECK_INTERVAL 250
+
+typedef enum {
+  CANCEL_TOKEN_ACTIVE,          /* the job may go on */
+  CANCEL_TOKEN_CANCELLED,       /* cancel_token_cancel has been called */
+  CANCEL_TOKEN_EXPIRED          /* the deadline has passed */
+} CancelTokenState;
+
+typedef struct _CancelToken CancelToken;
+
+/*
+ * Creates a token which expires TIMEOUT seconds after cancel_token_start
+ * is called, or never if TIMEOUT is zero.  The token has a single
+ * reference.
+ */
+CancelToken *    cancel_token_new       (guint        timeout);
+
+/*
+ * Adds a reference to TOKEN and returns it.
+ */
+CancelToken *    cancel_token_ref       (CancelToken *token);
+
+/*
+ * Drops a reference to TOKEN, freeing it with the last one.
+ */
+void             cancel_token_unref     (CancelToken *token);
+
+/*
+ * Cancels TOKEN.  May be called from any thread, and more than once.
+ */
+void             cancel_token_cancel    (CancelToken *token);
+
+/*
+ * Starts the countdown to the deadline of TOKEN, unless it has already
+ * been started.  Called by the thread running the job when the job
+ * starts.  TOKEN may be NULL.
+ */
+void             cancel_token_start     (CancelToken *token);
+
+/*
+ * Returns the state of TOKEN, CANCEL_TOKEN_ACTIVE if TOKEN is NULL.
+ * Cancellation takes precedence over expiry.  Only the thread running the
+ * job may call this, since it reads the deadline set by
+ * cancel_token_start; other threads use cancel_token_is_cancelled.
+ */
+CancelTokenState cancel_token_get_state (CancelToken *token);
+
+/*
+ * Returns TRUE if TOKEN has been cancelled.  May be called from any
+ * thread.
+ */
+gboolean         cancel_token_is_cancelled (CancelToken *token);
+
+/*
+ * Returns the milliseconds left until the deadline of TOKEN, at most
+ * LIMIT, or LIMIT if TOKEN has no deadline or has not been started.
+ * Returns zero once the deadline has passed.
+ */
+gint             cancel_token_get_wait  (CancelToken *token,
+                                         gint         limit);
+
+#endif
@@ -114,6 +114,66 @@ get_main_menu ()
                       G_CALLBACK(on_main_feeds),
                       NULL);
 
+    /* Stop Sync menu item. */
+    image = g_object_new (GTK_TYPE_IMAGE,
+                          "stock", GTK_STOCK_STOP,
+                          "icon-size", GTK_ICON_SIZE_MENU,
+                          NULL);
+
+    item = gtk_image_menu_item_new_with_mnemonic ("S_top Sync");
+
+    gtk_image_menu_item_set_image (GTK_IMAGE_MENU_ITEM(item),
+                                   image);
+
+    gtk_menu_shell_append (GTK_MENU_SHELL(main_menu),
+                           item);
+
+    g_signal_connect (item,
+                      "activate",
+                      G_CALLBACK(on_main_stop),
+                      NULL);
+
+    /* Import menu item. */
+    item = gtk_menu_item_new_with_mnemonic ("_Import Feeds...");
+
+    gtk_menu_shell_append (GTK_MENU_SHELL(main_menu),
+                           item);
+
+    g_signal_connect (item,
+                      "activate",
+                      G_CALLBACK(on_main_import),
+                      NULL);
+
+    /* Export menu item. */
+    item = gtk_menu_item_new_with_mnemonic ("E_xport Feeds...");
+
+    gtk_menu_shell_append (GTK_MENU_SHELL(main_menu),
+                           item);
+
+    g_signal_connect (item,
+                      "activate",
+                      G_CALLBACK(on_main_export),
+                      NULL);
+
+    /* Search menu item. */
+    image = g_object_new (GTK_TYPE_IMAGE,
+                          "stock", GTK_STOCK_FIND,
+                          "icon-size", GTK_ICON_SIZE_MENU,
+                          NULL);
+
+    item = gtk_image_menu_item_new_with_mnemonic ("S_earch");
+
+    gtk_image_menu_item_set_image (GTK_IMAGE_MENU_ITEM(item),
+                                   image);
+
+    gtk_menu_shell_append (GTK_MENU_SHELL(main_menu),
+                           item);
+
+    g_signal_connect (item,
+                      "activate",
+                      G_CALLBACK(on_main_search),
+                      NULL);
+
     /* About menu item. */
     item = gtk_image_menu_item_new_from_stock (GTK_STOCK_ABOUT,
                                                NULL);
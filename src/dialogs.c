@@ -19,11 +19,17 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <config.h>
 #endif
 
+#include <time.h>
 #include <gtk/gtk.h>
 
 #include "common.h"
 #include "dialogs.h"
+#include "favicon.h"
+#include "feedlist.h"
+#include "feedmenu.h"
 #include "feeds.h"
+#include "rssfeed.h"
+#include "scheduler.h"
 
 /* Closure notify callback to destroy the dialog data structure. */
 static void
@@ -33,6 +39,25 @@ destroy_data (gpointer *data,
   g_free (data);
 }
 
+/* Shows MESSAGE in an error dialog. */
+static void
+show_error (const gchar *message)
+{
+  GtkWidget *dialog;
+
+  dialog = gtk_message_dialog_new (NULL, 0,
+                                   GTK_MESSAGE_ERROR,
+                                   GTK_BUTTONS_CLOSE,
+                                   "%s", message);
+
+  g_signal_connect (dialog,
+                    "response",
+                    G_CALLBACK(gtk_widget_destroy),
+                    NULL);
+
+  gtk_widget_show_all (dialog);
+}
+
 /***** ABOUT DIALOG *****/
 
 /* List of authors.  */
@@ -102,18 +127,29 @@ on_subscribe_response (GtkDialog       *dialog,
   g_assert (data->source != NULL);
 
   if (response_id == GTK_RESPONSE_OK) {
-    Feed      *feed;
-
-    feed = g_new (Feed, 1);
+    Feed *feed;
+
+    feed = feeds_add (gtk_entry_get_text (data->title),
+                      gtk_entry_get_text (data->source));
+    if (feed == NULL) {
+      gchar *message;
+
+      /* The dialog is left open so the URL can be corrected. */
+      message = g_strdup_printf ("You are already subscribed to %s.",
+                                 gtk_entry_get_text (data->source));
+      show_error (message);
+      g_free (message);
+      return;
+    }
 
-    feed->title  = g_strdup (gtk_entry_get_text (data->title));
-    feed->source = g_strdup (gtk_entry_get_text (data->source));
-    feed->dirty  = TRUE;
-    feed->menu   = gtk_menu_item_new_with_label (feed->title);
+    feed->dirty = TRUE;
+    feed->menu  = gtk_image_menu_item_new_with_label (feed->title);
 
+    feed_menu_init (feed);
+    favicon_request (feed);
+    gtk_menu_shell_append (GTK_MENU_SHELL(get_feeds_menu ()), feed->menu);
     gtk_widget_show_all (feed->menu);
 
-    feeds = g_list_append (feeds, feed);
     sync_feeds ();
   }
 
@@ -192,21 +228,135 @@ show_subscribe_dialog ()
   gtk_widget_show_all (dialog);
 }
 
+/***** IMPORT AND EXPORT DIALOGS *****/
+
+/* Import dialog response handler. */
+static void
+on_import_response (GtkDialog *dialog,
+                    gint       response_id,
+                    gpointer   user_data)
+{
+  gchar  *filename;
+  GError *error = NULL;
+
+  g_assert (dialog != NULL);
+
+  if (response_id == GTK_RESPONSE_ACCEPT) {
+    filename = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER(dialog));
+    if (import_feeds (filename, &error) < 0) {
+      show_error (error->message);
+      g_error_free (error);
+    }
+    g_free (filename);
+  }
+
+  gtk_widget_destroy (GTK_WIDGET(dialog));
+}
+
+/* Export dialog response handler. */
+static void
+on_export_response (GtkDialog *dialog,
+                    gint       response_id,
+                    gpointer   user_data)
+{
+  gchar  *filename;
+  GError *error = NULL;
+
+  g_assert (dialog != NULL);
+
+  if (response_id == GTK_RESPONSE_ACCEPT) {
+    filename = gtk_file_chooser_get_filename (GTK_FILE_CHOOSER(dialog));
+    if (!export_feeds (filename, &error)) {
+      show_error (error->message);
+      g_error_free (error);
+    }
+    g_free (filename);
+  }
+
+  gtk_widget_destroy (GTK_WIDGET(dialog));
+}
+
+/* Creates a file chooser dialog for OPML files titled TITLE. */
+static GtkWidget *
+create_opml_chooser (const gchar          *title,
+                     GtkFileChooserAction  action,
+                     const gchar          *accept)
+{
+  GtkWidget     *dialog;
+  GtkFileFilter *filter;
+
+  dialog = gtk_file_chooser_dialog_new (title, NULL, action,
+                                        GTK_STOCK_CANCEL,
+                                        GTK_RESPONSE_CANCEL,
+                                        accept,
+                                        GTK_RESPONSE_ACCEPT,
+                                        NULL);
+
+  filter = gtk_file_filter_new ();
+  gtk_file_filter_set_name (filter, "OPML files");
+  gtk_file_filter_add_pattern (filter, "*.opml");
+  gtk_file_filter_add_pattern (filter, "*.xml");
+  gtk_file_chooser_add_filter (GTK_FILE_CHOOSER(dialog), filter);
+
+  filter = gtk_file_filter_new ();
+  gtk_file_filter_set_name (filter, "All files");
+  gtk_file_filter_add_pattern (filter, "*");
+  gtk_file_chooser_add_filter (GTK_FILE_CHOOSER(dialog), filter);
+
+  return dialog;
+}
+
+/* Shows the import dialog, which subscribes to the feeds of an OPML
+   file. */
+void
+show_import_dialog ()
+{
+  GtkWidget *dialog;
+
+  dialog = create_opml_chooser ("Import Feeds",
+                                GTK_FILE_CHOOSER_ACTION_OPEN,
+                                GTK_STOCK_OPEN);
+
+  g_signal_connect (dialog,
+                    "response",
+                    G_CALLBACK(on_import_response),
+                    NULL);
+
+  gtk_widget_show_all (dialog);
+}
+
+/* Shows the export dialog, which writes the feeds into an OPML file. */
+void
+show_export_dialog ()
+{
+  GtkWidget *dialog;
+
+  dialog = create_opml_chooser ("Export Feeds",
+                                GTK_FILE_CHOOSER_ACTION_SAVE,
+                                GTK_STOCK_SAVE);
+  gtk_file_chooser_set_current_name (GTK_FILE_CHOOSER(dialog),
+                                     "feeds.opml");
+  gtk_file_chooser_set_do_overwrite_confirmation (GTK_FILE_CHOOSER(dialog),
+                                                  TRUE);
+
+  g_signal_connect (dialog,
+                    "response",
+                    G_CALLBACK(on_export_response),
+                    NULL);
+
+  gtk_widget_show_all (dialog);
+}
+
 /***** FEEDS DIALOG *****/
 
 /* Feeds dialog data structure. */
 typedef struct {
   GtkTreeView      *feeds;
   GtkTreeSelection *selection;
+  FeedList         *list;
+  GtkEntry         *filter;
 } FeedsDialog;
 
-/* Columns. */
-enum {
-  FEEDS_PTR_COLUMN,
-  FEEDS_TITLE_COLUMN,
-  FEEDS_N_COLUMNS,
-};
-
 /* Feeds dialog response handler. */
 static void
 on_feeds_response (GtkDialog   *dialog,
@@ -232,60 +382,181 @@ on_feeds_response (GtkDialog   *dialog,
     if (gtk_tree_selection_get_selected (data->selection, &model, &iter)) {
       Feed *feed;
 
-      gtk_tree_model_get (model, &iter, 0, (gpointer) &feed, -1);
+      gtk_tree_model_get (model, &iter,
+                          FEED_LIST_PTR_COLUMN, (gpointer) &feed,
+                          -1);
       g_assert (feed != NULL);
-      gtk_list_store_remove (GTK_LIST_STORE(model), &iter);
-      feeds = g_list_remove (feeds, feed);
 
+      /* The list's row is deleted by the registry. */
+      feeds_remove (feed);
+
+      scheduler_remove (feed);
+      rss_feed_forget (feed);
+      favicon_forget (feed);
+      feed_menu_destroy (feed);
       gtk_widget_destroy (GTK_WIDGET(feed->menu));
       g_free (feed->title);
       g_free (feed->source);
+      g_free (feed->etag);
+      g_free (feed->last_modified);
+      g_free (feed->stats.last_error);
       g_free (feed);
     }
   }
 }
 
-/* Populate the feeds list. */
-static GtkWidget *
-build_feeds_list ()
+/* "changed" handler of the filter entry.  Filters the feeds list as the
+   filter is typed. */
+static void
+on_feeds_filter_changed (GtkEditable *editable,
+                         FeedsDialog *data)
 {
-  GtkWidget         *feeds_view;
-  GtkListStore      *feeds_store;
-  GtkCellRenderer   *title_renderer;
-  GtkTreeViewColumn *title_column;
-  GList             *ptr;
-  GtkTreeIter        iter;
-
-  feeds_store =
-    gtk_list_store_new (FEEDS_N_COLUMNS,
-                        G_TYPE_POINTER,
-                        G_TYPE_STRING);
-
-  for (ptr = g_list_first (feeds);
-       ptr!= NULL;
-       ptr = g_list_next (ptr)) {
-    gtk_list_store_append (feeds_store, &iter);
-    gtk_list_store_set (feeds_store,
-                        &iter,
-                        0, ptr->data, 
-                        1, ((Feed*)ptr->data)->title,
-                        -1);
+  feed_list_set_filter (data->list, gtk_entry_get_text (data->filter));
+}
+
+/* Cell data function of the time columns.  Shows the time in
+   milliseconds. */
+static void
+format_time (GtkTreeViewColumn *column,
+             GtkCellRenderer   *renderer,
+             GtkTreeModel      *model,
+             GtkTreeIter       *iter,
+             gpointer           data)
+{
+  gdouble  seconds;
+  gchar   *text;
+
+  gtk_tree_model_get (model, iter, GPOINTER_TO_INT(data), &seconds, -1);
+  text = g_strdup_printf ("%.1f ms", seconds * 1000.0);
+  g_object_set (renderer, "text", text, NULL);
+  g_free (text);
+}
+
+/* Cell data function of the bytes column. */
+static void
+format_bytes (GtkTreeViewColumn *column,
+              GtkCellRenderer   *renderer,
+              GtkTreeModel      *model,
+              GtkTreeIter       *iter,
+              gpointer           data)
+{
+  gulong  bytes;
+  gchar  *text;
+
+  gtk_tree_model_get (model, iter, GPOINTER_TO_INT(data), &bytes, -1);
+  text = g_format_size_for_display (bytes);
+  g_object_set (renderer, "text", text, NULL);
+  g_free (text);
+}
+
+/* Cell data function of the date columns. */
+static void
+format_date (GtkTreeViewColumn *column,
+             GtkCellRenderer   *renderer,
+             GtkTreeModel      *model,
+             GtkTreeIter       *iter,
+             gpointer           data)
+{
+  glong     seconds;
+  time_t    date;
+  struct tm tm;
+  gchar     text[64];
+
+  gtk_tree_model_get (model, iter, GPOINTER_TO_INT(data), &seconds, -1);
+  date = seconds;
+
+  if (date == 0) {
+    g_strlcpy (text, "Never", sizeof (text));
+  } else {
+    localtime_r (&date, &tm);
+    strftime (text, sizeof (text), "%x %X", &tm);
   }
 
-  feeds_view = gtk_tree_view_new_with_model (GTK_TREE_MODEL(feeds_store));
-  g_object_unref (feeds_store);
+  g_object_set (renderer, "text", text, NULL);
+}
 
-  title_renderer = gtk_cell_renderer_text_new ();
+/* Appends a sortable column showing the model column COLUMN to VIEW.  If
+   WIDTH is not zero, the column has a fixed width of WIDTH pixels.  If FUNC
+   is not NULL, it formats the cells; otherwise the model column is shown
+   as text. */
+static void
+append_column (GtkTreeView         *view,
+               const gchar         *title,
+               gint                 column,
+               gint                 width,
+               GtkTreeCellDataFunc  func)
+{
+  GtkCellRenderer   *renderer;
+  GtkTreeViewColumn *view_column;
+
+  renderer = gtk_cell_renderer_text_new ();
+  view_column = gtk_tree_view_column_new ();
+  gtk_tree_view_column_set_title (view_column, title);
+  gtk_tree_view_column_pack_start (view_column, renderer, TRUE);
+
+  if (func != NULL) {
+    gtk_tree_view_column_set_cell_data_func (view_column,
+                                             renderer,
+                                             func,
+                                             GINT_TO_POINTER(column),
+                                             NULL);
+  } else {
+    gtk_tree_view_column_add_attribute (view_column,
+                                        renderer,
+                                        "text",
+                                        column);
+  }
 
-  title_column =
-    gtk_tree_view_column_new_with_attributes ("Feed",
-                                              title_renderer,
-                                              "text",
-                                              FEEDS_TITLE_COLUMN,
-                                              NULL);
+  gtk_tree_view_column_set_sort_column_id (view_column, column);
+  if (width > 0) {
+    gtk_tree_view_column_set_sizing (view_column,
+                                     GTK_TREE_VIEW_COLUMN_FIXED);
+    gtk_tree_view_column_set_fixed_width (view_column, width);
+  }
+  gtk_tree_view_column_set_resizable (view_column, TRUE);
+  gtk_tree_view_append_column (view, view_column);
+}
 
-  gtk_tree_view_append_column (GTK_TREE_VIEW(feeds_view),
-                               title_column);
+/* Builds the feeds list of DATA.  Besides the titles, the list shows the
+   statistics of the last sync of each feed, so slow or failing feeds can
+   be found by sorting the columns.  The list is a view of the feed
+   registry, see feedlist.h, and the columns have a fixed width, so the
+   list is shown at once however many feeds there are. */
+static GtkWidget *
+build_feeds_list (FeedsDialog *data)
+{
+  GtkWidget    *feeds_view;
+  GtkTreeModel *sorted;
+
+  data->list = feed_list_new ();
+  sorted = gtk_tree_model_sort_new_with_model (GTK_TREE_MODEL(data->list));
+  g_object_unref (data->list);
+
+  feeds_view = gtk_tree_view_new_with_model (sorted);
+  g_object_unref (sorted);
+
+  append_column (GTK_TREE_VIEW(feeds_view), "Feed",
+                 FEED_LIST_TITLE_COLUMN, 200, NULL);
+  append_column (GTK_TREE_VIEW(feeds_view), "Sync time",
+                 FEED_LIST_TOTAL_COLUMN, 80, format_time);
+  append_column (GTK_TREE_VIEW(feeds_view), "Connect",
+                 FEED_LIST_CONNECT_COLUMN, 80, format_time);
+  append_column (GTK_TREE_VIEW(feeds_view), "Transfer",
+                 FEED_LIST_TRANSFER_COLUMN, 80, format_time);
+  append_column (GTK_TREE_VIEW(feeds_view), "Parse",
+                 FEED_LIST_PARSE_COLUMN, 80, format_time);
+  append_column (GTK_TREE_VIEW(feeds_view), "Apply",
+                 FEED_LIST_APPLY_COLUMN, 80, format_time);
+  append_column (GTK_TREE_VIEW(feeds_view), "Size",
+                 FEED_LIST_BYTES_COLUMN, 80, format_bytes);
+  append_column (GTK_TREE_VIEW(feeds_view), "Articles",
+                 FEED_LIST_ITEMS_COLUMN, 70, NULL);
+  append_column (GTK_TREE_VIEW(feeds_view), "Last success",
+                 FEED_LIST_SUCCESS_COLUMN, 150, format_date);
+  append_column (GTK_TREE_VIEW(feeds_view), "Last error",
+                 FEED_LIST_ERROR_COLUMN, 200, NULL);
+
+  gtk_tree_view_set_fixed_height_mode (GTK_TREE_VIEW(feeds_view), TRUE);
 
   return feeds_view;
 }
@@ -297,6 +568,9 @@ show_feeds_dialog ()
   FeedsDialog *data;
   GtkWidget   *dialog;
   GtkWidget   *content;
+  GtkWidget   *box;
+  GtkWidget   *label;
+  GtkWidget   *scrolled;
 
   /* Feeds dialog. */
   data = g_new0 (FeedsDialog, 1);
@@ -306,7 +580,7 @@ show_feeds_dialog ()
                          "has-separator", FALSE,
                          "border-width", 12,
                          "skip-taskbar-hint", TRUE,
-                         "default-width", 300,
+                         "default-width", 700,
                          "default-height", 300,
                          NULL);
 
@@ -327,15 +601,225 @@ show_feeds_dialog ()
   g_object_set (content, "spacing", 12, NULL);
 
   /* Feeds list. */
-  data->feeds = GTK_TREE_VIEW(build_feeds_list ());
+  data->feeds = GTK_TREE_VIEW(build_feeds_list (data));
   data->selection = gtk_tree_view_get_selection (data->feeds);
 
+  scrolled = g_object_new (GTK_TYPE_SCROLLED_WINDOW,
+                           "hscrollbar-policy", GTK_POLICY_AUTOMATIC,
+                           "vscrollbar-policy", GTK_POLICY_AUTOMATIC,
+                           "shadow-type", GTK_SHADOW_IN,
+                           NULL);
+  gtk_container_add (GTK_CONTAINER(scrolled), GTK_WIDGET(data->feeds));
+
+  /* Filter entry. */
+  box = g_object_new (GTK_TYPE_HBOX, "spacing", 6, NULL);
+
+  label = g_object_new (GTK_TYPE_LABEL,
+                        "label", "Filter:",
+                        NULL);
+  gtk_box_pack_start (GTK_BOX(box), label, FALSE, FALSE, 0);
+
+  data->filter = GTK_ENTRY(g_object_new (GTK_TYPE_ENTRY, NULL));
+  gtk_box_pack_start (GTK_BOX(box), GTK_WIDGET(data->filter), TRUE, TRUE, 0);
+
+  g_signal_connect (data->filter,
+                    "changed",
+                    G_CALLBACK(on_feeds_filter_changed),
+                    data);
+
+  gtk_box_pack_start (GTK_BOX(content),
+                      box,
+                      FALSE,
+                      FALSE,
+                      0);
+
+  gtk_box_pack_start (GTK_BOX(content),
+                      scrolled,
+                      TRUE,
+                      TRUE,
+                      0);
+
+  /* Show the dialog. */
+  gtk_widget_show_all (dialog);
+}
+
+/***** SEARCH DIALOG *****/
+
+/* Maximum number of search results shown. */
+#define SEARCH_MAX_RESULTS 50
+
+/* Search dialog data structure. */
+typedef struct {
+  GtkEntry     *query;
+  GtkListStore *results;
+} SearchDialog;
+
+/* Columns. */
+enum {
+  SEARCH_TITLE_COLUMN,
+  SEARCH_FEED_COLUMN,
+  SEARCH_DATE_COLUMN,
+  SEARCH_LINK_COLUMN,
+  SEARCH_N_COLUMNS,
+};
+
+/* Search dialog response handler. */
+static void
+on_search_response (GtkDialog    *dialog,
+                    gint          response_id,
+                    SearchDialog *data)
+{
+  gtk_widget_destroy (GTK_WIDGET(dialog));
+}
+
+/* "changed" handler of the query entry.  Runs the query as it is typed
+   and shows the best matches. */
+static void
+on_search_changed (GtkEditable  *editable,
+                   SearchDialog *data)
+{
+  SearchResult  results[SEARCH_MAX_RESULTS];
+  GtkTreeIter   iter;
+  GTimer       *timer;
+  guint         n_results, i;
+
+  timer = g_timer_new ();
+  n_results = search_index_query (rss_feed_get_index (),
+                                  gtk_entry_get_text (data->query),
+                                  results,
+                                  SEARCH_MAX_RESULTS);
+  g_debug ("Found %u articles in %.2f ms.", n_results,
+           g_timer_elapsed (timer, NULL) * 1000.0);
+  g_timer_destroy (timer);
+
+  gtk_list_store_clear (data->results);
+
+  for (i = 0; i < n_results; i++) {
+    Feed *feed = feeds_lookup_owner (results[i].owner);
+
+    /* Articles of feeds which are no longer in the feed list, such as
+       feeds removed from feeds.xml by hand, are not shown. */
+    if (feed == NULL) {
+      continue;
+    }
+
+    gtk_list_store_append (data->results, &iter);
+    gtk_list_store_set (data->results,
+                        &iter,
+                        SEARCH_TITLE_COLUMN, results[i].title,
+                        SEARCH_FEED_COLUMN, feed->title,
+                        SEARCH_DATE_COLUMN, (glong) results[i].date,
+                        SEARCH_LINK_COLUMN, results[i].link,
+                        -1);
+  }
+}
+
+/* "row-activated" handler of the results list.  Opens the article in a
+   web browser. */
+static void
+on_search_activated (GtkTreeView       *view,
+                     GtkTreePath       *path,
+                     GtkTreeViewColumn *column,
+                     SearchDialog      *data)
+{
+  GtkTreeModel *model = GTK_TREE_MODEL(data->results);
+  GtkTreeIter   iter;
+  gchar        *link;
+
+  if (gtk_tree_model_get_iter (model, &iter, path)) {
+    gtk_tree_model_get (model, &iter, SEARCH_LINK_COLUMN, &link, -1);
+    if (link != NULL) {
+      open_url (link, NULL);
+      g_free (link);
+    }
+  }
+}
+
+/* Shows the search dialog. */
+void
+show_search_dialog ()
+{
+  SearchDialog *data;
+  GtkWidget    *dialog;
+  GtkWidget    *content;
+  GtkWidget    *view;
+  GtkWidget    *scrolled;
+
+  /* Search dialog. */
+  data = g_new0 (SearchDialog, 1);
+
+  dialog = g_object_new (GTK_TYPE_DIALOG,
+                         "title", "Search",
+                         "has-separator", FALSE,
+                         "border-width", 12,
+                         "skip-taskbar-hint", TRUE,
+                         "default-width", 600,
+                         "default-height", 400,
+                         NULL);
+
+  gtk_dialog_add_buttons (GTK_DIALOG(dialog),
+                          GTK_STOCK_CLOSE, GTK_RESPONSE_CLOSE,
+                          NULL);
+
+  g_signal_connect_data (dialog,
+                         "response",
+                         G_CALLBACK(on_search_response),
+                         data,
+                         (GClosureNotify) destroy_data,
+                         0);
+
+  content = gtk_dialog_get_content_area (GTK_DIALOG(dialog));
+  g_object_set (content, "spacing", 12, NULL);
+
+  /* Query entry. */
+  data->query = GTK_ENTRY(g_object_new (GTK_TYPE_ENTRY, NULL));
+  gtk_box_pack_start (GTK_BOX(content),
+                      GTK_WIDGET(data->query),
+                      FALSE,
+                      FALSE,
+                      0);
+
+  g_signal_connect (data->query,
+                    "changed",
+                    G_CALLBACK(on_search_changed),
+                    data);
+
+  /* Results list, in the order of the ranking until sorted otherwise. */
+  data->results = gtk_list_store_new (SEARCH_N_COLUMNS,
+                                      G_TYPE_STRING,
+                                      G_TYPE_STRING,
+                                      G_TYPE_LONG,
+                                      G_TYPE_STRING);
+
+  view = gtk_tree_view_new_with_model (GTK_TREE_MODEL(data->results));
+  g_object_unref (data->results);
+
+  append_column (GTK_TREE_VIEW(view), "Article",
+                 SEARCH_TITLE_COLUMN, 0, NULL);
+  append_column (GTK_TREE_VIEW(view), "Feed",
+                 SEARCH_FEED_COLUMN, 0, NULL);
+  append_column (GTK_TREE_VIEW(view), "Date",
+                 SEARCH_DATE_COLUMN, 0, format_date);
+
+  g_signal_connect (view,
+                    "row-activated",
+                    G_CALLBACK(on_search_activated),
+                    data);
+
+  scrolled = g_object_new (GTK_TYPE_SCROLLED_WINDOW,
+                           "hscrollbar-policy", GTK_POLICY_AUTOMATIC,
+                           "vscrollbar-policy", GTK_POLICY_AUTOMATIC,
+                           "shadow-type", GTK_SHADOW_IN,
+                           NULL);
+  gtk_container_add (GTK_CONTAINER(scrolled), view);
+
   gtk_box_pack_start (GTK_BOX(content),
-                      GTK_WIDGET(data->feeds),
+                      scrolled,
                       TRUE,
                       TRUE,
                       0);
 
   /* Show the dialog. */
   gtk_widget_show_all (dialog);
+  gtk_widget_grab_focus (GTK_WIDGET(data->query));
 }
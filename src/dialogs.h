@@ -20,6 +20,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 void show_about_dialog ();
 void show_subscribe_dialog ();
+void show_import_dialog ();
+void show_export_dialog ();
 void show_feeds_dialog ();
+void show_search_dialog ();
 
 #endif
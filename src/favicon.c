@@ -0,0 +1,185 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <gtk/gtk.h>
+
+#include "favicon.h"
+#include "iconcache.h"
+
+/* Number of threads loading icons.  Most icons come from the disk cache,
+   and the rest should not compete with the feeds for the network. */
+#define LOADER_THREADS 2
+
+/* Icon of a site, shared by all of its feeds. */
+typedef struct {
+  gchar     *site;
+  gint       width;     /* size the icon is scaled to */
+  gint       height;
+  GdkPixbuf *pixbuf;    /* the icon, or NULL if the site has none; set by
+                           the loader thread */
+  gboolean   loaded;    /* if TRUE, PIXBUF may be used */
+  GList     *waiting;   /* feeds to set the icon of when it is loaded */
+} SiteIcon;
+
+/* Icons by site, kept for the lifetime of the program. */
+static GHashTable  *icons = NULL;
+static GThreadPool *loader = NULL;
+
+/* Sets the image of FEED's menu item to PIXBUF. */
+static void
+set_icon (Feed      *feed,
+          GdkPixbuf *pixbuf)
+{
+  GtkWidget *image;
+
+  if (pixbuf == NULL || !GTK_IS_IMAGE_MENU_ITEM(feed->menu)) {
+    return;
+  }
+
+  image = gtk_image_new_from_pixbuf (pixbuf);
+  gtk_image_menu_item_set_image (GTK_IMAGE_MENU_ITEM(feed->menu), image);
+  gtk_widget_show (image);
+}
+
+/* Main loop callback which sets the loaded ICON on the feeds waiting for
+   it. */
+static gboolean
+on_icon_loaded (SiteIcon *icon)
+{
+  GList *ptr;
+
+  icon->loaded = TRUE;
+
+  for (ptr = icon->waiting; ptr != NULL; ptr = ptr->next) {
+    set_icon (ptr->data, icon->pixbuf);
+  }
+
+  g_debug ("Loaded the icon of %s for %u feeds.",
+           icon->site, g_list_length (icon->waiting));
+
+  g_list_free (icon->waiting);
+  icon->waiting = NULL;
+
+  return FALSE;
+}
+
+/* Loader thread function.  Reads ICON from the icon cache and decodes it
+   at the size of a menu icon. */
+static void
+load_icon (SiteIcon *icon,
+           gpointer  user_data)
+{
+  GdkPixbufLoader *pixbuf_loader;
+  gchar           *data;
+  gsize            length;
+  GError          *error = NULL;
+
+  if (icon_cache_load (icon->site, &data, &length)) {
+    pixbuf_loader = gdk_pixbuf_loader_new ();
+    gdk_pixbuf_loader_set_size (pixbuf_loader, icon->width, icon->height);
+
+    if (gdk_pixbuf_loader_write (pixbuf_loader, (const guchar *) data,
+                                 length, &error) &&
+        gdk_pixbuf_loader_close (pixbuf_loader, &error)) {
+      icon->pixbuf = gdk_pixbuf_loader_get_pixbuf (pixbuf_loader);
+      if (icon->pixbuf != NULL) {
+        g_object_ref (icon->pixbuf);
+      }
+    } else {
+      g_debug ("Failed to decode the icon of %s: %s",
+               icon->site, error->message);
+      g_error_free (error);
+      gdk_pixbuf_loader_close (pixbuf_loader, NULL);
+    }
+
+    g_object_unref (pixbuf_loader);
+    g_free (data);
+  }
+
+  gdk_threads_add_idle ((GSourceFunc) on_icon_loaded, icon);
+}
+
+void
+favicon_request (Feed *feed)
+{
+  SiteIcon *icon;
+  gchar    *site;
+
+  g_assert (feed != NULL);
+  g_assert (feed->menu != NULL);
+
+  site = icon_cache_get_site (feed->source);
+  if (site == NULL) {
+    return;
+  }
+
+  if (icons == NULL) {
+    GError *error = NULL;
+
+    loader = g_thread_pool_new ((GFunc) load_icon, NULL, LOADER_THREADS,
+                                FALSE, &error);
+    if (loader == NULL) {
+      g_critical ("Failed to create the icon loader: %s", error->message);
+      g_error_free (error);
+      g_free (site);
+      return;
+    }
+
+    icons = g_hash_table_new (g_str_hash, g_str_equal);
+  }
+
+  icon = g_hash_table_lookup (icons, site);
+  if (icon == NULL) {
+    icon = g_new0 (SiteIcon, 1);
+    icon->site = site;
+    gtk_icon_size_lookup (GTK_ICON_SIZE_MENU, &icon->width, &icon->height);
+    g_hash_table_insert (icons, icon->site, icon);
+
+    g_thread_pool_push (loader, icon, NULL);
+  } else {
+    g_free (site);
+  }
+
+  if (icon->loaded) {
+    set_icon (feed, icon->pixbuf);
+  } else {
+    icon->waiting = g_list_prepend (icon->waiting, feed);
+  }
+}
+
+void
+favicon_forget (Feed *feed)
+{
+  SiteIcon *icon = NULL;
+  gchar    *site;
+
+  g_assert (feed != NULL);
+
+  site = icon_cache_get_site (feed->source);
+  if (site != NULL && icons != NULL) {
+    icon = g_hash_table_lookup (icons, site);
+  }
+  g_free (site);
+
+  if (icon != NULL) {
+    icon->waiting = g_list_remove (icon->waiting, feed);
+  }
+}
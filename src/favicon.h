@@ -0,0 +1,47 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FAVICON_H
+#define FAVICON_H
+
+#include "feeds.h"
+
+/*
+ * Feed icons in the feeds menu.
+ *
+ * The icon of each feed's site is shown next to the feed's title.  Icons
+ * are read from the icon cache, see iconcache.h, which fetches them when
+ * needed, by a background thread, and each site's icon is decoded once
+ * into a pixbuf shared by all feeds of the site.  A feed's menu item gets
+ * its icon when it has been loaded, so the feeds menu never waits for
+ * icons.
+ *
+ * These functions must be called from the main thread.
+ */
+
+/*
+ * Sets the icon of FEED's menu item, a GtkImageMenuItem, as soon as the
+ * icon of its site has been loaded.
+ */
+void favicon_request (Feed *feed);
+
+/*
+ * Cancels a pending icon request of FEED, before the feed is destroyed.
+ */
+void favicon_forget  (Feed *feed);
+
+#endif
@@ -0,0 +1,406 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <glib.h>
+
+#include "feedfilter.h"
+
+/* Filter rule. */
+typedef struct {
+  gchar  *pattern;      /* keyword or regular expression */
+  GRegex *regex;        /* compiled regular expression, or NULL for a
+                           keyword */
+} Rule;
+
+/* The keywords are compiled into a deterministic automaton over classes of
+   bytes: bytes which occur in no keyword share class zero, and each other
+   byte has a class of its own, shared by both cases of ASCII letters.  The
+   table DELTA has N_CLASSES transitions for each of the N_STATES states;
+   state zero is the start state.  A state is accepting if the text read so
+   far ends with a keyword. */
+struct _FeedFilter {
+  GArray    *rules;         /* Rule records */
+  GPtrArray *regexes;       /* the regular expressions to match */
+  GRegex    *combined;      /* alternation of the regular expressions of
+                               the rules, or NULL */
+  guint      n_keywords;
+  guint8     classes[256];
+  guint      n_classes;
+  guint32   *delta;
+  guint8    *accept;
+  guint      n_states;
+  gboolean   compiled;
+};
+
+FeedFilter *
+feed_filter_new ()
+{
+  FeedFilter *filter;
+
+  filter = g_new0 (FeedFilter, 1);
+  filter->rules = g_array_new (FALSE, FALSE, sizeof (Rule));
+  filter->regexes = g_ptr_array_new ();
+
+  return filter;
+}
+
+void
+feed_filter_add_keyword (FeedFilter  *filter,
+                         const gchar *keyword)
+{
+  Rule rule;
+
+  g_assert (filter != NULL);
+  g_assert (keyword != NULL);
+
+  rule.pattern = g_strdup (keyword);
+  rule.regex = NULL;
+  g_array_append_val (filter->rules, rule);
+
+  if (*keyword != '\0') {
+    filter->n_keywords++;
+  }
+  filter->compiled = FALSE;
+}
+
+gboolean
+feed_filter_add_regex (FeedFilter   *filter,
+                       const gchar  *pattern,
+                       GError      **error)
+{
+  Rule rule;
+
+  g_assert (filter != NULL);
+  g_assert (pattern != NULL);
+
+  rule.regex = g_regex_new (pattern, G_REGEX_CASELESS | G_REGEX_OPTIMIZE,
+                            0, error);
+  if (rule.regex == NULL) {
+    return FALSE;
+  }
+
+  rule.pattern = g_strdup (pattern);
+  g_array_append_val (filter->rules, rule);
+  filter->compiled = FALSE;
+
+  return TRUE;
+}
+
+/* Returns TRUE if PATTERN may be matched as one branch of an alternation,
+   that is, it refers to no group by number or name, which would mean a
+   different group in the alternation. */
+static gboolean
+is_self_contained (const gchar *pattern)
+{
+  const gchar *p;
+
+  for (p = pattern; *p != '\0'; p++) {
+    if (p[0] == '\\' && p[1] != '\0') {
+      if (g_ascii_isdigit (p[1]) || p[1] == 'g' || p[1] == 'k') {
+        return FALSE;
+      }
+      p++;
+    } else if (p[0] == '(' && p[1] == '?' &&
+               (p[2] == 'P' || p[2] == 'R' || p[2] == '&' ||
+                p[2] == '|' || g_ascii_isdigit (p[2]) ||
+                p[2] == '+' || p[2] == '-')) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+/* Chooses the regular expressions matched by FILTER.  The patterns of the
+   rules are joined into a single alternation when possible, so the text
+   is scanned once by a single compiled pattern rather than once per
+   rule.  Returns the number of regular expressions of the rules. */
+static guint
+compile_regexes (FeedFilter *filter)
+{
+  GString  *alternation;
+  gboolean  combine = TRUE;
+  guint     n_regexes = 0;
+  guint     i;
+
+  if (filter->combined != NULL) {
+    g_regex_unref (filter->combined);
+    filter->combined = NULL;
+  }
+  g_ptr_array_set_size (filter->regexes, 0);
+
+  alternation = g_string_new (NULL);
+
+  for (i = 0; i < filter->rules->len; i++) {
+    Rule *rule = &g_array_index (filter->rules, Rule, i);
+
+    if (rule->regex == NULL) {
+      continue;
+    }
+
+    g_ptr_array_add (filter->regexes, rule->regex);
+    combine = combine && is_self_contained (rule->pattern);
+    g_string_append_printf (alternation, "%s(?:%s)",
+                            n_regexes++ > 0 ? "|" : "", rule->pattern);
+  }
+
+  if (combine && n_regexes > 1) {
+    /* The alternation may still fail to compile, for example if it has
+       too many groups in total; the rules are then matched one by one. */
+    filter->combined = g_regex_new (alternation->str,
+                                    G_REGEX_CASELESS | G_REGEX_OPTIMIZE,
+                                    0, NULL);
+    if (filter->combined != NULL) {
+      g_ptr_array_set_size (filter->regexes, 0);
+      g_ptr_array_add (filter->regexes, filter->combined);
+    }
+  }
+
+  g_string_free (alternation, TRUE);
+
+  return n_regexes;
+}
+
+/* Adds a state with no transitions to the automaton being built in DELTA
+   and ACCEPT, and returns it. */
+static guint32
+add_state (FeedFilter *filter,
+           GArray     *delta,
+           GArray     *accept)
+{
+  guint8 zero = 0;
+
+  g_array_set_size (delta, delta->len + filter->n_classes);
+  g_array_append_val (accept, zero);
+
+  return filter->n_states++;
+}
+
+void
+feed_filter_compile (FeedFilter *filter)
+{
+  GArray  *delta, *accept;
+  guint32 *fail, *queue;
+  guint    head = 0, tail = 0;
+  guint    n_regexes;
+  guint    i, c;
+
+  g_assert (filter != NULL);
+
+  n_regexes = compile_regexes (filter);
+
+  g_free (filter->delta);
+  g_free (filter->accept);
+  memset (filter->classes, 0, sizeof (filter->classes));
+  filter->n_classes = 1;
+  filter->n_states = 0;
+
+  /* Assign the byte classes. */
+  for (i = 0; i < filter->rules->len; i++) {
+    Rule        *rule = &g_array_index (filter->rules, Rule, i);
+    const gchar *p;
+
+    for (p = rule->pattern; rule->regex == NULL && *p != '\0'; p++) {
+      guchar byte = g_ascii_tolower (*p);
+
+      if (filter->classes[byte] == 0) {
+        filter->classes[byte] = filter->n_classes++;
+      }
+    }
+  }
+  for (c = 'A'; c <= 'Z'; c++) {
+    filter->classes[c] = filter->classes[(guchar) g_ascii_tolower (c)];
+  }
+
+  /* Build the trie of the keywords.  No trie edge leads to the start
+     state, so zero means no edge. */
+  delta = g_array_new (FALSE, TRUE, sizeof (guint32));
+  accept = g_array_new (FALSE, TRUE, sizeof (guint8));
+  add_state (filter, delta, accept);
+
+  for (i = 0; i < filter->rules->len; i++) {
+    Rule        *rule = &g_array_index (filter->rules, Rule, i);
+    const gchar *p;
+    guint32      state = 0;
+
+    if (rule->regex != NULL || *rule->pattern == '\0') {
+      continue;
+    }
+
+    for (p = rule->pattern; *p != '\0'; p++) {
+      guint   class = filter->classes[(guchar) *p];
+      guint32 next = g_array_index (delta, guint32,
+                                    state * filter->n_classes + class);
+
+      if (next == 0) {
+        next = add_state (filter, delta, accept);
+        g_array_index (delta, guint32,
+                       state * filter->n_classes + class) = next;
+      }
+      state = next;
+    }
+
+    g_array_index (accept, guint8, state) = 1;
+  }
+
+  /* Turn the trie into the automaton breadth first: a missing edge of a
+     state leads where the same edge of its failure state does, and the
+     failure state of a state is the state of the longest proper suffix of
+     its text which is a prefix of some keyword. */
+  fail = g_new0 (guint32, filter->n_states);
+  queue = g_new (guint32, filter->n_states);
+  queue[tail++] = 0;
+
+  while (head < tail) {
+    guint32  state = queue[head++];
+    guint32 *edges = &g_array_index (delta, guint32,
+                                     state * filter->n_classes);
+    guint32 *fail_edges = &g_array_index (delta, guint32,
+                                          fail[state] * filter->n_classes);
+
+    for (c = 0; c < filter->n_classes; c++) {
+      if (edges[c] != 0) {
+        guint32 next = edges[c];
+
+        fail[next] = state == 0 ? 0 : fail_edges[c];
+        if (g_array_index (accept, guint8, fail[next])) {
+          g_array_index (accept, guint8, next) = 1;
+        }
+        queue[tail++] = next;
+      } else if (state != 0) {
+        edges[c] = fail_edges[c];
+      }
+    }
+  }
+
+  g_free (queue);
+  g_free (fail);
+
+  filter->delta = (guint32 *) g_array_free (delta, FALSE);
+  filter->accept = (guint8 *) g_array_free (accept, FALSE);
+  filter->compiled = TRUE;
+
+  g_debug ("Compiled %u keywords into %u states of %u classes (%lu bytes) "
+           "and %u regular expressions into %u.",
+           filter->n_keywords, filter->n_states, filter->n_classes,
+           (gulong) filter->n_states * (filter->n_classes * sizeof (guint32) +
+                                        sizeof (guint8)),
+           n_regexes, filter->regexes->len);
+}
+
+/* Returns TRUE if TEXT matches a rule of FILTER. */
+static gboolean
+match_text (FeedFilter  *filter,
+            const gchar *text)
+{
+  const guint32 *delta = filter->delta;
+  const guint8  *accept = filter->accept;
+  const guint8  *classes = filter->classes;
+  guint          n_classes = filter->n_classes;
+  const gchar   *p;
+  guint32        state = 0;
+  guint          i;
+
+  if (filter->n_keywords > 0) {
+    for (p = text; *p != '\0'; p++) {
+      state = delta[state * n_classes + classes[(guchar) *p]];
+      if (accept[state]) {
+        return TRUE;
+      }
+    }
+  }
+
+  for (i = 0; i < filter->regexes->len; i++) {
+    if (g_regex_match (g_ptr_array_index (filter->regexes, i), text, 0,
+                       NULL)) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+gboolean
+feed_filter_match (FeedFilter     *filter,
+                   const FeedItem *item)
+{
+  g_assert (filter != NULL);
+  g_assert (filter->compiled);
+  g_assert (item != NULL);
+
+  return (item->title != NULL && match_text (filter, item->title)) ||
+         (item->description != NULL && match_text (filter, item->description));
+}
+
+guint
+feed_filter_get_n_rules (FeedFilter *filter)
+{
+  g_assert (filter != NULL);
+
+  return filter->rules->len;
+}
+
+const gchar *
+feed_filter_get_rule (FeedFilter *filter,
+                      guint       i,
+                      gboolean   *regex)
+{
+  Rule *rule;
+
+  g_assert (filter != NULL);
+  g_assert (i < filter->rules->len);
+
+  rule = &g_array_index (filter->rules, Rule, i);
+  if (regex != NULL) {
+    *regex = rule->regex != NULL;
+  }
+
+  return rule->pattern;
+}
+
+void
+feed_filter_free (FeedFilter *filter)
+{
+  guint i;
+
+  if (filter == NULL) {
+    return;
+  }
+
+  for (i = 0; i < filter->rules->len; i++) {
+    Rule *rule = &g_array_index (filter->rules, Rule, i);
+
+    g_free (rule->pattern);
+    if (rule->regex != NULL) {
+      g_regex_unref (rule->regex);
+    }
+  }
+
+  g_array_free (filter->rules, TRUE);
+  g_ptr_array_free (filter->regexes, TRUE);
+  if (filter->combined != NULL) {
+    g_regex_unref (filter->combined);
+  }
+  g_free (filter->delta);
+  g_free (filter->accept);
+  g_free (filter);
+}
@@ -0,0 +1,97 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FEEDFILTER_H
+#define FEEDFILTER_H
+
+#include <glib.h>
+
+#include "feedparser.h"
+
+/*
+ * Article filter.
+ *
+ * A filter is a set of rules, each a keyword or a regular expression, and
+ * an article matching any rule in its title or description is dropped.
+ * The keywords are compiled into a single Aho-Corasick automaton, a table
+ * with one transition per state and character class, so all of them are
+ * searched for in one pass over the text at the cost of one table lookup
+ * per byte, however many there are.  Keywords are matched anywhere in the
+ * text, ignoring the case of ASCII letters.  The regular expressions are
+ * matched case-insensitively, joined into a single alternation unless
+ * they refer to groups by number or name, in which case they are matched
+ * one after the other.  They cost more than keywords and are best kept for
+ * what keywords cannot express.
+ *
+ * A compiled filter is not modified by matching, so it may be shared by
+ * the sync jobs of all threads.
+ */
+
+typedef struct _FeedFilter FeedFilter;
+
+/*
+ * Creates a filter without rules.
+ */
+FeedFilter *  feed_filter_new         ();
+
+/*
+ * Adds a rule matching texts containing KEYWORD.
+ */
+void          feed_filter_add_keyword (FeedFilter     *filter,
+                                       const gchar    *keyword);
+
+/*
+ * Adds a rule matching texts matching the regular expression PATTERN.
+ * Returns FALSE and sets ERROR if PATTERN is not valid.
+ */
+gboolean      feed_filter_add_regex   (FeedFilter     *filter,
+                                       const gchar    *pattern,
+                                       GError        **error);
+
+/*
+ * Compiles the keywords of FILTER.  Must be called after the last rule
+ * has been added and before the filter is used for matching.
+ */
+void          feed_filter_compile     (FeedFilter     *filter);
+
+/*
+ * Returns TRUE if the title or the description of ITEM matches a rule of
+ * FILTER.
+ */
+gboolean      feed_filter_match       (FeedFilter     *filter,
+                                       const FeedItem *item);
+
+/*
+ * Returns the number of rules of FILTER.
+ */
+guint         feed_filter_get_n_rules (FeedFilter     *filter);
+
+/*
+ * Returns the keyword or the pattern of the Ith rule of FILTER, in the
+ * order they were added, and sets REGEX to TRUE if it is a regular
+ * expression.
+ */
+const gchar * feed_filter_get_rule    (FeedFilter     *filter,
+                                       guint           i,
+                                       gboolean       *regex);
+
+/*
+ * Destroys FILTER.  FILTER may be NULL.
+ */
+void          feed_filter_free        (FeedFilter     *filter);
+
+#endif
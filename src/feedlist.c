@@ -0,0 +1,575 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <gtk/gtk.h>
+
+#include "feedlist.h"
+
+struct _FeedList {
+  GObject     parent;
+  gint        stamp;    /* stamp of the model's iterators */
+  gchar      *filter;   /* case-folded filter text, or NULL */
+  GPtrArray  *rows;     /* feeds shown in registry order, or NULL if all
+                           feeds are shown */
+  GHashTable *keys;     /* feed to its case-folded title and source */
+};
+
+struct _FeedListClass {
+  GObjectClass parent_class;
+};
+
+/* Live models. */
+static GSList *lists = NULL;
+
+static void feed_list_tree_model_init (GtkTreeModelIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (FeedList, feed_list, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (GTK_TYPE_TREE_MODEL,
+                                                feed_list_tree_model_init))
+
+/* Returns the number of rows of LIST. */
+static guint
+get_n_rows (FeedList *list)
+{
+  return list->rows != NULL ? list->rows->len : feeds_get_count ();
+}
+
+/* Returns the feed of ROW of LIST. */
+static Feed *
+get_row (FeedList *list,
+         guint     row)
+{
+  return list->rows != NULL ? g_ptr_array_index (list->rows, row)
+                            : feeds_get (row);
+}
+
+/* Returns the row of FEED in LIST, or -1 if it is not shown.  The rows are
+   in registry order, so they are searched for FEED's index. */
+static gint
+find_row (FeedList *list,
+          Feed     *feed)
+{
+  guint low, high;
+
+  if (list->rows == NULL) {
+    return feed->index;
+  }
+
+  /* A feed just removed from the registry still has its former index, and
+     the feed after it has the same one; the removed feed is found first. */
+  low = 0;
+  high = list->rows->len;
+  while (low < high) {
+    guint middle = (low + high) / 2;
+
+    if (((Feed *) g_ptr_array_index (list->rows, middle))->index <
+        feed->index) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  if (low < list->rows->len && g_ptr_array_index (list->rows, low) == feed) {
+    return low;
+  }
+
+  return -1;
+}
+
+/* Returns TRUE if FEED matches the filter of LIST. */
+static gboolean
+matches (FeedList *list,
+         Feed     *feed)
+{
+  gchar *key;
+
+  if (list->filter == NULL) {
+    return TRUE;
+  }
+
+  key = g_hash_table_lookup (list->keys, feed);
+  if (key == NULL) {
+    gchar *title, *source;
+
+    /* The line break keeps a match from spanning the two. */
+    title = g_utf8_casefold (feed->title, -1);
+    source = g_utf8_casefold (feed->source, -1);
+    key = g_strconcat (title, "\n", source, NULL);
+    g_free (title);
+    g_free (source);
+    g_hash_table_insert (list->keys, feed, key);
+  }
+
+  return strstr (key, list->filter) != NULL;
+}
+
+/* Emits a row signal of ROW of LIST: "row-inserted" if INSERTED is TRUE,
+   "row-changed" otherwise. */
+static void
+emit_row (FeedList *list,
+          guint     row,
+          gboolean  inserted)
+{
+  GtkTreePath *path;
+  GtkTreeIter  iter;
+
+  path = gtk_tree_path_new_from_indices (row, -1);
+  iter.stamp = list->stamp;
+  iter.user_data = get_row (list, row);
+
+  if (inserted) {
+    gtk_tree_model_row_inserted (GTK_TREE_MODEL(list), path, &iter);
+  } else {
+    gtk_tree_model_row_changed (GTK_TREE_MODEL(list), path, &iter);
+  }
+
+  gtk_tree_path_free (path);
+}
+
+/* Emits "row-deleted" for ROW of LIST. */
+static void
+emit_deleted (FeedList *list,
+              guint     row)
+{
+  GtkTreePath *path;
+
+  path = gtk_tree_path_new_from_indices (row, -1);
+  gtk_tree_model_row_deleted (GTK_TREE_MODEL(list), path);
+  gtk_tree_path_free (path);
+}
+
+/* Inserts FEED into ROWS at INDEX. */
+static void
+insert_row (GPtrArray *rows,
+            guint      index,
+            Feed      *feed)
+{
+  g_ptr_array_add (rows, NULL);
+  memmove (&rows->pdata[index + 1],
+           &rows->pdata[index],
+           (rows->len - 1 - index) * sizeof (gpointer));
+  rows->pdata[index] = feed;
+}
+
+/* Shows the feeds of ROWS in LIST, or all feeds if ROWS is NULL, and takes
+   ROWS over.  The rows no longer shown are deleted from the end, then the
+   new ones are inserted from the start, so the model agrees with each
+   signal. */
+static void
+set_rows (FeedList  *list,
+          GPtrArray *rows)
+{
+  guint i, j;
+
+  if (list->rows == NULL) {
+    list->rows = g_ptr_array_sized_new (feeds_get_count ());
+    for (i = 0; i < feeds_get_count (); i++) {
+      g_ptr_array_add (list->rows, feeds_get (i));
+    }
+  }
+
+  if (rows != NULL) {
+    j = rows->len;
+    for (i = list->rows->len; i-- > 0; ) {
+      if (j > 0 &&
+          g_ptr_array_index (rows, j - 1) ==
+          g_ptr_array_index (list->rows, i)) {
+        j--;
+      } else {
+        g_ptr_array_remove_index (list->rows, i);
+        emit_deleted (list, i);
+      }
+    }
+  }
+
+  for (i = 0; i < (rows != NULL ? rows->len : feeds_get_count ()); i++) {
+    Feed *feed = rows != NULL ? g_ptr_array_index (rows, i) : feeds_get (i);
+
+    if (i >= list->rows->len || g_ptr_array_index (list->rows, i) != feed) {
+      insert_row (list->rows, i, feed);
+      emit_row (list, i, TRUE);
+    }
+  }
+
+  /* The rows are now the same; drop the copy. */
+  g_ptr_array_free (list->rows, TRUE);
+  list->rows = rows;
+}
+
+static void
+feed_list_init (FeedList *list)
+{
+  list->stamp = g_random_int ();
+  list->keys = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                      NULL, g_free);
+  lists = g_slist_prepend (lists, list);
+}
+
+static void
+feed_list_finalize (GObject *object)
+{
+  FeedList *list = FEED_LIST(object);
+
+  lists = g_slist_remove (lists, list);
+  if (list->rows != NULL) {
+    g_ptr_array_free (list->rows, TRUE);
+  }
+  g_hash_table_destroy (list->keys);
+  g_free (list->filter);
+
+  G_OBJECT_CLASS(feed_list_parent_class)->finalize (object);
+}
+
+static void
+feed_list_class_init (FeedListClass *klass)
+{
+  G_OBJECT_CLASS(klass)->finalize = feed_list_finalize;
+}
+
+static GtkTreeModelFlags
+feed_list_get_flags (GtkTreeModel *model)
+{
+  /* Iterators hold the feed, so they stay valid as long as the row. */
+  return GTK_TREE_MODEL_ITERS_PERSIST | GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint
+feed_list_get_n_columns (GtkTreeModel *model)
+{
+  return FEED_LIST_N_COLUMNS;
+}
+
+static GType
+feed_list_get_column_type (GtkTreeModel *model,
+                           gint          column)
+{
+  switch (column) {
+  case FEED_LIST_PTR_COLUMN:
+    return G_TYPE_POINTER;
+  case FEED_LIST_TITLE_COLUMN:
+  case FEED_LIST_ERROR_COLUMN:
+    return G_TYPE_STRING;
+  case FEED_LIST_BYTES_COLUMN:
+    return G_TYPE_ULONG;
+  case FEED_LIST_ITEMS_COLUMN:
+    return G_TYPE_UINT;
+  case FEED_LIST_SUCCESS_COLUMN:
+    return G_TYPE_LONG;
+  default:
+    g_assert (column > 0 && column < FEED_LIST_N_COLUMNS);
+    return G_TYPE_DOUBLE;
+  }
+}
+
+/* Points ITER of LIST to ROW.  Returns FALSE if there is no such row. */
+static gboolean
+set_iter (FeedList    *list,
+          GtkTreeIter *iter,
+          gint         row)
+{
+  if (row < 0 || (guint) row >= get_n_rows (list)) {
+    iter->stamp = 0;
+    return FALSE;
+  }
+
+  iter->stamp = list->stamp;
+  iter->user_data = get_row (list, row);
+
+  return TRUE;
+}
+
+static gboolean
+feed_list_get_iter (GtkTreeModel *model,
+                    GtkTreeIter  *iter,
+                    GtkTreePath  *path)
+{
+  if (gtk_tree_path_get_depth (path) != 1) {
+    return FALSE;
+  }
+
+  return set_iter (FEED_LIST(model), iter,
+                   gtk_tree_path_get_indices (path)[0]);
+}
+
+static GtkTreePath *
+feed_list_get_path (GtkTreeModel *model,
+                    GtkTreeIter  *iter)
+{
+  FeedList *list = FEED_LIST(model);
+
+  g_return_val_if_fail (iter->stamp == list->stamp, NULL);
+
+  return gtk_tree_path_new_from_indices (find_row (list, iter->user_data),
+                                         -1);
+}
+
+static void
+feed_list_get_value (GtkTreeModel *model,
+                     GtkTreeIter  *iter,
+                     gint          column,
+                     GValue       *value)
+{
+  Feed      *feed = iter->user_data;
+  FeedStats *stats;
+
+  g_return_if_fail (iter->stamp == FEED_LIST(model)->stamp);
+
+  stats = &feed->stats;
+  g_value_init (value, feed_list_get_column_type (model, column));
+
+  switch (column) {
+  case FEED_LIST_PTR_COLUMN:
+    g_value_set_pointer (value, feed);
+    break;
+  case FEED_LIST_TITLE_COLUMN:
+    g_value_set_string (value, feed->title);
+    break;
+  case FEED_LIST_TOTAL_COLUMN:
+    g_value_set_double (value, stats->sync.connect_time +
+                               stats->sync.transfer_time +
+                               stats->sync.parse_time +
+                               stats->apply_time);
+    break;
+  case FEED_LIST_CONNECT_COLUMN:
+    g_value_set_double (value, stats->sync.connect_time);
+    break;
+  case FEED_LIST_TRANSFER_COLUMN:
+    g_value_set_double (value, stats->sync.transfer_time);
+    break;
+  case FEED_LIST_PARSE_COLUMN:
+    g_value_set_double (value, stats->sync.parse_time);
+    break;
+  case FEED_LIST_APPLY_COLUMN:
+    g_value_set_double (value, stats->apply_time);
+    break;
+  case FEED_LIST_BYTES_COLUMN:
+    g_value_set_ulong (value, stats->sync.bytes);
+    break;
+  case FEED_LIST_ITEMS_COLUMN:
+    g_value_set_uint (value, stats->sync.n_items);
+    break;
+  case FEED_LIST_SUCCESS_COLUMN:
+    g_value_set_long (value, stats->last_success);
+    break;
+  case FEED_LIST_ERROR_COLUMN:
+    g_value_set_string (value, stats->last_error);
+    break;
+  }
+}
+
+static gboolean
+feed_list_iter_next (GtkTreeModel *model,
+                     GtkTreeIter  *iter)
+{
+  FeedList *list = FEED_LIST(model);
+
+  g_return_val_if_fail (iter->stamp == list->stamp, FALSE);
+
+  return set_iter (list, iter, find_row (list, iter->user_data) + 1);
+}
+
+static gboolean
+feed_list_iter_children (GtkTreeModel *model,
+                         GtkTreeIter  *iter,
+                         GtkTreeIter  *parent)
+{
+  if (parent != NULL) {
+    return FALSE;
+  }
+
+  return set_iter (FEED_LIST(model), iter, 0);
+}
+
+static gboolean
+feed_list_iter_has_child (GtkTreeModel *model,
+                          GtkTreeIter  *iter)
+{
+  return FALSE;
+}
+
+static gint
+feed_list_iter_n_children (GtkTreeModel *model,
+                           GtkTreeIter  *iter)
+{
+  if (iter != NULL) {
+    return 0;
+  }
+
+  return get_n_rows (FEED_LIST(model));
+}
+
+static gboolean
+feed_list_iter_nth_child (GtkTreeModel *model,
+                          GtkTreeIter  *iter,
+                          GtkTreeIter  *parent,
+                          gint          n)
+{
+  if (parent != NULL) {
+    return FALSE;
+  }
+
+  return set_iter (FEED_LIST(model), iter, n);
+}
+
+static gboolean
+feed_list_iter_parent (GtkTreeModel *model,
+                       GtkTreeIter  *iter,
+                       GtkTreeIter  *child)
+{
+  return FALSE;
+}
+
+static void
+feed_list_tree_model_init (GtkTreeModelIface *iface)
+{
+  iface->get_flags = feed_list_get_flags;
+  iface->get_n_columns = feed_list_get_n_columns;
+  iface->get_column_type = feed_list_get_column_type;
+  iface->get_iter = feed_list_get_iter;
+  iface->get_path = feed_list_get_path;
+  iface->get_value = feed_list_get_value;
+  iface->iter_next = feed_list_iter_next;
+  iface->iter_children = feed_list_iter_children;
+  iface->iter_has_child = feed_list_iter_has_child;
+  iface->iter_n_children = feed_list_iter_n_children;
+  iface->iter_nth_child = feed_list_iter_nth_child;
+  iface->iter_parent = feed_list_iter_parent;
+}
+
+FeedList *
+feed_list_new ()
+{
+  return g_object_new (FEED_TYPE_LIST, NULL);
+}
+
+void
+feed_list_set_filter (FeedList    *list,
+                      const gchar *text)
+{
+  gchar     *filter = NULL;
+  gboolean   narrower;
+  GPtrArray *rows;
+  GTimer    *timer;
+  guint      i, n;
+
+  g_assert (list != NULL);
+
+  if (text != NULL && *text != '\0') {
+    filter = g_utf8_casefold (text, -1);
+  }
+
+  if (filter == NULL ? list->filter == NULL
+                     : list->filter != NULL &&
+                       strcmp (filter, list->filter) == 0) {
+    g_free (filter);
+    return;
+  }
+
+  timer = g_timer_new ();
+
+  /* If the new filter contains the old one, only the feeds shown can
+     match it. */
+  narrower = filter != NULL &&
+             (list->filter == NULL || strstr (filter, list->filter) != NULL);
+
+  g_free (list->filter);
+  list->filter = filter;
+
+  if (filter == NULL) {
+    set_rows (list, NULL);
+  } else {
+    n = narrower ? get_n_rows (list) : feeds_get_count ();
+    rows = g_ptr_array_new ();
+    for (i = 0; i < n; i++) {
+      Feed *feed = narrower ? get_row (list, i) : feeds_get (i);
+
+      if (matches (list, feed)) {
+        g_ptr_array_add (rows, feed);
+      }
+    }
+    set_rows (list, rows);
+  }
+
+  g_debug ("Filtered %u feeds to %u in %.1f ms.", feeds_get_count (),
+           get_n_rows (list), g_timer_elapsed (timer, NULL) * 1000.0);
+  g_timer_destroy (timer);
+}
+
+void
+feed_list_add (Feed *feed)
+{
+  GSList *ptr;
+
+  g_assert (feed != NULL);
+
+  /* The feed is the last one in the registry, so it is the last row. */
+  for (ptr = lists; ptr != NULL; ptr = g_slist_next (ptr)) {
+    FeedList *list = ptr->data;
+
+    if (list->rows == NULL) {
+      emit_row (list, feed->index, TRUE);
+    } else if (matches (list, feed)) {
+      g_ptr_array_add (list->rows, feed);
+      emit_row (list, list->rows->len - 1, TRUE);
+    }
+  }
+}
+
+void
+feed_list_remove (Feed *feed)
+{
+  GSList *ptr;
+  gint    row;
+
+  g_assert (feed != NULL);
+
+  for (ptr = lists; ptr != NULL; ptr = g_slist_next (ptr)) {
+    FeedList *list = ptr->data;
+
+    g_hash_table_remove (list->keys, feed);
+
+    row = find_row (list, feed);
+    if (row >= 0) {
+      if (list->rows != NULL) {
+        g_ptr_array_remove_index (list->rows, row);
+      }
+      emit_deleted (list, row);
+    }
+  }
+}
+
+void
+feed_list_update (Feed *feed)
+{
+  GSList *ptr;
+  gint    row;
+
+  g_assert (feed != NULL);
+
+  for (ptr = lists; ptr != NULL; ptr = g_slist_next (ptr)) {
+    row = find_row (ptr->data, feed);
+    if (row >= 0) {
+      emit_row (ptr->data, row, FALSE);
+    }
+  }
+}
@@ -0,0 +1,95 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FEEDLIST_H
+#define FEEDLIST_H
+
+#include <gtk/gtk.h>
+
+#include "feeds.h"
+
+/*
+ * Feed list model.
+ *
+ * FeedList is a flat GtkTreeModel which reads the rows straight from the
+ * feed registry, see feeds.h, so creating one costs nothing however many
+ * feeds there are.  The registry and the sync code tell the live models
+ * about added, removed and synced feeds, and the models emit the row
+ * signals, so views of them are always up to date.
+ *
+ * A model may be filtered to the feeds whose title or source contains a
+ * text, ignoring case.  When the filter is typed a character at a time,
+ * only the feeds shown are tested again.  The rows stay in subscription
+ * order; wrap the model in a GtkTreeModelSort to sort them.
+ */
+
+#define FEED_TYPE_LIST (feed_list_get_type ())
+#define FEED_LIST(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST ((obj), FEED_TYPE_LIST, FeedList))
+
+typedef struct _FeedList      FeedList;
+typedef struct _FeedListClass FeedListClass;
+
+/*
+ * Columns.  The times are in seconds.
+ */
+enum {
+  FEED_LIST_PTR_COLUMN,         /* Feed * */
+  FEED_LIST_TITLE_COLUMN,       /* string */
+  FEED_LIST_TOTAL_COLUMN,       /* double */
+  FEED_LIST_CONNECT_COLUMN,     /* double */
+  FEED_LIST_TRANSFER_COLUMN,    /* double */
+  FEED_LIST_PARSE_COLUMN,       /* double */
+  FEED_LIST_APPLY_COLUMN,       /* double */
+  FEED_LIST_BYTES_COLUMN,       /* gulong */
+  FEED_LIST_ITEMS_COLUMN,       /* guint */
+  FEED_LIST_SUCCESS_COLUMN,     /* glong, time of the last success */
+  FEED_LIST_ERROR_COLUMN,       /* string */
+  FEED_LIST_N_COLUMNS
+};
+
+GType      feed_list_get_type   ();
+
+/*
+ * Creates a model of all feeds.
+ */
+FeedList * feed_list_new        ();
+
+/*
+ * Shows only the feeds of LIST whose title or source contains TEXT, or all
+ * feeds if TEXT is NULL or empty.
+ */
+void       feed_list_set_filter (FeedList    *list,
+                                 const gchar *text);
+
+/*
+ * Called by the feed registry after FEED has been appended.
+ */
+void       feed_list_add        (Feed        *feed);
+
+/*
+ * Called by the feed registry after FEED has been removed.  FEED's index
+ * is still its former position.
+ */
+void       feed_list_remove     (Feed        *feed);
+
+/*
+ * Called when the statistics of FEED have changed.
+ */
+void       feed_list_update     (Feed        *feed);
+
+#endif
@@ -0,0 +1,641 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <gtk/gtk.h>
+
+#include "callbacks.h"
+#include "common.h"
+#include "feedmenu.h"
+#include "readstate.h"
+
+/* Seconds after a submenu was last shown until its menu items are
+   released in lazy mode. */
+#define RELEASE_DELAY 300
+
+/* If TRUE, submenus are built only when first needed. */
+static gboolean lazy = TRUE;
+
+/* Number of article menu items alive. */
+static guint n_menu_items = 0;
+
+/* Store of the read articles, opened on first use. */
+static ReadState *read_state = NULL;
+
+/* Number of unread articles in all feeds. */
+static guint n_unread = 0;
+
+/* Fewest articles a feed is trimmed to for the memory budget. */
+#define BUDGET_MIN_ARTICLES 10
+
+/* Bytes the articles of all feeds may use, or zero for no limit. */
+static gsize memory_budget = 0;
+
+/* Approximate bytes used by the articles of all feeds. */
+static gsize articles_size = 0;
+
+/* Returns TRUE if ITEM has been read. */
+static gboolean
+is_read (const FeedItem *item)
+{
+  if (read_state == NULL) {
+    gchar *dirname;
+
+    dirname = g_build_filename (g_get_user_data_dir (), PACKAGE, NULL);
+    read_state = read_state_open (dirname);
+    g_free (dirname);
+  }
+
+  return read_state_is_read (read_state, feed_item_hash (item));
+}
+
+/* Sets the text of LABEL to TITLE, in bold if the article is unread. */
+static void
+set_item_label (GtkWidget   *label,
+                const gchar *title,
+                gboolean     unread)
+{
+  if (unread) {
+    gchar *markup;
+
+    markup = g_markup_printf_escaped ("<b>%s</b>", title);
+    gtk_label_set_markup (GTK_LABEL(label), markup);
+    g_free (markup);
+  } else {
+    gtk_label_set_text (GTK_LABEL(label), title);
+  }
+}
+
+/* Shows the unread count of FEED next to its title, and the total count
+   in the tooltip of the system tray icon. */
+static void
+update_unread (Feed *feed)
+{
+  GtkWidget *label;
+  gchar     *text;
+
+  label = gtk_bin_get_child (GTK_BIN(feed->menu));
+  if (label != NULL && feed->n_unread > 0) {
+    text = g_markup_printf_escaped ("<b>%s (%u)</b>",
+                                    feed->title, feed->n_unread);
+    gtk_label_set_markup (GTK_LABEL(label), text);
+    g_free (text);
+  } else if (label != NULL) {
+    gtk_label_set_text (GTK_LABEL(label), feed->title);
+  }
+
+  if (n_unread == 0) {
+    text = g_strdup ("No unread articles");
+  } else {
+    text = g_strdup_printf ("%u unread article%s",
+                            n_unread, n_unread == 1 ? "" : "s");
+  }
+  gtk_status_icon_set_tooltip (get_status_icon (), text);
+  g_free (text);
+}
+
+/* "destroy" handler of the article menu items. */
+static void
+on_item_destroy (GtkWidget *menu_item,
+                 gpointer   user_data)
+{
+  n_menu_items--;
+}
+
+/* Returns the key by which ITEM is matched to an existing menu item. */
+static const gchar *
+get_item_key (const FeedItem *item)
+{
+  if (item->guid != NULL) {
+    return item->guid;
+  } else if (item->link != NULL) {
+    return item->link;
+  } else if (item->title != NULL) {
+    return item->title;
+  }
+  return "";
+}
+
+/* Creates a menu item for ITEM, the INDEXth article of FEED.  The menu
+   item refers to the article by its index, which is kept as object data,
+   so it holds no copies of the article's strings. */
+static GtkWidget *
+build_item (Feed           *feed,
+            const FeedItem *item,
+            guint           index)
+{
+  GtkWidget *menu_item;
+
+  menu_item = gtk_menu_item_new ();
+
+  if (item->title != NULL) {
+    GtkWidget *label;
+
+    label = g_object_new (GTK_TYPE_LABEL,
+                          "xalign", 0.0f,
+                          NULL);
+    set_item_label (label, item->title, !is_read (item));
+
+    gtk_container_add (GTK_CONTAINER(menu_item), label);
+  }
+
+  g_object_set_data (G_OBJECT(menu_item), "index", GUINT_TO_POINTER(index));
+
+  if (item->link != NULL) {
+    gtk_widget_set_tooltip_text (menu_item, item->link);
+
+    g_signal_connect (menu_item,
+                      "activate",
+                      G_CALLBACK(on_feed_open),
+                      feed);
+  }
+
+  g_signal_connect (menu_item,
+                    "destroy",
+                    G_CALLBACK(on_item_destroy),
+                    NULL);
+
+  n_menu_items++;
+  gtk_widget_show_all (menu_item);
+
+  return menu_item;
+}
+
+/* Returns the index of the article MENU_ITEM was built for. */
+static guint
+get_item_index (GtkWidget *menu_item)
+{
+  return GPOINTER_TO_UINT(g_object_get_data (G_OBJECT(menu_item), "index"));
+}
+
+/* Returns TRUE if MENU_ITEM, built for OLD_ITEM, can be reused for ITEM.
+   A changed title is updated in place; a changed link needs a new menu
+   item, since the link decides whether the menu item is activatable. */
+static gboolean
+reuse_item (GtkWidget      *menu_item,
+            const FeedItem *old_item,
+            const FeedItem *item)
+{
+  GtkWidget *label;
+
+  if (g_strcmp0 (old_item->link, item->link) != 0) {
+    return FALSE;
+  }
+
+  label = gtk_bin_get_child (GTK_BIN(menu_item));
+  if (label == NULL) {
+    return item->title == NULL;
+  } else if (item->title == NULL) {
+    return FALSE;
+  }
+
+  if (g_strcmp0 (gtk_label_get_text (GTK_LABEL(label)), item->title) != 0) {
+    set_item_label (label, item->title, !is_read (item));
+  }
+
+  return TRUE;
+}
+
+/* Records MENU_ITEM in the index of FEED under KEY, unless another menu
+   item already has the same key.  Duplicates are shown but not indexed.
+   The keys point to the strings of the articles, so the index must not
+   outlive them. */
+static void
+index_item (GHashTable  *index,
+            GtkWidget   *menu_item,
+            const gchar *key)
+{
+  if (g_hash_table_lookup (index, key) == NULL) {
+    g_hash_table_insert (index, (gpointer) key, menu_item);
+  }
+}
+
+/* Updates the materialized submenu of FEED to match its articles.  OLD
+   are the articles the menu items were built for.  The articles are
+   matched to the existing menu items by their key, so only new articles
+   get new menu items, stale ones are removed and the rest are reused in
+   place. */
+static void
+update_submenu (Feed         *feed,
+                FeedArticles *old)
+{
+  const FeedItem *items = feed_articles_get (feed->articles, 0);
+  guint           n_items = feed->articles->items->len;
+  GtkWidget      *menu;
+  GHashTable     *index;
+  GHashTable     *keys;
+  GList          *remaining, *ptr;
+  guint           i;
+
+  menu = gtk_menu_item_get_submenu (GTK_MENU_ITEM(feed->menu));
+
+  /* Remove the menu items of articles which are gone. */
+  keys = g_hash_table_new (g_str_hash, g_str_equal);
+  for (i = 0; i < n_items; i++) {
+    g_hash_table_insert (keys, (gpointer) get_item_key (&items[i]), NULL);
+  }
+
+  remaining = gtk_container_get_children (GTK_CONTAINER(menu));
+  for (ptr = remaining; ptr != NULL; ) {
+    GList       *next = ptr->next;
+    const gchar *key;
+
+    key = get_item_key (feed_articles_get (old, get_item_index (ptr->data)));
+
+    /* Unindexed menu items are duplicates, which are always rebuilt. */
+    if (g_hash_table_lookup (feed->items, key) != ptr->data ||
+        !g_hash_table_lookup_extended (keys, key, NULL, NULL)) {
+      if (g_hash_table_lookup (feed->items, key) == ptr->data) {
+        g_hash_table_remove (feed->items, key);
+      }
+      gtk_widget_destroy (GTK_WIDGET(ptr->data));
+      remaining = g_list_delete_link (remaining, ptr);
+    }
+
+    ptr = next;
+  }
+
+  g_hash_table_destroy (keys);
+
+  /* Place the articles in order.  The menu's children are always the
+     articles placed so far followed by the REMAINING old menu items, so
+     old items already in the right position are left alone. */
+  index = g_hash_table_new (g_str_hash, g_str_equal);
+
+  for (i = 0; i < n_items; i++) {
+    const gchar *key = get_item_key (&items[i]);
+    GtkWidget   *menu_item;
+
+    menu_item = g_hash_table_lookup (feed->items, key);
+    if (menu_item != NULL) {
+      g_hash_table_remove (feed->items, key);
+    }
+
+    if (menu_item != NULL &&
+        reuse_item (menu_item,
+                    feed_articles_get (old, get_item_index (menu_item)),
+                    &items[i])) {
+      if (remaining != NULL && remaining->data == menu_item) {
+        remaining = g_list_delete_link (remaining, remaining);
+      } else {
+        remaining = g_list_remove (remaining, menu_item);
+        gtk_menu_reorder_child (GTK_MENU(menu), menu_item, i);
+      }
+    } else {
+      if (menu_item != NULL) {
+        remaining = g_list_remove (remaining, menu_item);
+        gtk_widget_destroy (menu_item);
+      }
+
+      menu_item = build_item (feed, &items[i], i);
+      gtk_menu_shell_insert (GTK_MENU_SHELL(menu), menu_item, i);
+    }
+
+    g_object_set_data (G_OBJECT(menu_item), "index", GUINT_TO_POINTER(i));
+    index_item (index, menu_item, key);
+  }
+
+  /* Nothing should be left over, but be safe. */
+  for (ptr = remaining; ptr != NULL; ptr = ptr->next) {
+    gtk_widget_destroy (GTK_WIDGET(ptr->data));
+  }
+  g_list_free (remaining);
+
+  g_hash_table_destroy (feed->items);
+  feed->items = index;
+}
+
+/* Builds the menu items of FEED's submenu from its articles. */
+static void
+materialize (Feed *feed)
+{
+  GtkWidget *menu;
+  guint      i;
+
+  if (feed->items != NULL) {
+    return;
+  }
+
+  menu = gtk_menu_item_get_submenu (GTK_MENU_ITEM(feed->menu));
+  feed->items = g_hash_table_new (g_str_hash, g_str_equal);
+
+  for (i = 0; feed->articles != NULL && i < feed->articles->items->len; i++) {
+    const FeedItem *item = feed_articles_get (feed->articles, i);
+    GtkWidget      *menu_item;
+
+    menu_item = build_item (feed, item, i);
+    gtk_menu_shell_append (GTK_MENU_SHELL(menu), menu_item);
+    index_item (feed->items, menu_item, get_item_key (item));
+  }
+
+  g_debug ("Built the submenu of %s (%u menu items alive).",
+           feed->source, n_menu_items);
+}
+
+/* Destroys the menu items of FEED's submenu.  The articles are kept, so
+   the submenu can be built again. */
+static void
+release (Feed *feed)
+{
+  GtkWidget *menu;
+
+  if (feed->items == NULL) {
+    return;
+  }
+
+  menu = gtk_menu_item_get_submenu (GTK_MENU_ITEM(feed->menu));
+  gtk_container_foreach (GTK_CONTAINER(menu),
+                         (GtkCallback) gtk_widget_destroy,
+                         NULL);
+
+  g_hash_table_destroy (feed->items);
+  feed->items = NULL;
+
+  g_debug ("Released the submenu of %s (%u menu items alive).",
+           feed->source, n_menu_items);
+}
+
+/* Timeout which releases a submenu which has not been used for a while. */
+static gboolean
+on_release_timeout (Feed *feed)
+{
+  feed->release_id = 0;
+  release (feed);
+  return FALSE;
+}
+
+/* "select" handler of the feed menu items.  Builds the feed's submenu
+   before it is popped up. */
+static void
+on_feed_select (GtkMenuItem *menu_item,
+                Feed        *feed)
+{
+  if (feed->release_id != 0) {
+    g_source_remove (feed->release_id);
+    feed->release_id = 0;
+  }
+
+  feed->last_viewed = time (NULL);
+  materialize (feed);
+}
+
+/* "hide" handler of the feed submenus.  Schedules the release of the
+   submenu's menu items in lazy mode. */
+static void
+on_submenu_hide (GtkWidget *menu,
+                 Feed      *feed)
+{
+  if (lazy && feed->items != NULL && feed->release_id == 0) {
+    feed->release_id =
+      gdk_threads_add_timeout_seconds (RELEASE_DELAY,
+                                       (GSourceFunc) on_release_timeout,
+                                       feed);
+  }
+}
+
+void
+feed_menu_set_lazy (gboolean value)
+{
+  lazy = value;
+}
+
+gboolean
+feed_menu_get_lazy ()
+{
+  return lazy;
+}
+
+void
+feed_menu_init (Feed *feed)
+{
+  GtkWidget *menu;
+
+  g_assert (feed != NULL);
+  g_assert (feed->menu != NULL);
+
+  menu = gtk_menu_new ();
+  gtk_menu_item_set_submenu (GTK_MENU_ITEM(feed->menu), menu);
+
+  g_signal_connect (feed->menu,
+                    "select",
+                    G_CALLBACK(on_feed_select),
+                    feed);
+
+  g_signal_connect (menu,
+                    "hide",
+                    G_CALLBACK(on_submenu_hide),
+                    feed);
+}
+
+/* Replaces the articles of FEED with ARTICLES and updates its submenu
+   and unread count. */
+static void
+replace_articles (Feed         *feed,
+                  FeedArticles *articles)
+{
+  FeedArticles *old;
+  guint         count = 0;
+  guint         i;
+
+  for (i = 0; i < articles->items->len; i++) {
+    if (!is_read (feed_articles_get (articles, i))) {
+      count++;
+    }
+  }
+
+  n_unread = n_unread - feed->n_unread + count;
+  feed->n_unread = count;
+  update_unread (feed);
+
+  /* The menu items refer to the old articles until they are updated, so
+     the old generation is released last. */
+  old = feed->articles;
+  feed->articles = articles;
+
+  if (feed->items != NULL) {
+    update_submenu (feed, old);
+  } else if (!lazy) {
+    materialize (feed);
+  }
+
+  articles_size = articles_size - (old != NULL ? old->size : 0) +
+                  articles->size;
+  feed_articles_free (old);
+}
+
+/* Evicts articles until the articles of all feeds fit in the memory
+   budget.  The oldest articles of the feed viewed least recently go
+   first, but no feed is trimmed below BUDGET_MIN_ARTICLES, so the budget
+   may be exceeded if it is very small. */
+static void
+enforce_budget ()
+{
+  guint  n_evicted = 0;
+  guint  i;
+
+  while (memory_budget > 0 && articles_size > memory_budget) {
+    Feed  *victim = NULL;
+    gsize  item_size;
+    guint  n_items;
+    guint  n_keep;
+
+    for (i = 0; i < feeds_get_count (); i++) {
+      Feed *feed = feeds_get (i);
+
+      if (feed->articles != NULL &&
+          feed->articles->items->len > BUDGET_MIN_ARTICLES &&
+          (victim == NULL || feed->last_viewed < victim->last_viewed)) {
+        victim = feed;
+      }
+    }
+
+    if (victim == NULL) {
+      g_debug ("The articles exceed the memory budget of %lu bytes by "
+               "%lu bytes.", (gulong) memory_budget,
+               (gulong) (articles_size - memory_budget));
+      break;
+    }
+
+    /* Evict enough of the victim's articles to fit in the budget, on
+       average. */
+    n_items = victim->articles->items->len;
+    item_size = MAX (victim->articles->size / n_items, 1);
+    n_keep = n_items - MIN (n_items - BUDGET_MIN_ARTICLES,
+                            (articles_size - memory_budget) / item_size + 1);
+
+    replace_articles (victim,
+                      feed_articles_keep_newest (victim->articles, n_keep));
+    n_evicted += n_items - n_keep;
+  }
+
+  if (n_evicted > 0) {
+    g_debug ("Evicted %u articles; the articles of all feeds use %lu bytes.",
+             n_evicted, (gulong) articles_size);
+  }
+}
+
+void
+feed_menu_set_memory_budget (gsize bytes)
+{
+  memory_budget = bytes;
+  enforce_budget ();
+}
+
+gsize
+feed_menu_get_memory_budget ()
+{
+  return memory_budget;
+}
+
+void
+feed_menu_set_articles (Feed         *feed,
+                        FeedArticles *articles)
+{
+  g_assert (feed != NULL);
+  g_assert (articles != NULL);
+
+  replace_articles (feed, articles);
+  enforce_budget ();
+}
+
+void
+feed_menu_destroy (Feed *feed)
+{
+  g_assert (feed != NULL);
+
+  if (feed->release_id != 0) {
+    g_source_remove (feed->release_id);
+    feed->release_id = 0;
+  }
+
+  release (feed);
+  if (feed->articles != NULL) {
+    articles_size -= feed->articles->size;
+  }
+  feed_articles_free (feed->articles);
+  feed->articles = NULL;
+
+  n_unread -= feed->n_unread;
+  feed->n_unread = 0;
+  update_unread (feed);
+}
+
+void
+feed_menu_mark_read (Feed      *feed,
+                     GtkWidget *menu_item)
+{
+  const FeedItem *item;
+  GtkWidget      *label;
+
+  g_assert (feed != NULL);
+  g_assert (feed->articles != NULL);
+
+  item = feed_articles_get (feed->articles, get_item_index (menu_item));
+
+  /* Opening the article also loads the store, if no article was shown
+     before. */
+  if (is_read (item) ||
+      !read_state_mark (read_state, feed_item_hash (item))) {
+    return;
+  }
+
+  label = gtk_bin_get_child (GTK_BIN(menu_item));
+  if (label != NULL) {
+    set_item_label (label, item->title, FALSE);
+  }
+
+  if (feed->n_unread > 0) {
+    feed->n_unread--;
+    n_unread--;
+  }
+  update_unread (feed);
+}
+
+guint
+feed_menu_get_n_unread ()
+{
+  return n_unread;
+}
+
+guint
+feed_menu_get_n_items ()
+{
+  return n_menu_items;
+}
+
+void
+feed_menu_log_usage ()
+{
+  gchar  *statm = NULL;
+  gulong  size = 0, resident = 0;
+
+  if (g_file_get_contents ("/proc/self/statm", &statm, NULL, NULL)) {
+    sscanf (statm, "%lu %lu", &size, &resident);
+    g_free (statm);
+  }
+
+  g_debug ("%s menus: %u article menu items alive, RSS %lu kB.",
+           lazy ? "Lazy" : "Eager",
+           n_menu_items,
+           resident * (sysconf (_SC_PAGESIZE) / 1024));
+}
@@ -0,0 +1,109 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FEEDMENU_H
+#define FEEDMENU_H
+
+#include <gtk/gtk.h>
+
+#include "feedparser.h"
+#include "feeds.h"
+
+/*
+ * Feed submenus.
+ *
+ * The articles of each feed are kept as plain records in the Feed
+ * structure, and the menu items refer to them by index.  In lazy mode,
+ * which is the default, the menu items of a feed's submenu are built only
+ * when the user first selects the feed in the feeds menu, and they are
+ * released again after the submenu has not been shown for a while.  In
+ * eager mode, the submenus are always kept built.
+ *
+ * Articles which have not been opened are shown in bold, and the number
+ * of unread articles is shown next to the title of each feed and in the
+ * tooltip of the system tray icon.  The read articles are recorded in
+ * '$XDG_DATA_HOME/gtk-feed/', see readstate.h.  The unread counts are
+ * updated as articles are replaced and opened, never by scanning all
+ * feeds.
+ *
+ * The articles of all feeds may be limited to a memory budget.  When new
+ * articles exceed it, the oldest articles of the feeds whose submenus
+ * were shown least recently are evicted, until they fit.
+ *
+ * These functions must be called from the main thread.
+ */
+
+/*
+ * Selects between lazy (TRUE) and eager (FALSE) mode.
+ */
+void     feed_menu_set_lazy     (gboolean        lazy);
+gboolean feed_menu_get_lazy     ();
+
+/*
+ * Attaches an empty submenu to the menu item of FEED and sets up building
+ * its contents on demand.
+ */
+void     feed_menu_init         (Feed           *feed);
+
+/*
+ * Replaces the articles of FEED with ARTICLES, a new generation of
+ * articles.  The feed takes ownership of ARTICLES, and the previous
+ * generation is freed as a unit.  The unread count of FEED is updated.
+ * If the submenu is built, it is updated incrementally: articles are
+ * matched to the existing menu items by their guid, falling back to
+ * the link and the title, so only new articles get new menu items, stale
+ * ones are removed and the rest are reused in place.  Articles of any
+ * feed may be evicted for the memory budget.
+ */
+void     feed_menu_set_articles (Feed           *feed,
+                                 FeedArticles   *articles);
+
+/*
+ * Sets the number of bytes the articles of all feeds may use, or zero for
+ * no limit, and evicts articles if they do not fit.
+ */
+void     feed_menu_set_memory_budget (gsize      bytes);
+gsize    feed_menu_get_memory_budget ();
+
+/*
+ * Marks the article of MENU_ITEM, a menu item of FEED's submenu, read.
+ */
+void     feed_menu_mark_read    (Feed           *feed,
+                                 GtkWidget      *menu_item);
+
+/*
+ * Returns the number of unread articles in all feeds.
+ */
+guint    feed_menu_get_n_unread ();
+
+/*
+ * Releases the submenu contents and the articles of FEED.
+ */
+void     feed_menu_destroy      (Feed           *feed);
+
+/*
+ * Returns the number of article menu items alive.
+ */
+guint    feed_menu_get_n_items  ();
+
+/*
+ * Logs the number of article menu items alive and the resident memory of
+ * the process, for comparing the lazy and eager modes.
+ */
+void     feed_menu_log_usage    ();
+
+#endif
@@ -0,0 +1,868 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+#include <libxml/parser.h>
+
+#include "feedparser.h"
+#include "hash.h"
+
+/* Number of article fields. */
+#define N_FIELDS 5
+
+/* Size of the blocks holding the strings of a generation of articles. */
+#define ARTICLES_CHUNK_SIZE 4096
+
+/* Namespaces of the feed formats and their common extensions. */
+#define RDF_NS    "http://www.w3.org/1999/02/22-rdf-syntax-ns#"
+#define RSS090_NS "http://my.netscape.com/rdf/simple/0.9/"
+#define RSS10_NS  "http://purl.org/rss/1.0/"
+#define ATOM_NS   "http://www.w3.org/2005/Atom"
+#define DC_NS     "http://purl.org/dc/elements/1.1/"
+
+/* Field indices, in FeedField bit order. */
+enum {
+  FIELD_TITLE,
+  FIELD_LINK,
+  FIELD_GUID,
+  FIELD_DATE,
+  FIELD_DESCRIPTION
+};
+
+/* Element holding an article field.  NS is the namespace of the element,
+   or NULL if it is in the same namespace as the article element.  If
+   OVERRIDE is TRUE, the element replaces a value read from an earlier
+   element mapped to the same field. */
+typedef struct {
+  const gchar *ns;
+  const gchar *name;
+  gint         field;
+  gboolean     override;
+} FieldElement;
+
+/* Channel properties. */
+typedef enum {
+  CHANNEL_NONE,
+  CHANNEL_TTL,
+  CHANNEL_SKIP_HOURS,
+  CHANNEL_SKIP_DAYS
+} ChannelProperty;
+
+/* Parser state.  DEPTH is the nesting depth of the current element, with
+   the root element at depth 1.  FORMAT is told by the root element, and
+   NS is the namespace of the format's elements.  CHANNEL_DEPTH and
+   ITEM_DEPTH are the depths of the open RSS <channel> and the open
+   article element, or zero when outside of them.  FIELD is the buffer
+   collecting the character data of the article field or channel property
+   being parsed, or NULL if the current element is not interesting.
+   PROPERTY is the channel property being parsed. */
+struct _FeedParser {
+  gchar              *source;
+  guint               fields;
+  FeedItemFunc        func;
+  gpointer            user_data;
+  xmlParserCtxtPtr    ctxt;
+
+  gint                depth;
+  FeedFormat          format;
+  const gchar        *ns;
+  const FieldElement *elements;
+  gboolean            channel_done;
+  gint                channel_depth;
+  gint                item_depth;
+  gint                field_depth;
+  GString            *field;
+
+  GString            *values[N_FIELDS];
+  guint               present;
+  guint               n_items;
+
+  ChannelProperty     property;
+  gint                property_depth;
+  GString            *property_value;
+  FeedChannel         channel;
+};
+
+/* Article fields of RSS 0.9x and 2.0.  Dublin Core dates are common in
+   feeds which lack <pubDate>. */
+static const FieldElement rss_elements[] = {
+  { NULL,  "title",       FIELD_TITLE,       FALSE },
+  { NULL,  "link",        FIELD_LINK,        FALSE },
+  { NULL,  "guid",        FIELD_GUID,        FALSE },
+  { NULL,  "pubDate",     FIELD_DATE,        TRUE  },
+  { DC_NS, "date",        FIELD_DATE,        FALSE },
+  { NULL,  "description", FIELD_DESCRIPTION, FALSE },
+  { NULL,  NULL,          0,                 FALSE }
+};
+
+/* Article fields of RSS 0.90 and 1.0.  The guid is the rdf:about
+   attribute of the <item>. */
+static const FieldElement rdf_elements[] = {
+  { NULL,  "title",       FIELD_TITLE,       FALSE },
+  { NULL,  "link",        FIELD_LINK,        FALSE },
+  { DC_NS, "date",        FIELD_DATE,        FALSE },
+  { NULL,  "description", FIELD_DESCRIPTION, FALSE },
+  { NULL,  NULL,          0,                 FALSE }
+};
+
+/* Article fields of Atom 1.0.  The link is the href attribute of the
+   alternate <link>.  The publication date is preferred over the date of
+   the last update. */
+static const FieldElement atom_elements[] = {
+  { NULL,  "title",       FIELD_TITLE,       FALSE },
+  { NULL,  "id",          FIELD_GUID,        FALSE },
+  { NULL,  "published",   FIELD_DATE,        TRUE  },
+  { NULL,  "updated",     FIELD_DATE,        FALSE },
+  { NULL,  "summary",     FIELD_DESCRIPTION, FALSE },
+  { NULL,  "content",     FIELD_DESCRIPTION, FALSE },
+  { NULL,  NULL,          0,                 FALSE }
+};
+
+/* Tells the format of the document from its root element. */
+static void
+begin_document (FeedParser    *parser,
+                const xmlChar *localname,
+                const xmlChar *uri)
+{
+  if (uri == NULL && xmlStrEqual (localname, (const xmlChar *) "rss")) {
+    parser->format = FEED_FORMAT_RSS;
+    parser->elements = rss_elements;
+  } else if (xmlStrEqual (uri, (const xmlChar *) RDF_NS) &&
+             xmlStrEqual (localname, (const xmlChar *) "RDF")) {
+    /* The namespace is told by the first article. */
+    parser->format = FEED_FORMAT_RDF;
+    parser->elements = rdf_elements;
+  } else if (xmlStrEqual (uri, (const xmlChar *) ATOM_NS) &&
+             xmlStrEqual (localname, (const xmlChar *) "feed")) {
+    parser->format = FEED_FORMAT_ATOM;
+    parser->ns = ATOM_NS;
+    parser->elements = atom_elements;
+  } else {
+    g_warning ("%s is not a web feed (root element <%s>).",
+               parser->source, localname);
+  }
+}
+
+/* Returns TRUE if the element LOCALNAME in namespace URI is an article of
+   an RDF or Atom document. */
+static gboolean
+is_item (FeedParser    *parser,
+         const xmlChar *localname,
+         const xmlChar *uri)
+{
+  if (parser->format == FEED_FORMAT_RDF) {
+    if (!xmlStrEqual (localname, (const xmlChar *) "item")) {
+      return FALSE;
+    }
+
+    if (xmlStrEqual (uri, (const xmlChar *) RSS10_NS)) {
+      parser->ns = RSS10_NS;
+    } else if (xmlStrEqual (uri, (const xmlChar *) RSS090_NS)) {
+      parser->ns = RSS090_NS;
+    } else {
+      return FALSE;
+    }
+
+    return TRUE;
+  }
+
+  return parser->format == FEED_FORMAT_ATOM &&
+         xmlStrEqual (uri, (const xmlChar *) ATOM_NS) &&
+         xmlStrEqual (localname, (const xmlChar *) "entry");
+}
+
+/* Returns a copy of the value of the attribute NAME in namespace NS from
+   the SAX2 ATTRIBUTES, or NULL if it is not present. */
+static gchar *
+get_attribute (const xmlChar **attributes,
+               gint            n_attributes,
+               const gchar    *ns,
+               const gchar    *name)
+{
+  gint i;
+
+  /* Each attribute is given as localname, prefix, URI, value and end. */
+  for (i = 0; i < n_attributes; i++) {
+    const xmlChar **attribute = &attributes[i * 5];
+
+    if (xmlStrEqual (attribute[0], (const xmlChar *) name) &&
+        xmlStrEqual (attribute[2], (const xmlChar *) ns)) {
+      return g_strndup ((const gchar *) attribute[3],
+                        attribute[4] - attribute[3]);
+    }
+  }
+
+  return NULL;
+}
+
+/* Stores VALUE as field I of the article, unless the field was not
+   requested or is already present.  Takes ownership of VALUE. */
+static void
+set_field (FeedParser *parser,
+           gint        i,
+           gchar      *value)
+{
+  if (value != NULL &&
+      (parser->fields & (1 << i)) &&
+      (parser->present & (1 << i)) == 0) {
+    parser->present |= 1 << i;
+    g_string_assign (parser->values[i], value);
+  }
+
+  g_free (value);
+}
+
+/* Reports the article collected so far to the callback. */
+static void
+emit_item (FeedParser *parser)
+{
+  FeedItem     item;
+  const gchar *values[N_FIELDS];
+  gint         i;
+
+  for (i = 0; i < N_FIELDS; i++) {
+    if (parser->present & (1 << i)) {
+      values[i] = g_strstrip (parser->values[i]->str);
+    } else {
+      values[i] = NULL;
+    }
+  }
+
+  item.title       = values[FIELD_TITLE];
+  item.link        = values[FIELD_LINK];
+  item.guid        = values[FIELD_GUID];
+  item.date        = values[FIELD_DATE] != NULL ?
+                     feed_parse_date (values[FIELD_DATE]) : 0;
+  item.description = values[FIELD_DESCRIPTION];
+
+  parser->n_items++;
+  parser->func (&item, parser->user_data);
+}
+
+/* Starts a new article. */
+static void
+begin_item (FeedParser     *parser,
+            const xmlChar **attributes,
+            gint            n_attributes)
+{
+  gint i;
+
+  for (i = 0; i < N_FIELDS; i++) {
+    g_string_truncate (parser->values[i], 0);
+  }
+
+  parser->present = 0;
+  parser->item_depth = parser->depth;
+
+  if (parser->format == FEED_FORMAT_RDF) {
+    set_field (parser, FIELD_GUID,
+               get_attribute (attributes, n_attributes, RDF_NS, "about"));
+  }
+}
+
+/* Starts collecting an article field if the element LOCALNAME in
+   namespace URI holds one which was requested.  Unrequested fields are
+   skipped entirely. */
+static void
+begin_field (FeedParser     *parser,
+             const xmlChar  *localname,
+             const xmlChar  *uri,
+             const xmlChar **attributes,
+             gint            n_attributes)
+{
+  const FieldElement *element;
+
+  /* The link of an Atom entry is in an attribute.  Links with other
+     relations than "alternate" point elsewhere than the article. */
+  if (parser->format == FEED_FORMAT_ATOM &&
+      xmlStrEqual (localname, (const xmlChar *) "link") &&
+      xmlStrEqual (uri, (const xmlChar *) ATOM_NS)) {
+    gchar *rel = get_attribute (attributes, n_attributes, NULL, "rel");
+
+    if (rel == NULL || strcmp (rel, "alternate") == 0) {
+      set_field (parser, FIELD_LINK,
+                 get_attribute (attributes, n_attributes, NULL, "href"));
+    }
+
+    g_free (rel);
+    return;
+  }
+
+  for (element = parser->elements; element->name != NULL; element++) {
+    gint i = element->field;
+
+    if (xmlStrEqual (localname, (const xmlChar *) element->name) &&
+        xmlStrEqual (uri, (const xmlChar *) (element->ns != NULL ?
+                                             element->ns : parser->ns))) {
+      if ((parser->fields & (1 << i)) == 0) {
+        break;
+      }
+
+      /* Only the first occurrence of each field counts, unless the
+         element takes precedence. */
+      if ((parser->present & (1 << i)) == 0 || element->override) {
+        g_string_truncate (parser->values[i], 0);
+        parser->present |= 1 << i;
+        parser->field = parser->values[i];
+        parser->field_depth = parser->depth;
+      }
+      break;
+    }
+  }
+}
+
+/* Starts parsing a channel property, or a value inside one. */
+static void
+begin_property (FeedParser    *parser,
+                const xmlChar *name)
+{
+  if (parser->depth == parser->channel_depth + 1) {
+    if (xmlStrcmp (name, (const xmlChar *) "ttl") == 0) {
+      parser->property = CHANNEL_TTL;
+    } else if (xmlStrcmp (name, (const xmlChar *) "skipHours") == 0) {
+      parser->property = CHANNEL_SKIP_HOURS;
+    } else if (xmlStrcmp (name, (const xmlChar *) "skipDays") == 0) {
+      parser->property = CHANNEL_SKIP_DAYS;
+    } else {
+      return;
+    }
+    parser->property_depth = parser->depth;
+  } else if (parser->property == CHANNEL_TTL ||
+             (parser->property == CHANNEL_SKIP_HOURS &&
+              xmlStrcmp (name, (const xmlChar *) "hour") != 0) ||
+             (parser->property == CHANNEL_SKIP_DAYS &&
+              xmlStrcmp (name, (const xmlChar *) "day") != 0)) {
+    return;
+  }
+
+  /* The value of <ttl> is its content; <skipHours> and <skipDays> have
+     their values in <hour> and <day> children. */
+  if (parser->property == CHANNEL_TTL ||
+      parser->depth == parser->property_depth + 1) {
+    g_string_truncate (parser->property_value, 0);
+    parser->field = parser->property_value;
+    parser->field_depth = parser->depth;
+  }
+}
+
+/* Stores the channel property value collected so far. */
+static void
+end_property (FeedParser *parser)
+{
+  static const gchar *days[] = {
+    "Sunday", "Monday", "Tuesday", "Wednesday",
+    "Thursday", "Friday", "Saturday"
+  };
+  gchar *value = g_strstrip (parser->property_value->str);
+  gint   i;
+
+  switch (parser->property) {
+  case CHANNEL_TTL:
+    parser->channel.ttl = MAX (atoi (value), 0);
+    break;
+  case CHANNEL_SKIP_HOURS:
+    i = atoi (value);
+    /* Hour 24 is sometimes used for midnight. */
+    if (i >= 0 && i <= 24) {
+      parser->channel.skip_hours |= 1 << (i % 24);
+    }
+    break;
+  case CHANNEL_SKIP_DAYS:
+    for (i = 0; i < G_N_ELEMENTS (days); i++) {
+      if (g_ascii_strcasecmp (value, days[i]) == 0) {
+        parser->channel.skip_days |= 1 << i;
+      }
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+/* SAX2 start element handler. */
+static void
+on_start_element (void           *ctx,
+                  const xmlChar  *localname,
+                  const xmlChar  *prefix,
+                  const xmlChar  *uri,
+                  int             nb_namespaces,
+                  const xmlChar **namespaces,
+                  int             nb_attributes,
+                  int             nb_defaulted,
+                  const xmlChar **attributes)
+{
+  FeedParser *parser = ctx;
+
+  parser->depth++;
+
+  if (parser->depth == 1) {
+    begin_document (parser, localname, uri);
+  } else if (parser->format == FEED_FORMAT_UNKNOWN ||
+             parser->field != NULL) {
+    /* Not a feed, or markup inside a field. */
+  } else if (parser->item_depth > 0) {
+    if (parser->depth == parser->item_depth + 1) {
+      begin_field (parser, localname, uri, attributes, nb_attributes);
+    }
+  } else if (parser->format != FEED_FORMAT_RSS) {
+    /* The articles of RDF and Atom documents are children of the root. */
+    if (parser->depth == 2 && is_item (parser, localname, uri)) {
+      begin_item (parser, attributes, nb_attributes);
+    }
+  } else if (uri != NULL) {
+    /* An extension element of the RSS channel. */
+  } else if (parser->depth == 2) {
+    if (!parser->channel_done &&
+        xmlStrcmp (localname, (const xmlChar *) "channel") == 0) {
+      parser->channel_depth = parser->depth;
+    }
+  } else if (parser->channel_depth > 0 &&
+             parser->depth == parser->channel_depth + 1) {
+    if (xmlStrcmp (localname, (const xmlChar *) "item") == 0) {
+      begin_item (parser, attributes, nb_attributes);
+    } else {
+      begin_property (parser, localname);
+    }
+  } else if (parser->property != CHANNEL_NONE) {
+    begin_property (parser, localname);
+  }
+}
+
+/* SAX2 end element handler. */
+static void
+on_end_element (void          *ctx,
+                const xmlChar *localname,
+                const xmlChar *prefix,
+                const xmlChar *uri)
+{
+  FeedParser *parser = ctx;
+
+  if (parser->depth == parser->field_depth) {
+    if (parser->property != CHANNEL_NONE) {
+      end_property (parser);
+    }
+    parser->field = NULL;
+    parser->field_depth = 0;
+  }
+
+  if (parser->depth == parser->property_depth) {
+    parser->property = CHANNEL_NONE;
+    parser->property_depth = 0;
+  } else if (parser->depth == parser->item_depth) {
+    emit_item (parser);
+    parser->item_depth = 0;
+  } else if (parser->depth == parser->channel_depth) {
+    /* Like before, only the first channel is read. */
+    parser->channel_depth = 0;
+    parser->channel_done = TRUE;
+  }
+
+  parser->depth--;
+}
+
+/* SAX2 character data handler.  Also handles CDATA sections. */
+static void
+on_characters (void          *ctx,
+               const xmlChar *ch,
+               int            len)
+{
+  FeedParser *parser = ctx;
+
+  if (parser->field != NULL) {
+    g_string_append_len (parser->field, (const gchar *) ch, len);
+  }
+}
+
+guint64
+feed_item_hash (const FeedItem *item)
+{
+  const gchar *key;
+
+  g_assert (item != NULL);
+
+  if (item->guid != NULL) {
+    key = item->guid;
+  } else if (item->link != NULL) {
+    key = item->link;
+  } else if (item->title != NULL) {
+    key = item->title;
+  } else {
+    key = "";
+  }
+
+  return hash64_update (HASH64_INIT, key, strlen (key));
+}
+
+FeedArticles *
+feed_articles_new ()
+{
+  FeedArticles *articles;
+
+  articles = g_new (FeedArticles, 1);
+  articles->items = g_array_new (FALSE, FALSE, sizeof (FeedItem));
+  articles->strings = g_string_chunk_new (ARTICLES_CHUNK_SIZE);
+  articles->size = 0;
+
+  return articles;
+}
+
+/* Copies STRING into the string chunk of ARTICLES.  Equal strings are
+   stored once, since the guid is often the link. */
+static const gchar *
+articles_insert (FeedArticles *articles,
+                 const gchar  *string)
+{
+  if (string == NULL) {
+    return NULL;
+  }
+
+  return g_string_chunk_insert_const (articles->strings, string);
+}
+
+void
+feed_articles_add (FeedArticles   *articles,
+                   const FeedItem *item)
+{
+  FeedItem copy;
+
+  g_assert (articles != NULL);
+  g_assert (item != NULL);
+
+  copy.title = articles_insert (articles, item->title);
+  copy.link = articles_insert (articles, item->link);
+  copy.guid = articles_insert (articles, item->guid);
+  copy.date = item->date;
+  copy.description = NULL;
+
+  g_array_append_val (articles->items, copy);
+
+  /* The guid is often the link, which is then stored once. */
+  articles->size += sizeof (FeedItem);
+  if (copy.title != NULL) {
+    articles->size += strlen (copy.title) + 1;
+  }
+  if (copy.link != NULL) {
+    articles->size += strlen (copy.link) + 1;
+  }
+  if (copy.guid != NULL && copy.guid != copy.link) {
+    articles->size += strlen (copy.guid) + 1;
+  }
+}
+
+/* Orders the indices A and B of the articles ITEMS newest first, and in
+   their original order if equally old. */
+static gint
+compare_age (gconstpointer a,
+             gconstpointer b,
+             gpointer      items)
+{
+  guint    i = *(const guint *) a;
+  guint    j = *(const guint *) b;
+  gint64   date_i = g_array_index ((GArray *) items, FeedItem, i).date;
+  gint64   date_j = g_array_index ((GArray *) items, FeedItem, j).date;
+
+  if (date_i != date_j) {
+    return date_i > date_j ? -1 : 1;
+  }
+
+  return i < j ? -1 : i > j;
+}
+
+FeedArticles *
+feed_articles_keep_newest (FeedArticles *articles,
+                           guint         n)
+{
+  FeedArticles *newest;
+  guint        *order;
+  guint8       *keep;
+  guint         len;
+  guint         i;
+
+  g_assert (articles != NULL);
+
+  len = articles->items->len;
+  newest = feed_articles_new ();
+
+  order = g_new (guint, len);
+  keep = g_new0 (guint8, len);
+  for (i = 0; i < len; i++) {
+    order[i] = i;
+  }
+
+  g_qsort_with_data (order, len, sizeof (guint), compare_age,
+                     articles->items);
+  for (i = 0; i < n && i < len; i++) {
+    keep[order[i]] = 1;
+  }
+
+  for (i = 0; i < len; i++) {
+    if (keep[i]) {
+      feed_articles_add (newest, feed_articles_get (articles, i));
+    }
+  }
+
+  g_free (keep);
+  g_free (order);
+
+  return newest;
+}
+
+void
+feed_articles_free (FeedArticles *articles)
+{
+  if (articles == NULL) {
+    return;
+  }
+
+  g_array_free (articles->items, TRUE);
+  g_string_chunk_free (articles->strings);
+  g_free (articles);
+}
+
+/* Returns the number of days from 1970-01-01 to the given date of the
+   proleptic Gregorian calendar.  MONTH is 1-based. */
+static gint64
+days_from_civil (gint year,
+                 gint month,
+                 gint day)
+{
+  gint era, yoe, doy, doe;
+
+  year -= month <= 2;
+  era = (year >= 0 ? year : year - 399) / 400;
+  yoe = year - era * 400;
+  doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+  return (gint64) era * 146097 + doe - 719468;
+}
+
+/* Parses the time zone of an RFC 822 date.  Returns the offset from UTC
+   in seconds. */
+static glong
+parse_zone (const gchar *zone)
+{
+  static const struct {
+    const gchar *name;
+    gint         hours;
+  } zones[] = {
+    { "UT", 0 }, { "GMT", 0 }, { "Z", 0 },
+    { "EST", -5 }, { "EDT", -4 }, { "CST", -6 }, { "CDT", -5 },
+    { "MST", -7 }, { "MDT", -6 }, { "PST", -8 }, { "PDT", -7 }
+  };
+  guint i;
+
+  if (zone[0] == '+' || zone[0] == '-') {
+    glong value = strtol (zone + 1, NULL, 10);
+    glong offset = (value / 100) * 3600 + (value % 100) * 60;
+    return zone[0] == '-' ? -offset : offset;
+  }
+
+  for (i = 0; i < G_N_ELEMENTS (zones); i++) {
+    if (g_ascii_strcasecmp (zone, zones[i].name) == 0) {
+      return zones[i].hours * 3600;
+    }
+  }
+
+  return 0;
+}
+
+gint64
+feed_parse_date (const gchar *date)
+{
+  static const gchar *months[] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+  };
+  gchar    month_name[4], zone[8];
+  gint     day, month, year, hour, minute, second = 0;
+  GTimeVal time;
+
+  g_assert (date != NULL);
+
+  /* RFC 822 as used by RSS, with the weekday being optional: "Sat, 07 Sep
+     2002 00:00:01 GMT". */
+  if (!g_ascii_isdigit (*date)) {
+    const gchar *comma = strchr (date, ',');
+    if (comma != NULL) {
+      date = comma + 1;
+    }
+  }
+
+  zone[0] = '\0';
+  if (sscanf (date, "%d %3s %d %d:%d:%d %7s",
+              &day, month_name, &year, &hour, &minute, &second, zone) >= 6 ||
+      sscanf (date, "%d %3s %d %d:%d %7s",
+              &day, month_name, &year, &hour, &minute, zone) >= 5) {
+    for (month = 0; month < 12; month++) {
+      if (g_ascii_strcasecmp (month_name, months[month]) == 0) {
+        break;
+      }
+    }
+    if (month == 12) {
+      return 0;
+    }
+    if (year < 100) {
+      year += year < 50 ? 2000 : 1900;
+    }
+
+    return days_from_civil (year, month + 1, day) * 86400 +
+           hour * 3600 + minute * 60 + second - parse_zone (zone);
+  }
+
+  /* ISO 8601, as used by Atom and Dublin Core. */
+  if (g_time_val_from_iso8601 (date, &time)) {
+    return time.tv_sec;
+  }
+
+  return 0;
+}
+
+FeedParser *
+feed_parser_new (const gchar  *source,
+                 guint         fields,
+                 FeedItemFunc  func,
+                 gpointer      user_data)
+{
+  FeedParser    *parser;
+  xmlSAXHandler  sax;
+  gint           i;
+
+  g_assert (source != NULL);
+  g_assert (func != NULL);
+
+  parser = g_new0 (FeedParser, 1);
+  parser->source = g_strdup (source);
+  parser->fields = fields;
+  parser->func = func;
+  parser->user_data = user_data;
+
+  for (i = 0; i < N_FIELDS; i++) {
+    parser->values[i] = g_string_new (NULL);
+  }
+  parser->property_value = g_string_new (NULL);
+
+  /* Only the handlers needed for extracting the articles are set; in
+     particular, no tree building handlers are installed. */
+  memset (&sax, 0, sizeof (sax));
+  sax.initialized = XML_SAX2_MAGIC;
+  sax.startElementNs = on_start_element;
+  sax.endElementNs = on_end_element;
+  sax.characters = on_characters;
+  sax.cdataBlock = on_characters;
+
+  parser->ctxt = xmlCreatePushParserCtxt (&sax, parser, NULL, 0, source);
+  g_assert (parser->ctxt != NULL);
+  xmlCtxtUseOptions (parser->ctxt, XML_PARSE_NONET);
+
+  return parser;
+}
+
+gboolean
+feed_parser_feed (FeedParser  *parser,
+                  const gchar *data,
+                  gint         length)
+{
+  g_assert (parser != NULL);
+
+  if (!parser->ctxt->wellFormed) {
+    return FALSE;
+  }
+
+  xmlParseChunk (parser->ctxt, data, length, 0);
+
+  return parser->ctxt->wellFormed;
+}
+
+gboolean
+feed_parser_finish (FeedParser *parser)
+{
+  g_assert (parser != NULL);
+
+  if (parser->ctxt->wellFormed) {
+    xmlParseChunk (parser->ctxt, NULL, 0, 1);
+  }
+
+  if (!parser->ctxt->wellFormed) {
+    g_warning ("%s is not a well-formed XML document.", parser->source);
+    return FALSE;
+  }
+
+  return parser->format != FEED_FORMAT_UNKNOWN;
+}
+
+const FeedChannel *
+feed_parser_get_channel (FeedParser *parser)
+{
+  g_assert (parser != NULL);
+  return &parser->channel;
+}
+
+FeedFormat
+feed_parser_get_format (FeedParser *parser)
+{
+  g_assert (parser != NULL);
+  return parser->format;
+}
+
+const gchar *
+feed_format_get_name (FeedFormat format)
+{
+  switch (format) {
+  case FEED_FORMAT_RSS:
+    return "RSS";
+  case FEED_FORMAT_RDF:
+    return "RSS 1.0";
+  case FEED_FORMAT_ATOM:
+    return "Atom";
+  default:
+    return "unknown";
+  }
+}
+
+guint
+feed_parser_get_n_items (FeedParser *parser)
+{
+  g_assert (parser != NULL);
+  return parser->n_items;
+}
+
+void
+feed_parser_free (FeedParser *parser)
+{
+  gint i;
+
+  if (parser == NULL) {
+    return;
+  }
+
+  for (i = 0; i < N_FIELDS; i++) {
+    g_string_free (parser->values[i], TRUE);
+  }
+  g_string_free (parser->property_value, TRUE);
+
+  xmlFreeParserCtxt (parser->ctxt);
+  g_free (parser->source);
+  g_free (parser);
+}
@@ -0,0 +1,199 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FEEDPARSER_H
+#define FEEDPARSER_H
+
+#include <glib.h>
+
+/*
+ * Streaming web feed parser.
+ *
+ * The parser is fed the feed document in chunks as they are read and
+ * reports the news articles it finds one at a time through a callback.
+ * The document tree is never built; only the fields of the article being
+ * parsed are kept in memory, so the memory use is bounded by the size of
+ * a single article rather than the size of the whole document.
+ *
+ * RSS 0.9x and 2.0, RSS 1.0 (RDF) and Atom 1.0 documents are understood.
+ * The format is told by the root element and its namespace as soon as the
+ * root element has been parsed, and the rest of the document is parsed
+ * according to that format; the document is never read twice.
+ */
+
+/*
+ * Feed document formats.
+ */
+typedef enum {
+  FEED_FORMAT_UNKNOWN,
+  FEED_FORMAT_RSS,      /* RSS 0.9x and 2.0 */
+  FEED_FORMAT_RDF,      /* RSS 0.90 and 1.0 */
+  FEED_FORMAT_ATOM      /* Atom 1.0 */
+} FeedFormat;
+
+/*
+ * Article fields.  Fields which are not requested are skipped without
+ * buffering their contents.
+ */
+typedef enum {
+  FEED_FIELD_TITLE       = 1 << 0,
+  FEED_FIELD_LINK        = 1 << 1,
+  FEED_FIELD_GUID        = 1 << 2,
+  FEED_FIELD_DATE        = 1 << 3,
+  FEED_FIELD_DESCRIPTION = 1 << 4
+} FeedField;
+
+/*
+ * News article record.  Fields which were not requested or which are
+ * missing from the article are NULL, or zero for the date.  The strings
+ * are owned by the parser and are valid only for the duration of the
+ * callback.
+ */
+typedef struct {
+  const gchar *title;
+  const gchar *link;
+  const gchar *guid;
+  gint64       date;        /* publication date, seconds since the epoch */
+  const gchar *description;
+} FeedItem;
+
+/*
+ * Channel properties which tell when the feed should be fetched again.
+ */
+typedef struct {
+  gint    ttl;          /* minutes the feed may be cached, or zero */
+  guint32 skip_hours;   /* bit N is set if hour N (GMT) is to be skipped */
+  guint8  skip_days;    /* bit N is set if weekday N (0 = Sunday) is to be
+                           skipped */
+} FeedChannel;
+
+/*
+ * Callback which is called for each article in the feed.
+ */
+typedef void (*FeedItemFunc) (const FeedItem *item, gpointer user_data);
+
+/*
+ * Returns a 64-bit hash identifying ITEM, computed from its guid, or its
+ * link if it has no guid, or its title if it has neither.
+ */
+guint64 feed_item_hash (const FeedItem *item);
+
+/*
+ * Articles of one generation of a feed, that is, of one fetch of the feed
+ * document.  The strings of all the articles are kept in a single string
+ * chunk, so they are allocated in a few large blocks and freed as a unit
+ * when the generation is replaced.
+ */
+typedef struct {
+  GArray       *items;      /* FeedItem records */
+  GStringChunk *strings;    /* strings of the records */
+  gsize         size;       /* approximate bytes used by the records and
+                               their strings */
+} FeedArticles;
+
+/*
+ * Creates an empty generation of articles.
+ */
+FeedArticles * feed_articles_new  ();
+
+/*
+ * Appends a copy of ITEM to ARTICLES.  Its strings are copied into the
+ * string chunk of ARTICLES; the description is not copied.
+ */
+void           feed_articles_add  (FeedArticles   *articles,
+                                   const FeedItem *item);
+
+/*
+ * Returns the Ith article of ARTICLES.
+ */
+#define feed_articles_get(articles, i) \
+  (&g_array_index ((articles)->items, FeedItem, (i)))
+
+/*
+ * Returns a new generation holding copies of the N newest articles of
+ * ARTICLES, in their original order.  Articles without a date count as
+ * older than any dated article, and of equally old articles the first
+ * ones are kept.
+ */
+FeedArticles * feed_articles_keep_newest (FeedArticles *articles,
+                                          guint         n);
+
+/*
+ * Frees ARTICLES and all of their strings.  ARTICLES may be NULL.
+ */
+void           feed_articles_free (FeedArticles   *articles);
+
+typedef struct _FeedParser FeedParser;
+
+/*
+ * Creates a new parser which extracts the FIELDS (a bitwise OR of
+ * FeedField values) of each article and passes them to FUNC.  SOURCE is
+ * used only in diagnostic messages.
+ */
+FeedParser * feed_parser_new    (const gchar   *source,
+                                 guint          fields,
+                                 FeedItemFunc   func,
+                                 gpointer       user_data);
+
+/*
+ * Parses the next LENGTH bytes of the document.  Returns FALSE if the
+ * document is not well-formed.
+ */
+gboolean     feed_parser_feed   (FeedParser    *parser,
+                                 const gchar   *data,
+                                 gint           length);
+
+/*
+ * Signals the end of the document.  Returns FALSE if the document is not
+ * well-formed or is not a web feed.
+ */
+gboolean     feed_parser_finish (FeedParser    *parser);
+
+/*
+ * Returns the channel properties parsed so far.
+ */
+const FeedChannel *
+             feed_parser_get_channel (FeedParser *parser);
+
+/*
+ * Returns the format of the document, or FEED_FORMAT_UNKNOWN if the root
+ * element has not been parsed yet or is not recognized.
+ */
+FeedFormat   feed_parser_get_format (FeedParser *parser);
+
+/*
+ * Returns a human-readable name of FORMAT.
+ */
+const gchar *feed_format_get_name (FeedFormat format);
+
+/*
+ * Returns the number of articles reported so far.
+ */
+guint        feed_parser_get_n_items (FeedParser *parser);
+
+/*
+ * Parses an RFC 822 or ISO 8601 date.  Returns the date as seconds since
+ * the epoch, or zero if DATE is not recognized.
+ */
+gint64       feed_parse_date    (const gchar   *date);
+
+/*
+ * Destroys the parser.
+ */
+void         feed_parser_free   (FeedParser    *parser);
+
+#endif
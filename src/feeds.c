@@ -19,57 +19,534 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <config.h>
 #endif
 
+#include <stdlib.h>
+#include <string.h>
 #include <gtk/gtk.h>
 #include <libxml/parser.h>
 #include <libxml/tree.h>
 #include <libxml/xmlsave.h>
 
 #include "common.h"
+#include "favicon.h"
+#include "feedlist.h"
+#include "feedmenu.h"
 #include "feeds.h"
+#include "hash.h"
+#include "opml.h"
 #include "rssfeed.h"
+#include "scheduler.h"
+#include "startup.h"
+#include "syncengine.h"
+
+static GPtrArray  *registry = NULL;  /* feeds in subscription order */
+static GHashTable *ids = NULL;       /* ID to feed */
+static GHashTable *sources = NULL;   /* normalized source URL to feed */
+static GHashTable *owners = NULL;    /* owner to feed */
+static guint       next_id = 1;
+
+/* Seconds each slice of the article cache load may take. */
+#define CACHE_LOAD_SLICE 0.01
+
+/* IDs of the feeds whose menus are populated from the article cache,
+   the next one to load, the number of feeds loaded and the time the
+   slices have taken, while the load is in progress. */
+static GArray     *cache_ids = NULL;
+static guint       cache_next = 0;
+static guint       n_cached = 0;
+static gdouble     cache_time = 0.0;
+
+/* Returns SOURCE normalized for comparison: the scheme and host are in lower
+   case, a default port and the fragment are dropped, and an empty path is
+   "/".  Sources which are not URLs are returned as they are. */
+static gchar *
+normalize_source (const gchar *source)
+{
+  const gchar *host;
+  const gchar *path;
+  GString     *result;
+  gchar       *prefix;
+
+  host = strstr (source, "://");
+  if (host == NULL) {
+    return g_strdup (source);
+  }
+  host += 3;
+  path = host + strcspn (host, "/?#");
+
+  prefix = g_ascii_strdown (source, path - source);
+  result = g_string_new (prefix);
+  g_free (prefix);
+
+  if ((g_str_has_prefix (result->str, "http://") &&
+       g_str_has_suffix (result->str, ":80")) ||
+      (g_str_has_prefix (result->str, "https://") &&
+       g_str_has_suffix (result->str, ":443"))) {
+    g_string_truncate (result, strrchr (result->str, ':') - result->str);
+  }
+
+  if (*path != '/') {
+    g_string_append_c (result, '/');
+  }
+  g_string_append_len (result, path, strcspn (path, "#"));
+
+  return g_string_free (result, FALSE);
+}
+
+Feed *
+feeds_add (const gchar *title,
+           const gchar *source)
+{
+  Feed  *feed;
+  gchar *key;
+
+  g_assert (title != NULL);
+  g_assert (source != NULL);
+
+  if (registry == NULL) {
+    registry = g_ptr_array_new ();
+    ids = g_hash_table_new (g_direct_hash, g_direct_equal);
+    sources = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    owners = g_hash_table_new (g_direct_hash, g_direct_equal);
+  }
+
+  key = normalize_source (source);
+  if (g_hash_table_lookup (sources, key) != NULL) {
+    g_free (key);
+    return NULL;
+  }
+
+  feed = g_new0 (Feed, 1);
+  feed->id = next_id++;
+  feed->index = registry->len;
+  feed->title = g_strdup (title);
+  feed->source = g_strdup (source);
+
+  /* A hash of the source, so the owner does not change when the feed list
+     does.  Zero is not a valid owner. */
+  feed->owner = (guint32) hash64_update (HASH64_INIT, source,
+                                         strlen (source)) | 1;
+
+  g_ptr_array_add (registry, feed);
+  g_hash_table_insert (ids, GUINT_TO_POINTER(feed->id), feed);
+  g_hash_table_insert (sources, key, feed);
+  if (g_hash_table_lookup (owners, GUINT_TO_POINTER(feed->owner)) == NULL) {
+    g_hash_table_insert (owners, GUINT_TO_POINTER(feed->owner), feed);
+  }
+  feed_list_add (feed);
+
+  return feed;
+}
+
+void
+feeds_remove (Feed *feed)
+{
+  gchar *key;
+  guint  i;
+
+  g_assert (feed != NULL);
+  g_assert (feeds_lookup (feed->id) == feed);
+
+  /* The feeds after FEED are moved down to keep the order. */
+  g_ptr_array_remove_index (registry, feed->index);
+  for (i = feed->index; i < registry->len; i++) {
+    ((Feed *) g_ptr_array_index (registry, i))->index = i;
+  }
+
+  key = normalize_source (feed->source);
+  g_hash_table_remove (sources, key);
+  g_free (key);
+  g_hash_table_remove (ids, GUINT_TO_POINTER(feed->id));
+
+  /* Another feed whose source hashes to the same owner takes over. */
+  if (g_hash_table_lookup (owners, GUINT_TO_POINTER(feed->owner)) == feed) {
+    g_hash_table_remove (owners, GUINT_TO_POINTER(feed->owner));
+    for (i = 0; i < registry->len; i++) {
+      Feed *other = g_ptr_array_index (registry, i);
+
+      if (other->owner == feed->owner) {
+        g_hash_table_insert (owners, GUINT_TO_POINTER(other->owner), other);
+        break;
+      }
+    }
+  }
+  feed_list_remove (feed);
+}
+
+guint
+feeds_get_count ()
+{
+  return registry != NULL ? registry->len : 0;
+}
+
+Feed *
+feeds_get (guint index)
+{
+  g_assert (index < feeds_get_count ());
+
+  return g_ptr_array_index (registry, index);
+}
+
+Feed *
+feeds_lookup (guint id)
+{
+  if (ids == NULL) {
+    return NULL;
+  }
+
+  return g_hash_table_lookup (ids, GUINT_TO_POINTER(id));
+}
+
+Feed *
+feeds_lookup_owner (guint32 owner)
+{
+  if (owners == NULL) {
+    return NULL;
+  }
+
+  return g_hash_table_lookup (owners, GUINT_TO_POINTER(owner));
+}
+
+Feed *
+feeds_lookup_source (const gchar *source)
+{
+  Feed  *feed;
+  gchar *key;
+
+  g_assert (source != NULL);
+
+  if (sources == NULL) {
+    return NULL;
+  }
+
+  key = normalize_source (source);
+  feed = g_hash_table_lookup (sources, key);
+  g_free (key);
+
+  return feed;
+}
+
+/* Returns the name of the file holding the HTTP validators. */
+static gchar *
+get_validators_filename ()
+{
+  return g_build_filename (g_get_user_config_dir (),
+                           PACKAGE,
+                           "validators",
+                           NULL);
+}
 
-GList *feeds = NULL;
+/* Reads the HTTP validators of the feeds.  The validators are kept in a
+   key file with one group per feed source. */
+static void
+load_validators ()
+{
+  GKeyFile *keyfile;
+  gchar    *filename;
+  guint     i;
+
+  filename = get_validators_filename ();
+  keyfile = g_key_file_new ();
+
+  if (g_key_file_load_from_file (keyfile, filename, G_KEY_FILE_NONE, NULL)) {
+    for (i = 0; i < feeds_get_count (); i++) {
+      Feed *feed = feeds_get (i);
+      feed->etag = g_key_file_get_string (keyfile, feed->source,
+                                          "etag", NULL);
+      feed->last_modified = g_key_file_get_string (keyfile, feed->source,
+                                                   "last-modified", NULL);
+    }
+  }
+
+  g_key_file_free (keyfile);
+  g_free (filename);
+}
+
+/* Writes the HTTP validators of the feeds. */
+static void
+save_validators ()
+{
+  GKeyFile *keyfile;
+  gchar    *filename;
+  gchar    *data;
+  gsize     length;
+  guint     i;
+  GError   *error = NULL;
+
+  filename = get_validators_filename ();
+  keyfile = g_key_file_new ();
+
+  for (i = 0; i < feeds_get_count (); i++) {
+    Feed *feed = feeds_get (i);
+    if (feed->etag != NULL) {
+      g_key_file_set_string (keyfile, feed->source, "etag", feed->etag);
+    }
+    if (feed->last_modified != NULL) {
+      g_key_file_set_string (keyfile, feed->source, "last-modified",
+                             feed->last_modified);
+    }
+  }
+
+  data = g_key_file_to_data (keyfile, &length, NULL);
+  if (!g_file_set_contents (filename, data, length, &error)) {
+    g_critical ("Failed to write %s: %s", filename, error->message);
+    g_error_free (error);
+  }
+
+  g_free (data);
+  g_key_file_free (keyfile);
+  g_free (filename);
+}
+
+/* Returns the non-negative integer value of the attribute NAME of NODE,
+   or zero if it is not set. */
+static guint
+get_uint_prop (xmlNodePtr   node,
+               const gchar *name)
+{
+  xmlChar *value;
+  gint     number = 0;
+
+  value = xmlGetProp (node, (const xmlChar *) name);
+  if (value != NULL) {
+    number = MAX (atoi ((const char *) value), 0);
+    xmlFree (value);
+  }
+
+  return number;
+}
+
+/* Sets the attribute NAME of NODE to NUMBER, unless it is zero. */
+static void
+set_uint_prop (xmlNodePtr   node,
+               const gchar *name,
+               guint        number)
+{
+  gchar *value;
+
+  if (number == 0) {
+    return;
+  }
+
+  value = g_strdup_printf ("%u", number);
+  xmlNewProp (node, (const xmlChar *) name, (const xmlChar *) value);
+  g_free (value);
+}
+
+/* Creates the menu item of FEED and appends it to the feeds menu. */
+static void
+add_menu (Feed *feed)
+{
+  feed->menu = gtk_image_menu_item_new_with_label (feed->title);
+  feed_menu_init (feed);
+  favicon_request (feed);
+  gtk_menu_shell_append (GTK_MENU_SHELL(get_feeds_menu ()),
+                         feed->menu);
+  gtk_widget_show_all (feed->menu);
+}
 
 static void
 parse_feed_element (xmlNodePtr root)
 {
   xmlNodePtr  node;
+  xmlChar    *title = NULL;
+  xmlChar    *source = NULL;
   Feed       *feed;
 
   g_assert (root != NULL);
 
-  feed = g_new0 (Feed, 1);
-  feed->dirty = TRUE;
-
   for (node = root->children;
        node!= NULL;
        node = node->next) {
     if (xmlStrcmp (node->name, (const xmlChar *) "title") == 0) {
-      feed->title = g_strdup ((gchar *) xmlNodeGetContent (node));
+      xmlFree (title);
+      title = xmlNodeGetContent (node);
     } else if (xmlStrcmp (node->name, (const xmlChar *) "source") == 0) {
-      feed->source = g_strdup ((gchar *) xmlNodeGetContent (node));
+      xmlFree (source);
+      source = xmlNodeGetContent (node);
     }
   }
 
-  feed->menu = gtk_menu_item_new_with_label (feed->title);
-  gtk_menu_shell_append (GTK_MENU_SHELL(get_feeds_menu ()),
-                         feed->menu);
-  gtk_widget_show_all (feed->menu);
-  feeds = g_list_append (feeds, feed);
+  if (source == NULL) {
+    g_warning ("Ignoring a feed without a source in feeds.xml");
+    xmlFree (title);
+    return;
+  }
+
+  feed = feeds_add (title != NULL ? (gchar *) title : (gchar *) source,
+                    (gchar *) source);
+  if (feed == NULL) {
+    g_message ("Ignoring a second subscription to %s in feeds.xml",
+               (gchar *) source);
+  } else {
+    /* The feed is not dirty; it is synced by the scheduler's startup
+       sync. */
+    feed->max_items = get_uint_prop (root, "max-items");
+    feed->max_age = get_uint_prop (root, "max-age");
+    feed->sync_deadline = get_uint_prop (root, "sync-deadline");
+    add_menu (feed);
+  }
+
+  xmlFree (title);
+  xmlFree (source);
+}
+
+/* Adds the rule of a <filter> element to FILTER.  The element holds a
+   keyword, or a regular expression if its "type" attribute is "regex". */
+static void
+parse_filter_element (xmlNodePtr  node,
+                      FeedFilter *filter)
+{
+  xmlChar *type;
+  xmlChar *pattern;
+  GError  *error = NULL;
+
+  type = xmlGetProp (node, (const xmlChar *) "type");
+  pattern = xmlNodeGetContent (node);
+
+  if (type != NULL && xmlStrcmp (type, (const xmlChar *) "regex") == 0) {
+    if (!feed_filter_add_regex (filter, (const gchar *) pattern, &error)) {
+      g_warning ("Ignoring filter /%s/: %s", pattern, error->message);
+      g_error_free (error);
+    }
+  } else {
+    feed_filter_add_keyword (filter, (const gchar *) pattern);
+  }
+
+  xmlFree (pattern);
+  xmlFree (type);
 }
 
 static void
 parse_feeds_element (xmlNodePtr root)
 {
-  xmlNodePtr node;
+  xmlNodePtr  node;
+  xmlChar    *threads;
+  xmlChar    *mode;
+  xmlChar    *lazy;
+  xmlChar    *interval;
+  xmlChar    *window;
+  xmlChar    *deadline;
+  guint       budget;
+  FeedFilter *filter;
+
   g_assert (root != NULL);
+
+  threads = xmlGetProp (root, (const xmlChar *) "sync-threads");
+  if (threads != NULL) {
+    sync_engine_set_max_threads (atoi ((const char *) threads));
+    xmlFree (threads);
+  }
+
+  mode = xmlGetProp (root, (const xmlChar *) "sync-mode");
+  if (mode != NULL) {
+    sync_engine_set_async (xmlStrcmp (mode, (const xmlChar *) "async") == 0);
+    xmlFree (mode);
+  }
+
+  lazy = xmlGetProp (root, (const xmlChar *) "lazy-menus");
+  if (lazy != NULL) {
+    feed_menu_set_lazy (xmlStrcmp (lazy, (const xmlChar *) "false") != 0);
+    xmlFree (lazy);
+  }
+
+  interval = xmlGetProp (root, (const xmlChar *) "refresh-interval");
+  if (interval != NULL) {
+    scheduler_set_interval (atoi ((const char *) interval));
+    xmlFree (interval);
+  }
+
+  window = xmlGetProp (root, (const xmlChar *) "startup-window");
+  if (window != NULL) {
+    scheduler_set_startup_window (atoi ((const char *) window));
+    xmlFree (window);
+  }
+
+  deadline = xmlGetProp (root, (const xmlChar *) "sync-deadline");
+  if (deadline != NULL) {
+    rss_feed_set_deadline (atoi ((const char *) deadline));
+    xmlFree (deadline);
+  }
+
+  /* The budget is given in kilobytes. */
+  budget = get_uint_prop (root, "memory-budget");
+  feed_menu_set_memory_budget ((gsize) budget * 1024);
+
+  filter = feed_filter_new ();
+
   for (node = root->children;
        node!= NULL;
        node = node->next) {
     if (xmlStrcmp (node->name, (const xmlChar *) "feed") == 0) {
       parse_feed_element (node);
+    } else if (xmlStrcmp (node->name, (const xmlChar *) "filter") == 0) {
+      parse_filter_element (node, filter);
+    }
+  }
+
+  if (feed_filter_get_n_rules (filter) > 0) {
+    feed_filter_compile (filter);
+    rss_feed_set_filter (filter);
+  } else {
+    feed_filter_free (filter);
+  }
+}
+
+gboolean
+load_cached_articles ()
+{
+  GTimer *slice;
+  guint   i;
+
+  if (cache_ids == NULL) {
+    cache_ids = g_array_sized_new (FALSE, FALSE, sizeof (guint),
+                                   feeds_get_count ());
+    for (i = 0; i < feeds_get_count (); i++) {
+      g_array_append_val (cache_ids, feeds_get (i)->id);
+    }
+    cache_next = 0;
+    n_cached = 0;
+    cache_time = 0.0;
+  }
+
+  slice = g_timer_new ();
+
+  while (cache_next < cache_ids->len &&
+         g_timer_elapsed (slice, NULL) < CACHE_LOAD_SLICE) {
+    Feed *feed = feeds_lookup (g_array_index (cache_ids, guint,
+                                              cache_next++));
+
+    /* Feeds deleted or synchronized since the load began are skipped. */
+    if (feed == NULL || feed->articles != NULL) {
+      continue;
+    }
+
+    /* Feeds without a usable cache are fetched unconditionally, since a
+       "304 Not Modified" would leave them empty. */
+    if (rss_feed_load_cache (feed)) {
+      n_cached++;
+    } else {
+      g_free (feed->etag);
+      g_free (feed->last_modified);
+      feed->etag = NULL;
+      feed->last_modified = NULL;
     }
   }
+
+  cache_time += g_timer_elapsed (slice, NULL);
+  g_timer_destroy (slice);
+
+  if (cache_next < cache_ids->len) {
+    return TRUE;
+  }
+
+  g_debug ("Populated %u of %u feed menus from the article cache in %.1f ms.",
+           n_cached, cache_ids->len, cache_time * 1000.0);
+  startup_mark (STARTUP_CACHE_LOADED);
+
+  g_array_free (cache_ids, TRUE);
+  cache_ids = NULL;
+
+  return FALSE;
 }
 
 void
@@ -87,6 +564,7 @@ load_feeds ()
   doc = xmlReadFile (filename, NULL, 0);
   if (doc == NULL) {
     g_critical ("Failed to read %s", filename);
+    startup_skip (STARTUP_FEEDS_PARSED);
     goto cleanup;
   }
 
@@ -103,8 +581,9 @@ load_feeds ()
   }
 
   g_debug ("Done reading %s", filename);
-  sync_feeds ();
-  
+  load_validators ();
+  startup_mark (STARTUP_FEEDS_PARSED);
+
  cleanup:
   xmlFreeDoc (doc);
   g_free (filename);
@@ -115,7 +594,7 @@ save_feeds ()
 {
   xmlDocPtr       doc;
   xmlNodePtr      root;
-  GList          *ptr;
+  guint           i;
   gchar          *filename;
   xmlSaveCtxtPtr  ctxt;
 
@@ -135,19 +614,89 @@ save_feeds ()
 
   xmlDocSetRootElement (doc, root);
 
-  for (ptr = g_list_first (feeds);
-       ptr!= NULL;
-       ptr = g_list_next (ptr)) {
-    xmlNodePtr node;
+  if (sync_engine_get_max_threads () > 0) {
+    gchar *threads;
+
+    threads = g_strdup_printf ("%d", sync_engine_get_max_threads ());
+    xmlNewProp (root, (const xmlChar *) "sync-threads",
+                (const xmlChar *) threads);
+    g_free (threads);
+  }
+
+  if (sync_engine_get_async ()) {
+    xmlNewProp (root, (const xmlChar *) "sync-mode",
+                (const xmlChar *) "async");
+  }
+
+  if (!feed_menu_get_lazy ()) {
+    xmlNewProp (root, (const xmlChar *) "lazy-menus",
+                (const xmlChar *) "false");
+  }
+
+  if (scheduler_get_interval () != SCHEDULER_DEFAULT_INTERVAL) {
+    gchar *interval;
+
+    interval = g_strdup_printf ("%d", scheduler_get_interval ());
+    xmlNewProp (root, (const xmlChar *) "refresh-interval",
+                (const xmlChar *) interval);
+    g_free (interval);
+  }
+
+  if (scheduler_get_startup_window () != SCHEDULER_DEFAULT_STARTUP_WINDOW) {
+    gchar *window;
+
+    window = g_strdup_printf ("%d", scheduler_get_startup_window ());
+    xmlNewProp (root, (const xmlChar *) "startup-window",
+                (const xmlChar *) window);
+    g_free (window);
+  }
+
+  if (rss_feed_get_deadline () != RSS_FEED_DEFAULT_DEADLINE) {
+    gchar *deadline;
+
+    deadline = g_strdup_printf ("%d", rss_feed_get_deadline ());
+    xmlNewProp (root, (const xmlChar *) "sync-deadline",
+                (const xmlChar *) deadline);
+    g_free (deadline);
+  }
+
+  set_uint_prop (root, "memory-budget",
+                 feed_menu_get_memory_budget () / 1024);
+
+  if (rss_feed_get_filter () != NULL) {
+    FeedFilter *filter = rss_feed_get_filter ();
+
+    for (i = 0; i < feed_filter_get_n_rules (filter); i++) {
+      const gchar *pattern;
+      gboolean     regex;
+      xmlNodePtr   node;
+
+      pattern = feed_filter_get_rule (filter, i, &regex);
+      node = xmlNewTextChild (root, NULL, (const xmlChar *) "filter",
+                              (const xmlChar *) pattern);
+      if (regex) {
+        xmlNewProp (node, (const xmlChar *) "type",
+                    (const xmlChar *) "regex");
+      }
+    }
+  }
+
+  for (i = 0; i < feeds_get_count (); i++) {
+    Feed       *feed = feeds_get (i);
+    xmlNodePtr  node;
 
     node = xmlNewNode (NULL, (const xmlChar *) "feed");
     g_assert (node != NULL);
 
+    set_uint_prop (node, "max-items", feed->max_items);
+    set_uint_prop (node, "max-age", feed->max_age);
+    set_uint_prop (node, "sync-deadline", feed->sync_deadline);
+
     xmlNewChild (node, NULL, (const xmlChar *) "title",
-                 (const xmlChar *) ((Feed *)ptr->data)->title);
+                 (const xmlChar *) feed->title);
 
     xmlNewChild (node, NULL, (const xmlChar *) "source",
-                 (const xmlChar *) ((Feed *)ptr->data)->source);
+                 (const xmlChar *) feed->source);
 
     xmlAddChild (root, node);
   }
@@ -160,25 +709,96 @@ save_feeds ()
 
   g_free (filename);
   xmlFreeDoc (doc);
+
+  save_validators ();
+  rss_feed_save_index ();
+}
+
+/* State of an OPML import. */
+typedef struct {
+  guint n_added;
+  guint n_skipped;          /* feeds already subscribed to */
+} Import;
+
+/* OPML reader callback which subscribes to the feed at URL, unless it is
+   already subscribed to. */
+static void
+import_feed (const gchar *title,
+             const gchar *url,
+             Import      *import)
+{
+  Feed *feed;
+
+  feed = feeds_add (title, url);
+  if (feed == NULL) {
+    import->n_skipped++;
+    return;
+  }
+
+  feed->dirty = TRUE;
+  add_menu (feed);
+  import->n_added++;
+}
+
+gint
+import_feeds (const gchar  *filename,
+              GError      **error)
+{
+  Import    import = { 0, 0 };
+  GTimer   *timer;
+  gboolean  result;
+
+  g_assert (filename != NULL);
+
+  /* The feeds read before an error are kept. */
+  timer = g_timer_new ();
+  result = opml_read (filename, (OpmlFeedFunc) import_feed, &import, error);
+
+  g_debug ("Imported %u feeds from %s in %.1f ms; %u were subscribed to "
+           "already.", import.n_added, filename,
+           g_timer_elapsed (timer, NULL) * 1000.0, import.n_skipped);
+  g_timer_destroy (timer);
+
+  if (import.n_added > 0) {
+    sync_feeds ();
+  }
+
+  return result ? (gint) import.n_added : -1;
+}
+
+gboolean
+export_feeds (const gchar  *filename,
+              GError      **error)
+{
+  OpmlWriter *writer;
+  guint       i;
+
+  g_assert (filename != NULL);
+
+  writer = opml_writer_new (filename, "GTK Feed Reader subscriptions", error);
+  if (writer == NULL) {
+    return FALSE;
+  }
+
+  for (i = 0; i < feeds_get_count (); i++) {
+    Feed *feed = feeds_get (i);
+
+    opml_writer_add (writer, feed->title, feed->source);
+  }
+
+  return opml_writer_close (writer, error);
 }
 
 void
 sync_feeds ()
 {
-  GList *ptr;
-  for (ptr = g_list_first (feeds);
-       ptr!= NULL;
-       ptr = g_list_next (ptr)) {
-    if (((Feed*)ptr->data)->dirty) {
-      RSSFeedParser *parser;
-      parser = g_new (RSSFeedParser, 1);
-      parser->menu = ((Feed*)ptr->data)->menu;
-      parser->source = ((Feed*)ptr->data)->source;
-      ((Feed*)ptr->data)->dirty = FALSE;
-      if (g_thread_create ((GThreadFunc) rss_feed_parser,
-                           parser, FALSE, NULL) == NULL) {
-        g_critical ("Failed to create parse thread for %s", parser->source);
-        g_free (parser);
+  guint i;
+  for (i = 0; i < feeds_get_count (); i++) {
+    Feed *feed = feeds_get (i);
+    if (feed->dirty) {
+      feed->dirty = FALSE;
+      if (!rss_feed_sync (feed)) {
+        scheduler_feed_done (feed, FALSE);
       }
     }
   }
@@ -187,10 +807,8 @@ sync_feeds ()
 void
 flush_feeds ()
 {
-  GList *ptr;
-  for (ptr = g_list_first (feeds);
-       ptr!= NULL;
-       ptr = g_list_next (ptr)) {
-    ((Feed*)ptr->data)->dirty = TRUE;
+  guint i;
+  for (i = 0; i < feeds_get_count (); i++) {
+    feeds_get (i)->dirty = TRUE;
   }
 }
@@ -20,6 +20,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <gtk/gtk.h>
 
+#include "feedparser.h"
+#include "feedsync.h"
+
 /*
  * Web feeds are Internet resources which contain news articles.  Each news
  * article contains a title, a description and a link to the web page
@@ -27,43 +30,173 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
  * information, but these are ignored.
  *
  * In practice, web feeds are XML documents.  Currently, there are three
- * different web feed standards in use: RSS 0.91, RSS/RDF 1.0 and Atom.  At
- * the moment, gtk-feed tries only to handle RSS 0.91 and it's variants.
+ * different web feed standards in use: RSS 0.91, RSS/RDF 1.0 and Atom.
+ * gtk-feed handles all of them, see feedparser.h.
  */
 
+/*
+ * Sync statistics of a feed, shown in the Feeds dialog.
+ */
+typedef struct {
+  FeedSyncStats  sync;          /* measurements of the last sync job */
+  gdouble        apply_time;    /* seconds spent applying the last sync job
+                                   in the main thread */
+  time_t         last_success;  /* time of the last successful sync, or
+                                   zero */
+  gchar         *last_error;    /* reason of the last failed sync, or NULL */
+} FeedStats;
+
 /*
  * Web feed structure.
  */
 typedef struct {
-  gchar     *title;     /* feed's title */
-  gchar     *source;    /* feed's URL */
-  gboolean   dirty;     /* if TRUE, the feed needs resynching */
-  GtkWidget *menu;      /* feed's menu item */
+  guint         id;            /* feed's ID in the registry, never reused */
+  guint         index;         /* feed's position in the registry */
+  gchar        *title;         /* feed's title */
+  gchar        *source;        /* feed's URL */
+  guint32       owner;         /* owner of the feed's articles in the set of
+                                  seen articles and the search index */
+  gboolean      dirty;         /* if TRUE, the feed needs resynching */
+  GtkWidget    *menu;          /* feed's menu item */
+  gchar        *etag;          /* HTTP ETag of the last fetch, or NULL */
+  gchar        *last_modified; /* HTTP Last-Modified of the last fetch, or
+                                  NULL */
+  guint64       fingerprint;   /* hash of the last fetched document */
+  FeedArticles *articles;      /* current generation of articles, see
+                                  feedmenu.h */
+  guint         max_items;     /* number of articles to keep, or zero for
+                                  all */
+  guint         max_age;       /* age in days of the oldest article to
+                                  keep, or zero for any */
+  guint         sync_deadline; /* seconds a sync may take, or zero for
+                                  the default, see rssfeed.h */
+  CancelToken  *cancel;        /* token of the sync job in flight, or
+                                  NULL */
+  time_t        last_viewed;   /* time the submenu was last shown, or zero
+                                  if never */
+  GHashTable   *items;         /* article key to menu item, or NULL if the
+                                  submenu is not built */
+  guint         n_unread;      /* number of current articles not read */
+  guint         release_id;    /* submenu release timeout, or zero */
+  FeedChannel   channel;       /* scheduling hints of the last fetch */
+  guint         failures;      /* number of consecutive failed fetches */
+  time_t        next_due;      /* time of the next scheduled sync, or zero
+                                  if not scheduled, see scheduler.h */
+  guint         queue_index;   /* position in the scheduler's queue */
+  FeedStats     stats;         /* sync statistics */
 } Feed;
 
 /*
- * List of feeds.
+ * Feed registry.
+ *
+ * The feeds subscribed to are kept in an array in subscription order, which
+ * is also the order of the feeds menu and feeds.xml.  Each feed is given an
+ * ID when it is added, which is not reused for another feed while the
+ * program runs, so a feed can be referred to by its ID where it may be
+ * deleted in the meantime.  The feeds are indexed by ID, by owner and by
+ * source URL; the URLs are compared with the scheme and host in lower case
+ * and without a fragment, so a feed cannot be subscribed to twice.
+ *
+ * To walk the feeds:
+ *
+ *   for (i = 0; i < feeds_get_count (); i++) {
+ *     Feed *feed = feeds_get (i);
+ *     ...
+ *   }
+ */
+
+/*
+ * Creates a feed with TITLE and SOURCE and appends it to the registry.
+ * Returns NULL if a feed with the same source is already registered.
+ */
+Feed *   feeds_add           (const gchar *title,
+                              const gchar *source);
+
+/*
+ * Removes FEED from the registry.  The feed is not freed.
+ */
+void     feeds_remove        (Feed        *feed);
+
+/*
+ * Returns the number of feeds.
+ */
+guint    feeds_get_count     ();
+
+/*
+ * Returns the feed at INDEX, which must be less than feeds_get_count ().
+ */
+Feed *   feeds_get           (guint        index);
+
+/*
+ * Returns the feed with ID, or NULL if there is none.
+ */
+Feed *   feeds_lookup        (guint        id);
+
+/*
+ * Returns the feed whose articles are owned by OWNER, see Feed, or NULL if
+ * there is none.
+ */
+Feed *   feeds_lookup_owner  (guint32      owner);
+
+/*
+ * Returns the feed whose source is SOURCE, or NULL if there is none.
  */
-extern GList *feeds;
+Feed *   feeds_lookup_source (const gchar *source);
 
 /*
  * Loads the feed sources which the user has configured from the file
  * '$XDG_CONFIG/gtk-feed/feeds.xml' and builds the corresponding data
- * structures to 'feeds' list.  This function also calls sync_feeds to
- * automatically synchronize them.
+ * structures in the feed registry.  The HTTP validators of the feeds are read
+ * from '$XDG_CONFIG/gtk-feed/validators'.  The feed menus are populated
+ * later, by load_cached_articles, and the feeds synchronized after that, by
+ * scheduler_start.
  */
 void load_feeds ();
 
+/*
+ * Populates the menus of the feeds from the article cache in
+ * '$XDG_CACHE_HOME/gtk-feed/', so they are usable before any network
+ * activity.  The feeds are loaded in slices of a few milliseconds, so the
+ * main loop stays responsive; returns TRUE if feeds remain, in which case
+ * it must be called again.  Feeds deleted or synchronized in the meantime
+ * are skipped.
+ */
+gboolean load_cached_articles ();
+
 /*
  * Saves the user configured feed data structures to the file
- * '$XDG_CONFIG/gtk-feed/feeds.xml'.
+ * '$XDG_CONFIG/gtk-feed/feeds.xml' and their HTTP validators to the file
+ * '$XDG_CONFIG/gtk-feed/validators'.  The search index is written to the
+ * cache directory if it has changed.
  */
 void save_feeds ();
 
+/*
+ * Subscribes to the feeds listed in the OPML file FILENAME, see opml.h,
+ * skipping those already subscribed to, and synchronizes the new feeds in
+ * a single batch.  Returns the number of feeds added, or -1 and sets ERROR
+ * if the file could not be read in full; the feeds read before the error
+ * are added.
+ */
+gint     import_feeds (const gchar  *filename,
+                       GError      **error);
+
+/*
+ * Writes the feeds subscribed to into the OPML file FILENAME.  Returns
+ * FALSE and sets ERROR if the file could not be written.
+ */
+gboolean export_feeds (const gchar  *filename,
+                       GError      **error);
+
 /*
  * Synchronises feeds which are marked as "dirty" by loading them from the
- * Internet.  This function will spawn background threads to synchronize
- * the feeds.
+ * Internet.  Feeds fetched over HTTP are requested conditionally with the
+ * validators of the previous fetch; if the server answers "304 Not
+ * Modified", the feed's menu is left as it is.  This function queues a job
+ * for each dirty feed on the sync engine's worker pool.  The pool size is
+ * taken from the "sync-threads" attribute of the <feeds> element in
+ * feeds.xml.  Once a job has finished, the feed is scheduled to be
+ * synchronized again, see scheduler.h.
  */
 void sync_feeds ();
 
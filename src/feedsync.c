@@ -0,0 +1,707 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <glib.h>
+#include <libxml/xmlIO.h>
+
+#include "articlecache.h"
+#include "feedsync.h"
+#include "hash.h"
+#include "http.h"
+
+/* Size of the chunks in which the feed document is read and parsed. */
+#define CHUNK_SIZE 4096
+
+/* Seconds a non-blocking job may go without any progress, and the
+   interval at which this is checked.  The token of a job which has one
+   is checked every CANCEL_TOKEN_CHECK_INTERVAL milliseconds instead. */
+#define SYNC_TIMEOUT           30
+#define TIMEOUT_CHECK_INTERVAL 5
+
+/* State of a single sync job. */
+typedef struct {
+  FeedSyncJob        *job;
+  gint64              oldest;       /* date of the oldest article to keep,
+                                       or zero */
+  HttpConnection     *connection;   /* connection of an HTTP source, or
+                                       NULL */
+  FeedParser         *parser;       /* parser of the document, or NULL
+                                       until it is read */
+  guint64             fingerprint;  /* hash of the document read so far */
+  GTimer             *timer;
+  GTimer             *total;        /* runs from the start of the job */
+
+  /* State of a non-blocking job. */
+  FeedSyncFunc        finished;     /* completion callback */
+  guint               watch;        /* socket watch, or zero */
+  gint                watched_fd;
+  GIOCondition        watched_condition;
+  guint               timeout;      /* timeout source, or zero */
+  time_t              last_activity;
+} SyncState;
+
+/* Article callback of the sync jobs.  Records a copy of ITEM for the
+   owner of the job, claims it in the pending generation of the owner and
+   adds it to the search index, unless the article is filtered out,
+   expired or claimed by another feed.  Duplicates are dropped before the
+   maximum number of articles is applied, so they do not count against
+   it.  The article is cached only once the document turns out to have
+   changed; see commit_items(). */
+static void
+add_item (const FeedItem *item,
+          SyncState      *state)
+{
+  FeedSyncJob *job = state->job;
+  guint64      hash = 0;
+
+  g_assert (item != NULL);
+  g_assert (state != NULL);
+
+  if (job->filter != NULL && feed_filter_match (job->filter, item)) {
+    job->stats.n_filtered++;
+    return;
+  }
+
+  /* Articles without a date are never too old. */
+  if (item->date != 0 && item->date < state->oldest) {
+    job->stats.n_expired++;
+    return;
+  }
+
+  if (job->seen != NULL) {
+    guint32 owner;
+
+    hash = feed_item_hash (item);
+    owner = item_set_lookup (job->seen, hash);
+    if (owner != 0 && owner != job->owner) {
+      job->stats.n_duplicates++;
+      return;
+    }
+  }
+
+  if (job->max_items > 0 && job->articles->items->len >= job->max_items) {
+    job->stats.n_expired++;
+    return;
+  }
+
+  /* Another feed may have claimed the article since the lookup. */
+  if (job->seen != NULL && !item_set_claim (job->seen, hash, job->owner)) {
+    job->stats.n_duplicates++;
+    return;
+  }
+
+  /* The description is indexed now, while the parser still has it, so
+     it is never copied.  Articles already in the index, such as all those
+     of an unchanged document, are only looked up. */
+  if (job->index != NULL) {
+    search_index_add (job->index, item, job->owner);
+  }
+
+  feed_articles_add (job->articles, item);
+}
+
+/* Commits the articles of the changed document of the job as the new
+   generation of its owner, releasing the articles of the previous one
+   and removing them from the search index, and writes them to the
+   article cache. */
+static void
+commit_items (SyncState *state)
+{
+  FeedSyncJob        *job = state->job;
+  ArticleCacheWriter *cache;
+  guint               i;
+
+  if (job->seen != NULL) {
+    guint64 *hashes;
+
+    hashes = g_new (guint64, MAX (job->articles->items->len, 1));
+    for (i = 0; i < job->articles->items->len; i++) {
+      hashes[i] = feed_item_hash (feed_articles_get (job->articles, i));
+    }
+    item_set_commit (job->seen, job->owner, hashes,
+                     job->articles->items->len);
+    g_free (hashes);
+  }
+
+  if (job->index != NULL) {
+    search_index_commit (job->index, job->owner);
+  }
+
+  cache = job->cache ? article_cache_writer_new (job->source) : NULL;
+
+  for (i = 0; i < job->articles->items->len; i++) {
+    FeedItem *item = feed_articles_get (job->articles, i);
+
+    if (cache != NULL) {
+      article_cache_writer_add (cache, item);
+    }
+  }
+
+  if (cache != NULL) {
+    article_cache_writer_set_fingerprint (cache, state->fingerprint);
+    article_cache_writer_commit (cache);
+    article_cache_writer_free (cache);
+  }
+}
+
+FeedSyncJob *
+feed_sync_job_new (const gchar  *source,
+                   FeedSyncFunc  done,
+                   gpointer      user_data)
+{
+  FeedSyncJob *job;
+
+  g_assert (source != NULL);
+
+  job = g_new0 (FeedSyncJob, 1);
+  job->source = g_strdup (source);
+  job->cache = TRUE;
+  job->done = done;
+  job->user_data = user_data;
+  job->status = FEED_SYNC_FAILED;
+
+  return job;
+}
+
+/* Marks JOB as failed and records the reason. */
+static void
+fail (FeedSyncJob *job,
+      const gchar *format,
+      ...)
+{
+  va_list args;
+
+  job->status = FEED_SYNC_FAILED;
+
+  g_free (job->error);
+  va_start (args, format);
+  job->error = g_strdup_vprintf (format, args);
+  va_end (args);
+
+  g_warning ("Failed to read %s: %s", job->source, job->error);
+}
+
+/* Sets the outcome of JOB if its cancellation token has been cancelled or
+   has expired.  Returns TRUE if so. */
+static gboolean
+check_cancel (FeedSyncJob *job)
+{
+  switch (cancel_token_get_state (job->cancel)) {
+  case CANCEL_TOKEN_CANCELLED:
+    g_debug ("Sync of %s cancelled", job->source);
+    job->status = FEED_SYNC_CANCELLED;
+    g_free (job->error);
+    job->error = g_strdup ("Cancelled");
+    return TRUE;
+
+  case CANCEL_TOKEN_EXPIRED:
+    fail (job, "Sync deadline exceeded");
+    return TRUE;
+
+  default:
+    return FALSE;
+  }
+}
+
+/* Prepares STATE for running JOB and clears the outcome of JOB. */
+static void
+begin_job (SyncState   *state,
+           FeedSyncJob *job)
+{
+  g_assert (job != NULL);
+  g_assert (job->articles == NULL);
+
+  memset (state, 0, sizeof (*state));
+  state->job = job;
+  state->timer = g_timer_new ();
+  state->total = g_timer_new ();
+
+  job->status = FEED_SYNC_FAILED;
+  memset (&job->stats, 0, sizeof (job->stats));
+  g_free (job->error);
+  job->error = NULL;
+}
+
+/* Checks the response to the HTTP request of the job.  Returns TRUE if
+   the document follows; otherwise sets the outcome of the job and closes
+   the connection. */
+static gboolean
+check_response (SyncState *state)
+{
+  const HttpResponse *response;
+
+  response = http_get_response (state->connection);
+  if (response->status == 304) {
+    /* Nothing has changed; skip the download, the parse and the menu
+       rebuild. */
+    g_debug ("%s not modified", state->job->source);
+    state->job->status = FEED_SYNC_NOT_MODIFIED;
+  } else if (response->status != 200) {
+    fail (state->job, "HTTP status %d", response->status);
+  } else {
+    return TRUE;
+  }
+
+  http_close (state->connection);
+  state->connection = NULL;
+
+  return FALSE;
+}
+
+/* Sets up parsing the document of the job. */
+static void
+begin_parse (SyncState *state)
+{
+  FeedSyncJob *job = state->job;
+  guint        fields;
+
+  g_debug ("Reading %s", job->source);
+
+  state->oldest = job->max_age > 0 ? time (NULL) - job->max_age : 0;
+  job->articles = feed_articles_new ();
+  if (job->seen != NULL) {
+    item_set_begin (job->seen, job->owner);
+  }
+  if (job->index != NULL) {
+    search_index_begin (job->index, job->owner);
+  }
+
+  /* The articles are collected as plain records; the menu is built by the
+     main thread once the whole feed has been read. */
+  fields = FEED_FIELD_TITLE | FEED_FIELD_LINK |
+           FEED_FIELD_GUID | FEED_FIELD_DATE;
+  if (job->index != NULL || job->filter != NULL) {
+    fields |= FEED_FIELD_DESCRIPTION;
+  }
+
+  state->parser = feed_parser_new (job->source,
+                                   fields,
+                                   (FeedItemFunc) add_item,
+                                   state);
+
+  /* The fingerprint of the document is computed as it is read. */
+  state->fingerprint = HASH64_INIT;
+}
+
+/* Parses the next LENGTH bytes of the document.  Returns FALSE if the
+   document is not well-formed. */
+static gboolean
+parse_chunk (SyncState   *state,
+             const gchar *buffer,
+             gint         length)
+{
+  gboolean success;
+
+  state->job->stats.bytes += length;
+  state->fingerprint = hash64_update (state->fingerprint, buffer, length);
+
+  g_timer_start (state->timer);
+  success = feed_parser_feed (state->parser, buffer, length);
+  state->job->stats.parse_time += g_timer_elapsed (state->timer, NULL);
+
+  return success;
+}
+
+/* Finishes parsing the document and sets the outcome of the job.  ERROR
+   tells why the document could not be read in full, unless the job was
+   cancelled, or is NULL. */
+static void
+end_parse (SyncState   *state,
+           const gchar *error)
+{
+  FeedSyncJob *job = state->job;
+  gboolean     success;
+
+  if (error != NULL) {
+    if (!check_cancel (job)) {
+      fail (job, "%s", error);
+    }
+    success = FALSE;
+  } else {
+    g_timer_start (state->timer);
+    success = feed_parser_finish (state->parser);
+    job->stats.parse_time += g_timer_elapsed (state->timer, NULL);
+
+    if (!success) {
+      fail (job, "Not a well-formed web feed");
+    }
+  }
+
+  /* Report the articles and remember them and the validators only if the
+     whole document was read, so a failed fetch is retried in full.  A
+     document identical to the previous one needs no further work; in
+     particular its articles are not cached again, and their claims stay
+     with the current generation. */
+  if (success) {
+    job->channel = *feed_parser_get_channel (state->parser);
+  }
+
+  if (success && state->fingerprint == job->fingerprint) {
+    g_debug ("%s unchanged", job->source);
+    job->status = FEED_SYNC_UNCHANGED;
+    feed_articles_free (job->articles);
+    job->articles = NULL;
+  } else if (success) {
+    job->status = FEED_SYNC_CHANGED;
+    job->fingerprint = state->fingerprint;
+    commit_items (state);
+    if (state->connection != NULL) {
+      const HttpResponse *response = http_get_response (state->connection);
+
+      if (response->etag != NULL || response->last_modified != NULL) {
+        g_free (job->etag);
+        g_free (job->last_modified);
+        job->etag = g_strdup (response->etag);
+        job->last_modified = g_strdup (response->last_modified);
+      }
+    }
+  } else {
+    feed_articles_free (job->articles);
+    job->articles = NULL;
+  }
+
+  if (job->seen != NULL && job->status != FEED_SYNC_CHANGED) {
+    item_set_abort (job->seen, job->owner);
+  }
+
+  job->stats.n_items = feed_parser_get_n_items (state->parser) -
+                       job->stats.n_duplicates - job->stats.n_filtered -
+                       job->stats.n_expired;
+
+  g_debug ("Done reading %s (%s, %u items, %u duplicates, %u filtered, "
+           "%u expired)",
+           job->source,
+           feed_format_get_name (feed_parser_get_format (state->parser)),
+           job->stats.n_items, job->stats.n_duplicates,
+           job->stats.n_filtered, job->stats.n_expired);
+
+  feed_parser_free (state->parser);
+  state->parser = NULL;
+}
+
+void
+feed_sync_run (FeedSyncJob *job)
+{
+  SyncState  state;
+  void      *input;
+  int      (*input_read) (void *, char *, int);
+  int      (*input_close) (void *);
+  gchar      buffer[CHUNK_SIZE];
+  int        length;
+
+  begin_job (&state, job);
+
+  /* A job cancelled while it was queued is not started at all.  Its
+     deadline counts from here. */
+  if (check_cancel (job)) {
+    goto cleanup;
+  }
+  cancel_token_start (job->cancel);
+
+  /* Open the document.  HTTP sources are fetched conditionally, other
+     sources are handed to libxml's own I/O handlers. */
+  if (http_match (job->source)) {
+    GError *error = NULL;
+
+    state.connection = http_open (job->source,
+                                  job->etag,
+                                  job->last_modified,
+                                  job->cancel,
+                                  &error);
+    job->stats.connect_time = g_timer_elapsed (state.timer, NULL);
+    if (state.connection == NULL) {
+      if (!check_cancel (job)) {
+        fail (job, "%s", error->message);
+      }
+      g_error_free (error);
+      goto cleanup;
+    }
+
+    if (!check_response (&state)) {
+      goto cleanup;
+    }
+
+    input = state.connection;
+    input_read = (int (*) (void *, char *, int)) http_read;
+    input_close = (int (*) (void *)) http_close;
+  } else {
+    input = xmlFileOpen (job->source);
+    input_read = xmlFileRead;
+    input_close = xmlFileClose;
+    job->stats.connect_time = g_timer_elapsed (state.timer, NULL);
+  }
+
+  if (input == NULL) {
+    fail (job, "Cannot open the document");
+    goto cleanup;
+  }
+
+  /* Parse the document as it arrives.  The time spent reading and parsing
+     is measured separately. */
+  begin_parse (&state);
+
+  for (;;) {
+    g_timer_start (state.timer);
+    length = input_read (input, buffer, sizeof (buffer));
+    job->stats.transfer_time += g_timer_elapsed (state.timer, NULL);
+
+    /* Local documents do not wait on the token, so check it here. */
+    if (length > 0 &&
+        cancel_token_get_state (job->cancel) != CANCEL_TOKEN_ACTIVE) {
+      length = -1;
+    }
+
+    if (length <= 0 || !parse_chunk (&state, buffer, length)) {
+      break;
+    }
+  }
+
+  end_parse (&state, length < 0 ? "Read error" : NULL);
+  input_close (input);
+
+ cleanup:
+  job->stats.total_time = g_timer_elapsed (state.total, NULL);
+  g_timer_destroy (state.timer);
+  g_timer_destroy (state.total);
+}
+
+/* Finishes the non-blocking job of STATE: removes its event sources,
+   closes its connection and passes the job to the callback. */
+static void
+complete (SyncState *state)
+{
+  if (state->watch != 0) {
+    g_source_remove (state->watch);
+  }
+  if (state->timeout != 0) {
+    g_source_remove (state->timeout);
+  }
+
+  if (state->connection != NULL) {
+    http_close (state->connection);
+  }
+  state->job->stats.total_time = g_timer_elapsed (state->total, NULL);
+  g_timer_destroy (state->timer);
+  g_timer_destroy (state->total);
+
+  state->finished (state->job);
+  g_free (state);
+}
+
+static gboolean on_ready (GIOChannel   *channel,
+                          GIOCondition  condition,
+                          SyncState    *state);
+
+/* Watches the socket of the non-blocking job of STATE for the condition
+   its HTTP connection waits for.  Returns TRUE if the current watch is
+   still the right one. */
+static gboolean
+watch (SyncState *state)
+{
+  GIOChannel   *channel;
+  GIOCondition  condition;
+  gint          fd;
+
+  fd = http_get_fd (state->connection, &condition);
+  if (state->watch != 0 && fd == state->watched_fd &&
+      condition == state->watched_condition) {
+    return TRUE;
+  }
+
+  if (state->watch != 0) {
+    g_source_remove (state->watch);
+  }
+
+  channel = g_io_channel_unix_new (fd);
+  state->watch = g_io_add_watch (channel,
+                                 condition | G_IO_HUP | G_IO_ERR,
+                                 (GIOFunc) on_ready,
+                                 state);
+  g_io_channel_unref (channel);
+
+  state->watched_fd = fd;
+  state->watched_condition = condition;
+
+  return FALSE;
+}
+
+/* Socket watch of the non-blocking jobs.  Advances the request until the
+   response headers have been read, and then parses whatever has arrived
+   of the document. */
+static gboolean
+on_ready (GIOChannel   *channel,
+          GIOCondition  condition,
+          SyncState    *state)
+{
+  FeedSyncJob *job = state->job;
+  gchar        buffer[CHUNK_SIZE];
+  gint         length;
+
+  state->last_activity = time (NULL);
+
+  if (state->parser == NULL) {
+    GError *error = NULL;
+
+    switch (http_step (state->connection, &error)) {
+    case HTTP_STEP_PENDING:
+      return watch (state);
+
+    case HTTP_STEP_FAILED:
+      fail (job, "%s", error->message);
+      g_error_free (error);
+      state->watch = 0;
+      complete (state);
+      return FALSE;
+
+    case HTTP_STEP_READY:
+      job->stats.connect_time = g_timer_elapsed (state->timer, NULL);
+      if (!check_response (state)) {
+        state->watch = 0;
+        complete (state);
+        return FALSE;
+      }
+      begin_parse (state);
+      break;
+    }
+  }
+
+  /* Read until the socket has nothing more; data may be left in the
+     buffers of the connection, which the watch would not tell of. */
+  for (;;) {
+    g_timer_start (state->timer);
+    length = http_read (state->connection, buffer, sizeof (buffer));
+    job->stats.transfer_time += g_timer_elapsed (state->timer, NULL);
+
+    if (length == HTTP_WOULD_BLOCK) {
+      return watch (state);
+    } else if (length <= 0 || !parse_chunk (state, buffer, length)) {
+      break;
+    }
+  }
+
+  end_parse (state, length < 0 ? "Read error" : NULL);
+  state->watch = 0;
+  complete (state);
+
+  return FALSE;
+}
+
+/* Timeout of the non-blocking jobs.  Ends the job if its token has been
+   cancelled or has expired, and fails it if its connection has been idle
+   for too long. */
+static gboolean
+on_timeout (SyncState *state)
+{
+  if (cancel_token_get_state (state->job->cancel) == CANCEL_TOKEN_ACTIVE &&
+      time (NULL) - state->last_activity < SYNC_TIMEOUT) {
+    return TRUE;
+  }
+
+  state->timeout = 0;
+
+  if (state->parser != NULL) {
+    end_parse (state, "Timed out");
+  } else if (!check_cancel (state->job)) {
+    fail (state->job, "Timed out");
+  }
+  complete (state);
+
+  return FALSE;
+}
+
+/* Idle callback which runs a job which cannot be run without blocking,
+   or reports a job which failed to start. */
+static gboolean
+run_later (SyncState *state)
+{
+  if (!http_match (state->job->source)) {
+    feed_sync_run (state->job);
+  }
+
+  complete (state);
+
+  return FALSE;
+}
+
+void
+feed_sync_start (FeedSyncJob  *job,
+                 FeedSyncFunc  finished)
+{
+  SyncState *state;
+  GError    *error = NULL;
+
+  g_assert (finished != NULL);
+
+  state = g_new (SyncState, 1);
+  begin_job (state, job);
+  state->finished = finished;
+  cancel_token_start (job->cancel);
+
+  if (!check_cancel (job) && http_match (job->source)) {
+    state->connection = http_open_async (job->source,
+                                         job->etag,
+                                         job->last_modified,
+                                         &error);
+    if (state->connection != NULL) {
+      state->last_activity = time (NULL);
+      watch (state);
+      if (job->cancel != NULL) {
+        state->timeout = g_timeout_add (CANCEL_TOKEN_CHECK_INTERVAL,
+                                        (GSourceFunc) on_timeout,
+                                        state);
+      } else {
+        state->timeout = g_timeout_add_seconds (TIMEOUT_CHECK_INTERVAL,
+                                                (GSourceFunc) on_timeout,
+                                                state);
+      }
+      return;
+    }
+
+    fail (job, "%s", error->message);
+    g_error_free (error);
+  }
+
+  /* Local documents are read at once, and cancelled jobs and jobs which
+     failed to start are reported.  The callback is always called from the
+     main loop, never from this function. */
+  g_idle_add ((GSourceFunc) run_later, state);
+}
+
+void
+feed_sync_job_free (FeedSyncJob *job)
+{
+  if (job == NULL) {
+    return;
+  }
+
+  feed_articles_free (job->articles);
+  g_free (job->error);
+  g_free (job->source);
+  g_free (job->etag);
+  g_free (job->last_modified);
+  if (job->cancel != NULL) {
+    cancel_token_unref (job->cancel);
+  }
+  g_free (job);
+}
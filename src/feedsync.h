@@ -0,0 +1,170 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FEEDSYNC_H
+#define FEEDSYNC_H
+
+#include <glib.h>
+
+#include "canceltoken.h"
+#include "feedfilter.h"
+#include "feedparser.h"
+#include "itemset.h"
+#include "searchindex.h"
+
+/*
+ * Feed sync jobs.
+ *
+ * A sync job fetches a single feed document and streams it through the
+ * feed parser, collecting the articles as a new generation.  HTTP sources
+ * are fetched conditionally with the validators of the previous fetch, and
+ * a document whose fingerprint matches that of the previous fetch is not
+ * reported as changed.  Other sources are read with libxml's own I/O
+ * handlers.  If the job has a filter, articles matching it are dropped as
+ * soon as they are parsed, before anything is copied.  If the job has a
+ * set of seen articles, articles claimed by other feeds are dropped as
+ * duplicates as soon as they are parsed, and the others are claimed in a
+ * pending generation of the feed.  Articles older than the maximum age of
+ * the job, and articles beyond its maximum number, are dropped in the same
+ * way, so feeds of thousands of articles cost no more than the articles
+ * kept; feeds list their newest articles first, so the first ones are
+ * kept, and duplicates do not count against the maximum.  The articles
+ * kept are added to the search index, descriptions included, as soon as
+ * they are parsed, so no description is held beyond its article; articles
+ * already in the index are only looked up.  Only once the document turns
+ * out to have changed is the pending generation committed in the set of
+ * seen articles and in the search index, which removes the articles the
+ * feed no longer has from both, and are the articles written to the
+ * article cache; for an unchanged document the pending generation is
+ * dropped, and nothing is removed or written.
+ *
+ * A job is either run to completion on the calling thread, blocking on
+ * the network, or started on the GLib main loop, where it advances
+ * without blocking as its socket becomes ready: each chunk of the
+ * document is parsed as soon as it arrives, so any number of jobs can
+ * overlap their transfers and parses on a single thread.
+ *
+ * A job may carry a cancellation token, see canceltoken.h.  The job checks
+ * it before it starts, while it waits on the network and between the
+ * chunks of the document, and ends as soon as the token is cancelled or
+ * its deadline passes, keeping the articles of the previous sync.  A job
+ * whose token expires fails as timed out; one whose token is cancelled
+ * ends as cancelled.
+ *
+ * Sync jobs do not depend on GTK.  They may be run on any thread, and
+ * outside of the application, for example by the benchmarks.
+ */
+
+/*
+ * Outcome of a sync job.
+ */
+typedef enum {
+  FEED_SYNC_CHANGED,        /* a new version of the feed was read */
+  FEED_SYNC_UNCHANGED,      /* the document was read but had not changed */
+  FEED_SYNC_NOT_MODIFIED,   /* the server reported the feed not modified */
+  FEED_SYNC_FAILED,         /* the feed could not be read */
+  FEED_SYNC_CANCELLED       /* the job was cancelled before it ended */
+} FeedSyncStatus;
+
+/*
+ * Measurements of a sync job.
+ */
+typedef struct {
+  gdouble connect_time;     /* seconds spent opening the document */
+  gdouble transfer_time;    /* seconds spent reading the document */
+  gdouble parse_time;       /* seconds spent parsing the document */
+  gdouble total_time;       /* seconds from the start of the job to its
+                               end, waits included */
+  gsize   bytes;            /* size of the document read */
+  guint   n_items;          /* number of articles read */
+  guint   n_duplicates;     /* number of articles dropped as duplicates */
+  guint   n_filtered;       /* number of articles dropped by the filter */
+  guint   n_expired;        /* number of articles dropped as too old or
+                               too many */
+} FeedSyncStats;
+
+typedef struct _FeedSyncJob FeedSyncJob;
+
+/*
+ * Callback which is called when JOB has been run.  The callback takes
+ * ownership of JOB.
+ */
+typedef void (*FeedSyncFunc) (FeedSyncJob *job);
+
+/*
+ * Sync job structure.  The strings are owned by the job.
+ */
+struct _FeedSyncJob {
+  gchar          *source;        /* feed's URL */
+  gchar          *etag;          /* HTTP validators of the previous fetch, */
+  gchar          *last_modified; /* replaced by the new ones if changed */
+  guint64         fingerprint;   /* fingerprint of the previous fetch,
+                                    replaced by the new one if changed */
+  gboolean        cache;         /* if TRUE, a changed feed is written to
+                                    the article cache */
+  FeedFilter     *filter;        /* articles to drop, or NULL */
+  guint           max_items;     /* number of articles to keep, or zero
+                                    for all */
+  gint64          max_age;       /* age in seconds of the oldest article
+                                    to keep, or zero for any */
+  ItemSet        *seen;          /* articles seen in all feeds, or NULL */
+  guint32         owner;         /* identifier of the feed in SEEN and
+                                    INDEX */
+  SearchIndex    *index;         /* search index, or NULL */
+  CancelToken    *cancel;        /* cancellation token, or NULL; the job
+                                    holds a reference to it */
+  FeedSyncFunc    done;          /* completion callback, or NULL */
+  gpointer        user_data;     /* data of the callback */
+
+  FeedSyncStatus  status;        /* outcome of the job */
+  FeedArticles   *articles;      /* new articles if changed, or NULL */
+  FeedChannel     channel;       /* channel properties, valid if the
+                                    document was read */
+  FeedSyncStats   stats;         /* measurements of the job */
+  gchar          *error;         /* message telling why the job failed, or
+                                    NULL */
+};
+
+/*
+ * Creates a job which syncs the feed SOURCE and then calls DONE, if not
+ * NULL.  The article cache is written by default.
+ */
+FeedSyncJob * feed_sync_job_new  (const gchar  *source,
+                                  FeedSyncFunc  done,
+                                  gpointer      user_data);
+
+/*
+ * Runs JOB in the calling thread and sets its outcome.  Does not call the
+ * completion callback.
+ */
+void          feed_sync_run      (FeedSyncJob  *job);
+
+/*
+ * Starts JOB on the default main loop and calls FINISHED with it from the
+ * main loop once it has been run.  Only HTTP sources are read without
+ * blocking; other sources are read at once in a single main loop
+ * callback.  The completion callback of JOB is not called.
+ */
+void          feed_sync_start    (FeedSyncJob  *job,
+                                  FeedSyncFunc  finished);
+
+/*
+ * Destroys JOB and its articles.
+ */
+void          feed_sync_job_free (FeedSyncJob  *job);
+
+#endif
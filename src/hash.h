@@ -0,0 +1,34 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <glib.h>
+
+/*
+ * 64-bit FNV-1a hashing.  The hash can be computed incrementally by
+ * passing the previous result to hash64_update.
+ */
+
+#define HASH64_INIT G_GUINT64_CONSTANT(0xcbf29ce484222325)
+
+guint64 hash64_update (guint64       hash,
+                       gconstpointer data,
+                       gsize         length);
+
+#endif
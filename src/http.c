@@ -0,0 +1,1506 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <glib.h>
+#include <libxml/uri.h>
+#include <libxml/xmlmemory.h>
+#include <zlib.h>
+
+#include "canceltoken.h"
+#include "http.h"
+
+/* Maximum number of redirects followed. */
+#define MAX_REDIRECTS 5
+
+/* Maximum size of the response headers. */
+#define MAX_HEADER_SIZE (64 * 1024)
+
+/* Seconds allowed for connecting to a server, and for each send and
+   receive on a connection. */
+#define CONNECT_TIMEOUT 15
+#define IO_TIMEOUT      30
+
+/* Maximum number of idle connections kept per server, and the seconds
+   they are kept.  Servers close idle connections after a while anyway. */
+#define MAX_IDLE_PER_SERVER 4
+#define IDLE_TIMEOUT        30
+
+/* Maximum number of body bytes read and discarded to make a connection
+   reusable, for example the body of a redirect. */
+#define MAX_DRAIN_SIZE (16 * 1024)
+
+/* Size of the buffers of received and compressed data. */
+#define BUFFER_SIZE 4096
+
+/* Value returned by the reading functions when a non-blocking socket has
+   no data yet. */
+#define WOULD_BLOCK HTTP_WOULD_BLOCK
+
+/* Progress of a request on a non-blocking connection. */
+typedef enum {
+  PHASE_CONNECTING,     /* waiting for the connection to be established */
+  PHASE_SENDING,        /* sending the request */
+  PHASE_HEADERS,        /* reading the response headers */
+  PHASE_BODY            /* the response body can be read */
+} HttpPhase;
+
+/* Connection state.  BUFFER holds data which has been received but not
+   yet consumed; after the headers have been parsed, it holds the start of
+   the response body.  REMAINING is the number of body bytes still to be
+   read, of the current chunk if the body is chunked, or -1 if the body
+   extends to the end of the connection. */
+struct _HttpConnection {
+  gint          fd;
+  gchar        *server;         /* "host:port" of the server */
+  GString      *buffer;
+  gint64        remaining;
+  gboolean      chunked;        /* if TRUE, the body is chunked */
+  gboolean      chunk_end;      /* if TRUE, a line break ends the chunk
+                                   just read */
+  gboolean      trailer;        /* if TRUE, the last chunk has been read
+                                   and the trailer is being skipped */
+  gboolean      done;           /* if TRUE, the body has been read */
+  gboolean      keep_alive;     /* if TRUE, the server keeps the
+                                   connection open after the body */
+  z_stream     *inflater;       /* decompressor of the body, or NULL */
+  gchar        *compressed;     /* compressed data for INFLATER */
+  gboolean      inflated;       /* if TRUE, INFLATER has reached the end
+                                   of the compressed data */
+  guint64       n_received;     /* body bytes received */
+  guint64       n_decoded;      /* body bytes returned to the caller */
+  HttpResponse  response;
+  gchar        *etag;
+  gchar        *last_modified;
+  CancelToken  *cancel;         /* token checked by the blocking waits, or
+                                   NULL */
+
+  /* State of a request on a non-blocking connection. */
+  gboolean      async;          /* if TRUE, the socket does not block */
+  HttpPhase     phase;
+  gboolean      reused;         /* if TRUE, the socket was taken from the
+                                   pool */
+  struct addrinfo *addresses;   /* addresses of the server while
+                                   connecting, or NULL */
+  struct addrinfo *address;     /* address being connected to */
+  gchar        *url;            /* URL requested */
+  gchar        *request_etag;   /* validators of the request */
+  gchar        *request_last_modified;
+  GString      *request;        /* request being sent */
+  gsize         n_sent;         /* bytes of REQUEST sent */
+  gint          redirects;      /* number of redirects followed */
+};
+
+/* Parsed URL. */
+typedef struct {
+  gchar *host;
+  gchar *port;
+  gchar *path;
+} HttpUrl;
+
+/* Connection kept for reuse. */
+typedef struct {
+  gint   fd;
+  time_t since;         /* time the connection became idle */
+} IdleConnection;
+
+/* Idle connections by server, each a queue of IdleConnection records,
+   newest first, and the counters of the client. */
+static GHashTable   *pool = NULL;
+static HttpStats     stats;
+static GStaticMutex  pool_mutex = G_STATIC_MUTEX_INIT;
+
+GQuark
+http_error_quark (void)
+{
+  return g_quark_from_static_string ("http-error-quark");
+}
+
+gboolean
+http_match (const gchar *url)
+{
+  return url != NULL && g_ascii_strncasecmp (url, "http://", 7) == 0;
+}
+
+/* Splits URL into host, port and path.  Returns FALSE if URL is not an
+   HTTP URL. */
+static gboolean
+parse_url (const gchar *url,
+           HttpUrl     *parts)
+{
+  const gchar *host, *path, *port;
+
+  if (!http_match (url)) {
+    return FALSE;
+  }
+
+  host = url + 7;
+  path = strchr (host, '/');
+  if (path == NULL) {
+    path = host + strlen (host);
+  }
+
+  port = memchr (host, ':', path - host);
+  if (port == host || path == host) {
+    return FALSE;
+  }
+
+  if (port != NULL) {
+    parts->host = g_strndup (host, port - host);
+    parts->port = g_strndup (port + 1, path - port - 1);
+  } else {
+    parts->host = g_strndup (host, path - host);
+    parts->port = g_strdup ("80");
+  }
+
+  parts->path = g_strdup (*path != '\0' ? path : "/");
+
+  return TRUE;
+}
+
+static void
+free_url (HttpUrl *parts)
+{
+  g_free (parts->host);
+  g_free (parts->port);
+  g_free (parts->path);
+}
+
+/* Returns TRUE if the idle connection FD may still be used.  An idle
+   connection has nothing to read unless the server has closed it. */
+static gboolean
+is_alive (gint fd)
+{
+  struct pollfd poll_fd;
+
+  poll_fd.fd = fd;
+  poll_fd.events = POLLIN;
+  poll_fd.revents = 0;
+
+  return poll (&poll_fd, 1, 0) == 0;
+}
+
+/* Takes an idle connection to SERVER from the pool.  Returns the socket
+   or -1 if there is none. */
+static gint
+pool_take (const gchar *server)
+{
+  GQueue *idle;
+  gint    fd = -1;
+
+  g_static_mutex_lock (&pool_mutex);
+
+  idle = pool != NULL ? g_hash_table_lookup (pool, server) : NULL;
+  while (fd < 0 && idle != NULL && !g_queue_is_empty (idle)) {
+    IdleConnection *connection = g_queue_pop_head (idle);
+
+    if (time (NULL) - connection->since < IDLE_TIMEOUT &&
+        is_alive (connection->fd)) {
+      fd = connection->fd;
+    } else {
+      close (connection->fd);
+    }
+    g_free (connection);
+  }
+
+  g_static_mutex_unlock (&pool_mutex);
+
+  return fd;
+}
+
+/* Makes reads and writes on the socket FD give up after IO_TIMEOUT
+   seconds when it blocks. */
+static void
+set_timeouts (gint fd)
+{
+  struct timeval timeout;
+
+  timeout.tv_sec = IO_TIMEOUT;
+  timeout.tv_usec = 0;
+  setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof (timeout));
+  setsockopt (fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof (timeout));
+}
+
+/* Puts the connection FD to SERVER in the pool, or closes it if the pool
+   has enough connections to SERVER already.  The connection may have
+   been made without blocking, so its timeouts are set for the blocking
+   requests which may take it. */
+static void
+pool_put (const gchar *server,
+          gint         fd)
+{
+  IdleConnection *connection;
+  GQueue         *idle;
+
+  g_static_mutex_lock (&pool_mutex);
+
+  if (pool == NULL) {
+    pool = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  }
+
+  idle = g_hash_table_lookup (pool, server);
+  if (idle == NULL) {
+    idle = g_queue_new ();
+    g_hash_table_insert (pool, g_strdup (server), idle);
+  }
+
+  if (g_queue_get_length (idle) < MAX_IDLE_PER_SERVER) {
+    set_timeouts (fd);
+    connection = g_new (IdleConnection, 1);
+    connection->fd = fd;
+    connection->since = time (NULL);
+    g_queue_push_head (idle, connection);
+  } else {
+    close (fd);
+  }
+
+  g_static_mutex_unlock (&pool_mutex);
+}
+
+/* Waits at most TIMEOUT seconds until FD is ready for EVENTS.  If CANCEL
+   is non-NULL, the wait is split into slices after each of which CANCEL
+   is checked, and does not go past its deadline.  Returns FALSE and sets
+   errno to ETIMEDOUT, ECANCELED or the error of poll if FD did not become
+   ready. */
+static gboolean
+wait_fd (gint         fd,
+         gshort       events,
+         gint         timeout,
+         CancelToken *cancel)
+{
+  struct pollfd poll_fd;
+  gint          left = timeout * 1000;
+
+  poll_fd.fd = fd;
+  poll_fd.events = events;
+
+  while (left > 0) {
+    gint slice = left;
+    gint status;
+
+    if (cancel != NULL) {
+      if (cancel_token_get_state (cancel) != CANCEL_TOKEN_ACTIVE) {
+        errno = ECANCELED;
+        return FALSE;
+      }
+      slice = cancel_token_get_wait (cancel,
+                                     MIN (slice, CANCEL_TOKEN_CHECK_INTERVAL));
+    }
+
+    poll_fd.revents = 0;
+    status = poll (&poll_fd, 1, slice);
+    if (status > 0) {
+      return TRUE;
+    } else if (status < 0) {
+      if (errno != EINTR) {
+        return FALSE;
+      }
+      continue;
+    }
+
+    left -= slice;
+  }
+
+  errno = ETIMEDOUT;
+  return FALSE;
+}
+
+/* Waits until the non-blocking connect on FD has finished, checking
+   CANCEL meanwhile.  Returns FALSE and sets errno if it failed, timed out
+   or was cancelled. */
+static gboolean
+wait_connected (gint         fd,
+                CancelToken *cancel)
+{
+  gint      result = 0;
+  socklen_t length = sizeof (result);
+
+  if (!wait_fd (fd, POLLOUT, CONNECT_TIMEOUT, cancel)) {
+    return FALSE;
+  }
+
+  if (getsockopt (fd, SOL_SOCKET, SO_ERROR, &result, &length) < 0) {
+    return FALSE;
+  } else if (result != 0) {
+    errno = result;
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Connects to HOST:PORT, giving up after CONNECT_TIMEOUT seconds or when
+   CANCEL is cancelled, and sets the timeouts of the connection.  Returns
+   the socket or -1 on failure. */
+static gint
+connect_to (const gchar  *host,
+            const gchar  *port,
+            CancelToken  *cancel,
+            GError      **error)
+{
+  struct addrinfo  hints, *result, *ai;
+  gint             fd = -1;
+  gint             status;
+  gint             flags;
+  gint             saved_errno = 0;
+
+  memset (&hints, 0, sizeof (hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  /* The resolver cannot be interrupted, so CANCEL is only checked once it
+     has answered; it gives up by itself after its own timeout. */
+  status = getaddrinfo (host, port, &hints, &result);
+  if (status != 0) {
+    g_set_error (error, HTTP_ERROR, HTTP_ERROR_CONNECT,
+                 "Failed to resolve %s: %s", host, gai_strerror (status));
+    return -1;
+  }
+
+  for (ai = result; ai != NULL; ai = ai->ai_next) {
+    fd = socket (ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) {
+      saved_errno = errno;
+      continue;
+    }
+
+    /* Connect without blocking, so the wait can be bounded. */
+    flags = fcntl (fd, F_GETFL);
+    fcntl (fd, F_SETFL, flags | O_NONBLOCK);
+    if (connect (fd, ai->ai_addr, ai->ai_addrlen) == 0 ||
+        (errno == EINPROGRESS && wait_connected (fd, cancel))) {
+      fcntl (fd, F_SETFL, flags);
+      break;
+    }
+
+    saved_errno = errno;
+    close (fd);
+    fd = -1;
+
+    if (saved_errno == ECANCELED) {
+      break;
+    }
+  }
+
+  freeaddrinfo (result);
+
+  if (fd < 0) {
+    g_set_error (error, HTTP_ERROR, HTTP_ERROR_CONNECT,
+                 "Failed to connect to %s:%s: %s", host, port,
+                 g_strerror (saved_errno));
+    return -1;
+  }
+
+  set_timeouts (fd);
+
+  return fd;
+}
+
+/* Writes all of DATA to FD.  If CANCEL is non-NULL, the socket is waited
+   for in slices, so the write stops when CANCEL is cancelled. */
+static gboolean
+write_all (gint          fd,
+           const gchar  *data,
+           gsize         length,
+           CancelToken  *cancel)
+{
+  while (length > 0) {
+    gssize written;
+
+    if (cancel != NULL && !wait_fd (fd, POLLOUT, IO_TIMEOUT, cancel)) {
+      return FALSE;
+    }
+
+    written = send (fd, data, length, MSG_NOSIGNAL);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return FALSE;
+    }
+
+    data += written;
+    length -= written;
+  }
+
+  return TRUE;
+}
+
+/* Reads more data from the connection into its buffer.  Returns the number
+   of bytes read, zero at the end of the connection, WOULD_BLOCK if the
+   connection does not block and has no data, or -1 on error, timeout or
+   cancellation. */
+static gssize
+fill_buffer (HttpConnection *connection)
+{
+  gchar  chunk[BUFFER_SIZE];
+  gssize length;
+
+  if (!connection->async && connection->cancel != NULL &&
+      !wait_fd (connection->fd, POLLIN, IO_TIMEOUT, connection->cancel)) {
+    return -1;
+  }
+
+  do {
+    length = recv (connection->fd, chunk, sizeof (chunk), 0);
+  } while (length < 0 && errno == EINTR);
+
+  if (length > 0) {
+    g_string_append_len (connection->buffer, chunk, length);
+  } else if (length < 0 && connection->async &&
+             (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    return WOULD_BLOCK;
+  }
+
+  return length;
+}
+
+/* Reads a line of the body, such as the size of a chunk, and stores it
+   without the line break in LINE, to be freed.  Returns 1, 0 on error or
+   WOULD_BLOCK, in which case nothing has been consumed. */
+static gint
+read_line (HttpConnection  *connection,
+           gchar          **line)
+{
+  gchar *end;
+
+  while ((end = memchr (connection->buffer->str, '\n',
+                        connection->buffer->len)) == NULL) {
+    gssize received;
+
+    if (connection->buffer->len > MAX_HEADER_SIZE) {
+      return 0;
+    }
+
+    received = fill_buffer (connection);
+    if (received <= 0) {
+      return received == WOULD_BLOCK ? WOULD_BLOCK : 0;
+    }
+  }
+
+  *line = g_strndup (connection->buffer->str, end - connection->buffer->str);
+  g_string_erase (connection->buffer, 0, end + 1 - connection->buffer->str);
+  g_strchomp (*line);
+
+  return 1;
+}
+
+/* Reads the size line of the next chunk of a chunked body, and the
+   trailer if it is the last chunk.  Returns 1, 0 if the body is malformed
+   or WOULD_BLOCK, in which case it may be called again once more data
+   has arrived. */
+static gint
+read_chunk_size (HttpConnection *connection)
+{
+  gchar   *line;
+  gchar   *end;
+  guint64  size;
+  gboolean valid;
+  gint     status;
+
+  if (connection->chunk_end) {
+    status = read_line (connection, &line);
+    if (status != 1) {
+      return status;
+    }
+    valid = *line == '\0';
+    g_free (line);
+    if (!valid) {
+      return 0;
+    }
+    connection->chunk_end = FALSE;
+  }
+
+  if (!connection->trailer) {
+    status = read_line (connection, &line);
+    if (status != 1) {
+      return status;
+    }
+
+    /* Chunk extensions after the size are ignored. */
+    size = g_ascii_strtoull (line, &end, 16);
+    valid = end != line;
+    g_free (line);
+    if (!valid) {
+      return 0;
+    }
+
+    connection->remaining = size;
+    connection->trailer = size == 0;
+  }
+
+  while (connection->trailer) {
+    status = read_line (connection, &line);
+    if (status != 1) {
+      return status;
+    }
+    if (*line == '\0') {
+      connection->trailer = FALSE;
+      connection->done = TRUE;
+    }
+    g_free (line);
+  }
+
+  return 1;
+}
+
+/* Reads up to LENGTH bytes of the response body as it was sent, removing
+   the chunk framing.  Returns the number of bytes read, zero at the end
+   of the body, WOULD_BLOCK if no data has arrived yet or -1 on error. */
+static gint
+read_body (HttpConnection *connection,
+           gchar          *buffer,
+           gint            length)
+{
+  gint count;
+
+  if (connection->done) {
+    return 0;
+  }
+
+  if (connection->chunked && connection->remaining == 0) {
+    gint status = read_chunk_size (connection);
+
+    if (status != 1) {
+      return status == WOULD_BLOCK ? WOULD_BLOCK : -1;
+    } else if (connection->done) {
+      return 0;
+    }
+  }
+
+  if (connection->buffer->len == 0) {
+    gssize received;
+
+    received = fill_buffer (connection);
+    if (received <= 0) {
+      /* The end of the connection is the end of the body unless the
+         server promised more. */
+      if (received == 0 && connection->remaining < 0) {
+        connection->done = TRUE;
+        return 0;
+      }
+      return received == WOULD_BLOCK ? WOULD_BLOCK : -1;
+    }
+  }
+
+  count = MIN ((gsize) length, connection->buffer->len);
+  if (connection->remaining > 0) {
+    count = MIN (count, connection->remaining);
+    connection->remaining -= count;
+  }
+
+  memcpy (buffer, connection->buffer->str, count);
+  g_string_erase (connection->buffer, 0, count);
+  connection->n_received += count;
+
+  if (connection->remaining == 0) {
+    if (connection->chunked) {
+      connection->chunk_end = TRUE;
+    } else {
+      connection->done = TRUE;
+    }
+  }
+
+  return count;
+}
+
+/* Returns the value of header NAME in the header block HEADERS, or NULL.
+   The returned string must be freed. */
+static gchar *
+find_header (gchar       **headers,
+             const gchar  *name)
+{
+  gsize length = strlen (name);
+  gint  i;
+
+  /* The first line is the status line. */
+  for (i = 1; headers[i] != NULL; i++) {
+    if (g_ascii_strncasecmp (headers[i], name, length) == 0 &&
+        headers[i][length] == ':') {
+      return g_strstrip (g_strdup (headers[i] + length + 1));
+    }
+  }
+
+  return NULL;
+}
+
+/* Returns TRUE if header NAME in the header block HEADERS lists TOKEN,
+   ignoring case. */
+static gboolean
+has_header_token (gchar       **headers,
+                  const gchar  *name,
+                  const gchar  *token)
+{
+  gchar    *value;
+  gchar   **tokens;
+  gboolean  found = FALSE;
+  gint      i;
+
+  value = find_header (headers, name);
+  if (value == NULL) {
+    return FALSE;
+  }
+
+  tokens = g_strsplit (value, ",", 0);
+  for (i = 0; !found && tokens[i] != NULL; i++) {
+    found = g_ascii_strcasecmp (g_strstrip (tokens[i]), token) == 0;
+  }
+
+  g_strfreev (tokens);
+  g_free (value);
+
+  return found;
+}
+
+/* Receives the response headers into the buffer of CONNECTION.  Returns
+   1 once they have arrived in full, 0 on error or WOULD_BLOCK. */
+static gint
+receive_headers (HttpConnection  *connection,
+                 GError         **error)
+{
+  while (strstr (connection->buffer->str, "\r\n\r\n") == NULL) {
+    gssize received;
+
+    if (connection->buffer->len > MAX_HEADER_SIZE) {
+      g_set_error (error, HTTP_ERROR, HTTP_ERROR_PROTOCOL,
+                   "Response headers are too large");
+      return 0;
+    }
+
+    received = fill_buffer (connection);
+    if (received == WOULD_BLOCK) {
+      return WOULD_BLOCK;
+    } else if (received <= 0) {
+      g_set_error (error, HTTP_ERROR, HTTP_ERROR_IO,
+                   received == 0 ?
+                   "Connection closed while reading response headers" :
+                   "Failed to read response headers");
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/* Parses the response headers received, and sets up reading the body. */
+static gboolean
+parse_headers (HttpConnection  *connection,
+               gchar          **location,
+               GError         **error)
+{
+  gchar  *end;
+  gchar **headers;
+  gchar  *length;
+  gint    major, minor;
+  gint    status;
+
+  end = strstr (connection->buffer->str, "\r\n\r\n");
+  *end = '\0';
+  headers = g_strsplit (connection->buffer->str, "\r\n", 0);
+
+  if (sscanf (headers[0], "HTTP/%d.%d %d", &major, &minor, &status) != 3) {
+    g_set_error (error, HTTP_ERROR, HTTP_ERROR_PROTOCOL,
+                 "Malformed status line");
+    g_strfreev (headers);
+    return FALSE;
+  }
+
+  connection->response.status = status;
+  connection->etag = find_header (headers, "ETag");
+  connection->last_modified = find_header (headers, "Last-Modified");
+  connection->response.etag = connection->etag;
+  connection->response.last_modified = connection->last_modified;
+
+  *location = find_header (headers, "Location");
+
+  /* HTTP/1.1 connections are persistent unless the server says
+     otherwise, older ones only if it says so. */
+  if (major == 1 && minor == 0) {
+    connection->keep_alive = has_header_token (headers, "Connection",
+                                               "keep-alive");
+  } else {
+    connection->keep_alive = !has_header_token (headers, "Connection",
+                                                "close");
+  }
+
+  connection->remaining = -1;
+  if ((status >= 100 && status < 200) || status == 204 || status == 304) {
+    connection->remaining = 0;
+  } else if (has_header_token (headers, "Transfer-Encoding", "chunked")) {
+    connection->chunked = TRUE;
+    connection->remaining = 0;
+  } else {
+    length = find_header (headers, "Content-Length");
+    if (length != NULL) {
+      connection->remaining = g_ascii_strtoll (length, NULL, 10);
+      g_free (length);
+    }
+  }
+
+  /* A body which extends to the end of the connection leaves nothing to
+     reuse. */
+  if (connection->remaining < 0) {
+    connection->keep_alive = FALSE;
+  }
+  connection->done = !connection->chunked && connection->remaining == 0;
+
+  if (has_header_token (headers, "Content-Encoding", "gzip") ||
+      has_header_token (headers, "Content-Encoding", "x-gzip")) {
+    connection->inflater = g_new0 (z_stream, 1);
+    connection->compressed = g_malloc (BUFFER_SIZE);
+
+    /* Accept a gzip header only. */
+    if (inflateInit2 (connection->inflater, 16 + MAX_WBITS) != Z_OK) {
+      g_set_error (error, HTTP_ERROR, HTTP_ERROR_PROTOCOL,
+                   "Cannot decompress the response");
+      g_strfreev (headers);
+      return FALSE;
+    }
+  }
+
+  g_strfreev (headers);
+
+  /* Keep only the start of the body in the buffer. */
+  g_string_erase (connection->buffer, 0, end + 4 - connection->buffer->str);
+
+  return TRUE;
+}
+
+/* Reads and parses the response headers. */
+static gboolean
+read_headers (HttpConnection  *connection,
+              gchar          **location,
+              GError         **error)
+{
+  return receive_headers (connection, error) == 1 &&
+         parse_headers (connection, location, error);
+}
+
+/* Clears the response of CONNECTION, so another request can be sent. */
+static void
+clear_response (HttpConnection *connection)
+{
+  if (connection->inflater != NULL) {
+    inflateEnd (connection->inflater);
+    g_free (connection->inflater);
+    g_free (connection->compressed);
+    connection->inflater = NULL;
+    connection->compressed = NULL;
+  }
+
+  g_free (connection->etag);
+  g_free (connection->last_modified);
+  connection->etag = NULL;
+  connection->last_modified = NULL;
+  memset (&connection->response, 0, sizeof (connection->response));
+
+  g_string_truncate (connection->buffer, 0);
+  connection->remaining = 0;
+  connection->chunked = FALSE;
+  connection->chunk_end = FALSE;
+  connection->trailer = FALSE;
+  connection->done = FALSE;
+  connection->keep_alive = FALSE;
+  connection->inflated = FALSE;
+}
+
+/* Frees the addresses of the server CONNECTION was connecting to. */
+static void
+free_addresses (HttpConnection *connection)
+{
+  if (connection->addresses != NULL) {
+    freeaddrinfo (connection->addresses);
+    connection->addresses = NULL;
+    connection->address = NULL;
+  }
+}
+
+/* Frees CONNECTION's resources. */
+static void
+free_connection (HttpConnection *connection)
+{
+  if (connection->fd >= 0) {
+    close (connection->fd);
+  }
+  free_addresses (connection);
+
+  clear_response (connection);
+
+  g_string_free (connection->buffer, TRUE);
+  if (connection->request != NULL) {
+    g_string_free (connection->request, TRUE);
+  }
+  g_free (connection->server);
+  g_free (connection->url);
+  g_free (connection->request_etag);
+  g_free (connection->request_last_modified);
+  if (connection->cancel != NULL) {
+    cancel_token_unref (connection->cancel);
+  }
+  g_free (connection);
+}
+
+/* Returns the request for PARTS, with the validators ETAG and
+   LAST_MODIFIED if not NULL. */
+static GString *
+build_request (HttpUrl     *parts,
+               const gchar *etag,
+               const gchar *last_modified)
+{
+  GString *request;
+
+  request = g_string_new (NULL);
+  g_string_append_printf (request, "GET %s HTTP/1.1\r\n", parts->path);
+  if (strcmp (parts->port, "80") == 0) {
+    g_string_append_printf (request, "Host: %s\r\n", parts->host);
+  } else {
+    g_string_append_printf (request, "Host: %s:%s\r\n",
+                            parts->host, parts->port);
+  }
+  g_string_append (request, "User-Agent: " PACKAGE "/" VERSION "\r\n");
+  g_string_append (request, "Accept-Encoding: gzip\r\n");
+  if (etag != NULL) {
+    g_string_append_printf (request, "If-None-Match: %s\r\n", etag);
+  }
+  if (last_modified != NULL) {
+    g_string_append_printf (request, "If-Modified-Since: %s\r\n",
+                            last_modified);
+  }
+  g_string_append (request, "\r\n");
+
+  return request;
+}
+
+/* Counts a request sent, on a new connection unless REUSED. */
+static void
+count_request (gboolean reused)
+{
+  g_static_mutex_lock (&pool_mutex);
+  stats.n_requests++;
+  if (!reused) {
+    stats.n_connections++;
+  }
+  g_static_mutex_unlock (&pool_mutex);
+}
+
+/* Sets the socket FD to block or not. */
+static void
+set_blocking (gint     fd,
+              gboolean blocking)
+{
+  gint flags = fcntl (fd, F_GETFL);
+
+  fcntl (fd, F_SETFL, blocking ? flags & ~O_NONBLOCK : flags | O_NONBLOCK);
+}
+
+/* Replaces the error in ERROR by an HTTP_ERROR_CANCELLED error if CANCEL
+   has been cancelled or has expired, since the former then only tells
+   which wait was cut short.  Returns TRUE if so. */
+static gboolean
+set_cancelled (CancelToken  *cancel,
+               const gchar  *url,
+               GError      **error)
+{
+  switch (cancel_token_get_state (cancel)) {
+  case CANCEL_TOKEN_CANCELLED:
+    g_clear_error (error);
+    g_set_error (error, HTTP_ERROR, HTTP_ERROR_CANCELLED,
+                 "Request for %s cancelled", url);
+    return TRUE;
+
+  case CANCEL_TOKEN_EXPIRED:
+    g_clear_error (error);
+    g_set_error (error, HTTP_ERROR, HTTP_ERROR_CANCELLED,
+                 "Request for %s ran past its deadline", url);
+    return TRUE;
+
+  default:
+    return FALSE;
+  }
+}
+
+/* Sends a single request for URL and reads the response headers.  An
+   idle connection to the server is reused if there is one; if the server
+   has closed it meanwhile, the request is sent again on a new
+   connection, which is safe since GET requests are idempotent.  The
+   waits of the connection check CANCEL. */
+static HttpConnection *
+request (const gchar  *url,
+         const gchar  *etag,
+         const gchar  *last_modified,
+         CancelToken  *cancel,
+         gchar       **location,
+         GError      **error)
+{
+  HttpConnection *connection = NULL;
+  HttpUrl         parts;
+  GString        *request;
+  gchar          *server;
+  gint            attempt;
+
+  if (!parse_url (url, &parts)) {
+    g_set_error (error, HTTP_ERROR, HTTP_ERROR_URL,
+                 "Unsupported URL %s", url);
+    return NULL;
+  }
+
+  request = build_request (&parts, etag, last_modified);
+  server = g_strdup_printf ("%s:%s", parts.host, parts.port);
+
+  for (attempt = 0; attempt < 2; attempt++) {
+    GError   *local_error = NULL;
+    gboolean  reused;
+
+    connection = g_new0 (HttpConnection, 1);
+    connection->buffer = g_string_new (NULL);
+    connection->server = g_strdup (server);
+    connection->fd = attempt == 0 ? pool_take (server) : -1;
+    if (cancel != NULL) {
+      connection->cancel = cancel_token_ref (cancel);
+    }
+
+    reused = connection->fd >= 0;
+    if (reused) {
+      set_blocking (connection->fd, TRUE);
+    } else {
+      connection->fd = connect_to (parts.host, parts.port, cancel,
+                                   &local_error);
+      if (connection->fd < 0) {
+        set_cancelled (cancel, url, &local_error);
+        g_propagate_error (error, local_error);
+        free_connection (connection);
+        connection = NULL;
+        break;
+      }
+    }
+
+    count_request (reused);
+
+    if (!write_all (connection->fd, request->str, request->len,
+                    connection->cancel)) {
+      g_set_error (&local_error, HTTP_ERROR, HTTP_ERROR_IO,
+                   "Failed to send request for %s", url);
+    } else {
+      read_headers (connection, location, &local_error);
+    }
+
+    if (local_error == NULL) {
+      break;
+    }
+
+    free_connection (connection);
+    connection = NULL;
+
+    if (set_cancelled (cancel, url, &local_error) || !reused) {
+      g_propagate_error (error, local_error);
+      break;
+    }
+    g_error_free (local_error);
+  }
+
+  g_free (server);
+  g_string_free (request, TRUE);
+  free_url (&parts);
+
+  return connection;
+}
+
+HttpConnection *
+http_open (const gchar  *url,
+           const gchar  *etag,
+           const gchar  *last_modified,
+           CancelToken  *cancel,
+           GError      **error)
+{
+  HttpConnection *connection;
+  gchar          *current;
+  gint            redirects;
+
+  g_assert (url != NULL);
+
+  current = g_strdup (url);
+
+  for (redirects = 0; redirects <= MAX_REDIRECTS; redirects++) {
+    gchar *location = NULL;
+    gchar *next;
+    gint   status;
+
+    connection = request (current, etag, last_modified, cancel, &location,
+                          error);
+    if (connection == NULL) {
+      g_free (current);
+      return NULL;
+    }
+
+    status = connection->response.status;
+    if ((status != 301 && status != 302 && status != 303 &&
+         status != 307 && status != 308) ||
+        location == NULL) {
+      g_free (location);
+      g_free (current);
+      return connection;
+    }
+
+    /* Follow the redirect.  The Location header may be relative. */
+    next = (gchar *) xmlBuildURI ((const xmlChar *) location,
+                                  (const xmlChar *) current);
+    g_debug ("Redirected from %s to %s", current, next);
+
+    http_close (connection);
+    g_free (location);
+    g_free (current);
+    current = g_strdup (next);
+    xmlFree (next);
+  }
+
+  g_set_error (error, HTTP_ERROR, HTTP_ERROR_REDIRECT,
+               "Too many redirects for %s", url);
+  g_free (current);
+  return NULL;
+}
+
+/* Starts connecting CONNECTION without blocking to the first address
+   from ADDRESS on of the server which accepts the attempt.  Returns FALSE
+   and sets errno if none does. */
+static gboolean
+connect_next (HttpConnection  *connection,
+              struct addrinfo *address)
+{
+  gint saved_errno;
+
+  for (; address != NULL; address = address->ai_next) {
+    connection->fd = socket (address->ai_family, address->ai_socktype,
+                             address->ai_protocol);
+    if (connection->fd < 0) {
+      continue;
+    }
+
+    set_blocking (connection->fd, FALSE);
+    if (connect (connection->fd, address->ai_addr, address->ai_addrlen) == 0 ||
+        errno == EINPROGRESS) {
+      connection->address = address;
+      return TRUE;
+    }
+
+    saved_errno = errno;
+    close (connection->fd);
+    connection->fd = -1;
+    errno = saved_errno;
+  }
+
+  return FALSE;
+}
+
+/* Starts the request of CONNECTION for its URL on an idle connection to
+   the server, or on a new non-blocking connection.  Name resolution
+   blocks, but only until the address is known. */
+static gboolean
+start_request (HttpConnection  *connection,
+               gboolean         reuse,
+               GError         **error)
+{
+  struct addrinfo  hints, *result;
+  HttpUrl          parts;
+  gint             status;
+
+  if (!parse_url (connection->url, &parts)) {
+    g_set_error (error, HTTP_ERROR, HTTP_ERROR_URL,
+                 "Unsupported URL %s", connection->url);
+    return FALSE;
+  }
+
+  if (connection->fd >= 0) {
+    close (connection->fd);
+    connection->fd = -1;
+  }
+  clear_response (connection);
+
+  if (connection->request != NULL) {
+    g_string_free (connection->request, TRUE);
+  }
+  connection->request = build_request (&parts,
+                                       connection->request_etag,
+                                       connection->request_last_modified);
+  connection->n_sent = 0;
+
+  g_free (connection->server);
+  connection->server = g_strdup_printf ("%s:%s", parts.host, parts.port);
+
+  connection->fd = reuse ? pool_take (connection->server) : -1;
+  connection->reused = connection->fd >= 0;
+  if (connection->reused) {
+    set_blocking (connection->fd, FALSE);
+    connection->phase = PHASE_SENDING;
+    count_request (TRUE);
+    free_url (&parts);
+    return TRUE;
+  }
+
+  memset (&hints, 0, sizeof (hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  status = getaddrinfo (parts.host, parts.port, &hints, &result);
+  if (status != 0) {
+    g_set_error (error, HTTP_ERROR, HTTP_ERROR_CONNECT,
+                 "Failed to resolve %s: %s", parts.host,
+                 gai_strerror (status));
+    free_url (&parts);
+    return FALSE;
+  }
+
+  /* The outcome of the connect is known only later, so the addresses are
+     kept to try the next one if it fails. */
+  free_addresses (connection);
+  connection->addresses = result;
+
+  if (!connect_next (connection, result)) {
+    g_set_error (error, HTTP_ERROR, HTTP_ERROR_CONNECT,
+                 "Failed to connect to %s:%s: %s", parts.host, parts.port,
+                 g_strerror (errno));
+    free_url (&parts);
+    return FALSE;
+  }
+
+  connection->phase = PHASE_CONNECTING;
+  count_request (FALSE);
+  free_url (&parts);
+
+  return TRUE;
+}
+
+HttpConnection *
+http_open_async (const gchar  *url,
+                 const gchar  *etag,
+                 const gchar  *last_modified,
+                 GError      **error)
+{
+  HttpConnection *connection;
+
+  g_assert (url != NULL);
+
+  connection = g_new0 (HttpConnection, 1);
+  connection->fd = -1;
+  connection->async = TRUE;
+  connection->buffer = g_string_new (NULL);
+  connection->url = g_strdup (url);
+  connection->request_etag = g_strdup (etag);
+  connection->request_last_modified = g_strdup (last_modified);
+
+  if (!start_request (connection, TRUE, error)) {
+    free_connection (connection);
+    return NULL;
+  }
+
+  return connection;
+}
+
+/* Handles the failure of the request of CONNECTION, telling the reason in
+   LOCAL_ERROR.  A request on a reused connection is sent again on a new
+   connection, since the server may have closed it meanwhile.  Returns
+   HTTP_STEP_PENDING if the request was restarted. */
+static HttpStep
+retry_or_fail (HttpConnection  *connection,
+               GError          *local_error,
+               GError         **error)
+{
+  if (connection->reused && start_request (connection, FALSE, NULL)) {
+    g_error_free (local_error);
+    return HTTP_STEP_PENDING;
+  }
+
+  g_propagate_error (error, local_error);
+  return HTTP_STEP_FAILED;
+}
+
+HttpStep
+http_step (HttpConnection  *connection,
+           GError         **error)
+{
+  GError *local_error = NULL;
+  gchar  *location = NULL;
+  gchar  *next;
+  gint    status;
+
+  g_assert (connection != NULL);
+  g_assert (connection->async);
+
+  switch (connection->phase) {
+  case PHASE_CONNECTING:
+    if (!wait_connected (connection->fd, NULL)) {
+      gint saved_errno = errno;
+
+      /* Try the next address of the server, as the blocking connect
+         does. */
+      close (connection->fd);
+      connection->fd = -1;
+      if (connect_next (connection, connection->address->ai_next)) {
+        return HTTP_STEP_PENDING;
+      }
+
+      free_addresses (connection);
+      g_set_error (error, HTTP_ERROR, HTTP_ERROR_CONNECT,
+                   "Failed to connect to %s: %s", connection->server,
+                   g_strerror (saved_errno));
+      return HTTP_STEP_FAILED;
+    }
+    free_addresses (connection);
+    connection->phase = PHASE_SENDING;
+    /* Fall through. */
+
+  case PHASE_SENDING:
+    while (connection->n_sent < connection->request->len) {
+      gssize written;
+
+      written = send (connection->fd,
+                      connection->request->str + connection->n_sent,
+                      connection->request->len - connection->n_sent,
+                      MSG_NOSIGNAL);
+      if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return HTTP_STEP_PENDING;
+      } else if (written < 0 && errno != EINTR) {
+        g_set_error (&local_error, HTTP_ERROR, HTTP_ERROR_IO,
+                     "Failed to send request for %s", connection->url);
+        return retry_or_fail (connection, local_error, error);
+      } else if (written > 0) {
+        connection->n_sent += written;
+      }
+    }
+    connection->phase = PHASE_HEADERS;
+    return HTTP_STEP_PENDING;
+
+  case PHASE_HEADERS:
+    status = receive_headers (connection, &local_error);
+    if (status == WOULD_BLOCK) {
+      return HTTP_STEP_PENDING;
+    } else if (status != 1) {
+      return retry_or_fail (connection, local_error, error);
+    } else if (!parse_headers (connection, &location, error)) {
+      return HTTP_STEP_FAILED;
+    }
+    break;
+
+  case PHASE_BODY:
+    return HTTP_STEP_READY;
+  }
+
+  status = connection->response.status;
+  if ((status != 301 && status != 302 && status != 303 &&
+       status != 307 && status != 308) ||
+      location == NULL) {
+    g_free (location);
+    connection->phase = PHASE_BODY;
+    return HTTP_STEP_READY;
+  }
+
+  if (++connection->redirects > MAX_REDIRECTS) {
+    g_set_error (error, HTTP_ERROR, HTTP_ERROR_REDIRECT,
+                 "Too many redirects for %s", connection->url);
+    g_free (location);
+    return HTTP_STEP_FAILED;
+  }
+
+  /* Follow the redirect on the same connection if the body of the
+     redirect has arrived, or on another one otherwise. */
+  next = (gchar *) xmlBuildURI ((const xmlChar *) location,
+                                (const xmlChar *) connection->url);
+  g_debug ("Redirected from %s to %s", connection->url, next);
+  g_free (location);
+
+  if (connection->keep_alive) {
+    gchar buffer[BUFFER_SIZE];
+
+    while (read_body (connection, buffer, sizeof (buffer)) > 0) {
+    }
+  }
+  if (connection->keep_alive && connection->done &&
+      connection->buffer->len == 0) {
+    pool_put (connection->server, connection->fd);
+    connection->fd = -1;
+  }
+
+  g_free (connection->url);
+  connection->url = g_strdup (next);
+  xmlFree (next);
+
+  if (!start_request (connection, TRUE, error)) {
+    return HTTP_STEP_FAILED;
+  }
+
+  return HTTP_STEP_PENDING;
+}
+
+gint
+http_get_fd (HttpConnection *connection,
+             GIOCondition   *condition)
+{
+  g_assert (connection != NULL);
+
+  if (condition != NULL) {
+    *condition = connection->phase == PHASE_CONNECTING ||
+                 connection->phase == PHASE_SENDING ? G_IO_OUT : G_IO_IN;
+  }
+
+  return connection->fd;
+}
+
+const HttpResponse *
+http_get_response (HttpConnection *connection)
+{
+  g_assert (connection != NULL);
+  return &connection->response;
+}
+
+gint
+http_read (HttpConnection *connection,
+           gchar          *buffer,
+           gint            length)
+{
+  z_stream *inflater;
+  gint      count;
+
+  g_assert (connection != NULL);
+  g_assert (buffer != NULL);
+
+  inflater = connection->inflater;
+  if (inflater == NULL) {
+    count = read_body (connection, buffer, length);
+    if (count > 0) {
+      connection->n_decoded += count;
+    }
+    return count;
+  }
+
+  inflater->next_out = (Bytef *) buffer;
+  inflater->avail_out = length;
+
+  /* Inflate until some output is produced. */
+  while (inflater->avail_out == (guint) length && !connection->inflated) {
+    gint status;
+
+    if (inflater->avail_in == 0) {
+      count = read_body (connection, connection->compressed, BUFFER_SIZE);
+      if (count == WOULD_BLOCK) {
+        return WOULD_BLOCK;
+      } else if (count <= 0) {
+        /* An empty body is not compressed data. */
+        return (count == 0 && inflater->total_in == 0) ? 0 : -1;
+      }
+
+      inflater->next_in = (Bytef *) connection->compressed;
+      inflater->avail_in = count;
+    }
+
+    status = inflate (inflater, Z_NO_FLUSH);
+    if (status == Z_STREAM_END) {
+      connection->inflated = TRUE;
+    } else if (status != Z_OK) {
+      return -1;
+    }
+  }
+
+  count = length - inflater->avail_out;
+  connection->n_decoded += count;
+
+  return count;
+}
+
+void
+http_close (HttpConnection *connection)
+{
+  gchar buffer[BUFFER_SIZE];
+  gint  drained = 0;
+
+  if (connection == NULL) {
+    return;
+  }
+
+  /* Skip the rest of a short body, so the connection can be reused. */
+  while (connection->keep_alive && !connection->done &&
+         drained < MAX_DRAIN_SIZE) {
+    gint count = read_body (connection, buffer, sizeof (buffer));
+
+    if (count <= 0) {
+      break;
+    }
+    drained += count;
+  }
+
+  if (connection->keep_alive && connection->done &&
+      connection->buffer->len == 0) {
+    pool_put (connection->server, connection->fd);
+    connection->fd = -1;
+  }
+
+  g_static_mutex_lock (&pool_mutex);
+  stats.bytes_received += connection->n_received;
+  stats.bytes_decoded += connection->n_decoded;
+  g_static_mutex_unlock (&pool_mutex);
+
+  free_connection (connection);
+}
+
+void
+http_get_stats (HttpStats *value)
+{
+  g_assert (value != NULL);
+
+  g_static_mutex_lock (&pool_mutex);
+  *value = stats;
+  g_static_mutex_unlock (&pool_mutex);
+}
+
+/* Closes the idle connections of a server. */
+static gboolean
+close_idle (gpointer server,
+            GQueue  *idle,
+            gpointer user_data)
+{
+  IdleConnection *connection;
+
+  while ((connection = g_queue_pop_head (idle)) != NULL) {
+    close (connection->fd);
+    g_free (connection);
+  }
+  g_queue_free (idle);
+
+  return TRUE;
+}
+
+void
+http_close_idle ()
+{
+  g_static_mutex_lock (&pool_mutex);
+  if (pool != NULL) {
+    g_hash_table_foreach_remove (pool, (GHRFunc) close_idle, NULL);
+  }
+  g_static_mutex_unlock (&pool_mutex);
+}
@@ -0,0 +1,181 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HTTP_H
+#define HTTP_H
+
+#include <glib.h>
+
+#include "canceltoken.h"
+
+/*
+ * Minimal blocking HTTP/1.1 client.
+ *
+ * Unlike libxml's built-in HTTP client, this one gives access to the
+ * response headers and allows sending conditional requests, so feeds
+ * which have not changed since the last sync can be skipped with a
+ * "304 Not Modified" response.
+ *
+ * Connections are kept alive: once a response body has been read in
+ * full, its connection is put in a pool shared by all threads, and the
+ * next request to the same server reuses it instead of connecting again.
+ * Idle connections are dropped after a while or when the server closes
+ * them.  Responses are requested gzip-compressed and decompressed as they
+ * are read, and chunked responses are decoded.  Connecting and each send
+ * and receive time out, so a stalled server cannot block a sync thread
+ * forever, and a blocking request may be given a cancellation token, see
+ * canceltoken.h, which ends it as soon as it is cancelled or expires.
+ * The name resolution is the exception: getaddrinfo cannot be interrupted,
+ * so a request cancelled while the server's name is being resolved ends
+ * only once the resolver answers or gives up, which with the default
+ * resolver settings takes up to half a minute or so.
+ *
+ * A request may also be made without blocking, for running many of them
+ * on a single thread: http_open_async starts it on a non-blocking socket,
+ * and http_step advances it each time the socket returned by http_get_fd
+ * is ready, until the response headers have been read.  http_read then
+ * returns HTTP_WOULD_BLOCK whenever no data has arrived yet.  Only the
+ * name resolution blocks.
+ */
+
+#define HTTP_ERROR http_error_quark ()
+
+typedef enum {
+  HTTP_ERROR_URL,       /* malformed or unsupported URL */
+  HTTP_ERROR_CONNECT,   /* could not connect to the server in time */
+  HTTP_ERROR_IO,        /* read or write error */
+  HTTP_ERROR_PROTOCOL,  /* malformed response */
+  HTTP_ERROR_REDIRECT,  /* too many redirects */
+  HTTP_ERROR_CANCELLED  /* the cancellation token was cancelled or
+                           expired */
+} HttpError;
+
+/*
+ * Response information.  Strings are owned by the connection.
+ */
+typedef struct {
+  gint         status;          /* status code of the final response */
+  const gchar *etag;            /* ETag header, or NULL */
+  const gchar *last_modified;   /* Last-Modified header, or NULL */
+} HttpResponse;
+
+/*
+ * Returned by http_read on a non-blocking connection which has no data
+ * yet.
+ */
+#define HTTP_WOULD_BLOCK (-2)
+
+/*
+ * Progress of a non-blocking request.
+ */
+typedef enum {
+  HTTP_STEP_PENDING,    /* wait for the socket and call http_step again */
+  HTTP_STEP_READY,      /* the response headers have been read */
+  HTTP_STEP_FAILED      /* the request failed */
+} HttpStep;
+
+/*
+ * Counters of the client, summed over all threads.  The bytes are counted
+ * when the connections are closed.
+ */
+typedef struct {
+  guint   n_requests;       /* requests sent */
+  guint   n_connections;    /* connections opened; the other requests
+                               reused a kept-alive connection */
+  guint64 bytes_received;   /* response body bytes received */
+  guint64 bytes_decoded;    /* response body bytes after decompression */
+} HttpStats;
+
+typedef struct _HttpConnection HttpConnection;
+
+GQuark           http_error_quark (void);
+
+/*
+ * Returns TRUE if URL is an HTTP URL which this client can fetch.
+ */
+gboolean         http_match       (const gchar    *url);
+
+/*
+ * Sends a GET request for URL and reads the response headers, following
+ * redirects.  If ETAG or LAST_MODIFIED are non-NULL, they are sent as the
+ * If-None-Match and If-Modified-Since validators.  If CANCEL is non-NULL,
+ * the request and the reads of the connection stop waiting once it is
+ * cancelled or expires.  Returns NULL and sets ERROR on failure.
+ */
+HttpConnection * http_open        (const gchar    *url,
+                                   const gchar    *etag,
+                                   const gchar    *last_modified,
+                                   CancelToken    *cancel,
+                                   GError        **error);
+
+/*
+ * Starts a request like http_open, but without blocking.  Returns NULL and
+ * sets ERROR if the request cannot be started.
+ */
+HttpConnection * http_open_async  (const gchar    *url,
+                                   const gchar    *etag,
+                                   const gchar    *last_modified,
+                                   GError        **error);
+
+/*
+ * Advances the non-blocking request of CONNECTION, following redirects.
+ * Sets ERROR if the request failed.
+ */
+HttpStep         http_step        (HttpConnection *connection,
+                                   GError        **error);
+
+/*
+ * Returns the socket of the non-blocking request of CONNECTION, and sets
+ * CONDITION to the condition to wait for before calling http_step or
+ * http_read.  The socket changes when a redirect is followed.
+ */
+gint             http_get_fd      (HttpConnection *connection,
+                                   GIOCondition   *condition);
+
+/*
+ * Returns the response information of CONNECTION.
+ */
+const HttpResponse *
+                 http_get_response (HttpConnection *connection);
+
+/*
+ * Reads up to LENGTH bytes of the response body into BUFFER.  Returns the
+ * number of bytes read, zero at the end of the body, HTTP_WOULD_BLOCK if
+ * CONNECTION does not block and has no data yet, or -1 on error.
+ */
+gint             http_read        (HttpConnection *connection,
+                                   gchar          *buffer,
+                                   gint            length);
+
+/*
+ * Closes CONNECTION and frees it.  If the response body has been read in
+ * full, or what is left of it is short, the connection is kept for
+ * reuse.
+ */
+void             http_close       (HttpConnection *connection);
+
+/*
+ * Stores the counters of the client in STATS.
+ */
+void             http_get_stats   (HttpStats      *stats);
+
+/*
+ * Closes the connections kept for reuse.
+ */
+void             http_close_idle  ();
+
+#endif
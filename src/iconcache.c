@@ -0,0 +1,300 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libxml/HTMLparser.h>
+#include <libxml/uri.h>
+
+#include "http.h"
+#include "iconcache.h"
+
+/* Seconds an icon is used before it is fetched again. */
+#define ICON_MAX_AGE (7 * 24 * 60 * 60)
+
+/* Seconds until a site found to have no icon is tried again. */
+#define ICON_RETRY_AGE (24 * 60 * 60)
+
+/* Largest icon accepted, and the most of a front page read to find the
+   icon's link, in bytes. */
+#define MAX_ICON_SIZE (64 * 1024)
+#define MAX_PAGE_SIZE (256 * 1024)
+
+/* Returns the name of the cache file of the icon of SITE.  The name is
+   derived from a hash of the site. */
+static gchar *
+get_icon_filename (const gchar *site)
+{
+  gchar *hash, *filename;
+
+  hash = g_compute_checksum_for_string (G_CHECKSUM_SHA1, site, -1);
+  filename = g_build_filename (g_get_user_cache_dir (),
+                               PACKAGE,
+                               "icons",
+                               hash,
+                               NULL);
+  g_free (hash);
+
+  return filename;
+}
+
+gchar *
+icon_cache_get_site (const gchar *url)
+{
+  const gchar *host, *end;
+
+  if (!http_match (url)) {
+    return NULL;
+  }
+
+  host = url + 7;
+  end = host + strcspn (host, "/?#");
+  if (end == host) {
+    return NULL;
+  }
+
+  return g_ascii_strdown (url, end - url);
+}
+
+/* Fetches URL and returns its body, or NULL if the response was not
+   successful or the body is longer than LIMIT bytes.  Sets ERROR if the
+   server could not be reached. */
+static GString *
+fetch_url (const gchar  *url,
+           gsize         limit,
+           GError      **error)
+{
+  HttpConnection *connection;
+  GString        *body;
+  gchar           buffer[4096];
+  gint            n = 0;
+
+  connection = http_open (url, NULL, NULL, NULL, error);
+  if (connection == NULL) {
+    return NULL;
+  }
+
+  if (http_get_response (connection)->status != 200) {
+    http_close (connection);
+    return NULL;
+  }
+
+  body = g_string_new (NULL);
+  while (body->len <= limit &&
+         (n = http_read (connection, buffer, sizeof (buffer))) > 0) {
+    g_string_append_len (body, buffer, n);
+  }
+  http_close (connection);
+
+  if (n < 0) {
+    g_set_error (error, HTTP_ERROR, HTTP_ERROR_IO,
+                 "Failed to read %s", url);
+    g_string_free (body, TRUE);
+    return NULL;
+  }
+
+  if (body->len > limit) {
+    g_string_free (body, TRUE);
+    return NULL;
+  }
+
+  return body;
+}
+
+/* Returns TRUE if the "rel" attribute value REL has the link type
+   "icon", as in "icon" and "shortcut icon". */
+static gboolean
+is_icon_rel (const gchar *rel)
+{
+  gchar    **types;
+  gboolean   result = FALSE;
+  gint       i;
+
+  types = g_strsplit_set (rel, " \t\r\n", -1);
+  for (i = 0; types[i] != NULL && !result; i++) {
+    result = g_ascii_strcasecmp (types[i], "icon") == 0;
+  }
+  g_strfreev (types);
+
+  return result;
+}
+
+/* Returns the href of the first icon link element under NODE, or NULL.
+   The result should be freed with xmlFree. */
+static xmlChar *
+find_icon_link (xmlNodePtr node)
+{
+  for (; node != NULL; node = node->next) {
+    xmlChar *href = NULL;
+
+    if (node->type != XML_ELEMENT_NODE) {
+      continue;
+    }
+
+    if (xmlStrcasecmp (node->name, (const xmlChar *) "link") == 0) {
+      xmlChar *rel;
+
+      rel = xmlGetProp (node, (const xmlChar *) "rel");
+      if (rel != NULL && is_icon_rel ((const gchar *) rel)) {
+        href = xmlGetProp (node, (const xmlChar *) "href");
+      }
+      xmlFree (rel);
+    } else if (xmlStrcasecmp (node->name, (const xmlChar *) "body") != 0) {
+      /* Icon links belong in the head; the body is not searched. */
+      href = find_icon_link (node->children);
+    }
+
+    if (href != NULL) {
+      return href;
+    }
+  }
+
+  return NULL;
+}
+
+/* Returns the URL of the icon of SITE, as linked from its front page, or
+   '/favicon.ico'.  Sets ERROR if the site could not be reached. */
+static gchar *
+discover_icon (const gchar  *site,
+               GError      **error)
+{
+  GString   *page;
+  htmlDocPtr document;
+  xmlChar   *href = NULL;
+  gchar     *url = NULL;
+
+  page = fetch_url (site, MAX_PAGE_SIZE, error);
+  if (page != NULL) {
+    document = htmlReadMemory (page->str, page->len, site, NULL,
+                               HTML_PARSE_RECOVER | HTML_PARSE_NOERROR |
+                               HTML_PARSE_NOWARNING | HTML_PARSE_NONET);
+    if (document != NULL) {
+      href = find_icon_link (xmlDocGetRootElement (document));
+      xmlFreeDoc (document);
+    }
+    g_string_free (page, TRUE);
+  } else if (error != NULL && *error != NULL) {
+    return NULL;
+  }
+
+  if (href != NULL) {
+    xmlChar *resolved;
+
+    resolved = xmlBuildURI (href, (const xmlChar *) site);
+    if (resolved != NULL && http_match ((const gchar *) resolved)) {
+      url = g_strdup ((const gchar *) resolved);
+    }
+    xmlFree (resolved);
+    xmlFree (href);
+  }
+
+  if (url == NULL) {
+    url = g_strconcat (site, "/favicon.ico", NULL);
+  }
+
+  return url;
+}
+
+/* Fetches the icon of SITE.  Returns the icon data, or an empty string if
+   the site has no icon, or NULL if it could not be reached. */
+static GString *
+fetch_icon (const gchar *site)
+{
+  GString *icon = NULL;
+  gchar   *url;
+  GError  *error = NULL;
+
+  url = discover_icon (site, &error);
+  if (url != NULL) {
+    icon = fetch_url (url, MAX_ICON_SIZE, &error);
+    if (icon == NULL && error == NULL) {
+      icon = g_string_new (NULL);
+    }
+  }
+
+  if (error != NULL) {
+    g_debug ("Failed to fetch the icon of %s: %s", site, error->message);
+    g_error_free (error);
+  } else {
+    g_debug ("Fetched the icon of %s from %s (%lu bytes).",
+             site, url, (gulong) icon->len);
+  }
+  g_free (url);
+
+  return icon;
+}
+
+gboolean
+icon_cache_load (const gchar  *site,
+                 gchar       **data,
+                 gsize        *length)
+{
+  struct stat  info;
+  gchar       *filename;
+  gboolean     cached;
+  GString     *icon;
+
+  g_assert (site != NULL);
+  g_assert (data != NULL);
+  g_assert (length != NULL);
+
+  *data = NULL;
+  *length = 0;
+
+  filename = get_icon_filename (site);
+  cached = g_stat (filename, &info) == 0;
+
+  if (cached &&
+      time (NULL) - info.st_mtime < (info.st_size > 0 ? ICON_MAX_AGE
+                                                      : ICON_RETRY_AGE)) {
+    g_file_get_contents (filename, data, length, NULL);
+  } else if ((icon = fetch_icon (site)) != NULL) {
+    gchar *dirname;
+
+    dirname = g_path_get_dirname (filename);
+    g_mkdir_with_parents (dirname, 0700);
+    g_free (dirname);
+
+    if (!g_file_set_contents (filename, icon->str, icon->len, NULL)) {
+      g_warning ("Failed to write %s", filename);
+    }
+
+    *length = icon->len;
+    *data = g_string_free (icon, FALSE);
+  } else if (cached) {
+    /* The site could not be reached; the stale icon will do until it
+       can. */
+    g_file_get_contents (filename, data, length, NULL);
+  }
+
+  g_free (filename);
+
+  if (*length == 0) {
+    g_free (*data);
+    *data = NULL;
+    return FALSE;
+  }
+
+  return TRUE;
+}
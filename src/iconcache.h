@@ -0,0 +1,53 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ICONCACHE_H
+#define ICONCACHE_H
+
+#include <glib.h>
+
+/*
+ * On-disk cache of site icons.
+ *
+ * Feeds are grouped by their site, the scheme, host and port of their
+ * URL, and the icon of each site is fetched once for all of its feeds.
+ * The icon is discovered from the <link rel="icon"> element of the site's
+ * front page, falling back to '/favicon.ico', and stored undecoded in a
+ * file under '$XDG_CACHE_HOME/gtk-feed/icons/'.  Icons are fetched again
+ * after a week.  A site found to have no icon is recorded with an empty
+ * file, and is not tried again for a day.
+ *
+ * The functions may be called from any thread.
+ */
+
+/*
+ * Returns the site of the feed URL, or NULL if the feed is not fetched
+ * over HTTP.  The result should be freed with g_free.
+ */
+gchar *  icon_cache_get_site (const gchar  *url);
+
+/*
+ * Reads the icon of SITE from the cache, fetching it first if it is not
+ * cached or has expired.  Blocks while fetching.  On success, stores the
+ * icon file data in DATA, to be freed with g_free, and its size in LENGTH.
+ * Returns FALSE if the site has no icon.
+ */
+gboolean icon_cache_load     (const gchar  *site,
+                              gchar       **data,
+                              gsize        *length);
+
+#endif
@@ -0,0 +1,521 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "itemset.h"
+
+/* Initial number of slots; always a power of two. */
+#define INITIAL_SIZE 1024
+
+/* The table is rehashed when more than MAX_USED_NUM / MAX_USED_DEN of the
+   slots are in use, and doubled if more than MAX_CLAIMS_NUM /
+   MAX_CLAIMS_DEN of them hold current claims, so the current claims fill
+   from about a third to four fifths of the slots. */
+#define MAX_USED_NUM   13
+#define MAX_USED_DEN   16
+#define MAX_CLAIMS_NUM 5
+#define MAX_CLAIMS_DEN 8
+
+/* Number of ended generations which are left for the next rehash to
+   recycle before a rehash is forced. */
+#define MAX_ENDED 1024
+
+/* Multiplier for Fibonacci hashing, which spreads the hashes over the
+   slots using their high bits. */
+#define FIBONACCI G_GUINT64_CONSTANT(0x9e3779b97f4a7c15)
+
+/* Number of no generation. */
+#define NO_GENERATION G_MAXUINT32
+
+/* Generation of claims.  OWNER is zero once the generation has ended. */
+typedef struct {
+  guint32 owner;
+  guint32 n_claims;
+} Generation;
+
+/* Generations of an owner. */
+typedef struct {
+  guint32 current;
+  guint32 pending;      /* generation being claimed, or NO_GENERATION */
+} OwnerState;
+
+/* Hash set with linear probing.  HASHES and CLAIMS are parallel arrays of
+   SIZE slots: the hash of an article and the number of the generation
+   claiming it.  A zero hash marks an empty slot, so a zero hash is stored
+   as one.  A slot holds a current claim only if its generation has not
+   ended; the other slots are stale, and are dropped when the table is
+   rehashed, which also recycles the numbers of the ended generations.
+   Keeping the owners in the generations rather than in the slots makes a
+   slot twelve bytes. */
+struct _ItemSet {
+  GStaticMutex  mutex;
+  guint64      *hashes;
+  guint32      *claims;
+  guint         size;
+  guint         shift;
+  guint         n_used;           /* slots in use, stale ones included */
+  guint         n_claims;         /* current claims */
+  GArray       *generations;      /* Generation by number */
+  GArray       *recycled;         /* numbers of ended generations with no
+                                     slots left */
+  guint         n_ended;          /* ended generations not yet recycled */
+  GHashTable   *owner_states;     /* OwnerState of each owner */
+};
+
+static void rehash (ItemSet *set);
+
+/* Returns the slot where probing for HASH starts. */
+static inline guint
+get_slot (ItemSet *set,
+          guint64  hash)
+{
+  return (guint) ((hash * FIBONACCI) >> set->shift);
+}
+
+/* Returns generation number N. */
+static inline Generation *
+get_generation (ItemSet *set,
+                guint32  n)
+{
+  return &g_array_index (set->generations, Generation, n);
+}
+
+/* Returns the owner of the claim in slot I, or zero if it is stale. */
+static inline guint32
+get_claim_owner (ItemSet *set,
+                 guint    i)
+{
+  return get_generation (set, set->claims[i])->owner;
+}
+
+/* Starts a generation for OWNER and returns its number. */
+static guint32
+begin_generation (ItemSet *set,
+                  guint32  owner)
+{
+  Generation generation;
+  guint32    n;
+
+  if (set->recycled->len == 0 && set->n_ended >= MAX_ENDED) {
+    rehash (set);
+  }
+
+  generation.owner = owner;
+  generation.n_claims = 0;
+
+  if (set->recycled->len > 0) {
+    n = g_array_index (set->recycled, guint32, set->recycled->len - 1);
+    g_array_set_size (set->recycled, set->recycled->len - 1);
+    *get_generation (set, n) = generation;
+  } else {
+    n = set->generations->len;
+    g_array_append_val (set->generations, generation);
+  }
+
+  return n;
+}
+
+/* Ends generation number N, releasing its claims. */
+static void
+end_generation (ItemSet *set,
+                guint32  n)
+{
+  Generation *generation = get_generation (set, n);
+
+  set->n_claims -= generation->n_claims;
+  generation->owner = 0;
+  generation->n_claims = 0;
+  set->n_ended++;
+}
+
+/* Returns the generations of OWNER, starting a current generation for
+   OWNER if it has none. */
+static OwnerState *
+get_owner_state (ItemSet *set,
+                 guint32  owner)
+{
+  OwnerState *state;
+
+  state = g_hash_table_lookup (set->owner_states, GUINT_TO_POINTER (owner));
+  if (state == NULL) {
+    state = g_new (OwnerState, 1);
+    state->current = begin_generation (set, owner);
+    state->pending = NO_GENERATION;
+    g_hash_table_insert (set->owner_states, GUINT_TO_POINTER (owner), state);
+  }
+
+  return state;
+}
+
+/* Returns the slot holding HASH, or the empty slot where it would go. */
+static guint
+find_slot (ItemSet *set,
+           guint64  hash)
+{
+  guint mask = set->size - 1;
+  guint i;
+
+  for (i = get_slot (set, hash); set->hashes[i] != 0; i = (i + 1) & mask) {
+    if (set->hashes[i] == hash) {
+      break;
+    }
+  }
+
+  return i;
+}
+
+/* Allocates empty tables of SIZE slots. */
+static void
+allocate (ItemSet *set,
+          guint    size)
+{
+  guint bits = 0;
+
+  while ((1u << bits) < size) {
+    bits++;
+  }
+
+  set->size = size;
+  set->shift = 64 - bits;
+  set->n_used = 0;
+  set->hashes = g_new0 (guint64, size);
+  set->claims = g_new0 (guint32, size);
+}
+
+/* Stores HASH for generation number N; HASH must not be in the set. */
+static void
+insert (ItemSet *set,
+        guint64  hash,
+        guint32  n)
+{
+  guint mask = set->size - 1;
+  guint i;
+
+  i = get_slot (set, hash);
+  while (set->hashes[i] != 0) {
+    i = (i + 1) & mask;
+  }
+
+  set->hashes[i] = hash;
+  set->claims[i] = n;
+  set->n_used++;
+}
+
+/* Moves the current claims into a fresh table, leaving out the stale
+   slots, and doubles its size if the claims would fill it soon again.
+   The ended generations have no slots left afterwards, so their numbers
+   are recycled. */
+static void
+rehash (ItemSet *set)
+{
+  guint64 *hashes = set->hashes;
+  guint32 *claims = set->claims;
+  guint    old_size = set->size;
+  guint    size = set->size;
+  guint32  n;
+  guint    i;
+
+  if (set->n_claims * MAX_CLAIMS_DEN > size * MAX_CLAIMS_NUM) {
+    size *= 2;
+  }
+
+  allocate (set, size);
+
+  for (i = 0; i < old_size; i++) {
+    if (hashes[i] != 0 &&
+        get_generation (set, claims[i])->owner != 0) {
+      insert (set, hashes[i], claims[i]);
+    }
+  }
+
+  g_free (hashes);
+  g_free (claims);
+
+  g_array_set_size (set->recycled, 0);
+  for (n = 0; n < set->generations->len; n++) {
+    if (get_generation (set, n)->owner == 0) {
+      g_array_append_val (set->recycled, n);
+    }
+  }
+  set->n_ended = 0;
+}
+
+ItemSet *
+item_set_new ()
+{
+  ItemSet *set;
+
+  set = g_new0 (ItemSet, 1);
+  g_static_mutex_init (&set->mutex);
+  set->generations = g_array_new (FALSE, FALSE, sizeof (Generation));
+  set->recycled = g_array_new (FALSE, FALSE, sizeof (guint32));
+  set->owner_states = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                             NULL, g_free);
+  allocate (set, INITIAL_SIZE);
+
+  return set;
+}
+
+gboolean
+item_set_claim (ItemSet *set,
+                guint64  hash,
+                guint32  owner)
+{
+  OwnerState *state;
+  gboolean    result = TRUE;
+  guint32     n;
+  guint       i;
+
+  g_assert (set != NULL);
+  g_assert (owner != 0);
+
+  if (hash == 0) {
+    hash = 1;
+  }
+
+  g_static_mutex_lock (&set->mutex);
+
+  state = get_owner_state (set, owner);
+  n = state->pending != NO_GENERATION ? state->pending : state->current;
+
+  i = find_slot (set, hash);
+  if (set->hashes[i] != 0) {
+    guint32 claim_owner = get_claim_owner (set, i);
+
+    if (claim_owner != 0) {
+      result = claim_owner == owner;
+      goto done;
+    }
+
+    /* A stale claim is taken over in place. */
+    set->claims[i] = n;
+    get_generation (set, n)->n_claims++;
+    set->n_claims++;
+    goto done;
+  }
+
+  set->hashes[i] = hash;
+  set->claims[i] = n;
+  set->n_used++;
+  get_generation (set, n)->n_claims++;
+  set->n_claims++;
+
+  if (set->n_used * MAX_USED_DEN > set->size * MAX_USED_NUM) {
+    rehash (set);
+  }
+
+ done:
+  g_static_mutex_unlock (&set->mutex);
+  return result;
+}
+
+guint32
+item_set_lookup (ItemSet *set,
+                 guint64  hash)
+{
+  guint32 owner = 0;
+  guint   i;
+
+  g_assert (set != NULL);
+
+  if (hash == 0) {
+    hash = 1;
+  }
+
+  g_static_mutex_lock (&set->mutex);
+
+  i = find_slot (set, hash);
+  if (set->hashes[i] != 0) {
+    owner = get_claim_owner (set, i);
+  }
+
+  g_static_mutex_unlock (&set->mutex);
+
+  return owner;
+}
+
+void
+item_set_begin (ItemSet *set,
+                guint32  owner)
+{
+  OwnerState *state;
+
+  g_assert (set != NULL);
+  g_assert (owner != 0);
+
+  g_static_mutex_lock (&set->mutex);
+
+  state = get_owner_state (set, owner);
+  if (state->pending != NO_GENERATION) {
+    end_generation (set, state->pending);
+  }
+  state->pending = begin_generation (set, owner);
+
+  g_static_mutex_unlock (&set->mutex);
+}
+
+void
+item_set_commit (ItemSet       *set,
+                 guint32        owner,
+                 const guint64 *hashes,
+                 guint          n_hashes)
+{
+  OwnerState *state;
+  Generation *pending;
+  guint       i;
+
+  g_assert (set != NULL);
+  g_assert (owner != 0);
+
+  g_static_mutex_lock (&set->mutex);
+
+  state = get_owner_state (set, owner);
+  g_assert (state->pending != NO_GENERATION);
+
+  /* The articles the new generation keeps from the current one move over
+     to it before the current one ends, so no other feed can take them in
+     between. */
+  pending = get_generation (set, state->pending);
+  for (i = 0; i < n_hashes; i++) {
+    guint j = find_slot (set, hashes[i] != 0 ? hashes[i] : 1);
+
+    if (set->hashes[j] != 0 && set->claims[j] == state->current) {
+      set->claims[j] = state->pending;
+      get_generation (set, state->current)->n_claims--;
+      pending->n_claims++;
+    }
+  }
+
+  end_generation (set, state->current);
+  state->current = state->pending;
+  state->pending = NO_GENERATION;
+
+  g_static_mutex_unlock (&set->mutex);
+}
+
+void
+item_set_abort (ItemSet *set,
+                guint32  owner)
+{
+  OwnerState *state;
+
+  g_assert (set != NULL);
+  g_assert (owner != 0);
+
+  g_static_mutex_lock (&set->mutex);
+
+  state = get_owner_state (set, owner);
+  if (state->pending != NO_GENERATION) {
+    end_generation (set, state->pending);
+    state->pending = NO_GENERATION;
+  }
+
+  g_static_mutex_unlock (&set->mutex);
+}
+
+void
+item_set_renew (ItemSet *set,
+                guint32  owner)
+{
+  OwnerState *state;
+
+  g_assert (set != NULL);
+  g_assert (owner != 0);
+
+  g_static_mutex_lock (&set->mutex);
+
+  state = get_owner_state (set, owner);
+  end_generation (set, state->current);
+  state->current = begin_generation (set, owner);
+
+  g_static_mutex_unlock (&set->mutex);
+}
+
+void
+item_set_release (ItemSet *set,
+                  guint32  owner)
+{
+  OwnerState *state;
+
+  g_assert (set != NULL);
+  g_assert (owner != 0);
+
+  /* The claims go stale along with their generations; their slots are
+     reclaimed by the next rehash. */
+  g_static_mutex_lock (&set->mutex);
+
+  state = g_hash_table_lookup (set->owner_states, GUINT_TO_POINTER (owner));
+  if (state != NULL) {
+    end_generation (set, state->current);
+    if (state->pending != NO_GENERATION) {
+      end_generation (set, state->pending);
+    }
+    g_hash_table_remove (set->owner_states, GUINT_TO_POINTER (owner));
+  }
+
+  g_static_mutex_unlock (&set->mutex);
+}
+
+guint
+item_set_size (ItemSet *set)
+{
+  guint size;
+
+  g_assert (set != NULL);
+
+  g_static_mutex_lock (&set->mutex);
+  size = set->n_claims;
+  g_static_mutex_unlock (&set->mutex);
+
+  return size;
+}
+
+gsize
+item_set_memory (ItemSet *set)
+{
+  gsize memory;
+
+  g_assert (set != NULL);
+
+  g_static_mutex_lock (&set->mutex);
+  memory = (gsize) set->size * (sizeof (guint64) + sizeof (guint32)) +
+           set->generations->len * (sizeof (Generation) + sizeof (guint32));
+  g_static_mutex_unlock (&set->mutex);
+
+  return memory;
+}
+
+void
+item_set_free (ItemSet *set)
+{
+  if (set == NULL) {
+    return;
+  }
+
+  g_hash_table_destroy (set->owner_states);
+  g_array_free (set->recycled, TRUE);
+  g_array_free (set->generations, TRUE);
+  g_free (set->hashes);
+  g_free (set->claims);
+  g_static_mutex_free (&set->mutex);
+  g_free (set);
+}
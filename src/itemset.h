@@ -0,0 +1,126 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ITEMSET_H
+#define ITEMSET_H
+
+#include <glib.h>
+
+/*
+ * Set of article hashes for detecting duplicate articles.
+ *
+ * Each article is identified by a 64-bit hash of its guid, falling back
+ * to its link and its title, see feed_item_hash.  The set records which
+ * feed first claimed each hash, so an article carried by several feeds is
+ * shown only in the first one, while it stays in that feed across its
+ * refreshes.  The hashes are kept in an open-addressing table of twelve
+ * byte slots, which is kept from about a third to four fifths full, so
+ * 100,000 articles take at most 3 MB and 300,000 at most 6 MB.
+ *
+ * The claims of a feed belong to a generation.  While a feed reads a new
+ * generation of articles, it claims them into a pending generation, which
+ * holds its claims against the other feeds at once.  Once the whole
+ * generation has been read, the feed commits it, and the articles which
+ * dropped out of the feed are released along with the old generation; if
+ * the read fails, the feed aborts it instead, releasing the claims of the
+ * pending generation and keeping the old one.  Released claims go stale at
+ * once and their slots are reused when the table is next rehashed.
+ *
+ * Each owner has a generation, so the owners should be few, such as the
+ * feeds; the set is not meant to map each hash to a different value.
+ *
+ * The functions may be called from any thread.
+ */
+
+typedef struct _ItemSet ItemSet;
+
+/*
+ * Creates an empty set.
+ */
+ItemSet * item_set_new     ();
+
+/*
+ * Claims HASH for the feed OWNER, a non-zero feed identifier, in its
+ * pending generation if it has one and in its current one otherwise.
+ * Returns TRUE if HASH was not in the set or was already claimed by
+ * OWNER, and FALSE if another feed has claimed it, in which case the
+ * article is a duplicate.
+ */
+gboolean  item_set_claim   (ItemSet       *set,
+                            guint64        hash,
+                            guint32        owner);
+
+/*
+ * Returns the feed which has claimed HASH, or zero if HASH is not in the
+ * set.
+ */
+guint32   item_set_lookup  (ItemSet       *set,
+                            guint64        hash);
+
+/*
+ * Starts a pending generation of claims for OWNER, replacing the one it
+ * may already have.
+ */
+void      item_set_begin   (ItemSet       *set,
+                            guint32        owner);
+
+/*
+ * Makes the pending generation of OWNER its current one.  Of the hashes
+ * OWNER claimed before, the N_HASHES HASHES move to the new generation
+ * and the others are released.
+ */
+void      item_set_commit  (ItemSet       *set,
+                            guint32        owner,
+                            const guint64 *hashes,
+                            guint          n_hashes);
+
+/*
+ * Releases the claims of the pending generation of OWNER, if it has one,
+ * and keeps the current one.
+ */
+void      item_set_abort   (ItemSet       *set,
+                            guint32        owner);
+
+/*
+ * Starts a new current generation of claims for OWNER.  The hashes OWNER
+ * claimed before are released; OWNER claims the ones it keeps again.
+ */
+void      item_set_renew   (ItemSet       *set,
+                            guint32        owner);
+
+/*
+ * Forgets all hashes claimed by OWNER, so other feeds may claim them.
+ */
+void      item_set_release (ItemSet       *set,
+                            guint32        owner);
+
+/*
+ * Returns the number of hashes currently claimed.
+ */
+guint     item_set_size    (ItemSet       *set);
+
+/*
+ * Returns the number of bytes used by the table.
+ */
+gsize     item_set_memory  (ItemSet       *set);
+
+/*
+ * Destroys the set.
+ */
+void      item_set_free    (ItemSet       *set);
+
+#endif
@@ -22,24 +22,95 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <gtk/gtk.h>
 #include "common.h"
 #include "feeds.h"
+#include "rssfeed.h"
+#include "scheduler.h"
+#include "startup.h"
+#include "syncengine.h"
+
+/* If TRUE, the startup report is printed. */
+static gboolean startup_report = FALSE;
+
+/* Command line options. */
+static GOptionEntry options[] = {
+  { "startup-report", 0, 0, G_OPTION_ARG_NONE, &startup_report,
+    "Print the time taken by each phase of the startup", NULL },
+  { NULL }
+};
+
+/* "notify::embedded" handler of the status icon. */
+static void
+on_icon_embedded (GtkStatusIcon *status_icon,
+                  GParamSpec    *pspec,
+                  gpointer       user_data)
+{
+  if (gtk_status_icon_is_embedded (status_icon)) {
+    startup_mark (STARTUP_ICON_SHOWN);
+  }
+}
+
+/* Idle callback which populates the feed menus from the article cache a
+   slice at a time once the main loop runs, so the status icon is shown
+   first, and then starts synchronizing the feeds. */
+static gboolean
+on_startup_idle (gpointer user_data)
+{
+  if (load_cached_articles ()) {
+    return TRUE;
+  }
+
+  scheduler_start ();
+  return FALSE;
+}
 
 /* Program main function. */
 int
 main (int argc, char **argv)
 {
+  GtkStatusIcon *status_icon;
+  GError        *error = NULL;
+
   /* Initialize GTK and other libraries. */
   g_thread_init (NULL);
   gdk_threads_init ();
-  gtk_init (&argc, &argv);
+  startup_init ();
+
+  if (!gtk_init_with_args (&argc, &argv, NULL, options, NULL, &error)) {
+    g_printerr ("%s\n", error != NULL ? error->message
+                                       : "Cannot open the display");
+    return 1;
+  }
+  startup_set_report (startup_report);
+  startup_mark (STARTUP_GTK_INIT);
 
   /* Initialize the application. */
   g_set_application_name ("GTK Feed Reader");
   gtk_window_set_default_icon_name ("gtk-feed");
+
+  /* The status icon comes first, so it can be embedded while the feeds
+     are loaded. */
+  status_icon = get_status_icon ();
+  g_signal_connect (status_icon,
+                    "notify::embedded",
+                    G_CALLBACK(on_icon_embedded),
+                    NULL);
+  on_icon_embedded (status_icon, NULL, NULL);
+
   load_feeds ();
-  get_status_icon ();
+  if (feeds_get_count () == 0) {
+    startup_skip (STARTUP_FIRST_FEED);
+  }
+
+  gdk_threads_add_idle (on_startup_idle, NULL);
 
   /* Run the main loop. */
   gtk_main ();
+
+  /* Stop the syncs and wait for the workers, which add to the search
+     index, the set of seen articles and the article cache, before these
+     are saved.  A worker resolving a server name cannot be interrupted
+     and may delay the exit by the resolver's timeout. */
+  rss_feed_cancel_all ();
+  sync_engine_shutdown ();
   save_feeds ();
 
   return 0;
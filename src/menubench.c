@@ -0,0 +1,243 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Feed menu benchmark.
+ *
+ * Adds N feeds of M synthetic articles each to the feeds menu, the way
+ * the application does when it loads the article cache, then selects V
+ * of the feeds in the menu as the user does when opening their submenus.
+ * It prints the number of widgets in the feeds menu and its submenus, the
+ * number of article menu items alive, and how much the resident memory of
+ * the process grew.
+ *
+ * The submenus are built lazily unless "--eager" is given, so the two
+ * modes are compared by running the benchmark once in each, which "make
+ * bench-menus" does.  It needs a display; without one, run it under
+ * xvfb-run.  The read articles are recorded in a temporary directory, not
+ * in the user's.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <gtk/gtk.h>
+#include <glib/gstdio.h>
+
+#include "common.h"
+#include "feedmenu.h"
+#include "feeds.h"
+
+static gint     n_feeds = 200;
+static gint     n_items = 50;
+static gint     n_opened = 3;
+static gboolean eager = FALSE;
+
+static GOptionEntry entries[] = {
+  { "feeds", 'f', 0, G_OPTION_ARG_INT, &n_feeds,
+    "Number of feeds", "N" },
+  { "items", 'i', 0, G_OPTION_ARG_INT, &n_items,
+    "Number of articles per feed", "M" },
+  { "opened", 'v', 0, G_OPTION_ARG_INT, &n_opened,
+    "Number of feeds whose submenus are opened", "V" },
+  { "eager", 'e', 0, G_OPTION_ARG_NONE, &eager,
+    "Keep every submenu built", NULL },
+  { NULL }
+};
+
+/* Returns the resident memory of the process in kilobytes, or zero if it
+   is not known. */
+static glong
+get_memory ()
+{
+  FILE  *file;
+  glong  size;
+  glong  resident = 0;
+
+  file = fopen ("/proc/self/statm", "r");
+  if (file == NULL) {
+    return 0;
+  }
+
+  if (fscanf (file, "%ld %ld", &size, &resident) != 2) {
+    resident = 0;
+  }
+  fclose (file);
+
+  return resident * (sysconf (_SC_PAGESIZE) / 1024);
+}
+
+/* Adds WIDGET and the widgets it contains, including the submenus of menu
+   items, to the count at DATA. */
+static void
+count_widgets (GtkWidget *widget,
+               gpointer   data)
+{
+  guint *count = data;
+
+  (*count)++;
+
+  if (GTK_IS_MENU_ITEM(widget) &&
+      gtk_menu_item_get_submenu (GTK_MENU_ITEM(widget)) != NULL) {
+    count_widgets (gtk_menu_item_get_submenu (GTK_MENU_ITEM(widget)), data);
+  }
+
+  if (GTK_IS_CONTAINER(widget)) {
+    gtk_container_foreach (GTK_CONTAINER(widget), count_widgets, data);
+  }
+}
+
+/* Returns n_items synthetic articles of feed number INDEX. */
+static FeedArticles *
+create_articles (gint index)
+{
+  FeedArticles *articles;
+  gint          i;
+
+  articles = feed_articles_new ();
+
+  for (i = 0; i < n_items; i++) {
+    FeedItem  item = { 0 };
+    gchar    *title, *link;
+
+    title = g_strdup_printf ("Article %d of feed %d", i, index);
+    link = g_strdup_printf ("http://example.com/%d/%d.html", index, i);
+
+    item.title = title;
+    item.link = link;
+    item.guid = link;
+    item.date = n_items - i;
+    feed_articles_add (articles, &item);
+
+    g_free (link);
+    g_free (title);
+  }
+
+  return articles;
+}
+
+/* Adds feed number INDEX with its articles to the feeds menu. */
+static void
+add_feed (gint index)
+{
+  Feed  *feed;
+  gchar *title, *source;
+
+  title = g_strdup_printf ("Feed %d", index);
+  source = g_strdup_printf ("http://example.com/%d/feed.xml", index);
+
+  feed = feeds_add (title, source);
+  feed->menu = gtk_image_menu_item_new_with_label (feed->title);
+  feed_menu_init (feed);
+  gtk_menu_shell_append (GTK_MENU_SHELL(get_feeds_menu ()), feed->menu);
+  gtk_widget_show_all (feed->menu);
+
+  feed_menu_set_articles (feed, create_articles (index));
+
+  g_free (source);
+  g_free (title);
+}
+
+/* Removes FILENAME in DIRNAME. */
+static void
+remove_file (const gchar *dirname,
+             const gchar *filename)
+{
+  gchar *path;
+
+  path = g_build_filename (dirname, filename, NULL);
+  g_unlink (path);
+  g_free (path);
+}
+
+int
+main (int argc, char **argv)
+{
+  GError *error = NULL;
+  gchar  *directory;
+  gchar  *dirname;
+  glong   memory;
+  guint   n_widgets = 0;
+  gint    i;
+
+  /* The read state store is opened in the user data directory, which is
+     looked up once, so it is moved before GTK is initialized. */
+  directory = g_build_filename (g_get_tmp_dir (), "gtk-feed-menus-XXXXXX",
+                                NULL);
+  if (mkdtemp (directory) == NULL) {
+    perror (directory);
+    return 1;
+  }
+  g_setenv ("XDG_DATA_HOME", directory, TRUE);
+
+  if (!gtk_init_with_args (&argc, &argv, "- benchmark the feed menus",
+                           entries, NULL, &error)) {
+    g_printerr ("%s\n", error != NULL ? error->message
+                                       : "Cannot open the display");
+    g_rmdir (directory);
+    return 1;
+  }
+
+  if (n_feeds < 1 || n_items < 1 || n_opened < 0 || n_opened > n_feeds) {
+    g_printerr ("The numbers of feeds and articles must be positive, and "
+                "the number of feeds opened must not exceed them.\n");
+    g_rmdir (directory);
+    return 1;
+  }
+
+  feed_menu_set_lazy (!eager);
+  memory = get_memory ();
+
+  for (i = 0; i < n_feeds; i++) {
+    add_feed (i);
+  }
+
+  /* The opened feeds are spread over the menu. */
+  for (i = 0; i < n_opened; i++) {
+    Feed *feed = feeds_get (i * n_feeds / n_opened);
+
+    gtk_menu_item_select (GTK_MENU_ITEM(feed->menu));
+    gtk_menu_item_deselect (GTK_MENU_ITEM(feed->menu));
+  }
+
+  while (gtk_events_pending ()) {
+    gtk_main_iteration ();
+  }
+
+  count_widgets (get_feeds_menu (), &n_widgets);
+
+  printf ("%-6s %6s %6s %6s %9s %12s %10s\n",
+          "mode", "feeds", "items", "opened", "widgets", "menu items",
+          "RSS kB");
+  printf ("%-6s %6d %6d %6d %9u %12u %10ld\n",
+          eager ? "eager" : "lazy", n_feeds, n_items, n_opened, n_widgets,
+          feed_menu_get_n_items (), get_memory () - memory);
+
+  dirname = g_build_filename (directory, PACKAGE, NULL);
+  remove_file (dirname, "read.log");
+  remove_file (dirname, "read.table");
+  g_rmdir (dirname);
+  g_rmdir (directory);
+  g_free (dirname);
+  g_free (directory);
+
+  return 0;
+}
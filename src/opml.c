@@ -0,0 +1,259 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <libxml/xmlerror.h>
+#include <libxml/xmlreader.h>
+#include <libxml/xmlwriter.h>
+
+#include "opml.h"
+
+struct _OpmlWriter {
+  xmlTextWriterPtr  writer;
+  gchar            *filename;
+  gboolean          failed;     /* if TRUE, some write failed */
+};
+
+GQuark
+opml_error_quark (void)
+{
+  return g_quark_from_static_string ("opml-error-quark");
+}
+
+/* Returns the message of the last libxml error, or a generic one. */
+static const gchar *
+get_xml_error ()
+{
+  const xmlError *error = xmlGetLastError ();
+
+  if (error != NULL && error->message != NULL) {
+    return error->message;
+  }
+
+  return "Malformed document";
+}
+
+/* Passes the feed of the <outline> element READER is on to FUNC, if it
+   has one. */
+static void
+read_outline (xmlTextReaderPtr  reader,
+              OpmlFeedFunc      func,
+              gpointer          user_data)
+{
+  xmlChar *url;
+  xmlChar *title;
+
+  url = xmlTextReaderGetAttribute (reader, (const xmlChar *) "xmlUrl");
+  if (url == NULL || *url == '\0') {
+    xmlFree (url);
+    return;
+  }
+
+  title = xmlTextReaderGetAttribute (reader, (const xmlChar *) "title");
+  if (title == NULL || *title == '\0') {
+    xmlFree (title);
+    title = xmlTextReaderGetAttribute (reader, (const xmlChar *) "text");
+  }
+
+  func (title != NULL && *title != '\0' ? (const gchar *) title
+                                        : (const gchar *) url,
+        (const gchar *) url,
+        user_data);
+
+  xmlFree (title);
+  xmlFree (url);
+}
+
+gboolean
+opml_read (const gchar   *filename,
+           OpmlFeedFunc   func,
+           gpointer       user_data,
+           GError       **error)
+{
+  xmlTextReaderPtr reader;
+  gboolean         root = TRUE;
+  gint             result;
+
+  g_assert (filename != NULL);
+  g_assert (func != NULL);
+
+  xmlResetLastError ();
+  reader = xmlReaderForFile (filename, NULL,
+                             XML_PARSE_NONET | XML_PARSE_NOERROR |
+                             XML_PARSE_NOWARNING);
+  if (reader == NULL) {
+    g_set_error (error, OPML_ERROR, OPML_ERROR_PARSE,
+                 "Failed to open %s", filename);
+    return FALSE;
+  }
+
+  while ((result = xmlTextReaderRead (reader)) == 1) {
+    const xmlChar *name;
+
+    if (xmlTextReaderNodeType (reader) != XML_READER_TYPE_ELEMENT) {
+      continue;
+    }
+
+    name = xmlTextReaderConstLocalName (reader);
+
+    if (root) {
+      if (xmlStrcmp (name, (const xmlChar *) "opml") != 0) {
+        g_set_error (error, OPML_ERROR, OPML_ERROR_PARSE,
+                     "%s is not an OPML file", filename);
+        xmlFreeTextReader (reader);
+        return FALSE;
+      }
+      root = FALSE;
+    } else if (xmlStrcmp (name, (const xmlChar *) "outline") == 0) {
+      read_outline (reader, func, user_data);
+    }
+  }
+
+  xmlFreeTextReader (reader);
+
+  if (result < 0 || root) {
+    gchar *message;
+
+    /* The messages of libxml end in a line break. */
+    message = g_strchomp (g_strdup (get_xml_error ()));
+    g_set_error (error, OPML_ERROR, OPML_ERROR_PARSE,
+                 "Failed to read %s: %s", filename, message);
+    g_free (message);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Records the outcome RESULT of a write of WRITER. */
+static void
+check_write (OpmlWriter *writer,
+             gint        result)
+{
+  if (result < 0) {
+    writer->failed = TRUE;
+  }
+}
+
+OpmlWriter *
+opml_writer_new (const gchar  *filename,
+                 const gchar  *title,
+                 GError      **error)
+{
+  OpmlWriter *writer;
+
+  g_assert (filename != NULL);
+  g_assert (title != NULL);
+
+  writer = g_new0 (OpmlWriter, 1);
+  writer->filename = g_strdup (filename);
+  writer->writer = xmlNewTextWriterFilename (filename, 0);
+  if (writer->writer == NULL) {
+    g_set_error (error, OPML_ERROR, OPML_ERROR_WRITE,
+                 "Failed to create %s", filename);
+    g_free (writer->filename);
+    g_free (writer);
+    return NULL;
+  }
+
+  xmlTextWriterSetIndent (writer->writer, 1);
+  xmlTextWriterSetIndentString (writer->writer, (const xmlChar *) "  ");
+
+  check_write (writer,
+               xmlTextWriterStartDocument (writer->writer, NULL, "UTF-8",
+                                           NULL));
+  check_write (writer,
+               xmlTextWriterStartElement (writer->writer,
+                                          (const xmlChar *) "opml"));
+  check_write (writer,
+               xmlTextWriterWriteAttribute (writer->writer,
+                                            (const xmlChar *) "version",
+                                            (const xmlChar *) "2.0"));
+  check_write (writer,
+               xmlTextWriterStartElement (writer->writer,
+                                          (const xmlChar *) "head"));
+  check_write (writer,
+               xmlTextWriterWriteElement (writer->writer,
+                                          (const xmlChar *) "title",
+                                          (const xmlChar *) title));
+  check_write (writer, xmlTextWriterEndElement (writer->writer));
+  check_write (writer,
+               xmlTextWriterStartElement (writer->writer,
+                                          (const xmlChar *) "body"));
+
+  return writer;
+}
+
+void
+opml_writer_add (OpmlWriter  *writer,
+                 const gchar *title,
+                 const gchar *url)
+{
+  xmlTextWriterPtr w;
+
+  g_assert (writer != NULL);
+  g_assert (url != NULL);
+
+  w = writer->writer;
+  if (title == NULL) {
+    title = url;
+  }
+
+  check_write (writer,
+               xmlTextWriterStartElement (w, (const xmlChar *) "outline"));
+  check_write (writer,
+               xmlTextWriterWriteAttribute (w, (const xmlChar *) "type",
+                                            (const xmlChar *) "rss"));
+  check_write (writer,
+               xmlTextWriterWriteAttribute (w, (const xmlChar *) "text",
+                                            (const xmlChar *) title));
+  check_write (writer,
+               xmlTextWriterWriteAttribute (w, (const xmlChar *) "title",
+                                            (const xmlChar *) title));
+  check_write (writer,
+               xmlTextWriterWriteAttribute (w, (const xmlChar *) "xmlUrl",
+                                            (const xmlChar *) url));
+  check_write (writer, xmlTextWriterEndElement (w));
+}
+
+gboolean
+opml_writer_close (OpmlWriter  *writer,
+                   GError     **error)
+{
+  gboolean result;
+
+  g_assert (writer != NULL);
+
+  /* Ends the open elements and flushes the file. */
+  check_write (writer, xmlTextWriterEndDocument (writer->writer));
+  xmlFreeTextWriter (writer->writer);
+
+  result = !writer->failed;
+  if (!result) {
+    g_set_error (error, OPML_ERROR, OPML_ERROR_WRITE,
+                 "Failed to write %s", writer->filename);
+  }
+
+  g_free (writer->filename);
+  g_free (writer);
+
+  return result;
+}
@@ -0,0 +1,84 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OPML_H
+#define OPML_H
+
+#include <glib.h>
+
+/*
+ * OPML subscription lists.
+ *
+ * OPML files are read and written in a single streaming pass with
+ * libxml's text reader and writer, so no document tree is built and even
+ * lists of tens of thousands of feeds take little memory.  Each <outline>
+ * element with an "xmlUrl" attribute is a feed; other outlines are
+ * folders, which may be nested, and are flattened on reading.
+ */
+
+#define OPML_ERROR opml_error_quark ()
+
+typedef enum {
+  OPML_ERROR_PARSE,     /* the file could not be read or is not OPML */
+  OPML_ERROR_WRITE      /* the file could not be written */
+} OpmlError;
+
+/*
+ * Called for each feed read, with its title and URL.  TITLE is the URL if
+ * the outline has no title.
+ */
+typedef void (*OpmlFeedFunc) (const gchar *title,
+                              const gchar *url,
+                              gpointer     user_data);
+
+typedef struct _OpmlWriter OpmlWriter;
+
+GQuark       opml_error_quark  (void);
+
+/*
+ * Reads the OPML file FILENAME and passes its feeds to FUNC in document
+ * order.  Returns FALSE and sets ERROR if the file could not be read in
+ * full; the feeds read before the error have been passed to FUNC.
+ */
+gboolean     opml_read         (const gchar   *filename,
+                                OpmlFeedFunc   func,
+                                gpointer       user_data,
+                                GError       **error);
+
+/*
+ * Starts writing an OPML file titled TITLE to FILENAME.  Returns NULL and
+ * sets ERROR if the file cannot be created.
+ */
+OpmlWriter * opml_writer_new   (const gchar   *filename,
+                                const gchar   *title,
+                                GError       **error);
+
+/*
+ * Writes a feed with TITLE and URL.
+ */
+void         opml_writer_add   (OpmlWriter    *writer,
+                                const gchar   *title,
+                                const gchar   *url);
+
+/*
+ * Finishes the file and frees WRITER.  Returns FALSE and sets ERROR if
+ * any of it could not be written.
+ */
+gboolean     opml_writer_close (OpmlWriter    *writer,
+                                GError       **error);
+
+#endif
@@ -0,0 +1,378 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "itemset.h"
+#include "readstate.h"
+
+/* File magic and format version of the table. */
+#define TABLE_MAGIC   "GFRS"
+#define TABLE_VERSION 1
+
+/* The log is merged into the table when it holds more than
+   1 / COMPACT_RATIO as many hashes as the table, or COMPACT_MIN hashes
+   if that is more. */
+#define COMPACT_RATIO 8
+#define COMPACT_MIN   1024
+
+/* Owner of the hashes in the set of recent marks; there is only one. */
+#define RECENT_OWNER 1
+
+/* Table file header. */
+typedef struct {
+  gchar   magic[4];
+  guint32 version;
+  guint32 n_hashes;
+  guint32 reserved;
+} TableHeader;
+
+struct _ReadState {
+  gchar         *table_filename;
+  gchar         *log_filename;
+  GMappedFile   *table;         /* mapped table, or NULL if empty */
+  const guint64 *hashes;        /* sorted hashes of the table */
+  guint          n_hashes;
+  ItemSet       *recent;        /* hashes in the log */
+  GArray        *log;           /* hashes in the log, in order */
+  gint           log_fd;        /* log opened for appending, or -1 */
+  guint          compact_at;    /* length of the log at which it is merged
+                                   into the table */
+};
+
+/* Returns how many more hashes the log may take before it is merged into
+   the table. */
+static guint
+get_log_limit (ReadState *state)
+{
+  return MAX (COMPACT_MIN, state->n_hashes / COMPACT_RATIO);
+}
+
+/* Maps the table file of STATE.  A missing or invalid table leaves the
+   table empty. */
+static void
+map_table (ReadState *state)
+{
+  const TableHeader *header;
+  gsize              length, n_hashes;
+
+  state->table = g_mapped_file_new (state->table_filename, FALSE, NULL);
+  state->hashes = NULL;
+  state->n_hashes = 0;
+
+  if (state->table == NULL) {
+    return;
+  }
+
+  header = (const TableHeader *) g_mapped_file_get_contents (state->table);
+  length = g_mapped_file_get_length (state->table);
+
+  if (length < sizeof (TableHeader) ||
+      memcmp (header->magic, TABLE_MAGIC, 4) != 0 ||
+      GUINT32_FROM_LE (header->version) != TABLE_VERSION) {
+    g_warning ("Ignoring invalid read state table %s.",
+               state->table_filename);
+    g_mapped_file_free (state->table);
+    state->table = NULL;
+    return;
+  }
+
+  n_hashes = GUINT32_FROM_LE (header->n_hashes);
+  if (n_hashes > (length - sizeof (TableHeader)) / sizeof (guint64)) {
+    g_warning ("Ignoring truncated read state table %s.",
+               state->table_filename);
+    g_mapped_file_free (state->table);
+    state->table = NULL;
+    return;
+  }
+
+  /* The mapping is page aligned, so the hashes are suitably aligned. */
+  state->hashes = (const guint64 *) (header + 1);
+  state->n_hashes = n_hashes;
+}
+
+/* Returns TRUE if HASH is in the table of STATE. */
+static gboolean
+table_contains (ReadState *state,
+                guint64    hash)
+{
+  guint low = 0, high = state->n_hashes;
+
+  while (low < high) {
+    guint   middle = low + (high - low) / 2;
+    guint64 value = GUINT64_FROM_LE (state->hashes[middle]);
+
+    if (value == hash) {
+      return TRUE;
+    } else if (value < hash) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  return FALSE;
+}
+
+/* Records HASH as marked since the table was written. */
+static void
+add_recent (ReadState *state,
+            guint64    hash)
+{
+  item_set_claim (state->recent, hash, RECENT_OWNER);
+  g_array_append_val (state->log, hash);
+}
+
+/* Reads the hashes in the log file of STATE and opens it for appending.
+   A partial record left by a crash is cut off. */
+static void
+open_log (ReadState *state)
+{
+  gchar *contents;
+  gsize  length = 0, i;
+
+  if (g_file_get_contents (state->log_filename, &contents, &length, NULL)) {
+    for (i = 0; i + sizeof (guint64) <= length; i += sizeof (guint64)) {
+      guint64 hash;
+
+      memcpy (&hash, contents + i, sizeof (guint64));
+      hash = GUINT64_FROM_LE (hash);
+
+      /* The log may repeat the table if the program stopped after the
+         table was written but before the log was emptied. */
+      if (!read_state_is_read (state, hash)) {
+        add_recent (state, hash);
+      }
+    }
+    g_free (contents);
+  }
+
+  state->log_fd = g_open (state->log_filename,
+                          O_WRONLY | O_APPEND | O_CREAT,
+                          0600);
+  if (state->log_fd < 0) {
+    g_warning ("Failed to open %s: %s", state->log_filename,
+               g_strerror (errno));
+    return;
+  }
+
+  if (length % sizeof (guint64) != 0 &&
+      ftruncate (state->log_fd, length - length % sizeof (guint64)) != 0) {
+    g_warning ("Failed to truncate %s: %s", state->log_filename,
+               g_strerror (errno));
+  }
+}
+
+/* Comparison function for sorting hashes. */
+static gint
+compare_hashes (gconstpointer a,
+                gconstpointer b)
+{
+  guint64 x = *(const guint64 *) a;
+  guint64 y = *(const guint64 *) b;
+
+  return x < y ? -1 : x > y;
+}
+
+ReadState *
+read_state_open (const gchar *dirname)
+{
+  ReadState *state;
+
+  g_assert (dirname != NULL);
+
+  g_mkdir_with_parents (dirname, 0700);
+
+  state = g_new0 (ReadState, 1);
+  state->table_filename = g_build_filename (dirname, "read.table", NULL);
+  state->log_filename = g_build_filename (dirname, "read.log", NULL);
+  state->recent = item_set_new ();
+  state->log = g_array_new (FALSE, FALSE, sizeof (guint64));
+
+  map_table (state);
+  open_log (state);
+  state->compact_at = get_log_limit (state);
+
+  g_debug ("Read state: %u articles in the table, %u in the log.",
+           state->n_hashes, state->log->len);
+
+  if (state->log->len >= state->compact_at) {
+    read_state_compact (state);
+  }
+
+  return state;
+}
+
+gboolean
+read_state_is_read (ReadState *state,
+                    guint64    hash)
+{
+  g_assert (state != NULL);
+
+  return item_set_lookup (state->recent, hash) != 0 ||
+         table_contains (state, hash);
+}
+
+gboolean
+read_state_mark (ReadState *state,
+                 guint64    hash)
+{
+  guint64 record;
+
+  g_assert (state != NULL);
+
+  if (read_state_is_read (state, hash)) {
+    return FALSE;
+  }
+
+  add_recent (state, hash);
+
+  record = GUINT64_TO_LE (hash);
+  if (state->log_fd >= 0 &&
+      write (state->log_fd, &record, sizeof (record)) != sizeof (record)) {
+    g_warning ("Failed to write %s: %s", state->log_filename,
+               g_strerror (errno));
+  }
+
+  if (state->log->len >= state->compact_at) {
+    read_state_compact (state);
+  }
+
+  return TRUE;
+}
+
+gboolean
+read_state_compact (ReadState *state)
+{
+  TableHeader  header;
+  GString     *data;
+  GError      *error = NULL;
+  guint64     *log;
+  guint        n_log, i = 0, j = 0;
+  GTimer      *timer;
+
+  g_assert (state != NULL);
+
+  if (state->log->len == 0) {
+    return TRUE;
+  }
+
+  timer = g_timer_new ();
+
+  g_array_sort (state->log, compare_hashes);
+  log = (guint64 *) state->log->data;
+  n_log = state->log->len;
+
+  memcpy (header.magic, TABLE_MAGIC, 4);
+  header.version = GUINT32_TO_LE (TABLE_VERSION);
+  header.n_hashes = GUINT32_TO_LE (state->n_hashes + n_log);
+  header.reserved = 0;
+
+  data = g_string_sized_new (sizeof (header) +
+                             (state->n_hashes + n_log) * sizeof (guint64));
+  g_string_append_len (data, (const gchar *) &header, sizeof (header));
+
+  /* The hashes in the log are never in the table, so a plain merge gives
+     the new table. */
+  while (i < state->n_hashes || j < n_log) {
+    guint64 hash;
+
+    if (j == n_log ||
+        (i < state->n_hashes &&
+         GUINT64_FROM_LE (state->hashes[i]) < log[j])) {
+      hash = state->hashes[i++];
+    } else {
+      hash = GUINT64_TO_LE (log[j++]);
+    }
+
+    g_string_append_len (data, (const gchar *) &hash, sizeof (hash));
+  }
+
+  /* The table is replaced atomically; if it cannot be written, the log
+     is kept and the merge is tried again later. */
+  if (!g_file_set_contents (state->table_filename, data->str, data->len,
+                            &error)) {
+    g_warning ("Failed to write %s: %s", state->table_filename,
+               error->message);
+    g_error_free (error);
+    g_string_free (data, TRUE);
+    g_timer_destroy (timer);
+    state->compact_at = state->log->len + get_log_limit (state);
+    return FALSE;
+  }
+
+  g_string_free (data, TRUE);
+
+  if (state->table != NULL) {
+    g_mapped_file_free (state->table);
+  }
+  map_table (state);
+
+  if (state->log_fd >= 0 && ftruncate (state->log_fd, 0) != 0) {
+    g_warning ("Failed to truncate %s: %s", state->log_filename,
+               g_strerror (errno));
+  }
+
+  g_array_set_size (state->log, 0);
+  item_set_free (state->recent);
+  state->recent = item_set_new ();
+  state->compact_at = get_log_limit (state);
+
+  g_debug ("Merged %u read articles into a table of %u in %.1f ms.",
+           n_log, state->n_hashes, g_timer_elapsed (timer, NULL) * 1000.0);
+  g_timer_destroy (timer);
+
+  return TRUE;
+}
+
+guint
+read_state_size (ReadState *state)
+{
+  g_assert (state != NULL);
+
+  return state->n_hashes + state->log->len;
+}
+
+void
+read_state_close (ReadState *state)
+{
+  if (state == NULL) {
+    return;
+  }
+
+  if (state->log_fd >= 0) {
+    close (state->log_fd);
+  }
+  if (state->table != NULL) {
+    g_mapped_file_free (state->table);
+  }
+
+  item_set_free (state->recent);
+  g_array_free (state->log, TRUE);
+  g_free (state->table_filename);
+  g_free (state->log_filename);
+  g_free (state);
+}
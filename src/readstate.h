@@ -0,0 +1,83 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef READSTATE_H
+#define READSTATE_H
+
+#include <glib.h>
+
+/*
+ * Persistent store of the articles the user has read.
+ *
+ * Articles are identified by their hash, see feed_item_hash.  The store
+ * lives in two files in a directory of the caller's choice:
+ *
+ *   read.table  "GFRS", format version, number of hashes, reserved, and
+ *               the hashes in ascending order, all integers little-endian.
+ *               The file is memory mapped and searched in place, so
+ *               opening the store does not read it.
+ *   read.log    hashes marked read since the table was written, appended
+ *               as 8-byte little-endian integers.
+ *
+ * Marking an article read appends its hash to the log and to an
+ * in-memory set, so it costs one write of 8 bytes whatever the size of
+ * the store.  When the log has grown to a fraction of the table, the two
+ * are merged into a new table, which replaces the old one atomically, and
+ * the log is emptied; the cost of the merges is thus spread evenly over
+ * the marks.  A crash at any point loses at most the mark being written.
+ *
+ * The functions must be called from a single thread.
+ */
+
+typedef struct _ReadState ReadState;
+
+/*
+ * Opens the store in DIRNAME, creating the directory if needed.  A
+ * missing or invalid table is treated as empty.
+ */
+ReadState * read_state_open    (const gchar *dirname);
+
+/*
+ * Returns TRUE if the article with HASH has been marked read.
+ */
+gboolean    read_state_is_read (ReadState   *state,
+                                guint64      hash);
+
+/*
+ * Marks the article with HASH read.  Returns TRUE if it was not read
+ * before.
+ */
+gboolean    read_state_mark    (ReadState   *state,
+                                guint64      hash);
+
+/*
+ * Merges the log into the table.  Returns FALSE if the table could not be
+ * written, in which case the log is kept.
+ */
+gboolean    read_state_compact (ReadState   *state);
+
+/*
+ * Returns the number of articles marked read.
+ */
+guint       read_state_size    (ReadState   *state);
+
+/*
+ * Closes the store.
+ */
+void        read_state_close   (ReadState   *state);
+
+#endif
@@ -19,121 +19,447 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <config.h>
 #endif
 
+#include <string.h>
+#include <time.h>
 #include <gtk/gtk.h>
-#include <libxml/parser.h>
-#include <libxml/tree.h>
 
-#include "callbacks.h"
+#include "articlecache.h"
+#include "feedlist.h"
+#include "feedmenu.h"
+#include "feedparser.h"
+#include "itemset.h"
 #include "rssfeed.h"
+#include "scheduler.h"
+#include "searchindex.h"
+#include "startup.h"
+#include "syncengine.h"
 
+/* Interval in milliseconds at which the main loop applies finished sync
+   jobs; about one frame. */
+#define APPLY_INTERVAL 16
+
+/* Time budget in seconds for applying sync results in one go.  Results
+   left over are applied on the next tick, so the UI stays responsive. */
+#define APPLY_BUDGET 0.008
+
+#define SECONDS_PER_DAY (24 * 60 * 60)
+
+/* Queue of finished sync jobs waiting to be applied by the main thread.
+   No GTK objects are involved until a job reaches the main thread. */
+static GAsyncQueue  *results = NULL;
+static GStaticMutex  results_mutex = G_STATIC_MUTEX_INIT;
+
+/* Non-zero while an apply tick is scheduled. */
+static volatile gint apply_scheduled = 0;
+
+/* Hashes of the articles of all feeds, each owned by the feed which read
+   it first.  Created by the first feed loaded or synced. */
+static ItemSet      *seen = NULL;
+static GStaticMutex  seen_mutex = G_STATIC_MUTEX_INIT;
+
+/* Filter of the articles of all feeds, or NULL. */
+static FeedFilter   *filter = NULL;
+
+/* Search index of the articles of all feeds, loaded by the first feed
+   synced. */
+static SearchIndex  *search_index = NULL;
+static GStaticMutex  search_index_mutex = G_STATIC_MUTEX_INIT;
+
+/* Seconds a sync job may take by default, or zero for any time. */
+static gint          deadline = RSS_FEED_DEFAULT_DEADLINE;
+
+/* State of the cache loader. */
+typedef struct {
+  FeedArticles *articles;
+  guint32       owner;
+  guint         max_items;
+  gint64        oldest;     /* date of the oldest article to keep, or
+                               zero */
+} CacheLoad;
+
+/* Returns the set of seen articles, creating it if needed. */
+static ItemSet *
+get_seen ()
+{
+  g_static_mutex_lock (&seen_mutex);
+  if (seen == NULL) {
+    seen = item_set_new ();
+  }
+  g_static_mutex_unlock (&seen_mutex);
+
+  return seen;
+}
+
+/* Returns the name of the search index file. */
+static gchar *
+get_index_filename ()
+{
+  return g_build_filename (g_get_user_cache_dir (),
+                           PACKAGE,
+                           "search.index",
+                           NULL);
+}
+
+void
+rss_feed_set_filter (FeedFilter *value)
+{
+  /* Running jobs may still use the old filter, so it is kept. */
+  if (filter != NULL) {
+    g_warning ("The article filter can be set only once.");
+    feed_filter_free (value);
+    return;
+  }
+
+  filter = value;
+}
+
+FeedFilter *
+rss_feed_get_filter ()
+{
+  return filter;
+}
+
+SearchIndex *
+rss_feed_get_index ()
+{
+  g_static_mutex_lock (&search_index_mutex);
+  if (search_index == NULL) {
+    gchar  *filename;
+    GTimer *timer;
+
+    timer = g_timer_new ();
+    filename = get_index_filename ();
+    search_index = search_index_new ();
+    search_index_load (search_index, filename);
+    g_free (filename);
+
+    g_debug ("Loaded the search index of %u articles in %.1f ms.",
+             search_index_get_size (search_index),
+             g_timer_elapsed (timer, NULL) * 1000.0);
+    g_timer_destroy (timer);
+  }
+  g_static_mutex_unlock (&search_index_mutex);
+
+  return search_index;
+}
+
+void
+rss_feed_save_index ()
+{
+  gchar *filename;
+
+  if (search_index == NULL) {
+    return;
+  }
+
+  filename = get_index_filename ();
+  search_index_save (search_index, filename);
+  g_free (filename);
+}
+
+/* Returns the date of the oldest article FEED keeps, or zero. */
+static gint64
+get_oldest (Feed *feed)
+{
+  if (feed->max_age == 0) {
+    return 0;
+  }
+
+  return time (NULL) - (gint64) feed->max_age * SECONDS_PER_DAY;
+}
+
+/* Article callback of the cache loader.  Appends a copy of ITEM to the
+   articles being loaded, unless the filter or the retention policy drops
+   it, for they may have changed since the cache was written, or another
+   feed already has it. */
 static void
-parse_item_element (xmlNodePtr  root,
-                    GtkWidget  *menu)
-{
-  xmlNodePtr  node;
-  GtkWidget  *item;
-
-  g_assert (root != NULL);
-  g_assert (menu != NULL);
-
-  item = gtk_menu_item_new ();
-
-  for (node = root->children; node != NULL; node = node->next) {
-    if (xmlStrcmp (node->name, (const xmlChar *) "title") == 0) {
-      gchar     *title;
-      GtkWidget *label;
-
-      title = (gchar *) xmlNodeGetContent (node);
-      g_strstrip (title);
-
-      label = g_object_new (GTK_TYPE_LABEL,
-                            "label", title,
-                            "xalign", 0.0f,
-                            NULL);
-
-      gtk_container_add (GTK_CONTAINER(item), label);
-    } else if (xmlStrcmp (node->name, (const xmlChar *) "link") == 0) {
-      gtk_widget_set_tooltip_text (item,
-                                   (const gchar *) xmlNodeGetContent (node));
- 
-      g_signal_connect (item,
-                        "activate",
-                        G_CALLBACK(on_feed_open),
-                        g_strdup ((const gchar *) xmlNodeGetContent (node)));
-    }
+copy_item (const FeedItem *item,
+           CacheLoad      *load)
+{
+  if (filter != NULL && feed_filter_match (filter, item)) {
+    return;
+  }
+
+  if ((item->date != 0 && item->date < load->oldest) ||
+      (load->max_items > 0 &&
+       load->articles->items->len >= load->max_items)) {
+    return;
   }
 
-  gdk_threads_enter ();
-  gtk_menu_shell_append (GTK_MENU_SHELL(menu), item);
-  gtk_widget_show_all (item);
-  gdk_threads_leave ();
+  if (item_set_claim (get_seen (), feed_item_hash (item), load->owner)) {
+    feed_articles_add (load->articles, item);
+  }
 }
 
+gboolean
+rss_feed_load_cache (Feed *feed)
+{
+  CacheLoad load;
+
+  g_assert (feed != NULL);
+  g_assert (feed->menu != NULL);
+
+  load.articles = feed_articles_new ();
+  load.owner = feed->owner;
+  load.max_items = feed->max_items;
+  load.oldest = get_oldest (feed);
+
+  /* The cached articles are the feed's current generation. */
+  item_set_renew (get_seen (), load.owner);
+
+  if (!article_cache_load (feed->source,
+                           &feed->fingerprint,
+                           (FeedItemFunc) copy_item,
+                           &load)) {
+    feed_articles_free (load.articles);
+    return FALSE;
+  }
+
+  feed_menu_set_articles (feed, load.articles);
+
+  return TRUE;
+}
+
+/* Drops the reference of FEED to the token of its sync job. */
 static void
-parse_channel_element (xmlNodePtr  root,
-                       GtkWidget  *menu)
-{
-  xmlNodePtr node;
-  g_assert (root != NULL);
-  g_assert (menu != NULL);
-  for (node = root->children; node != NULL; node = node->next) {
-    if (xmlStrcmp (node->name, (const xmlChar *) "item") == 0) {
-      parse_item_element (node, menu);
-    }
+release_cancel (Feed *feed)
+{
+  if (feed->cancel != NULL) {
+    cancel_token_unref (feed->cancel);
+    feed->cancel = NULL;
   }
 }
 
+/* Applies the finished JOB to its feed: updates the feed's menu in a
+   single pass, stores the fingerprint and the HTTP validators and
+   schedules the next sync.  Runs in the main thread. */
 static void
-parse_rss_element (xmlNodePtr  root,
-                   GtkWidget  *menu)
-{
-  xmlNodePtr node;
-  g_assert (root != NULL);
-  g_assert (menu != NULL);
-  for (node = root->children; node != NULL; node = node->next) {
-    if (xmlStrcmp (node->name, (const xmlChar *) "channel") == 0) {
-      parse_channel_element (node, menu);
-      break;
+apply_result (FeedSyncJob *job)
+{
+  Feed   *feed;
+  GTimer *timer;
+
+  /* The job refers to its feed by ID, since the feed may have been deleted
+     while the job was running. */
+  feed = feeds_lookup (GPOINTER_TO_UINT(job->user_data));
+  if (feed == NULL) {
+    /* The job may have claimed and indexed articles after the feed was
+       forgotten, unless a feed of the same source has been added since. */
+    if (feeds_lookup_owner (job->owner) == NULL) {
+      item_set_release (job->seen, job->owner);
+      search_index_remove (job->index, job->owner);
     }
+    return;
   }
+
+  if (feed->cancel == job->cancel) {
+    release_cancel (feed);
+  }
+
+  /* A cancelled job tells nothing about the feed, which keeps its articles
+     and statistics and is synced again at the usual interval.  Its result
+     is dropped even if it finished before noticing, since a newer job of
+     the feed may have been queued meanwhile, which then schedules the
+     feed instead. */
+  if (job->status == FEED_SYNC_CANCELLED ||
+      cancel_token_is_cancelled (job->cancel)) {
+    if (feed->cancel == NULL) {
+      scheduler_feed_done (feed, TRUE);
+    }
+    return;
+  }
+
+  timer = g_timer_new ();
+
+  if (job->status == FEED_SYNC_CHANGED) {
+    /* The articles are handed over to the feed without copying. */
+    feed_menu_set_articles (feed, job->articles);
+    job->articles = NULL;
+    feed->fingerprint = job->fingerprint;
+
+    g_free (feed->etag);
+    g_free (feed->last_modified);
+    feed->etag = job->etag;
+    feed->last_modified = job->last_modified;
+    job->etag = NULL;
+    job->last_modified = NULL;
+  }
+
+  if (job->status == FEED_SYNC_CHANGED || job->status == FEED_SYNC_UNCHANGED) {
+    feed->channel = job->channel;
+  }
+
+  scheduler_feed_done (feed, job->status != FEED_SYNC_FAILED);
+
+  /* Record the statistics shown in the Feeds dialog. */
+  feed->stats.sync = job->stats;
+  feed->stats.apply_time = g_timer_elapsed (timer, NULL);
+  g_timer_destroy (timer);
+
+  if (job->status == FEED_SYNC_FAILED) {
+    g_free (feed->stats.last_error);
+    feed->stats.last_error = job->error;
+    job->error = NULL;
+  } else {
+    feed->stats.last_success = time (NULL);
+  }
+
+  feed_list_update (feed);
 }
 
-gpointer
-rss_feed_parser (RSSFeedParser *parser)
+/* Main loop callback which applies finished sync jobs in a batch, within
+   a time budget.  Keeps running while jobs are waiting. */
+static gboolean
+apply_results (gpointer user_data)
 {
-  xmlDocPtr   doc;
-  xmlNodePtr  node;
-  GtkWidget  *menu;
+  GTimer      *timer;
+  FeedSyncJob *job;
+  guint        n_applied = 0;
 
-  g_assert (parser != NULL);
-  g_assert (parser->menu != NULL);
-  g_assert (parser->source != NULL);
+  timer = g_timer_new ();
 
-  menu = gtk_menu_new ();
-  gtk_menu_item_set_submenu (GTK_MENU_ITEM(parser->menu),
-                             menu);
-  
-  doc = xmlReadFile (parser->source, NULL, 0);
-  if (doc == NULL) {
-    g_warning ("Failed to read %s", parser->source);
-    goto cleanup;
+  while (g_timer_elapsed (timer, NULL) < APPLY_BUDGET &&
+         (job = g_async_queue_try_pop (results)) != NULL) {
+    apply_result (job);
+    feed_sync_job_free (job);
+    n_applied++;
   }
 
-  g_debug ("Reading %s", parser->source);
+  g_timer_destroy (timer);
 
-  for (node = xmlDocGetRootElement (doc);
-       node!= NULL;
-       node = node->next) {
-    if (xmlStrcmp (node->name, (const xmlChar *) "rss") == 0) {
-      parse_rss_element (node, menu);
-      break;
-    }
-  }  
+  if (n_applied > 0) {
+    startup_mark (STARTUP_FIRST_FEED);
+    g_debug ("Applied %u sync results; %u articles seen, %lu bytes.",
+             n_applied, item_set_size (get_seen ()),
+             (gulong) item_set_memory (get_seen ()));
+    feed_menu_log_usage ();
+  }
+
+  if (g_async_queue_length (results) > 0) {
+    return TRUE;
+  }
+
+  /* A worker may have pushed a job after the queue was found empty but
+     before the flag is cleared; it would not schedule a new tick. */
+  g_atomic_int_set (&apply_scheduled, 0);
+  if (g_async_queue_length (results) > 0 &&
+      g_atomic_int_compare_and_exchange (&apply_scheduled, 0, 1)) {
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+/* Completion callback of the sync jobs.  Hands JOB over to the main
+   thread, whatever its outcome, so the feed gets scheduled again.  Runs in
+   a worker thread. */
+static void
+push_result (FeedSyncJob *job)
+{
+  g_static_mutex_lock (&results_mutex);
+  if (results == NULL) {
+    results = g_async_queue_new ();
+  }
+  g_static_mutex_unlock (&results_mutex);
+
+  g_async_queue_push (results, job);
+
+  if (g_atomic_int_compare_and_exchange (&apply_scheduled, 0, 1)) {
+    gdk_threads_add_timeout (APPLY_INTERVAL, apply_results, NULL);
+  }
+}
 
-  g_debug ("Done reading %s", parser->source);
+gboolean
+rss_feed_sync (Feed *feed)
+{
+  FeedSyncJob *job;
+
+  g_assert (feed != NULL);
+  g_assert (feed->source != NULL);
+
+  /* Two jobs of the same feed could finish in either order, and the older
+     result would then replace the newer one. */
+  if (feed->cancel != NULL) {
+    g_debug ("%s is already being synced", feed->source);
+    return TRUE;
+  }
+
+  job = feed_sync_job_new (feed->source, push_result,
+                           GUINT_TO_POINTER(feed->id));
+  job->etag = g_strdup (feed->etag);
+  job->last_modified = g_strdup (feed->last_modified);
+  job->fingerprint = feed->fingerprint;
+  job->filter = filter;
+  job->max_items = feed->max_items;
+  job->max_age = (gint64) feed->max_age * SECONDS_PER_DAY;
+  job->seen = get_seen ();
+  job->index = rss_feed_get_index ();
+  job->owner = feed->owner;
+  job->cancel = cancel_token_new (feed->sync_deadline > 0
+                                  ? feed->sync_deadline : deadline);
+
+  /* The feed keeps a reference so the job can be cancelled while it is
+     queued or running. */
+  feed->cancel = cancel_token_ref (job->cancel);
+
+  if (!sync_engine_push (job)) {
+    release_cancel (feed);
+    feed_sync_job_free (job);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+void
+rss_feed_cancel (Feed *feed)
+{
+  g_assert (feed != NULL);
+
+  if (feed->cancel != NULL) {
+    g_debug ("Cancelling the sync of %s", feed->source);
+    cancel_token_cancel (feed->cancel);
+    release_cancel (feed);
+  }
+}
+
+void
+rss_feed_cancel_all ()
+{
+  guint i;
+
+  for (i = 0; i < feeds_get_count (); i++) {
+    rss_feed_cancel (feeds_get (i));
+  }
+}
+
+void
+rss_feed_set_deadline (gint seconds)
+{
+  deadline = MAX (seconds, 0);
+}
+
+gint
+rss_feed_get_deadline ()
+{
+  return deadline;
+}
+
+void
+rss_feed_forget (Feed *feed)
+{
+  g_assert (feed != NULL);
+  g_assert (feed->source != NULL);
+
+  /* The worker holds only copies of the feed's data, but there is no
+     point in letting it finish. */
+  rss_feed_cancel (feed);
+
+  if (seen != NULL) {
+    item_set_release (seen, feed->owner);
+  }
 
- cleanup:
-  xmlFreeDoc (doc);
-  g_free (parser);
-  return NULL;
+  /* The index is loaded if need be, or a feed deleted before the first
+     sync would stay in it. */
+  search_index_remove (rss_feed_get_index (), feed->owner);
 }
@@ -18,15 +18,90 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef RSSFEED_H
 #define RSSFEED_H
 
+#include "feedfilter.h"
+#include "feeds.h"
+#include "searchindex.h"
+
+/*
+ * Default number of seconds a sync job may take.
+ */
+#define RSS_FEED_DEFAULT_DEADLINE 60
+
+/*
+ * Queues a sync job for FEED on the sync engine, see feedsync.h.  The
+ * finished job is handed to the main thread, which rebuilds the feed's
+ * menu in a single pass if the feed has changed, updates the validators
+ * of FEED and schedules the next sync.  Articles matching the filter, or
+ * which another feed has already read, are dropped, and the rest are
+ * added to the search index.  The timings of the job are stored in the
+ * statistics of FEED.  The job fails if it takes longer than the deadline
+ * of FEED, or the default deadline if FEED has none, and may be cancelled
+ * with rss_feed_cancel.  If a job of FEED is already queued or running, no
+ * other is queued, so the results of a feed are applied in order.
+ * Returns FALSE if the job could not be queued.
+ */
+gboolean rss_feed_sync (Feed *feed);
+
+/*
+ * Cancels the sync job of FEED, if it has one queued or running.  The job
+ * ends promptly, even if it is waiting on the network, and FEED keeps its
+ * articles.  Must be called from the main thread.
+ */
+void     rss_feed_cancel     (Feed *feed);
+
+/*
+ * Cancels the sync jobs of all feeds.
+ */
+void     rss_feed_cancel_all ();
+
+/*
+ * Sets the number of seconds a sync job may take, unless its feed has a
+ * deadline of its own.  Zero lets the jobs take any time.
+ */
+void     rss_feed_set_deadline (gint seconds);
+
 /*
- * RSS 0.91 Feed Parser.
+ * Returns the number of seconds a sync job may take by default.
  */
+gint     rss_feed_get_deadline ();
 
-typedef struct {
-  GtkWidget   *menu;
-  const gchar *source;
-} RSSFeedParser;
+/*
+ * Populates the menu of FEED from the article cache written by the last
+ * successful sync.  Must be called from the main thread.  Returns FALSE if
+ * the feed has no cached articles.
+ */
+gboolean rss_feed_load_cache (Feed *feed);
+
+/*
+ * Cancels the sync job of FEED, releases the articles of FEED in the set
+ * of articles seen in all feeds, so other feeds may show them, and
+ * removes them from the search index.  Called when FEED is deleted.
+ */
+void     rss_feed_forget (Feed *feed);
+
+/*
+ * Sets the filter of the articles of all feeds, see feedfilter.h.  The
+ * feeds take ownership of the compiled FILTER.  The filter can be set only
+ * once, before the first sync.
+ */
+void     rss_feed_set_filter (FeedFilter *filter);
 
-gpointer rss_feed_parser (RSSFeedParser *parser);
+/*
+ * Returns the filter of the articles of all feeds, or NULL.
+ */
+FeedFilter *
+         rss_feed_get_filter ();
+
+/*
+ * Returns the search index of the articles of all feeds, loading it from
+ * '$XDG_CACHE_HOME/gtk-feed/search.index' on first use.
+ */
+SearchIndex *
+         rss_feed_get_index  ();
+
+/*
+ * Writes the search index back to its file if it has changed.
+ */
+void     rss_feed_save_index ();
 
 #endif
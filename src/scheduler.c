@@ -0,0 +1,386 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <time.h>
+#include <gtk/gtk.h>
+
+#include "scheduler.h"
+
+/* Due times are rounded up to multiples of this many seconds, so feeds
+   due at about the same time are synchronized together. */
+#define TICK 60
+
+/* Delay in seconds before the first retry of a failed feed.  The delay is
+   doubled on each further failure, up to MAX_BACKOFF. */
+#define MIN_BACKOFF 60
+#define MAX_BACKOFF (6 * 60 * 60)
+
+/* Relative amount of random jitter added to the retry delays, so feeds
+   failing together do not retry in lockstep. */
+#define JITTER 0.2
+
+/* Interval in milliseconds between the steps of the startup sync. */
+#define STARTUP_STEP 250
+
+static gint       interval = SCHEDULER_DEFAULT_INTERVAL;
+static gint       startup_window = SCHEDULER_DEFAULT_STARTUP_WINDOW;
+
+/* Feeds waiting for their first sync, in the order they are synced, the
+   number of them started so far and the time since the first one.  The
+   slots of feeds removed meanwhile are NULL. */
+static GPtrArray *startup = NULL;
+static guint      startup_next = 0;
+static GTimer    *startup_timer = NULL;
+
+/* Scheduled feeds as a binary min-heap on the due time.  Each feed knows
+   its position in the heap, so it can be moved or removed in place. */
+static GPtrArray *queue = NULL;
+
+/* Main loop timeout armed for the earliest due time, or zero. */
+static guint      timer_id = 0;
+static time_t     timer_due = 0;
+
+#define QUEUE_FEED(i) ((Feed *) g_ptr_array_index (queue, (i)))
+
+/* Stores FEED at position I of the heap. */
+static void
+queue_set (guint  i,
+           Feed  *feed)
+{
+  g_ptr_array_index (queue, i) = feed;
+  feed->queue_index = i;
+}
+
+/* Moves the feed at position I towards the root until the heap order
+   holds. */
+static void
+sift_up (guint i)
+{
+  Feed *feed = QUEUE_FEED (i);
+
+  while (i > 0 && QUEUE_FEED ((i - 1) / 2)->next_due > feed->next_due) {
+    queue_set (i, QUEUE_FEED ((i - 1) / 2));
+    i = (i - 1) / 2;
+  }
+
+  queue_set (i, feed);
+}
+
+/* Moves the feed at position I towards the leaves until the heap order
+   holds. */
+static void
+sift_down (guint i)
+{
+  Feed *feed = QUEUE_FEED (i);
+
+  for (;;) {
+    guint child = 2 * i + 1;
+
+    if (child >= queue->len) {
+      break;
+    }
+    if (child + 1 < queue->len &&
+        QUEUE_FEED (child + 1)->next_due < QUEUE_FEED (child)->next_due) {
+      child++;
+    }
+    if (QUEUE_FEED (child)->next_due >= feed->next_due) {
+      break;
+    }
+
+    queue_set (i, QUEUE_FEED (child));
+    i = child;
+  }
+
+  queue_set (i, feed);
+}
+
+/* Removes FEED from the heap. */
+static void
+queue_remove (Feed *feed)
+{
+  guint  i = feed->queue_index;
+  Feed  *last;
+
+  g_assert (QUEUE_FEED (i) == feed);
+
+  last = g_ptr_array_remove_index (queue, queue->len - 1);
+  if (last != feed) {
+    queue_set (i, last);
+    sift_down (i);
+    sift_up (last->queue_index);
+  }
+
+  feed->next_due = 0;
+}
+
+/* Returns TRUE if CHANNEL asks not to be fetched at time T. */
+static gboolean
+is_skipped (const FeedChannel *channel,
+            time_t             t)
+{
+  struct tm tm;
+
+  gmtime_r (&t, &tm);
+
+  return (channel->skip_hours & (1 << tm.tm_hour)) != 0 ||
+         (channel->skip_days & (1 << tm.tm_wday)) != 0;
+}
+
+/* Returns the first time from T on which is not skipped by CHANNEL. */
+static time_t
+skip (const FeedChannel *channel,
+      time_t             t)
+{
+  time_t start = t;
+  gint   i;
+
+  /* Skipping is in whole hours, so at most a week needs to be tried. */
+  for (i = 0; i < 7 * 24 && is_skipped (channel, t); i++) {
+    t += 60 * 60 - t % (60 * 60);
+  }
+
+  /* A feed skipping every hour is fetched anyway. */
+  return i < 7 * 24 ? t : start;
+}
+
+static gboolean on_timer (gpointer user_data);
+
+/* Arms the timer for the earliest due time. */
+static void
+arm_timer ()
+{
+  time_t due;
+  time_t now;
+
+  due = queue->len > 0 ? QUEUE_FEED (0)->next_due : 0;
+  if (timer_id != 0 && timer_due == due) {
+    return;
+  }
+
+  if (timer_id != 0) {
+    g_source_remove (timer_id);
+    timer_id = 0;
+  }
+
+  if (due == 0) {
+    return;
+  }
+
+  now = time (NULL);
+  timer_due = due;
+  timer_id = gdk_threads_add_timeout_seconds (due > now ? due - now : 0,
+                                              on_timer,
+                                              NULL);
+}
+
+/* Timer callback.  Synchronizes all feeds which are due. */
+static gboolean
+on_timer (gpointer user_data)
+{
+  time_t now = time (NULL);
+  guint  n_due = 0;
+
+  timer_id = 0;
+
+  while (queue->len > 0 && QUEUE_FEED (0)->next_due <= now) {
+    Feed *feed = QUEUE_FEED (0);
+
+    queue_remove (feed);
+    feed->dirty = TRUE;
+    n_due++;
+  }
+
+  if (n_due > 0) {
+    g_debug ("%u feeds due, %u scheduled.", n_due, queue->len);
+    sync_feeds ();
+  }
+
+  arm_timer ();
+  return FALSE;
+}
+
+void
+scheduler_set_interval (gint minutes)
+{
+  interval = MAX (minutes, 0);
+}
+
+gint
+scheduler_get_interval ()
+{
+  return interval;
+}
+
+void
+scheduler_set_startup_window (gint seconds)
+{
+  startup_window = MAX (seconds, 0);
+}
+
+gint
+scheduler_get_startup_window ()
+{
+  return startup_window;
+}
+
+/* Startup sync step.  Synchronizes the feeds whose turn has come, so the
+   feeds are started evenly over the startup window.  Feeds synced
+   meanwhile for another reason are already scheduled and are skipped. */
+static gboolean
+on_startup_step (gpointer user_data)
+{
+  gdouble elapsed;
+  guint   n_due;
+  guint   n_started = 0;
+
+  elapsed = g_timer_elapsed (startup_timer, NULL);
+  if (startup_window == 0 || elapsed >= startup_window) {
+    n_due = startup->len;
+  } else {
+    n_due = MIN (startup->len * elapsed / startup_window + 1, startup->len);
+  }
+
+  for (; startup_next < n_due; startup_next++) {
+    Feed *feed = g_ptr_array_index (startup, startup_next);
+
+    if (feed != NULL && feed->next_due == 0) {
+      feed->dirty = TRUE;
+      n_started++;
+    }
+  }
+
+  if (n_started > 0) {
+    g_debug ("Startup sync of %u feeds, %u of %u started after %.1f s.",
+             n_started, startup_next, startup->len, elapsed);
+    sync_feeds ();
+  }
+
+  if (startup_next < startup->len) {
+    return TRUE;
+  }
+
+  g_ptr_array_free (startup, TRUE);
+  startup = NULL;
+  g_timer_destroy (startup_timer);
+  startup_timer = NULL;
+
+  return FALSE;
+}
+
+void
+scheduler_start ()
+{
+  guint i;
+
+  g_assert (startup == NULL);
+
+  /* Feeds with nothing to show go first. */
+  startup = g_ptr_array_sized_new (feeds_get_count ());
+  for (i = 0; i < feeds_get_count (); i++) {
+    if (feeds_get (i)->articles == NULL) {
+      g_ptr_array_add (startup, feeds_get (i));
+    }
+  }
+  for (i = 0; i < feeds_get_count (); i++) {
+    if (feeds_get (i)->articles != NULL) {
+      g_ptr_array_add (startup, feeds_get (i));
+    }
+  }
+
+  startup_next = 0;
+  startup_timer = g_timer_new ();
+
+  if (on_startup_step (NULL)) {
+    gdk_threads_add_timeout (STARTUP_STEP, on_startup_step, NULL);
+  }
+}
+
+void
+scheduler_feed_done (Feed     *feed,
+                     gboolean  success)
+{
+  time_t now;
+  time_t due;
+
+  g_assert (feed != NULL);
+
+  if (queue == NULL) {
+    queue = g_ptr_array_new ();
+  }
+
+  if (feed->next_due != 0) {
+    queue_remove (feed);
+  }
+
+  if (success) {
+    feed->failures = 0;
+  } else {
+    feed->failures++;
+  }
+
+  if (interval == 0) {
+    arm_timer ();
+    return;
+  }
+
+  now = time (NULL);
+
+  if (success) {
+    due = now + MAX (interval, feed->channel.ttl) * 60;
+  } else {
+    gdouble delay;
+
+    delay = MIN (MIN_BACKOFF << MIN (feed->failures - 1, 16), MAX_BACKOFF);
+    delay *= g_random_double_range (1.0 - JITTER, 1.0 + JITTER);
+    due = now + (time_t) delay;
+  }
+
+  due = skip (&feed->channel, due);
+  due += (TICK - due % TICK) % TICK;
+
+  feed->next_due = due;
+  g_ptr_array_add (queue, feed);
+  feed->queue_index = queue->len - 1;
+  sift_up (feed->queue_index);
+
+  arm_timer ();
+}
+
+void
+scheduler_remove (Feed *feed)
+{
+  g_assert (feed != NULL);
+
+  if (feed->next_due != 0) {
+    queue_remove (feed);
+    arm_timer ();
+  }
+
+  if (startup != NULL) {
+    guint i;
+
+    for (i = startup_next; i < startup->len; i++) {
+      if (g_ptr_array_index (startup, i) == feed) {
+        g_ptr_array_index (startup, i) = NULL;
+      }
+    }
+  }
+}
@@ -0,0 +1,92 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "feeds.h"
+
+/*
+ * The scheduler reloads feeds at regular time intervals.  Each feed has a
+ * time when it is next due, kept in a priority queue ordered by due time.
+ * A single main loop timeout is armed for the earliest due time; when it
+ * fires, all feeds due by then are marked dirty and synchronized in one
+ * go.  Due times are rounded up to shared ticks, so many feeds are
+ * synchronized by a few wakeups.
+ *
+ * A feed is scheduled again after each sync.  After a successful sync the
+ * feed is due after the refresh interval or the feed's <ttl>, whichever is
+ * longer, moved out of the hours and days listed in the feed's
+ * <skipHours> and <skipDays>.  After a failed sync the feed is retried
+ * with an exponentially growing, randomly jittered delay.
+ *
+ * The first sync of the feeds after startup is spread evenly over a
+ * window of time, rather than fetching all feeds at once while the
+ * desktop is still starting up.  Feeds with empty menus go first.
+ */
+
+/*
+ * Default refresh interval in minutes.
+ */
+#define SCHEDULER_DEFAULT_INTERVAL 30
+
+/*
+ * Sets the refresh interval in minutes.  Zero disables reloading feeds
+ * automatically.
+ */
+void scheduler_set_interval (gint minutes);
+
+/*
+ * Returns the refresh interval in minutes.
+ */
+gint scheduler_get_interval ();
+
+/*
+ * Default length of the startup sync window in seconds.
+ */
+#define SCHEDULER_DEFAULT_STARTUP_WINDOW 30
+
+/*
+ * Sets the number of seconds the first sync of the feeds is spread over.
+ * Zero syncs all feeds at once.
+ */
+void scheduler_set_startup_window (gint seconds);
+
+/*
+ * Returns the length of the startup sync window in seconds.
+ */
+gint scheduler_get_startup_window ();
+
+/*
+ * Starts the first sync of all feeds, spread over the startup window.
+ * Must be called from the main thread.
+ */
+void scheduler_start ();
+
+/*
+ * Schedules the next sync of FEED after a sync has finished.  SUCCESS
+ * tells whether the feed was read.  Must be called from the main thread.
+ */
+void scheduler_feed_done (Feed     *feed,
+                          gboolean  success);
+
+/*
+ * Removes FEED from the schedule.  Must be called before FEED is freed.
+ */
+void scheduler_remove (Feed *feed);
+
+#endif
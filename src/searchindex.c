@@ -0,0 +1,1286 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib.h>
+
+#include "searchindex.h"
+
+/* File magic and format version. */
+#define INDEX_MAGIC   "GFSI"
+#define INDEX_VERSION 1
+
+/* Offset of a missing string. */
+#define NO_STRING 0xffffffff
+
+/* Number of a removed article while the index is compacted. */
+#define NO_DOC 0xffffffff
+
+/* Words shorter than MIN_WORD_LENGTH characters or longer than
+   MAX_WORD_LENGTH bytes are not indexed. */
+#define MIN_WORD_LENGTH 2
+#define MAX_WORD_LENGTH 32
+
+/* Weight of a word in the title, relative to a word in the description. */
+#define TITLE_WEIGHT 4
+
+/* Weight of a word which the last word of a query is a prefix of,
+   relative to a word matching it exactly. */
+#define PREFIX_WEIGHT 0.7f
+
+/* Maximum number of words in a query; the rest are ignored. */
+#define MAX_QUERY_WORDS 8
+
+/* Maximum number of words an incomplete word of a query is expanded to;
+   the words in the most articles are kept. */
+#define MAX_EXPANSIONS 256
+
+/* Initial number of slots of the article table; always a power of two.
+   The table is doubled when it is more than three quarters full. */
+#define INITIAL_SLOTS 1024
+
+/* Multiplier for Fibonacci hashing of the article hashes. */
+#define FIBONACCI G_GUINT64_CONSTANT(0x9e3779b97f4a7c15)
+
+/* File header. */
+typedef struct {
+  gchar   magic[4];
+  guint32 version;
+  guint32 n_docs;
+  guint32 n_terms;
+  guint32 postings_length;
+  guint32 strings_length;
+} IndexHeader;
+
+/* Article record of the file. */
+typedef struct {
+  guint64 hash;
+  gint64  date;
+  guint32 title;
+  guint32 link;
+  guint32 owner;
+  guint32 reserved;
+} DocRecord;
+
+/* Word record of the file. */
+typedef struct {
+  guint32 text;
+  guint32 postings;
+  guint32 length;
+  guint32 n_docs;
+  guint32 last_doc;
+} TermRecord;
+
+/* Indexed article.  OWNER is zero once the article has been removed;
+   removed articles keep their numbers and postings until the index is
+   compacted. */
+typedef struct {
+  guint64      hash;
+  gint64       date;
+  const gchar *title;
+  const gchar *link;
+  guint32      owner;
+  guint32      generation;  /* generation of its owner it was last added
+                               in */
+} Document;
+
+/* Articles of a feed. */
+typedef struct {
+  GArray  *ids;         /* numbers of the articles of the feed, and of
+                           some it has since lost */
+  guint32  generation;  /* generation being added */
+} Owner;
+
+/* Indexed word and its postings. */
+typedef struct {
+  const gchar *text;
+  GByteArray  *postings;    /* article number deltas and weights */
+  guint32      n_docs;      /* number of articles containing the word */
+  guint32      last_doc;    /* last article containing the word */
+} Term;
+
+struct _SearchIndex {
+  GStaticMutex  mutex;
+  GArray       *docs;       /* Document records by article number */
+  GStringChunk *strings;    /* titles, links and words */
+  guint32      *slots;      /* article numbers plus one, by article hash,
+                               with linear probing; zero if empty */
+  guint         n_slots;
+  guint         shift;
+  guint         n_removed;  /* removed articles in DOCS */
+  GHashTable   *owners;     /* feed identifier to Owner */
+  guint32       next_generation;
+  GHashTable   *terms;      /* word to Term */
+  GPtrArray    *sorted;     /* Terms, sorted by word up to N_SORTED */
+  guint         n_sorted;
+  gfloat       *scores;     /* per-article scratch space of queries, */
+  guint8       *hits;       /* N_SCRATCH long and kept zeroed */
+  guint         n_scratch;
+  gboolean      dirty;      /* if TRUE, INDEX has changed since it was
+                               loaded or saved */
+};
+
+/* Callback which is called for each word of a text. */
+typedef void (*WordFunc) (const gchar *word, gpointer user_data);
+
+/* Passes WORD to FUNC if it is of indexable length, and empties it. */
+static void
+flush_word (GString  *word,
+            guint    *n_chars,
+            WordFunc  func,
+            gpointer  user_data)
+{
+  if (*n_chars >= MIN_WORD_LENGTH && word->len <= MAX_WORD_LENGTH) {
+    func (word->str, user_data);
+  }
+
+  g_string_truncate (word, 0);
+  *n_chars = 0;
+}
+
+/* Splits TEXT into case folded words of letters and digits and passes
+   them to FUNC.  If MARKUP is TRUE, HTML tags and entities are skipped. */
+static void
+split_words (const gchar *text,
+             gboolean     markup,
+             WordFunc     func,
+             gpointer     user_data)
+{
+  GString     *word;
+  const gchar *p, *end;
+  guint        n_chars = 0;
+
+  word = g_string_sized_new (MAX_WORD_LENGTH + 8);
+
+  for (p = text; *p != '\0'; p = g_utf8_next_char (p)) {
+    gunichar c = g_utf8_get_char (p);
+
+    if (markup && c == '<' && (end = strchr (p, '>')) != NULL) {
+      flush_word (word, &n_chars, func, user_data);
+      p = end;
+    } else if (markup && c == '&' && (end = strchr (p, ';')) != NULL &&
+               end - p <= 8) {
+      flush_word (word, &n_chars, func, user_data);
+      p = end;
+    } else if (g_unichar_isalnum (c)) {
+      g_string_append_unichar (word, g_unichar_tolower (c));
+      n_chars++;
+    } else {
+      flush_word (word, &n_chars, func, user_data);
+    }
+  }
+
+  flush_word (word, &n_chars, func, user_data);
+  g_string_free (word, TRUE);
+}
+
+/* Appends V to ARRAY as a variable-length integer, seven bits per byte,
+   least significant first. */
+static void
+put_varint (GByteArray *array,
+            guint32     v)
+{
+  guint8 byte;
+
+  while (v >= 0x80) {
+    byte = (v & 0x7f) | 0x80;
+    g_byte_array_append (array, &byte, 1);
+    v >>= 7;
+  }
+
+  byte = v;
+  g_byte_array_append (array, &byte, 1);
+}
+
+/* Reads a variable-length integer at P into V and returns the position
+   after it, or END if the integer is cut off by END. */
+static const guint8 *
+get_varint (const guint8 *p,
+            const guint8 *end,
+            guint32      *v)
+{
+  guint shift = 0;
+
+  *v = 0;
+  while (p < end && shift < 32) {
+    *v |= (guint32) (*p & 0x7f) << shift;
+    if ((*p++ & 0x80) == 0) {
+      return p;
+    }
+    shift += 7;
+  }
+
+  return end;
+}
+
+/* Returns the slot where probing for HASH starts. */
+static inline guint
+get_slot (SearchIndex *index,
+          guint64      hash)
+{
+  return (guint) ((hash * FIBONACCI) >> index->shift);
+}
+
+/* Returns the slot of the article with HASH, or of the empty slot where it
+   would go. */
+static guint
+find_slot (SearchIndex *index,
+           guint64      hash)
+{
+  guint mask = index->n_slots - 1;
+  guint i;
+
+  for (i = get_slot (index, hash); index->slots[i] != 0; i = (i + 1) & mask) {
+    if (g_array_index (index->docs, Document,
+                       index->slots[i] - 1).hash == hash) {
+      break;
+    }
+  }
+
+  return i;
+}
+
+/* Allocates an empty article table of N_SLOTS slots. */
+static void
+allocate_slots (SearchIndex *index,
+                guint        n_slots)
+{
+  guint bits = 0;
+
+  while ((1u << bits) < n_slots) {
+    bits++;
+  }
+
+  index->n_slots = n_slots;
+  index->shift = 64 - bits;
+  index->slots = g_new0 (guint32, n_slots);
+}
+
+/* Enters article number ID into the article table, growing it if it
+   gets too full.  The table holds only the article numbers, so the
+   hashes are read from the articles. */
+static void
+insert_doc (SearchIndex *index,
+            guint32      id)
+{
+  const Document *doc = &g_array_index (index->docs, Document, id);
+
+  if ((id + 1) * 4 > index->n_slots * 3) {
+    guint32 n;
+
+    g_free (index->slots);
+    allocate_slots (index, index->n_slots * 2);
+    for (n = 0; n < id; n++) {
+      index->slots[find_slot (index,
+                              g_array_index (index->docs, Document,
+                                             n).hash)] = n + 1;
+    }
+  }
+
+  index->slots[find_slot (index, doc->hash)] = id + 1;
+}
+
+/* Returns the number of the article with HASH, or NO_DOC if there is no
+   such article or it has been removed. */
+static guint32
+find_doc (SearchIndex *index,
+          guint64      hash)
+{
+  guint32 id = index->slots[find_slot (index, hash)];
+
+  if (id == 0 || g_array_index (index->docs, Document, id - 1).owner == 0) {
+    return NO_DOC;
+  }
+
+  return id - 1;
+}
+
+/* Frees OWNER. */
+static void
+free_owner (Owner *owner)
+{
+  g_array_free (owner->ids, TRUE);
+  g_free (owner);
+}
+
+/* Returns the articles of the feed ID, creating them if needed. */
+static Owner *
+get_owner (SearchIndex *index,
+           guint32      id)
+{
+  Owner *owner;
+
+  owner = g_hash_table_lookup (index->owners, GUINT_TO_POINTER (id));
+  if (owner == NULL) {
+    owner = g_new0 (Owner, 1);
+    owner->ids = g_array_new (FALSE, FALSE, sizeof (guint32));
+    g_hash_table_insert (index->owners, GUINT_TO_POINTER (id), owner);
+  }
+
+  return owner;
+}
+
+/* Adds article number ID to the current generation of the feed OWNER,
+   taking it over from the feed which had it, if any. */
+static void
+keep_doc (SearchIndex *index,
+          guint32      id,
+          guint32      owner)
+{
+  Document *doc = &g_array_index (index->docs, Document, id);
+  Owner    *articles = get_owner (index, owner);
+
+  if (doc->owner != owner) {
+    doc->owner = owner;
+    g_array_append_val (articles->ids, id);
+    index->dirty = TRUE;
+  }
+  doc->generation = articles->generation;
+}
+
+/* Removes article number ID. */
+static void
+remove_doc (SearchIndex *index,
+            guint32      id)
+{
+  g_array_index (index->docs, Document, id).owner = 0;
+  index->n_removed++;
+  index->dirty = TRUE;
+}
+
+/* Frees TERM. */
+static void
+free_term (Term *term)
+{
+  g_byte_array_free (term->postings, TRUE);
+  g_free (term);
+}
+
+/* Creates the empty structures of INDEX. */
+static void
+init (SearchIndex *index)
+{
+  index->docs = g_array_new (FALSE, FALSE, sizeof (Document));
+  index->strings = g_string_chunk_new (64 * 1024);
+  allocate_slots (index, INITIAL_SLOTS);
+  index->terms = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                        NULL, (GDestroyNotify) free_term);
+  index->sorted = g_ptr_array_new ();
+  index->n_sorted = 0;
+  index->n_removed = 0;
+  index->owners = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+                                         (GDestroyNotify) free_owner);
+  index->dirty = FALSE;
+}
+
+/* Frees the structures of INDEX. */
+static void
+clear (SearchIndex *index)
+{
+  g_ptr_array_free (index->sorted, TRUE);
+  g_hash_table_destroy (index->terms);
+  g_hash_table_destroy (index->owners);
+  g_free (index->slots);
+  g_string_chunk_free (index->strings);
+  g_array_free (index->docs, TRUE);
+  g_free (index->scores);
+  g_free (index->hits);
+  index->scores = NULL;
+  index->hits = NULL;
+  index->n_scratch = 0;
+}
+
+/* Returns the Term of TEXT, creating it if needed. */
+static Term *
+get_term (SearchIndex *index,
+          const gchar *text)
+{
+  Term *term;
+
+  term = g_hash_table_lookup (index->terms, text);
+  if (term == NULL) {
+    term = g_new0 (Term, 1);
+    term->text = g_string_chunk_insert (index->strings, text);
+    term->postings = g_byte_array_new ();
+    g_hash_table_insert (index->terms, (gpointer) term->text, term);
+
+    /* New words are sorted in by the next query. */
+    g_ptr_array_add (index->sorted, term);
+  }
+
+  return term;
+}
+
+/* Comparison function for sorting Terms by word. */
+static gint
+compare_terms (gconstpointer a,
+               gconstpointer b)
+{
+  return strcmp ((*(Term * const *) a)->text, (*(Term * const *) b)->text);
+}
+
+/* Sorts the words added since the last sort and merges them into the
+   sorted words. */
+static void
+sort_terms (SearchIndex *index)
+{
+  GPtrArray  *merged;
+  Term      **terms = (Term **) index->sorted->pdata;
+  guint       n_terms = index->sorted->len;
+  guint       i = 0, j = index->n_sorted;
+
+  if (index->n_sorted == n_terms) {
+    return;
+  }
+
+  qsort (terms + index->n_sorted, n_terms - index->n_sorted,
+         sizeof (Term *), compare_terms);
+
+  merged = g_ptr_array_sized_new (n_terms);
+  while (i < index->n_sorted || j < n_terms) {
+    if (j == n_terms ||
+        (i < index->n_sorted && strcmp (terms[i]->text, terms[j]->text) < 0)) {
+      g_ptr_array_add (merged, terms[i++]);
+    } else {
+      g_ptr_array_add (merged, terms[j++]);
+    }
+  }
+
+  g_ptr_array_free (index->sorted, TRUE);
+  index->sorted = merged;
+  index->n_sorted = n_terms;
+}
+
+SearchIndex *
+search_index_new ()
+{
+  SearchIndex *index;
+
+  index = g_new0 (SearchIndex, 1);
+  g_static_mutex_init (&index->mutex);
+  init (index);
+  index->next_generation = 1;
+
+  return index;
+}
+
+/* Word callback of search_index_add.  Counts a word of the title. */
+static void
+count_title_word (const gchar *word,
+                  GHashTable  *counts)
+{
+  guint count = GPOINTER_TO_UINT(g_hash_table_lookup (counts, word));
+
+  g_hash_table_insert (counts, g_strdup (word),
+                       GUINT_TO_POINTER(count + TITLE_WEIGHT));
+}
+
+/* Word callback of search_index_add.  Counts a word of the
+   description. */
+static void
+count_word (const gchar *word,
+            GHashTable  *counts)
+{
+  guint count = GPOINTER_TO_UINT(g_hash_table_lookup (counts, word));
+
+  g_hash_table_insert (counts, g_strdup (word),
+                       GUINT_TO_POINTER(count + 1));
+}
+
+void
+search_index_add (SearchIndex    *index,
+                  const FeedItem *item,
+                  guint32         owner)
+{
+  GHashTable     *counts;
+  GHashTableIter  iter;
+  gpointer        word, count;
+  Document        doc;
+  guint32         id;
+  guint64         hash;
+
+  g_assert (index != NULL);
+  g_assert (item != NULL);
+
+  hash = feed_item_hash (item);
+
+  g_static_mutex_lock (&index->mutex);
+  id = find_doc (index, hash);
+  if (id != NO_DOC) {
+    keep_doc (index, id, owner);
+  }
+  g_static_mutex_unlock (&index->mutex);
+
+  if (id != NO_DOC) {
+    return;
+  }
+
+  /* The text is split outside the lock, so the sync jobs can index their
+     articles in parallel. */
+  counts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  if (item->title != NULL) {
+    split_words (item->title, FALSE, (WordFunc) count_title_word, counts);
+  }
+  if (item->description != NULL) {
+    split_words (item->description, TRUE, (WordFunc) count_word, counts);
+  }
+
+  g_static_mutex_lock (&index->mutex);
+
+  /* Another job may have added the article meanwhile. */
+  id = find_doc (index, hash);
+  if (id != NO_DOC) {
+    keep_doc (index, id, owner);
+    g_static_mutex_unlock (&index->mutex);
+    g_hash_table_destroy (counts);
+    return;
+  }
+
+  id = index->docs->len;
+  doc.hash = hash;
+  doc.date = item->date;
+  doc.title = item->title != NULL ?
+    g_string_chunk_insert (index->strings, item->title) : NULL;
+  doc.link = item->link != NULL ?
+    g_string_chunk_insert (index->strings, item->link) : NULL;
+  doc.owner = 0;
+  g_array_append_val (index->docs, doc);
+  insert_doc (index, id);
+  keep_doc (index, id, owner);
+
+  g_hash_table_iter_init (&iter, counts);
+  while (g_hash_table_iter_next (&iter, &word, &count)) {
+    Term *term = get_term (index, word);
+
+    put_varint (term->postings, id - term->last_doc);
+    put_varint (term->postings, MIN (GPOINTER_TO_UINT(count), 255));
+    term->last_doc = id;
+    term->n_docs++;
+  }
+
+  index->dirty = TRUE;
+
+  g_static_mutex_unlock (&index->mutex);
+
+  g_hash_table_destroy (counts);
+}
+
+void
+search_index_begin (SearchIndex *index,
+                    guint32      owner)
+{
+  g_assert (index != NULL);
+  g_assert (owner != 0);
+
+  g_static_mutex_lock (&index->mutex);
+  get_owner (index, owner)->generation = index->next_generation++;
+  g_static_mutex_unlock (&index->mutex);
+}
+
+void
+search_index_commit (SearchIndex *index,
+                     guint32      owner)
+{
+  Owner *articles;
+  guint  n_kept = 0;
+  guint  i;
+
+  g_assert (index != NULL);
+  g_assert (owner != 0);
+
+  g_static_mutex_lock (&index->mutex);
+
+  articles = get_owner (index, owner);
+  for (i = 0; i < articles->ids->len; i++) {
+    guint32   id = g_array_index (articles->ids, guint32, i);
+    Document *doc = &g_array_index (index->docs, Document, id);
+
+    /* Articles taken over by another feed are only dropped from the
+       list. */
+    if (doc->owner != owner) {
+      continue;
+    }
+
+    if (doc->generation != articles->generation) {
+      remove_doc (index, id);
+      continue;
+    }
+
+    g_array_index (articles->ids, guint32, n_kept++) = id;
+  }
+  g_array_set_size (articles->ids, n_kept);
+
+  g_static_mutex_unlock (&index->mutex);
+}
+
+void
+search_index_remove (SearchIndex *index,
+                     guint32      owner)
+{
+  Owner *articles;
+  guint  i;
+
+  g_assert (index != NULL);
+  g_assert (owner != 0);
+
+  g_static_mutex_lock (&index->mutex);
+
+  articles = g_hash_table_lookup (index->owners, GUINT_TO_POINTER (owner));
+  if (articles != NULL) {
+    for (i = 0; i < articles->ids->len; i++) {
+      guint32 id = g_array_index (articles->ids, guint32, i);
+
+      if (g_array_index (index->docs, Document, id).owner == owner) {
+        remove_doc (index, id);
+      }
+    }
+    g_hash_table_remove (index->owners, GUINT_TO_POINTER (owner));
+  }
+
+  g_static_mutex_unlock (&index->mutex);
+}
+
+/* State of a query. */
+typedef struct {
+  SearchIndex *index;
+  GArray      *touched;     /* articles matching the first word */
+  guint        word;        /* number of the word being matched */
+} Query;
+
+/* Adds the postings of TERM, matching the current word of QUERY with
+   WEIGHT, to the scores of the articles which have matched all the
+   previous words. */
+static void
+match_term (Query *query,
+            Term  *term,
+            gfloat weight)
+{
+  SearchIndex  *index = query->index;
+  const guint8 *p = term->postings->data;
+  const guint8 *end = p + term->postings->len;
+  guint32       doc = 0, delta, count;
+  gfloat        idf;
+
+  idf = logf ((gfloat) (index->docs->len - index->n_removed + 1) /
+              term->n_docs);
+
+  while (p < end) {
+    p = get_varint (p, end, &delta);
+    p = get_varint (p, end, &count);
+    doc += delta;
+
+    if (doc >= index->n_scratch) {
+      break;
+    }
+
+    /* An article matching several words for the same query word counts
+       once, but is scored for all of them. */
+    if (index->hits[doc] == query->word) {
+      index->hits[doc]++;
+      if (query->word == 0) {
+        g_array_append_val (query->touched, doc);
+      }
+    }
+    if (index->hits[doc] == query->word + 1) {
+      index->scores[doc] += weight * idf * (1.0f + logf (count));
+    }
+  }
+}
+
+/* Comparison function for sorting Terms by decreasing number of
+   articles. */
+static gint
+compare_term_sizes (gconstpointer a,
+                    gconstpointer b)
+{
+  const Term *x = *(Term * const *) a;
+  const Term *y = *(Term * const *) b;
+
+  return x->n_docs > y->n_docs ? -1 : x->n_docs < y->n_docs;
+}
+
+/* Matches the words WORD is a prefix of, which are adjacent in the sorted
+   words, as the last word of QUERY.  Short prefixes may match thousands of
+   words; only the most common of them are matched. */
+static void
+match_prefix (Query       *query,
+              const gchar *word)
+{
+  SearchIndex  *index = query->index;
+  Term        **terms = (Term **) index->sorted->pdata;
+  Term        **matches;
+  guint         low = 0, high = index->sorted->len, end, n_matches, i;
+  gsize         length = strlen (word);
+
+  while (low < high) {
+    guint middle = low + (high - low) / 2;
+
+    if (strcmp (terms[middle]->text, word) < 0) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  end = low;
+  while (end < index->sorted->len &&
+         strncmp (terms[end]->text, word, length) == 0) {
+    end++;
+  }
+
+  n_matches = end - low;
+  matches = g_new (Term *, n_matches);
+  memcpy (matches, terms + low, n_matches * sizeof (Term *));
+  if (n_matches > MAX_EXPANSIONS) {
+    qsort (matches, n_matches, sizeof (Term *), compare_term_sizes);
+    n_matches = MAX_EXPANSIONS;
+  }
+
+  for (i = 0; i < n_matches; i++) {
+    match_term (query, matches[i],
+                matches[i]->text[length] == '\0' ? 1.0f : PREFIX_WEIGHT);
+  }
+
+  g_free (matches);
+}
+
+/* Word callback of search_index_query.  Collects the words of the
+   query. */
+static void
+add_query_word (const gchar *word,
+                GPtrArray   *words)
+{
+  if (words->len < MAX_QUERY_WORDS) {
+    g_ptr_array_add (words, g_strdup (word));
+  }
+}
+
+/* Returns TRUE if article A ranks above article B. */
+static gboolean
+ranks_above (const SearchResult *a,
+             const SearchResult *b)
+{
+  return a->score > b->score || (a->score == b->score && a->date > b->date);
+}
+
+guint
+search_index_query (SearchIndex  *index,
+                    const gchar  *text,
+                    SearchResult *results,
+                    guint         max_results)
+{
+  Query      query;
+  GPtrArray *words;
+  guint      n_results = 0;
+  guint      i;
+
+  g_assert (index != NULL);
+  g_assert (text != NULL);
+
+  words = g_ptr_array_new ();
+  split_words (text, FALSE, (WordFunc) add_query_word, words);
+
+  if (words->len == 0 || max_results == 0) {
+    g_ptr_array_free (words, TRUE);
+    return 0;
+  }
+
+  g_static_mutex_lock (&index->mutex);
+
+  sort_terms (index);
+
+  if (index->n_scratch < index->docs->len) {
+    g_free (index->scores);
+    g_free (index->hits);
+    index->n_scratch = index->docs->len + index->docs->len / 4;
+    index->scores = g_new0 (gfloat, index->n_scratch);
+    index->hits = g_new0 (guint8, index->n_scratch);
+  }
+
+  query.index = index;
+  query.touched = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+  for (query.word = 0; query.word < words->len; query.word++) {
+    const gchar *word = g_ptr_array_index (words, query.word);
+    Term        *term;
+
+    if (query.word + 1 < words->len) {
+      term = g_hash_table_lookup (index->terms, word);
+      if (term == NULL) {
+        break;
+      }
+      match_term (&query, term, 1.0f);
+    } else {
+      /* The last word may be incomplete. */
+      match_prefix (&query, word);
+    }
+  }
+
+  /* Keep the best matches in RESULTS, in order, and clear the scratch
+     space for the next query. */
+  for (i = 0; i < query.touched->len; i++) {
+    guint32  id = g_array_index (query.touched, guint32, i);
+    gfloat   score = index->scores[id];
+
+    /* The article is looked at only if its score may place it; removed
+       articles are matched like the others, but not shown. */
+    if (index->hits[id] == words->len &&
+        (n_results < max_results || score >= results[n_results - 1].score)) {
+      Document     *doc = &g_array_index (index->docs, Document, id);
+      SearchResult  result;
+      guint         j;
+
+      result.title = doc->title;
+      result.link = doc->link;
+      result.date = doc->date;
+      result.owner = doc->owner;
+      result.score = score;
+
+      if (doc->owner != 0 &&
+          (n_results < max_results ||
+           ranks_above (&result, &results[n_results - 1]))) {
+        /* When RESULTS is full, the worst match drops out. */
+        j = n_results < max_results ? n_results++ : n_results - 1;
+        while (j > 0 && ranks_above (&result, &results[j - 1])) {
+          results[j] = results[j - 1];
+          j--;
+        }
+        results[j] = result;
+      }
+    }
+
+    index->hits[id] = 0;
+    index->scores[id] = 0.0f;
+  }
+
+  g_static_mutex_unlock (&index->mutex);
+
+  g_array_free (query.touched, TRUE);
+  for (i = 0; i < words->len; i++) {
+    g_free (g_ptr_array_index (words, i));
+  }
+  g_ptr_array_free (words, TRUE);
+
+  return n_results;
+}
+
+/* Drops the removed articles from INDEX, numbering the others anew, and
+   the words left in no article. */
+static void
+compact (SearchIndex *index)
+{
+  GArray         *docs = index->docs;
+  GStringChunk   *strings = index->strings;
+  GHashTable     *terms = index->terms;
+  GPtrArray      *sorted;
+  GHashTableIter  iter;
+  gpointer        value;
+  guint32        *ids;
+  guint           i;
+
+  sort_terms (index);
+  sorted = index->sorted;
+
+  index->docs = g_array_sized_new (FALSE, FALSE, sizeof (Document),
+                                   docs->len - index->n_removed);
+  index->strings = g_string_chunk_new (64 * 1024);
+  index->terms = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                        NULL, (GDestroyNotify) free_term);
+  index->sorted = g_ptr_array_new ();
+  g_free (index->slots);
+  allocate_slots (index, INITIAL_SLOTS);
+
+  /* The articles keep their order, so the postings stay in order. */
+  ids = g_new (guint32, docs->len);
+  for (i = 0; i < docs->len; i++) {
+    Document doc = g_array_index (docs, Document, i);
+
+    if (doc.owner == 0) {
+      ids[i] = NO_DOC;
+      continue;
+    }
+
+    doc.title = doc.title != NULL ?
+      g_string_chunk_insert (index->strings, doc.title) : NULL;
+    doc.link = doc.link != NULL ?
+      g_string_chunk_insert (index->strings, doc.link) : NULL;
+    ids[i] = index->docs->len;
+    g_array_append_val (index->docs, doc);
+    insert_doc (index, ids[i]);
+  }
+
+  /* The words are taken in order, so they stay sorted. */
+  for (i = 0; i < sorted->len; i++) {
+    Term         *old = g_ptr_array_index (sorted, i);
+    Term         *term = NULL;
+    const guint8 *p = old->postings->data;
+    const guint8 *end = p + old->postings->len;
+    guint32       doc = 0, delta, count;
+
+    while (p < end) {
+      p = get_varint (p, end, &delta);
+      p = get_varint (p, end, &count);
+      doc += delta;
+
+      if (doc >= docs->len || ids[doc] == NO_DOC) {
+        continue;
+      }
+
+      if (term == NULL) {
+        term = get_term (index, old->text);
+      }
+      put_varint (term->postings, ids[doc] - term->last_doc);
+      put_varint (term->postings, count);
+      term->last_doc = ids[doc];
+      term->n_docs++;
+    }
+  }
+  index->n_sorted = index->sorted->len;
+
+  g_hash_table_iter_init (&iter, index->owners);
+  while (g_hash_table_iter_next (&iter, NULL, &value)) {
+    Owner *owner = value;
+    guint  n_kept = 0;
+    guint  j;
+
+    for (j = 0; j < owner->ids->len; j++) {
+      guint32 id = ids[g_array_index (owner->ids, guint32, j)];
+
+      if (id != NO_DOC) {
+        g_array_index (owner->ids, guint32, n_kept++) = id;
+      }
+    }
+    g_array_set_size (owner->ids, n_kept);
+  }
+
+  index->n_removed = 0;
+
+  g_free (ids);
+  g_ptr_array_free (sorted, TRUE);
+  g_hash_table_destroy (terms);
+  g_string_chunk_free (strings);
+  g_array_free (docs, TRUE);
+}
+
+/* Appends STRING to STRINGS and returns its offset. */
+static guint32
+add_string (GString     *strings,
+            const gchar *string)
+{
+  guint32 offset;
+
+  if (string == NULL) {
+    return GUINT32_TO_LE (NO_STRING);
+  }
+
+  offset = strings->len;
+  g_string_append_len (strings, string, strlen (string) + 1);
+
+  return GUINT32_TO_LE (offset);
+}
+
+gboolean
+search_index_save (SearchIndex *index,
+                   const gchar *filename)
+{
+  IndexHeader  header;
+  GArray      *docs, *terms;
+  GString     *postings, *strings, *data;
+  gchar       *dirname;
+  GError      *error = NULL;
+  guint        i;
+
+  g_assert (index != NULL);
+  g_assert (filename != NULL);
+
+  g_static_mutex_lock (&index->mutex);
+
+  if (!index->dirty) {
+    g_static_mutex_unlock (&index->mutex);
+    return TRUE;
+  }
+
+  /* The removed articles are left out of the file, and out of memory
+     too while at it. */
+  if (index->n_removed > 0) {
+    compact (index);
+  }
+
+  sort_terms (index);
+
+  docs = g_array_sized_new (FALSE, FALSE, sizeof (DocRecord),
+                            index->docs->len);
+  terms = g_array_sized_new (FALSE, FALSE, sizeof (TermRecord),
+                             index->sorted->len);
+  postings = g_string_new (NULL);
+  strings = g_string_new (NULL);
+
+  for (i = 0; i < index->docs->len; i++) {
+    Document  *doc = &g_array_index (index->docs, Document, i);
+    DocRecord  record;
+
+    record.hash = GUINT64_TO_LE (doc->hash);
+    record.date = GINT64_TO_LE (doc->date);
+    record.title = add_string (strings, doc->title);
+    record.link = add_string (strings, doc->link);
+    record.owner = GUINT32_TO_LE (doc->owner);
+    record.reserved = 0;
+    g_array_append_val (docs, record);
+  }
+
+  for (i = 0; i < index->sorted->len; i++) {
+    Term       *term = g_ptr_array_index (index->sorted, i);
+    TermRecord  record;
+
+    record.text = add_string (strings, term->text);
+    record.postings = GUINT32_TO_LE (postings->len);
+    record.length = GUINT32_TO_LE (term->postings->len);
+    record.n_docs = GUINT32_TO_LE (term->n_docs);
+    record.last_doc = GUINT32_TO_LE (term->last_doc);
+    g_array_append_val (terms, record);
+
+    g_string_append_len (postings, (const gchar *) term->postings->data,
+                         term->postings->len);
+  }
+
+  /* Articles added while the file is being written mark the index dirty
+     again. */
+  index->dirty = FALSE;
+
+  g_static_mutex_unlock (&index->mutex);
+
+  memcpy (header.magic, INDEX_MAGIC, 4);
+  header.version = GUINT32_TO_LE (INDEX_VERSION);
+  header.n_docs = GUINT32_TO_LE (docs->len);
+  header.n_terms = GUINT32_TO_LE (terms->len);
+  header.postings_length = GUINT32_TO_LE (postings->len);
+  header.strings_length = GUINT32_TO_LE (strings->len);
+
+  data = g_string_sized_new (sizeof (header) +
+                             docs->len * sizeof (DocRecord) +
+                             terms->len * sizeof (TermRecord) +
+                             postings->len + strings->len);
+  g_string_append_len (data, (const gchar *) &header, sizeof (header));
+  g_string_append_len (data, docs->data, docs->len * sizeof (DocRecord));
+  g_string_append_len (data, terms->data, terms->len * sizeof (TermRecord));
+  g_string_append_len (data, postings->str, postings->len);
+  g_string_append_len (data, strings->str, strings->len);
+
+  g_array_free (docs, TRUE);
+  g_array_free (terms, TRUE);
+  g_string_free (postings, TRUE);
+  g_string_free (strings, TRUE);
+
+  dirname = g_path_get_dirname (filename);
+  g_mkdir_with_parents (dirname, 0700);
+  g_free (dirname);
+
+  if (!g_file_set_contents (filename, data->str, data->len, &error)) {
+    g_warning ("Failed to write %s: %s", filename, error->message);
+    g_error_free (error);
+    g_string_free (data, TRUE);
+
+    g_static_mutex_lock (&index->mutex);
+    index->dirty = TRUE;
+    g_static_mutex_unlock (&index->mutex);
+
+    return FALSE;
+  }
+
+  g_string_free (data, TRUE);
+
+  return TRUE;
+}
+
+/* Returns the string at OFFSET of the strings section, or NULL if OFFSET
+   is missing or out of bounds. */
+static const gchar *
+get_string (const gchar *strings,
+            gsize        length,
+            guint32      offset)
+{
+  offset = GUINT32_FROM_LE (offset);
+
+  if (offset == NO_STRING || offset >= length ||
+      memchr (strings + offset, '\0', length - offset) == NULL) {
+    return NULL;
+  }
+
+  return strings + offset;
+}
+
+/* Fills INDEX from the mapped index file of LENGTH bytes at CONTENTS.
+   Returns FALSE if the file is not valid. */
+static gboolean
+read_index (SearchIndex *index,
+            const gchar *contents,
+            gsize        length)
+{
+  const IndexHeader *header = (const IndexHeader *) contents;
+  const DocRecord   *docs;
+  const TermRecord  *terms;
+  const guint8      *postings;
+  const gchar       *strings;
+  const gchar       *previous = NULL;
+  guint32            n_docs, n_terms, postings_length, strings_length;
+  guint32            i;
+
+  if (length < sizeof (IndexHeader) ||
+      memcmp (header->magic, INDEX_MAGIC, 4) != 0 ||
+      GUINT32_FROM_LE (header->version) != INDEX_VERSION) {
+    return FALSE;
+  }
+
+  n_docs = GUINT32_FROM_LE (header->n_docs);
+  n_terms = GUINT32_FROM_LE (header->n_terms);
+  postings_length = GUINT32_FROM_LE (header->postings_length);
+  strings_length = GUINT32_FROM_LE (header->strings_length);
+
+  if (sizeof (IndexHeader) +
+      (guint64) n_docs * sizeof (DocRecord) +
+      (guint64) n_terms * sizeof (TermRecord) +
+      postings_length + strings_length > length) {
+    return FALSE;
+  }
+
+  docs = (const DocRecord *) (header + 1);
+  terms = (const TermRecord *) (docs + n_docs);
+  postings = (const guint8 *) (terms + n_terms);
+  strings = (const gchar *) (postings + postings_length);
+
+  for (i = 0; i < n_docs; i++) {
+    const gchar *title, *link;
+    Document     doc;
+
+    title = get_string (strings, strings_length, docs[i].title);
+    link = get_string (strings, strings_length, docs[i].link);
+
+    doc.hash = GUINT64_FROM_LE (docs[i].hash);
+    doc.date = GINT64_FROM_LE (docs[i].date);
+    doc.title = title != NULL ?
+      g_string_chunk_insert (index->strings, title) : NULL;
+    doc.link = link != NULL ?
+      g_string_chunk_insert (index->strings, link) : NULL;
+    doc.owner = 0;
+    doc.generation = 0;
+    g_array_append_val (index->docs, doc);
+    insert_doc (index, i);
+
+    if (docs[i].owner != 0) {
+      keep_doc (index, i, GUINT32_FROM_LE (docs[i].owner));
+    } else {
+      index->n_removed++;
+    }
+  }
+
+  for (i = 0; i < n_terms; i++) {
+    const gchar *text;
+    guint32      offset, size;
+    Term        *term;
+
+    text = get_string (strings, strings_length, terms[i].text);
+    offset = GUINT32_FROM_LE (terms[i].postings);
+    size = GUINT32_FROM_LE (terms[i].length);
+
+    /* The words must be unique and in order, so they need not be sorted
+       again. */
+    if (text == NULL || offset > postings_length ||
+        size > postings_length - offset ||
+        (previous != NULL && strcmp (previous, text) >= 0)) {
+      return FALSE;
+    }
+
+    term = get_term (index, text);
+    previous = term->text;
+    g_byte_array_append (term->postings, postings + offset, size);
+    term->n_docs = MAX (GUINT32_FROM_LE (terms[i].n_docs), 1);
+    term->last_doc = GUINT32_FROM_LE (terms[i].last_doc);
+  }
+
+  index->n_sorted = index->sorted->len;
+  index->dirty = FALSE;
+
+  return TRUE;
+}
+
+gboolean
+search_index_load (SearchIndex *index,
+                   const gchar *filename)
+{
+  GMappedFile *file;
+  gboolean     result;
+
+  g_assert (index != NULL);
+  g_assert (filename != NULL);
+
+  file = g_mapped_file_new (filename, FALSE, NULL);
+  if (file == NULL) {
+    return FALSE;
+  }
+
+  g_static_mutex_lock (&index->mutex);
+
+  clear (index);
+  init (index);
+
+  result = read_index (index,
+                       g_mapped_file_get_contents (file),
+                       g_mapped_file_get_length (file));
+  if (!result) {
+    g_warning ("Ignoring invalid search index %s.", filename);
+    clear (index);
+    init (index);
+  }
+
+  g_static_mutex_unlock (&index->mutex);
+
+  g_mapped_file_free (file);
+
+  return result;
+}
+
+guint
+search_index_get_size (SearchIndex *index)
+{
+  guint size;
+
+  g_assert (index != NULL);
+
+  g_static_mutex_lock (&index->mutex);
+  size = index->docs->len - index->n_removed;
+  g_static_mutex_unlock (&index->mutex);
+
+  return size;
+}
+
+void
+search_index_free (SearchIndex *index)
+{
+  if (index == NULL) {
+    return;
+  }
+
+  clear (index);
+  g_static_mutex_free (&index->mutex);
+  g_free (index);
+}
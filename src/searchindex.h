@@ -0,0 +1,147 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <glib.h>
+
+#include "feedparser.h"
+
+/*
+ * Full-text search index over the articles of all feeds.
+ *
+ * The titles and descriptions of the articles are split into words, which
+ * are case folded, and each word maps to the list of articles containing
+ * it.  The lists, or postings, are stored as the differences between
+ * successive article numbers followed by the weight of the word in the
+ * article, each as a variable-length integer, so most postings take two
+ * or three bytes.  Articles are added as they are parsed.
+ *
+ * The index follows the articles the feeds keep.  Each sync of a feed
+ * adds its articles as a new generation, and once the feed commits it,
+ * the articles of the feed which were not added again, because they
+ * dropped out of the feed or expired, are removed; all the articles of a
+ * feed are removed when the feed is.  Removed articles are no longer
+ * found, and are dropped from memory and from the file when the index is
+ * next saved.
+ *
+ * A query matches the articles containing all of its words, the last of
+ * which may be incomplete, so results can be shown as the query is typed.
+ * The matches are ranked by the weights of the words, with rare words and
+ * words in titles weighing more, and by date.
+ *
+ * File layout (all integers little-endian):
+ *
+ *   header    "GFSI", format version, number of articles, number of words,
+ *             and the sizes of the postings and strings sections
+ *   articles  one record per article: hash, date, offsets of the title
+ *             and the link in the strings section (or 0xffffffff), owner
+ *             (zero if removed) and a reserved field
+ *   words     one record per word, in ascending order: offset of the word
+ *             in the strings section, offset and size of its postings,
+ *             number of articles and the last article
+ *   postings
+ *   strings   NUL-terminated strings
+ *
+ * The functions may be called from any thread.
+ */
+
+typedef struct _SearchIndex SearchIndex;
+
+/*
+ * Search result.  The strings are owned by the index and are valid as
+ * long as the index.
+ */
+typedef struct {
+  const gchar *title;
+  const gchar *link;
+  gint64       date;
+  guint32      owner;       /* feed identifier given to search_index_add */
+  gfloat       score;
+} SearchResult;
+
+/*
+ * Creates an empty index.
+ */
+SearchIndex * search_index_new      ();
+
+/*
+ * Replaces the contents of INDEX with the index stored in FILENAME.
+ * Returns FALSE if there is no valid index in FILENAME, in which case
+ * INDEX is left empty.
+ */
+gboolean      search_index_load     (SearchIndex    *index,
+                                     const gchar    *filename);
+
+/*
+ * Writes INDEX to FILENAME, unless it has not changed since it was loaded
+ * or last saved.  Returns FALSE if the file could not be written.
+ */
+gboolean      search_index_save     (SearchIndex    *index,
+                                     const gchar    *filename);
+
+/*
+ * Adds ITEM, an article of the feed OWNER, to INDEX and to the generation
+ * of OWNER being added.  If an article with the same hash is already
+ * there, it only passes to that generation.  The words of the description
+ * are indexed; the description itself is not kept.
+ */
+void          search_index_add      (SearchIndex    *index,
+                                     const FeedItem *item,
+                                     guint32         owner);
+
+/*
+ * Starts a new generation of the articles of the feed OWNER.
+ */
+void          search_index_begin    (SearchIndex    *index,
+                                     guint32         owner);
+
+/*
+ * Removes the articles of the feed OWNER which have not been added since
+ * the last search_index_begin.
+ */
+void          search_index_commit   (SearchIndex    *index,
+                                     guint32         owner);
+
+/*
+ * Removes all the articles of the feed OWNER.
+ */
+void          search_index_remove   (SearchIndex    *index,
+                                     guint32         owner);
+
+/*
+ * Searches INDEX for the articles matching QUERY and stores at most
+ * MAX_RESULTS of the best matches in RESULTS, best first.  Returns the
+ * number of results stored.
+ */
+guint         search_index_query    (SearchIndex    *index,
+                                     const gchar    *query,
+                                     SearchResult   *results,
+                                     guint           max_results);
+
+/*
+ * Returns the number of articles in INDEX.
+ */
+guint         search_index_get_size (SearchIndex    *index);
+
+/*
+ * Destroys INDEX.
+ */
+void          search_index_free     (SearchIndex    *index);
+
+#endif
@@ -0,0 +1,202 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <gtk/gtk.h>
+
+#include "startup.h"
+
+/* Seconds after which the report is made even if some phases have not
+   ended, for example if there is no system tray. */
+#define REPORT_TIMEOUT 60
+
+/* State of a phase. */
+typedef enum {
+  PHASE_PENDING,
+  PHASE_DONE,
+  PHASE_SKIPPED
+} PhaseState;
+
+static const gchar *phase_names[STARTUP_N_PHASES] = {
+  "libraries loaded",
+  "GTK initialized",
+  "feeds.xml parsed",
+  "status icon shown",
+  "article cache loaded",
+  "first feed synced"
+};
+
+static GTimer     *timer = NULL;
+static gdouble     before_main = 0.0;   /* seconds from the process start
+                                           to startup_init */
+static gdouble     phase_times[STARTUP_N_PHASES];
+static PhaseState  phase_states[STARTUP_N_PHASES];
+static gboolean    print_report = FALSE;
+static gboolean    reported = FALSE;
+static guint       timeout_id = 0;
+
+/* Returns the number of seconds since the process started, or zero if it
+   cannot be told.  The start time in /proc/self/stat is in clock ticks
+   since the boot, and /proc/uptime has the seconds since the boot. */
+static gdouble
+get_process_age ()
+{
+  gchar   *stat = NULL, *uptime = NULL;
+  gchar   *p;
+  gdouble  age = 0.0;
+  gint     i;
+
+  if (g_file_get_contents ("/proc/self/stat", &stat, NULL, NULL) &&
+      g_file_get_contents ("/proc/uptime", &uptime, NULL, NULL)) {
+    /* The start time is the 22nd field; the second field, the command
+       name in parentheses, may contain spaces. */
+    p = strrchr (stat, ')');
+    for (i = 2; p != NULL && i < 22; i++) {
+      p = strchr (p + 1, ' ');
+    }
+
+    if (p != NULL) {
+      age = g_ascii_strtod (uptime, NULL) -
+            (gdouble) strtoull (p + 1, NULL, 10) / sysconf (_SC_CLK_TCK);
+    }
+  }
+
+  g_free (stat);
+  g_free (uptime);
+
+  return MAX (age, 0.0);
+}
+
+/* Logs the breakdown of the startup, and prints it if asked to. */
+static void
+report ()
+{
+  gdouble previous = 0.0;
+  gint    i;
+
+  reported = TRUE;
+  if (timeout_id != 0) {
+    g_source_remove (timeout_id);
+    timeout_id = 0;
+  }
+
+  if (print_report) {
+    printf ("%-22s %10s %10s\n", "phase", "at ms", "took ms");
+  }
+
+  for (i = 0; i < STARTUP_N_PHASES; i++) {
+    if (phase_states[i] != PHASE_DONE) {
+      g_debug ("Startup phase %s: %s.", phase_names[i],
+               phase_states[i] == PHASE_SKIPPED ? "skipped" : "not reached");
+      if (print_report) {
+        printf ("%-22s %10s %10s\n", phase_names[i], "-", "-");
+      }
+      continue;
+    }
+
+    g_debug ("Startup phase %s at %.1f ms, took %.1f ms.", phase_names[i],
+             phase_times[i] * 1000.0, (phase_times[i] - previous) * 1000.0);
+    if (print_report) {
+      printf ("%-22s %10.1f %10.1f\n", phase_names[i],
+              phase_times[i] * 1000.0, (phase_times[i] - previous) * 1000.0);
+    }
+    previous = phase_times[i];
+  }
+
+  if (print_report) {
+    fflush (stdout);
+  }
+}
+
+/* Makes the report if no phase is pending. */
+static void
+check_done ()
+{
+  gint i;
+
+  for (i = 0; i < STARTUP_N_PHASES; i++) {
+    if (phase_states[i] == PHASE_PENDING) {
+      return;
+    }
+  }
+
+  report ();
+}
+
+/* Timeout which makes the report if some phase never ends. */
+static gboolean
+on_report_timeout (gpointer user_data)
+{
+  timeout_id = 0;
+  report ();
+  return FALSE;
+}
+
+void
+startup_init ()
+{
+  g_assert (timer == NULL);
+
+  timer = g_timer_new ();
+  before_main = get_process_age ();
+
+  timeout_id = gdk_threads_add_timeout_seconds (REPORT_TIMEOUT,
+                                                on_report_timeout,
+                                                NULL);
+
+  startup_mark (STARTUP_MAIN);
+}
+
+void
+startup_set_report (gboolean value)
+{
+  print_report = value;
+}
+
+void
+startup_mark (StartupPhase phase)
+{
+  g_assert (phase < STARTUP_N_PHASES);
+
+  if (timer == NULL || reported || phase_states[phase] != PHASE_PENDING) {
+    return;
+  }
+
+  phase_times[phase] = before_main + g_timer_elapsed (timer, NULL);
+  phase_states[phase] = PHASE_DONE;
+  check_done ();
+}
+
+void
+startup_skip (StartupPhase phase)
+{
+  g_assert (phase < STARTUP_N_PHASES);
+
+  if (timer == NULL || reported || phase_states[phase] != PHASE_PENDING) {
+    return;
+  }
+
+  phase_states[phase] = PHASE_SKIPPED;
+  check_done ();
+}
@@ -0,0 +1,70 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef STARTUP_H
+#define STARTUP_H
+
+#include <glib.h>
+
+/*
+ * Startup timing.
+ *
+ * The time at which each phase of the startup ends is recorded, counted
+ * from the start of the process, which is read from /proc so the time
+ * spent loading the shared libraries before main is included.  Once all
+ * phases have ended, or after a minute at the latest, the breakdown is
+ * logged, and printed on the standard output if a report was asked for
+ * with the --startup-report option.
+ *
+ * These functions must be called from the main thread.
+ */
+
+typedef enum {
+  STARTUP_MAIN,             /* main entered */
+  STARTUP_GTK_INIT,         /* GTK initialized */
+  STARTUP_FEEDS_PARSED,     /* feeds.xml parsed */
+  STARTUP_ICON_SHOWN,       /* status icon embedded in the tray */
+  STARTUP_CACHE_LOADED,     /* feed menus populated from the article
+                               cache */
+  STARTUP_FIRST_FEED,       /* first sync result applied */
+  STARTUP_N_PHASES
+} StartupPhase;
+
+/*
+ * Starts timing the startup.  Must be called right after the thread
+ * system has been initialized.
+ */
+void startup_init       ();
+
+/*
+ * If REPORT is TRUE, the breakdown is also printed on the standard
+ * output.
+ */
+void startup_set_report (gboolean     report);
+
+/*
+ * Records the end of PHASE, unless it has already ended.
+ */
+void startup_mark       (StartupPhase phase);
+
+/*
+ * Records that PHASE will not happen, so the report does not wait for
+ * it.
+ */
+void startup_skip       (StartupPhase phase);
+
+#endif
@@ -0,0 +1,271 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <unistd.h>
+#include <sys/resource.h>
+#include <glib.h>
+
+#include "syncengine.h"
+
+/* Number of worker threads per processor core.  Sync jobs are mostly
+   blocked on network I/O, so a few more threads than cores pays off. */
+#define THREADS_PER_CORE 2
+
+/* Upper limit for the default pool size. */
+#define MAX_DEFAULT_THREADS 16
+
+/* Maximum number of jobs run at once in asynchronous mode.  Each takes a
+   socket, and more would mostly open new connections rather than reuse
+   idle ones. */
+#define MAX_ASYNC_JOBS 32
+
+static GThreadPool     *pool = NULL;
+static gint             max_threads = 0;
+static SyncEngineStats  stats = { 0, 0, 0, 0, 0 };
+static GStaticMutex     stats_mutex = G_STATIC_MUTEX_INIT;
+
+/* If TRUE, jobs are run on the main loop; jobs waiting for their turn
+   are kept in WAITING. */
+static gboolean         async = FALSE;
+static GQueue          *waiting = NULL;
+
+/* Wall clock and CPU time at the start of the current round of jobs,
+   that is, since the engine was last idle. */
+static GTimer          *round_timer = NULL;
+static gdouble          round_cpu = 0.0;
+
+/* Returns the CPU time used by the process so far, in seconds. */
+static gdouble
+get_cpu_time ()
+{
+  struct rusage usage;
+
+  getrusage (RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+/* Returns the number of worker threads to use. */
+static gint
+get_pool_size ()
+{
+  glong cores;
+
+  if (max_threads > 0) {
+    return max_threads;
+  }
+
+  cores = sysconf (_SC_NPROCESSORS_ONLN);
+  if (cores < 1) {
+    cores = 1;
+  }
+
+  return CLAMP (cores * THREADS_PER_CORE, 2, MAX_DEFAULT_THREADS);
+}
+
+/* Counts JOB as started. */
+static void
+job_started (FeedSyncJob *job)
+{
+  g_static_mutex_lock (&stats_mutex);
+  stats.queued--;
+  stats.active++;
+  stats.started++;
+  stats.peak_active = MAX (stats.peak_active, stats.active);
+  g_debug ("Sync job started for %s (%u active, %u queued).",
+           job->source, stats.active, stats.queued);
+  g_static_mutex_unlock (&stats_mutex);
+}
+
+/* Counts JOB as finished and passes it to its completion callback.  Logs
+   the wall clock and CPU time of the round if it was the last job. */
+static void
+job_finished (FeedSyncJob *job)
+{
+  g_static_mutex_lock (&stats_mutex);
+  stats.active--;
+  stats.finished++;
+  g_debug ("Sync job finished for %s (%u active, %u queued).",
+           job->source, stats.active, stats.queued);
+
+  if (stats.active == 0 && stats.queued == 0) {
+    g_debug ("Sync round finished in %.3f s, using %.3f s of CPU (%s).",
+             g_timer_elapsed (round_timer, NULL),
+             get_cpu_time () - round_cpu,
+             async ? "asynchronous" : "threaded");
+  }
+  g_static_mutex_unlock (&stats_mutex);
+
+  /* The job may be freed by its completion callback. */
+  if (job->done != NULL) {
+    job->done (job);
+  } else {
+    feed_sync_job_free (job);
+  }
+}
+
+/* Worker thread function.  Runs a single sync job and keeps track of the
+   engine's counters. */
+static void
+run_job (FeedSyncJob *job,
+         gpointer     user_data)
+{
+  job_started (job);
+  feed_sync_run (job);
+  job_finished (job);
+}
+
+/* Completion callback of the jobs run on the main loop.  Starts waiting
+   jobs as long as there is room. */
+static void
+on_async_finished (FeedSyncJob *job)
+{
+  job_finished (job);
+
+  while (stats.active < MAX_ASYNC_JOBS && !g_queue_is_empty (waiting)) {
+    job = g_queue_pop_head (waiting);
+    job_started (job);
+    feed_sync_start (job, on_async_finished);
+  }
+}
+
+void
+sync_engine_set_max_threads (gint threads)
+{
+  max_threads = MAX (threads, 0);
+
+  if (pool != NULL) {
+    g_thread_pool_set_max_threads (pool, get_pool_size (), NULL);
+  }
+}
+
+gint
+sync_engine_get_max_threads ()
+{
+  return max_threads;
+}
+
+void
+sync_engine_set_async (gboolean value)
+{
+  async = value;
+}
+
+gboolean
+sync_engine_get_async ()
+{
+  return async;
+}
+
+/* Counts JOB as queued, starting a new round if the engine was idle. */
+static void
+job_queued (FeedSyncJob *job)
+{
+  g_static_mutex_lock (&stats_mutex);
+  if (stats.active == 0 && stats.queued == 0) {
+    if (round_timer == NULL) {
+      round_timer = g_timer_new ();
+    }
+    g_timer_start (round_timer);
+    round_cpu = get_cpu_time ();
+  }
+  stats.queued++;
+  g_static_mutex_unlock (&stats_mutex);
+}
+
+gboolean
+sync_engine_push (FeedSyncJob *job)
+{
+  GError *error = NULL;
+
+  g_assert (job != NULL);
+
+  if (async) {
+    if (waiting == NULL) {
+      waiting = g_queue_new ();
+    }
+
+    job_queued (job);
+    if (stats.active < MAX_ASYNC_JOBS) {
+      job_started (job);
+      feed_sync_start (job, on_async_finished);
+    } else {
+      g_queue_push_tail (waiting, job);
+    }
+
+    return TRUE;
+  }
+
+  if (pool == NULL) {
+    pool = g_thread_pool_new ((GFunc) run_job,
+                              NULL,
+                              get_pool_size (),
+                              FALSE,
+                              &error);
+    if (pool == NULL) {
+      g_critical ("Failed to create the sync worker pool: %s",
+                  error->message);
+      g_error_free (error);
+      return FALSE;
+    }
+
+    g_debug ("Created sync worker pool of %d threads.", get_pool_size ());
+  }
+
+  job_queued (job);
+
+  g_thread_pool_push (pool, job, &error);
+  if (error != NULL) {
+    g_critical ("Failed to queue sync job for %s: %s",
+                job->source, error->message);
+    g_error_free (error);
+
+    g_static_mutex_lock (&stats_mutex);
+    stats.queued--;
+    g_static_mutex_unlock (&stats_mutex);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+void
+sync_engine_shutdown ()
+{
+  if (pool == NULL) {
+    return;
+  }
+
+  /* The queued jobs are run too, so their completion callbacks are
+     called. */
+  g_thread_pool_free (pool, FALSE, TRUE);
+  pool = NULL;
+}
+
+void
+sync_engine_get_stats (SyncEngineStats *out)
+{
+  g_assert (out != NULL);
+
+  g_static_mutex_lock (&stats_mutex);
+  *out = stats;
+  g_static_mutex_unlock (&stats_mutex);
+}
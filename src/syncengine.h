@@ -0,0 +1,96 @@
+/*
+Copyright (C) 2008 Henri Häkkinen.
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SYNCENGINE_H
+#define SYNCENGINE_H
+
+#include <glib.h>
+
+#include "feedsync.h"
+
+/*
+ * The sync engine runs feed synchronization jobs on a fixed-size pool of
+ * worker threads.  Jobs which do not fit into the pool wait in a queue
+ * until a worker becomes free, so the number of threads stays bounded no
+ * matter how many feeds are configured.
+ *
+ * In asynchronous mode, the jobs are run on the main loop instead, up to
+ * 32 at once and the rest queued, without blocking and without threads;
+ * see feed_sync_start.  Their completion callbacks are then called in the
+ * main thread.  Either way, the wall clock and CPU time of each round of jobs
+ * is logged once the engine becomes idle.  The engine does not depend on
+ * GTK.
+ */
+
+/*
+ * Sync engine statistics.
+ */
+typedef struct {
+  guint queued;         /* jobs waiting for a worker */
+  guint active;         /* jobs currently running */
+  guint peak_active;    /* largest number of jobs ever run at once */
+  guint started;        /* total number of jobs started */
+  guint finished;       /* total number of jobs finished */
+} SyncEngineStats;
+
+/*
+ * Sets the number of worker threads.  Zero selects the default, which is
+ * a small multiple of the number of processor cores since the jobs spend
+ * most of their time waiting on the network.  May be called at any time;
+ * a running pool is resized in place.
+ */
+void sync_engine_set_max_threads (gint max_threads);
+
+/*
+ * Returns the configured number of worker threads, or zero if the default
+ * is in use.
+ */
+gint sync_engine_get_max_threads ();
+
+/*
+ * Selects between running the jobs on the main loop (TRUE) and on the
+ * worker pool (FALSE), which is the default.  Affects the jobs queued
+ * from then on.  In asynchronous mode, the engine must be used from the
+ * main thread only.
+ */
+void sync_engine_set_async (gboolean value);
+gboolean sync_engine_get_async ();
+
+/*
+ * Queues JOB to be run on the worker pool, or on the main loop in
+ * asynchronous mode.  Once run, JOB is passed to its completion callback
+ * in the worker thread or the main thread, or freed if it has none.  On
+ * success the engine takes ownership of JOB.  Returns FALSE if the job
+ * could not be queued, in which case JOB still belongs to the caller.
+ */
+gboolean sync_engine_push (FeedSyncJob *job);
+
+/*
+ * Waits until the worker pool has run all jobs queued on it and frees the
+ * pool.  Cancel the jobs first, see canceltoken.h, so they end at once.
+ * Jobs on the main loop in asynchronous mode are left alone, since they
+ * do not advance unless the main loop runs.  The pool is created again by
+ * the next sync_engine_push.
+ */
+void sync_engine_shutdown ();
+
+/*
+ * Fills STATS with a snapshot of the engine's counters.
+ */
+void sync_engine_get_stats (SyncEngineStats *stats);
+
+#endif